@@ -1,5 +1,6 @@
 #include "audioconverter.h"
 #include "logcategories.h"
+#include "metrics.h"
 #include "ulaw.h"
 
 audioConverter::audioConverter(QObject* parent) : QObject(parent) 
@@ -95,6 +96,8 @@ audioConverter::~audioConverter()
 
 bool audioConverter::convert(audioPacket audio)
 {
+    static latencyHistogram* wait = metrics::histogram("wfview_audio_to_converter_seconds", "Time an audio packet waits before the converter thread starts on it");
+    wait->recordSinceStamp(audio.stamp);
 
     // If inFormat and outFormat are identical, just emit the data back (removed as it doesn't then process amplitude)
     if (audio.data.size() > 0)
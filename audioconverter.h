@@ -36,6 +36,7 @@
 struct audioPacket {
     quint32 seq;
     QTime time;
+    qint64 stamp = 0;    // metrics::now() when the packet was received or captured
     quint16 sent;
     QByteArray data;
     quint8 guid[GUIDLEN];
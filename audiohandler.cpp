@@ -6,6 +6,7 @@
 #include "audiohandler.h"
 
 #include "logcategories.h"
+#include "metrics.h"
 #include "ulaw.h"
 
 
@@ -295,7 +296,9 @@ void audioHandler::incomingAudio(audioPacket packet)
 }
 
 void audioHandler::convertedOutput(audioPacket packet) {
-	
+
+    static latencyHistogram* toDevice = metrics::histogram("wfview_audio_rx_to_device_seconds", "Time from receiving an audio packet to writing it to the output device");
+
     if (packet.data.size() > 0 ) {
 
         currentLatency = packet.time.msecsTo(QTime::currentTime()) + (nativeFormat.durationForBytes(audioOutput->bufferSize() - audioOutput->bytesFree()) / 1000);
@@ -306,6 +309,7 @@ void audioHandler::convertedOutput(audioPacket packet) {
             } else {
                 isOverrun = false;
             }
+            toDevice->recordSinceStamp(packet.stamp);
             if (lastReceived.msecsTo(QTime::currentTime()) > 100) {
                 qDebug(logAudio()) << (setup.isinput ? "Input" : "Output") << "Time since last audio packet" << lastReceived.msecsTo(QTime::currentTime()) << "Expected around" << setup.blockSize;
             }
@@ -331,6 +335,7 @@ void audioHandler::getNextAudioChunk()
     if (tempBuf.data.length() >= nativeFormat.bytesForDuration(setup.blockSize * 1000)) {
 		audioPacket packet;
 		packet.time = QTime::currentTime();
+		packet.stamp = metrics::now();
 		packet.sent = 0;
 		packet.volume = volume;
 		memcpy(&packet.guid, setup.guid, GUIDLEN);
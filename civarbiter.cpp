@@ -0,0 +1,360 @@
+#include "civarbiter.h"
+#include "rigstate.h"
+#include "logcategories.h"
+#include "metrics.h"
+
+#include <functional>
+
+civArbiter::civArbiter(unsigned char rigCivAddr, unsigned char ownCivAddr, rigstate* state, QObject* parent) :
+    QObject(parent),
+    rigCivAddr(rigCivAddr),
+    ownCivAddr(ownCivAddr),
+    state(state)
+{
+    timeoutTimer = new QTimer(this);
+    timeoutTimer->setSingleShot(true);
+    connect(timeoutTimer, SIGNAL(timeout()), this, SLOT(timeout()));
+
+    dispatchTimer = new QTimer(this);
+    dispatchTimer->setSingleShot(true);
+    connect(dispatchTimer, SIGNAL(timeout()), this, SLOT(dispatch()));
+}
+
+civArbiter::~civArbiter()
+{
+    for (port& p : ports)
+    {
+        delete p.ptty;
+    }
+    ports.clear();
+}
+
+void civArbiter::addPort(const virtualPortConfig& config)
+{
+    if (config.name.isEmpty() || config.name.toLower() == "none")
+        return;
+
+    port p;
+    p.config = config;
+    p.ptty = new pttyHandler(config.name, this);
+    p.ptty->setScopeAllowed(config.scope);
+    p.tokens = qMax(config.maxRate, 1);
+    p.refill.start();
+
+    int index = ports.size();
+    connect(p.ptty, &pttyHandler::haveDataFromPort, this, std::bind(&civArbiter::receiveDataFromPort, this, index, std::placeholders::_1));
+    connect(p.ptty, SIGNAL(havePortError(errorType)), this, SIGNAL(havePortError(errorType)));
+    ports.append(p);
+
+    qInfo(logSerial()) << "virtual port" << index << config.name << "priority" << config.priority
+                       << "rate" << config.maxRate << "scope" << config.scope
+                       << "rig address" << QString("0x%1").arg(config.rigCivAddr ? config.rigCivAddr : rigCivAddr, 0, 16);
+}
+
+void civArbiter::receiveDataFromPort(int index, QByteArray data)
+{
+    // pttyHandler hands over one complete frame: FE FE to from cmd ... FD
+    int p = 0;
+    while (p < data.size() && (unsigned char)data[p] == 0xfe)
+        p++;
+    if (p < 2 || data.size() - p < 4)
+        return;
+
+    // Everything goes to the real rig address from our own, so the same
+    // query from two ports is byte for byte the same command.
+    QByteArray command = QByteArrayLiteral("\xfe\xfe\x00\x00");
+    command[2] = (char)rigCivAddr;
+    command[3] = (char)ownCivAddr;
+    command.append(data.constData() + p + 2, data.size() - p - 2);
+
+    if (answerFromCache(index, command))
+        return;
+    forgetCached(command);
+
+    if (busy && command == inFlight)
+    {
+        waiters.append(index);
+        ports[index].shared++;
+        return;
+    }
+
+    port& pt = ports[index];
+    if (pt.queue.size() >= ARBITER_PORT_QUEUE)
+    {
+        qInfo(logSerial()) << "virtual port" << pt.config.name << "queue full, dropping oldest command";
+        pt.queue.removeFirst();
+    }
+    pt.queue.append(command);
+    dispatch();
+}
+
+void civArbiter::forgetCached(const QByteArray& command)
+{
+    // Icom rigs don't report changes made over CI-V, so anything a port
+    // changes is only known again once the rig next tells us.
+    unsigned char cmd = (unsigned char)command[4];
+    bool freq = false;
+    bool mode = false;
+    switch (cmd)
+    {
+    case 0x00:
+    case 0x05:
+        freq = true;
+        break;
+    case 0x01:
+    case 0x06:
+        mode = true;
+        break;
+    case 0x07: // VFO select, swap or equalize
+    case 0x08: // Memory mode
+    case 0x0a: // Memory to VFO
+        freq = true;
+        mode = true;
+        break;
+    case 0x25: // Selected/unselected VFO, FE FE to from cmd vfo FD is a query
+        freq = command.size() > 7;
+        break;
+    case 0x26:
+        mode = command.size() > 7;
+        break;
+    default:
+        break;
+    }
+
+    if (freq)
+        freqSeen.invalidate();
+    if (mode)
+        modeSeen.invalidate();
+}
+
+bool civArbiter::answerFromCache(int index, const QByteArray& command)
+{
+    // Only plain queries (FE FE to from cmd FD) can be answered.
+    if (state == Q_NULLPTR || command.size() != 6)
+        return false;
+
+    QByteArray reply = QByteArrayLiteral("\xfe\xfe\x00\x00");
+    reply[2] = (char)ownCivAddr;
+    reply[3] = (char)rigCivAddr;
+
+    unsigned char cmd = (unsigned char)command[4];
+    if (cmd == 0x03)
+    {
+        stateTypes s = state->getChar(CURRENTVFO) == 0 ? VFOAFREQ : VFOBFREQ;
+        if (!freqSeen.isValid() || freqSeen.elapsed() > ARBITER_CACHE_AGE || !state->isValid(s) || state->isUpdated(s))
+            return false;
+        // Reply in the same width as the rig does, until we have seen one the rig answers.
+        if (freqBytes != 5 && freqBytes != 6)
+            return false;
+        quint64 hz = state->getInt64(s);
+        if (hz >= (freqBytes == 5 ? Q_UINT64_C(10000000000) : Q_UINT64_C(1000000000000)))
+            return false;
+        reply.append((char)cmd);
+        for (int i = 0; i < freqBytes; i++)
+        {
+            unsigned char low = hz % 10;
+            hz /= 10;
+            unsigned char high = hz % 10;
+            hz /= 10;
+            reply.append((char)((high << 4) | low));
+        }
+    }
+    else if (cmd == 0x04)
+    {
+        // A mode reply without a filter byte leaves FILTER at 0, let the rig answer then.
+        unsigned char filter = state->getChar(FILTER);
+        if (!modeSeen.isValid() || modeSeen.elapsed() > ARBITER_CACHE_AGE || !state->isValid(MODE) ||
+            !state->isValid(FILTER) || state->isUpdated(MODE) || state->isUpdated(FILTER) || filter < 1 || filter > 3)
+            return false;
+        reply.append((char)cmd);
+        reply.append((char)state->getChar(MODE));
+        reply.append((char)filter);
+    }
+    else
+    {
+        return false;
+    }
+    reply.append((char)0xfd);
+
+    port& p = ports[index];
+    p.cached++;
+    sendToPort(index, reply, p.ptty->remoteCivId() ? p.ptty->remoteCivId() : ownCivAddr);
+    return true;
+}
+
+void civArbiter::refillTokens(port& p)
+{
+    if (p.config.maxRate <= 0)
+        return;
+    double capacity = p.config.maxRate;
+    p.tokens = qMin(capacity, p.tokens + p.refill.restart() * capacity / 1000.0);
+}
+
+void civArbiter::dispatch()
+{
+    static metricGauge* queued = metrics::gauge("wfview_civ_arbiter_queued", "CI-V commands from virtual ports waiting for the rig");
+
+    if (busy || ports.isEmpty())
+        return;
+
+    qint64 total = 0;
+    for (const port& p : ports)
+        total += p.queue.size();
+    queued->set(total);
+
+    // Highest priority port with something to send and a token to spend,
+    // round robin between ports of equal priority.
+    int best = -1;
+    int wait = -1;
+    for (int n = 1; n <= ports.size(); n++)
+    {
+        int i = (lastServed + n) % ports.size();
+        port& p = ports[i];
+        if (p.queue.isEmpty())
+            continue;
+        refillTokens(p);
+        if (p.config.maxRate > 0 && p.tokens < 1.0)
+        {
+            int ms = int((1.0 - p.tokens) * 1000.0 / p.config.maxRate) + 1;
+            if (wait < 0 || ms < wait)
+                wait = ms;
+            continue;
+        }
+        if (best < 0 || p.config.priority > ports[best].config.priority)
+            best = i;
+    }
+
+    if (best < 0)
+    {
+        if (wait >= 0)
+            dispatchTimer->start(wait);
+        return;
+    }
+
+    port& p = ports[best];
+    if (p.config.maxRate > 0)
+        p.tokens -= 1.0;
+    lastServed = best;
+
+    inFlight = p.queue.takeFirst();
+    waiters.clear();
+    waiters.append(best);
+
+    // Anyone else waiting on the same command gets this transaction's reply.
+    for (int i = 0; i < ports.size(); i++)
+    {
+        int removed = ports[i].queue.removeAll(inFlight);
+        for (int r = 0; r < removed; r++)
+        {
+            waiters.append(i);
+            ports[i].shared++;
+        }
+    }
+
+    busy = true;
+    timeoutTimer->start(ARBITER_TIMEOUT);
+    emit haveDataForRig(inFlight);
+}
+
+void civArbiter::finish()
+{
+    // A reply to something sent before this change may have refreshed the
+    // cache while the change was queued.
+    if (!inFlight.isEmpty())
+        forgetCached(inFlight);
+    busy = false;
+    inFlight.clear();
+    waiters.clear();
+    timeoutTimer->stop();
+    dispatch();
+}
+
+void civArbiter::timeout()
+{
+    qDebug(logSerial()) << "virtual port command got no reply from rig, waiting ports:" << waiters.size();
+    finish();
+}
+
+void civArbiter::receiveDataFromRig(const QByteArray& data)
+{
+    int start = 0;
+    while (start < data.size())
+    {
+        int fd = data.indexOf((char)0xfd, start);
+        if (fd < 0)
+            break;
+        int p = start;
+        while (p < fd && (unsigned char)data[p] == 0xfe)
+            p++;
+        if (p - start < 2 || fd - p < 3)
+        {
+            start = fd + 1;
+            continue;
+        }
+
+        unsigned char to = (unsigned char)data[p];
+        unsigned char from = (unsigned char)data[p + 1];
+        unsigned char cmd = (unsigned char)data[p + 2];
+        QByteArray frame = data.mid(p - 2, fd - p + 3);
+        start = fd + 1;
+
+        if (from != rigCivAddr)
+            continue; // Our own commands echoed on the bus, or another controller.
+
+        if (to == 0x00 || to == 0xE1)
+        {
+            // rigCommander has parsed these into rigstate by now.
+            if (cmd == 0x00 || cmd == 0x03)
+            {
+                freqSeen.start();
+                freqBytes = fd - p - 3;
+            }
+            else if (cmd == 0x01 || cmd == 0x04)
+                modeSeen.start();
+        }
+
+        if (to == 0x00)
+        {
+            // Transceive, every port filters these for itself.
+            for (int i = 0; i < ports.size(); i++)
+                sendToPort(i, frame, 0x00);
+        }
+        else if (to == ownCivAddr && busy)
+        {
+            if (cmd == 0x03)
+                freqBytes = fd - p - 3;
+            for (int i : waiters)
+            {
+                quint8 civId = ports[i].ptty->remoteCivId();
+                sendToPort(i, frame, civId ? civId : ownCivAddr);
+            }
+            finish();
+        }
+    }
+}
+
+void civArbiter::sendToPort(int index, QByteArray frame, unsigned char to)
+{
+    port& p = ports[index];
+    frame[2] = (char)to;
+    frame[3] = (char)(p.config.rigCivAddr ? p.config.rigCivAddr : rigCivAddr);
+    p.ptty->receiveDataFromRigToPtty(frame);
+}
+
+void civArbiter::receiveFoundRigID(rigCapabilities rigCaps)
+{
+    for (port& p : ports)
+    {
+        p.ptty->receiveFoundRigID(rigCaps);
+    }
+}
+
+void civArbiter::debugThis()
+{
+    qInfo(logSerial()) << "civ arbiter busy:" << busy << "waiters:" << waiters.size();
+    for (const port& p : ports)
+    {
+        qInfo(logSerial()) << "virtual port" << p.config.name << "queued:" << p.queue.size()
+                           << "answered from state:" << p.cached << "shared transactions:" << p.shared;
+    }
+}
@@ -0,0 +1,92 @@
+#ifndef CIVARBITER_H
+#define CIVARBITER_H
+
+#include <QObject>
+#include <QList>
+#include <QTimer>
+#include <QElapsedTimer>
+
+#include "pttyhandler.h"
+#include "rigidentities.h"
+#include "wfviewtypes.h"
+
+// Shares the rig between several virtual CI-V ports. Commands from the
+// ports are queued per port and sent to the rig one at a time, highest
+// priority first, so programs no longer trample each other's replies.
+// Identical commands from different ports ride on a single transaction and
+// frequency/mode queries are answered from rigstate while it is current.
+//
+// Everything goes to the rig from the arbiter's own address (ArbiterCIVuInt,
+// ARBITER_CIV_ID by default), which must not be used by any real controller
+// on the bus. Each port may also present the rig at a different CI-V address
+// (rigCivAddr), for programs that are configured for another model.
+
+#define ARBITER_CIV_ID 0xE8        // Default address the arbiter uses towards the rig, unused by Icom controllers and wfview
+#define ARBITER_TIMEOUT 200        // ms to wait for a reply before moving on
+#define ARBITER_PORT_QUEUE 32      // Commands held per port, oldest dropped beyond this
+#define ARBITER_CACHE_AGE 500      // ms a frequency/mode seen from the rig stays usable
+
+class rigstate;
+
+class civArbiter : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit civArbiter(unsigned char rigCivAddr, unsigned char ownCivAddr, rigstate* state, QObject* parent = nullptr);
+    ~civArbiter();
+
+    void addPort(const virtualPortConfig& config);
+    void setRigCivAddr(unsigned char addr) { rigCivAddr = addr; }
+
+public slots:
+    void receiveDataFromRig(const QByteArray& data);
+    void receiveFoundRigID(rigCapabilities rigCaps);
+    void debugThis();
+
+signals:
+    void haveDataForRig(QByteArray data);
+    void havePortError(errorType err);
+
+private slots:
+    void dispatch();
+    void timeout();
+
+private:
+    struct port {
+        virtualPortConfig config;
+        pttyHandler* ptty = Q_NULLPTR;
+        QList<QByteArray> queue;
+        double tokens = 0.0;
+        QElapsedTimer refill;
+        quint64 cached = 0;
+        quint64 shared = 0;
+    };
+
+    void receiveDataFromPort(int index, QByteArray data);
+    bool answerFromCache(int index, const QByteArray& command);
+    void forgetCached(const QByteArray& command);
+    void sendToPort(int index, QByteArray frame, unsigned char to);
+    void refillTokens(port& p);
+    void finish();
+
+    unsigned char rigCivAddr;
+    unsigned char ownCivAddr;
+    rigstate* state;
+    QList<port> ports;
+    int lastServed = -1;
+
+    // The transaction currently on the rig and the ports waiting for it.
+    bool busy = false;
+    QByteArray inFlight;
+    QList<int> waiters;
+    QTimer* timeoutTimer = Q_NULLPTR;
+    QTimer* dispatchTimer = Q_NULLPTR;
+
+    // When the rig last told us the frequency/mode, by reply or transceive.
+    QElapsedTimer freqSeen;
+    QElapsedTimer modeSeen;
+    int freqBytes = 0;              // Frequency width the rig uses in its replies, 0 until seen
+};
+
+#endif // CIVARBITER_H
@@ -1,6 +1,8 @@
 #include "cluster.h"
 #include "logcategories.h"
 
+#include <cctype>
+
 
 dxClusterClient::dxClusterClient(QObject* parent):
     QObject(parent)
@@ -14,15 +16,13 @@ dxClusterClient::~dxClusterClient()
     enableUdp(false);
     enableTcp(false);
 #ifdef USESQL
-    database db;
-    db.close();
-#else
-    QMap<QString, spotData*>::iterator spot = allSpots.begin();
-    while (spot != allSpots.end())
+    if (db != Q_NULLPTR)
     {
-        delete spot.value(); // Stop memory leak?
-        spot = allSpots.erase(spot);
+        db->close();
+        delete db;
     }
+#else
+    allSpots.clear();
 #endif
 }
 
@@ -57,7 +57,7 @@ void dxClusterClient::enableTcp(bool enable)
     tcpEnable = enable;
     if (enable)
     {
-        tcpRegex = QRegularExpression("^DX de ([a-z-|A-Z|0-9|#|/]+):\\s+([0-9|.]+)\\s+([a-z|A-Z|0-9|/]+)+\\s+(.*)\\s+(\\d{4}Z)");
+        tcpBuffer.clear();
 
         if (tcpSocket == Q_NULLPTR)
         {
@@ -95,82 +95,89 @@ void dxClusterClient::enableTcp(bool enable)
 
 void dxClusterClient::udpDataReceived()
 {
-    QHostAddress sender;
-    quint16 port;
-    QByteArray datagram;
-    datagram.resize(udpSocket->pendingDatagramSize());
-    udpSocket->readDatagram(datagram.data(), datagram.size(), &sender, &port);
-
-    if (udpSpotReader.setContent(datagram))
+    bool changed = false;
+    while (udpSocket->hasPendingDatagrams())
     {
-        QDomElement spot = udpSpotReader.firstChildElement("spot");
-        if (spot.nodeName() == "spot")
+        QByteArray datagram;
+        datagram.resize(int(udpSocket->pendingDatagramSize()));
+        udpSocket->readDatagram(datagram.data(), datagram.size());
+
+        QString action;
+        spotData* data = new spotData();
+        if (!parseSpotXml(datagram, action, data))
         {
-            // This is a spot?
-            QString action = spot.firstChildElement("action").text();
-            if (action == "add") {
-                spotData* data = new spotData();
-                data->dxcall = spot.firstChildElement("dxcall").text();
-                data->frequency = spot.firstChildElement("frequency").text().toDouble() / 1000.0;
-                data->spottercall = spot.firstChildElement("spottercall").text();
-                data->timestamp = QDateTime::fromString(spot.firstChildElement("timestamp").text(),"yyyy-MM-dd hh:mm:ss");
-                data->mode = spot.firstChildElement("mode").text();
-                data->comment = spot.firstChildElement("comment").text();
+            delete data;
+            continue;
+        }
 
+        if (action == "add")
+        {
+            emit sendOutput(QString("<spot><action>add</action><dxcall>%1</dxcall><spottercall>%2</spottercall><frequency>%3</frequency><comment>%4</comment></spot>\n")
+                .arg(data->dxcall).arg(data->spottercall).arg(data->frequency).arg(data->comment));
+            ingestSpot(data, "UDP");
+            changed = true;
+        }
+        else if (action == "delete")
+        {
 #ifdef USESQL
-                database db = database();
-                db.query(QString("DELETE from spots where dxcall='%1'").arg(data->dxcall));
-                QString query = QString("INSERT INTO spots(type,spottercall,frequency,dxcall,mode,comment,timestamp) VALUES('%1','%2',%3,'%4','%5','%6','%7')\n")
-                    .arg("UDP").arg(data->spottercall).arg(data->frequency).arg(data->dxcall).arg(data->mode).arg(data->comment).arg(data->timestamp.toString("yyyy-MM-dd hh:mm:ss"));
-                db.query(query);
+            spotDatabase()->removeSpot(data->dxcall, data->frequency);
 #else
-                bool found = false;
-                QMap<QString, spotData*>::iterator spot = allSpots.find(data->dxcall);
-                while (spot != allSpots.end() && spot.key() == data->dxcall && spot.value()->frequency == data->frequency) {
-                    found = true;
-                    ++spot;
-                }
-                if (found == false) {
-                    allSpots.insert(data->dxcall, data);
-                }
-#endif
-                emit sendOutput(QString("<spot><action>add</action><dxcall>%1</dxcall><spottercall>%2</spottercall><frequency>%3</frequency><comment>%4</comment></spot>\n")
-                    .arg(data->dxcall).arg(data->spottercall).arg(data->frequency).arg(data->comment));
-
-            }
-            else if (action == "delete")
+            spotData* old = allSpots.find(data->dxcall);
+            if (old != Q_NULLPTR && old->frequency == data->frequency)
             {
-                QString dxcall = spot.firstChildElement("dxcall").text();
-                double frequency = spot.firstChildElement("frequency").text().toDouble() / 1000.0;
-
-#ifdef USESQL
-                database db = database();
-                QString query=QString("DELETE from spots where dxcall='%1' AND frequency=%2").arg(dxcall).arg(frequency);
-                db.query(query);
-                qInfo(logCluster()) << query;
-#else
-                QMap<QString, spotData*>::iterator spot = allSpots.find(dxcall);
-                while (spot != allSpots.end() && spot.key() == dxcall && spot.value()->frequency == frequency) 
-                {
-                    delete spot.value(); // Stop memory leak?
-                    spot = allSpots.erase(spot);
-                }
-#endif
-                emit sendOutput(QString("<spot><action>delete</action><dxcall>%1</dxcall<frequency>%3</frequency></spot>\n")
-                    .arg(dxcall).arg(frequency));
+                removeSpot(old);
             }
-            updateSpots();
+#endif
+            emit sendOutput(QString("<spot><action>delete</action><dxcall>%1</dxcall<frequency>%3</frequency></spot>\n")
+                .arg(data->dxcall).arg(data->frequency));
+            delete data;
+            changed = true;
+        }
+        else
+        {
+            delete data;
         }
     }
+    if (changed)
+        updateSpots();
 }
 
+bool dxClusterClient::parseSpotXml(const QByteArray& datagram, QString& action, spotData* data)
+{
+    // <spot><action>add</action><dxcall>..</dxcall><frequency>kHz</frequency>...</spot>
+    QXmlStreamReader xml(datagram);
+    if (!xml.readNextStartElement() || xml.name() != QLatin1String("spot"))
+        return false;
+
+    while (xml.readNextStartElement())
+    {
+        QString name = xml.name().toString();
+        QString text = xml.readElementText();
+        if (name == QLatin1String("action"))
+            action = text;
+        else if (name == QLatin1String("dxcall"))
+            data->dxcall = text;
+        else if (name == QLatin1String("frequency"))
+            data->frequency = text.toDouble() / 1000.0;
+        else if (name == QLatin1String("spottercall"))
+            data->spottercall = text;
+        else if (name == QLatin1String("timestamp"))
+            data->timestamp = QDateTime::fromString(text, "yyyy-MM-dd hh:mm:ss");
+        else if (name == QLatin1String("mode"))
+            data->mode = text;
+        else if (name == QLatin1String("comment"))
+            data->comment = text;
+    }
+    return !xml.hasError() && !action.isEmpty();
+}
 
 void dxClusterClient::tcpDataReceived()
 {
-    QString data = QString(tcpSocket->readAll());
+    QByteArray data = tcpSocket->readAll();
 
-    emit sendOutput(data);
     if (!authenticated) {
+        // Prompts don't end in a newline, so look at whatever arrived.
+        emit sendOutput(QString(data));
         if (data.contains("login:") || data.contains("call:") || data.contains("callsign:")) {
             sendTcpData(QString("%1\n").arg(tcpUserName));
             return;
@@ -181,42 +188,145 @@ void dxClusterClient::tcpDataReceived()
         }
         if (data.contains("Hello")) {
             authenticated = true;
+            tcpBuffer.clear();
             enableSkimmerSpots(skimmerSpots);
         }
+        return;
     }
-    else {
-        QRegularExpressionMatchIterator i = tcpRegex.globalMatch(data);
-        while (i.hasNext()) {
-            QRegularExpressionMatch match = i.next();
-            if (match.hasMatch()) {
-                spotData* data = new spotData();
-                data->spottercall = match.captured(1);
-                data->frequency = match.captured(2).toDouble() / 1000.0;
-                data->dxcall = match.captured(3);
-                data->comment = match.captured(4).trimmed();
-                data->timestamp = QDateTime::currentDateTimeUtc();
 
+    if (tcpBuffer.size() + data.size() > CLUSTER_MAX_BUFFER)
+    {
+        qWarning(logCluster()) << "Cluster input backlog too large, dropping" << tcpBuffer.size() << "bytes";
+        tcpBuffer.clear();
+    }
+    tcpBuffer.append(data);
+    processTcpLines();
+}
+
+void dxClusterClient::processTcpLines()
+{
+    // Whole lines only, a partial line waits in tcpBuffer for the next read.
+    // A busy feed is taken CLUSTER_MAX_LINES at a time so range changes from
+    // the UI still get a look in.
+    int start = 0;
+    int lines = 0;
+    QByteArray output;
+    spotData* data = Q_NULLPTR;
 #ifdef USESQL
-                database db = database();
-                db.query(QString("DELETE from spots where dxcall='%1'").arg(data->dxcall));
-                QString query = QString("INSERT INTO spots(type,spottercall,frequency,dxcall,comment,timestamp) VALUES('%1','%2',%3,'%4','%5','%6')\n")
-                    .arg("TCP").arg(data->spottercall).arg(data->frequency).arg(data->dxcall).arg(data->comment).arg(data->timestamp.toString("yyyy-MM-dd hh:mm:ss"));
-                db.query(query);
-#else
-                bool found = false;
-                QMap<QString, spotData*>::iterator spot = allSpots.find(data->dxcall);
-                while (spot != allSpots.end() && spot.key() == data->dxcall && spot.value()->frequency == data->frequency) {
-                    found = true;
-                    ++spot;
-                }
-                if (found == false) {
-                    allSpots.insert(data->dxcall, data);
-                }
+    // One transaction for everything in this pass.
+    spotDatabase()->transaction();
 #endif
-            }
+    while (lines < CLUSTER_MAX_LINES)
+    {
+        int end = tcpBuffer.indexOf('\n', start);
+        if (end < 0)
+            break;
+        QByteArray line = tcpBuffer.mid(start, end - start);
+        start = end + 1;
+        lines++;
+        if (line.endsWith('\r'))
+            line.chop(1);
+        output.append(line).append('\n');
+
+        if (data == Q_NULLPTR)
+            data = new spotData();
+        if (parseSpotLine(line, data))
+        {
+            ingestSpot(data, "TCP");
+            data = Q_NULLPTR;
         }
+    }
+    delete data;
+#ifdef USESQL
+    spotDatabase()->commit();
+#endif
+    tcpBuffer.remove(0, start);
+
+    if (tcpBuffer.size() > CLUSTER_MAX_LINE && tcpBuffer.indexOf('\n') < 0)
+    {
+        qWarning(logCluster()) << "Cluster line too long, dropping" << tcpBuffer.size() << "bytes";
+        tcpBuffer.clear();
+    }
+
+    if (!output.isEmpty())
+        emit sendOutput(QString(output));
+    if (lines > 0)
         updateSpots();
+    if (lines == CLUSTER_MAX_LINES)
+        QMetaObject::invokeMethod(this, "processTcpLines", Qt::QueuedConnection);
+}
+
+bool dxClusterClient::parseSpotLine(const QByteArray& line, spotData* data)
+{
+    // DX de SPOTTER:     14025.0  DXCALL       comment text            1234Z [locator]
+    if (!line.startsWith("DX de "))
+        return false;
+
+    int pos = 6;
+    int colon = line.indexOf(':', pos);
+    if (colon <= pos)
+        return false;
+    QByteArray spotter = line.mid(pos, colon - pos).trimmed();
+    pos = colon + 1;
+
+    auto skipSpaces = [&line](int p) {
+        while (p < line.size() && (line[p] == ' ' || line[p] == '\t'))
+            p++;
+        return p;
+    };
+    auto tokenEnd = [&line](int p) {
+        while (p < line.size() && line[p] != ' ' && line[p] != '\t')
+            p++;
+        return p;
+    };
+
+    pos = skipSpaces(pos);
+    int end = tokenEnd(pos);
+    bool ok = false;
+    double frequency = line.mid(pos, end - pos).toDouble(&ok);
+    if (!ok || frequency <= 0.0)
+        return false;
+
+    pos = skipSpaces(end);
+    end = tokenEnd(pos);
+    if (end == pos)
+        return false;
+    QByteArray dxcall = line.mid(pos, end - pos);
+    pos = end;
+
+    // The comment runs up to the last HHMMZ time, anything after it is ignored.
+    int time = -1;
+    for (int i = line.size() - 5; i > pos; i--)
+    {
+        if (line[i + 4] == 'Z' && (line[i - 1] == ' ' || line[i - 1] == '\t') &&
+            isdigit((unsigned char)line[i]) && isdigit((unsigned char)line[i + 1]) &&
+            isdigit((unsigned char)line[i + 2]) && isdigit((unsigned char)line[i + 3]) &&
+            (i + 5 == line.size() || line[i + 5] == ' ' || line[i + 5] == '\t'))
+        {
+            time = i;
+            break;
+        }
     }
+    if (time < 0)
+        return false;
+
+    data->spottercall = QString::fromLatin1(spotter);
+    data->frequency = frequency / 1000.0;
+    data->dxcall = QString::fromLatin1(dxcall);
+    data->comment = QString::fromLatin1(line.mid(pos, time - pos).trimmed());
+    data->timestamp = QDateTime::currentDateTimeUtc();
+    return true;
+}
+
+void dxClusterClient::ingestSpot(spotData* data, QString type)
+{
+#ifdef USESQL
+    spotDatabase()->addSpot(type, data->dxcall, data->spottercall, data->frequency, data->timestamp, data->mode, data->comment);
+    delete data;
+#else
+    Q_UNUSED(type);
+    storeSpot(data);
+#endif
 }
 
 
@@ -236,22 +346,16 @@ void dxClusterClient::sendTcpData(QString data)
 void dxClusterClient::tcpCleanup()
 {
 #ifdef USESQL
-    database db = database();
-    db.query(QString("DELETE FROM spots where timestamp < datetime('now', '-%1 minutes')").arg(tcpTimeout));
+    spotDatabase()->removeSpotsBefore(QDateTime::currentDateTimeUtc().addSecs(-tcpTimeout * 60));
 #else
-    QMap<QString, spotData*>::iterator spot = allSpots.begin();;
-    while (spot != allSpots.end()) {
-        if (spot.value()->timestamp.addSecs(tcpTimeout * 60) < QDateTime::currentDateTimeUtc())
-        {
-            delete spot.value(); // Stop memory leak?
-            spot = allSpots.erase(spot);
-        } 
-        else
-        {
-            ++spot;
-        }
+    for (spotData* spot : allSpots.takeOlderThan(QDateTime::currentDateTimeUtc().addSecs(-tcpTimeout * 60)))
+    {
+        if (visible(spot->frequency))
+            removedSpots.append(*spot);
+        delete spot;
     }
 #endif
+    updateSpots();
 }
 
 void dxClusterClient::tcpDisconnected() {
@@ -261,43 +365,126 @@ void dxClusterClient::tcpDisconnected() {
 
 void dxClusterClient::freqRange(double low, double high)
 {
+    if (low == lowFreq && high == highFreq)
+        return;
+#ifndef USESQL
+    // Only the spots that moved in or out of view are sent.
+    visibleChanges(lowFreq, highFreq, low, high, removedSpots);
+    visibleChanges(low, high, lowFreq, highFreq, addedSpots);
+#endif
     lowFreq = low;
     highFreq = high;
     //qInfo(logCluster) << "New range" << low << "-" << high;
     updateSpots();
 }
 
+#ifndef USESQL
+void dxClusterClient::storeSpot(spotData* spot)
+{
+    spotData* old = allSpots.find(spot->dxcall);
+    if (old != Q_NULLPTR && old->frequency == spot->frequency)
+    {
+        delete spot; // Already have it.
+        return;
+    }
+    if (old != Q_NULLPTR)
+        removeSpot(old);
+
+    allSpots.insert(spot);
+    if (visible(spot->frequency))
+        addedSpots.append(*spot);
+}
+
+void dxClusterClient::removeSpot(spotData* spot)
+{
+    if (visible(spot->frequency))
+    {
+        // A spot added and removed before the UI heard of it needs no update at all.
+        bool pending = false;
+        for (int i = 0; i < addedSpots.size(); i++)
+        {
+            if (addedSpots[i].dxcall == spot->dxcall && addedSpots[i].frequency == spot->frequency)
+            {
+                addedSpots.removeAt(i);
+                pending = true;
+                break;
+            }
+        }
+        if (!pending)
+            removedSpots.append(*spot);
+    }
+    allSpots.remove(spot);
+    delete spot;
+}
+
+void dxClusterClient::visibleChanges(double oldLow, double oldHigh, double newLow, double newHigh, QList<spotData>& out) const
+{
+    // Spots within (oldLow, oldHigh) that are not within (newLow, newHigh).
+    if (oldLow >= oldHigh)
+        return;
+    if (newLow >= newHigh || newLow >= oldHigh || newHigh <= oldLow)
+    {
+        allSpots.range(oldLow, false, oldHigh, false, out);
+        return;
+    }
+    if (newLow > oldLow)
+        allSpots.range(oldLow, false, newLow, true, out);
+    if (newHigh < oldHigh)
+        allSpots.range(newHigh, true, oldHigh, false, out);
+}
+#endif
+
 void dxClusterClient::updateSpots()
 {
-    QList<spotData> spots;
 #ifdef USESQL
+    QHash<QString, double> spots;
     // Set the required frequency range.
-    QString queryText = QString("SELECT * FROM spots WHERE frequency > %1 AND frequency < %2").arg(lowFreq).arg(highFreq);
-    //QString queryText = QString("SELECT * FROM spots");
-    database db;
-    auto query = db.query(queryText);
+    QSqlQuery& query = spotDatabase()->spotsInRange(lowFreq, highFreq);
 
     while (query.next()) {
         // Step through all current spots within range
         spotData s = spotData();
-        s.dxcall = query.value(query.record().indexOf("dxcall")).toString();
-        s.frequency = query.value(query.record().indexOf("frequency")).toDouble();
-        spots.append(s);
+        s.dxcall = query.value(0).toString();
+        s.frequency = query.value(1).toDouble();
+        spots.insert(s.dxcall, s.frequency);
+        QHash<QString, double>::const_iterator sent = sentSpots.constFind(s.dxcall);
+        if (sent == sentSpots.constEnd() || sent.value() != s.frequency)
+            addedSpots.append(s);
     }
-#else
-    QMap<QString, spotData*>::iterator spot = allSpots.begin();;
-    while (spot != allSpots.end()) {
-        if (spot.value()->frequency > lowFreq && spot.value()->frequency < highFreq)
+    query.finish();
+
+    // Anything the UI has that the query no longer returned has gone.
+    for (QHash<QString, double>::const_iterator sent = sentSpots.constBegin(); sent != sentSpots.constEnd(); ++sent)
+    {
+        QHash<QString, double>::const_iterator now = spots.constFind(sent.key());
+        if (now == spots.constEnd() || now.value() != sent.value())
         {
-            spots.append(**spot);
+            spotData s = spotData();
+            s.dxcall = sent.key();
+            s.frequency = sent.value();
+            removedSpots.append(s);
         }
-        ++spot;
     }
-
+    sentSpots = spots;
 #endif
-    emit sendSpots(spots);
+    if (!addedSpots.isEmpty() || !removedSpots.isEmpty())
+    {
+        emit spotsChanged(addedSpots, removedSpots);
+        addedSpots.clear();
+        removedSpots.clear();
+    }
 }
 
+#ifdef USESQL
+database* dxClusterClient::spotDatabase()
+{
+    // database connections are per thread, so this can't be done in the constructor.
+    if (db == Q_NULLPTR)
+        db = new database();
+    return db;
+}
+#endif
+
 void dxClusterClient::enableSkimmerSpots(bool enable)
 {
     skimmerSpots = enable;
@@ -312,3 +499,53 @@ void dxClusterClient::enableSkimmerSpots(bool enable)
         
     }
 }
+
+
+void spotStore::insert(spotData* spot)
+{
+    byFreq.insert(spot->frequency, spot);
+    byCall.insert(spot->dxcall, spot);
+    byTime.insert(spot->timestamp.toMSecsSinceEpoch(), spot);
+}
+
+void spotStore::remove(spotData* spot)
+{
+    byFreq.remove(spot->frequency, spot);
+    if (byCall.value(spot->dxcall) == spot)
+        byCall.remove(spot->dxcall);
+    byTime.remove(spot->timestamp.toMSecsSinceEpoch(), spot);
+}
+
+void spotStore::clear()
+{
+    qDeleteAll(byCall);
+    byCall.clear();
+    byFreq.clear();
+    byTime.clear();
+}
+
+void spotStore::range(double low, bool lowInclusive, double high, bool highInclusive, QList<spotData>& out) const
+{
+    QMultiMap<double, spotData*>::const_iterator it = lowInclusive ? byFreq.lowerBound(low) : byFreq.upperBound(low);
+    for (; it != byFreq.constEnd() && (it.key() < high || (highInclusive && it.key() == high)); ++it)
+    {
+        out.append(*it.value());
+    }
+}
+
+QList<spotData*> spotStore::takeOlderThan(const QDateTime& time)
+{
+    QList<spotData*> old;
+    qint64 limit = time.toMSecsSinceEpoch();
+    QMultiMap<qint64, spotData*>::iterator it = byTime.begin();
+    while (it != byTime.end() && it.key() < limit)
+    {
+        spotData* spot = it.value();
+        it = byTime.erase(it);
+        byFreq.remove(spot->frequency, spot);
+        if (byCall.value(spot->dxcall) == spot)
+            byCall.remove(spot->dxcall);
+        old.append(spot);
+    }
+    return old;
+}
@@ -5,12 +5,14 @@
 #include <QDebug>
 #include <QUdpSocket>
 #include <QTcpSocket>
-#include <QDomDocument>
+#include <QXmlStreamReader>
 #include <QMutex>
 #include <QMutexLocker>
 #include <QDateTime>
 #include <QRegularExpression>
 #include <QTimer>
+#include <QHash>
+#include <QMultiMap>
 
 #ifdef USESQL
 #include <QSqlDatabase>
@@ -23,6 +25,10 @@
 #include "database.h"
 #endif
 
+#define CLUSTER_MAX_LINE 4096      // Partial line discarded if no newline is seen within this many bytes
+#define CLUSTER_MAX_BUFFER 1048576 // Unprocessed input dropped beyond this
+#define CLUSTER_MAX_LINES 200      // Lines parsed before giving other events a turn
+
 struct spotData {
     QString dxcall;
     double frequency;
@@ -31,7 +37,6 @@ struct spotData {
     QString mode;
     QString comment;
     QCPItemText* text = Q_NULLPTR;
-    bool current = false;
 };
 
 struct clusterSettings {
@@ -43,6 +48,31 @@ struct clusterSettings {
     bool isdefault;
 };
 
+// Spots indexed by frequency for range queries, by callsign (one spot per
+// call, a new spot replaces the old one) and by time for expiry. The store
+// owns the spots it holds.
+class spotStore
+{
+public:
+    ~spotStore() { clear(); }
+
+    spotData* find(const QString& dxcall) const { return byCall.value(dxcall, Q_NULLPTR); }
+    void insert(spotData* spot);
+    void remove(spotData* spot); // Removes from the store, caller deletes
+    void clear();
+    int size() const { return byCall.size(); }
+
+    // Appends copies of the spots between low and high, each end inclusive or not.
+    void range(double low, bool lowInclusive, double high, bool highInclusive, QList<spotData>& out) const;
+    // Removes and returns every spot with a timestamp before time.
+    QList<spotData*> takeOlderThan(const QDateTime& time);
+
+private:
+    QMultiMap<double, spotData*> byFreq;
+    QHash<QString, spotData*> byCall;
+    QMultiMap<qint64, spotData*> byTime;
+};
+
 class dxClusterClient : public QObject
 {
     Q_OBJECT
@@ -56,7 +86,7 @@ signals:
     void deleteSpot(QString dxcall);
     void deleteOldSpots(int minutes);
     void sendOutput(QString text);
-    void sendSpots(QList<spotData> spots);
+    void spotsChanged(QList<spotData> added, QList<spotData> removed);
 
 public slots:
     void udpDataReceived();
@@ -74,10 +104,22 @@ public slots:
     void freqRange(double low, double high);
     void enableSkimmerSpots(bool enable);
 
+private slots:
+    void processTcpLines();
+
 private:
+    static bool parseSpotLine(const QByteArray& line, spotData* data);
+    static bool parseSpotXml(const QByteArray& datagram, QString& action, spotData* data);
+    void ingestSpot(spotData* data, QString type);
     void sendTcpData(QString data);
     bool databaseOpen();
     void updateSpots();
+    bool visible(double frequency) const { return frequency > lowFreq && frequency < highFreq; }
+#ifndef USESQL
+    void storeSpot(spotData* spot);
+    void removeSpot(spotData* spot);
+    void visibleChanges(double oldLow, double oldHigh, double newLow, double newHigh, QList<spotData>& out) const;
+#endif
 
     bool udpEnable;
     bool tcpEnable;
@@ -89,17 +131,24 @@ private:
     QString tcpUserName;
     QString tcpPassword;
     int tcpTimeout;
-    QDomDocument udpSpotReader;
-    QRegularExpression tcpRegex;
+    QByteArray tcpBuffer;
     QMutex mutex;
     bool authenticated=false;
     QTimer* tcpCleanupTimer=Q_NULLPTR;
 #ifdef USESQL
-    QSqlDatabase db;
+    database* spotDatabase();
+    database* db = Q_NULLPTR; // Created on first use, in the cluster thread
+#endif
+    double lowFreq = 0.0;
+    double highFreq = 0.0;
+#ifdef USESQL
+    QHash<QString, double> sentSpots; // Calls (and frequencies) the UI has been given
+#else
+    spotStore allSpots;
 #endif
-    double lowFreq;
-    double highFreq;
-    QMap<QString,spotData*> allSpots;
+    // Changes to the visible spots not yet sent to the UI
+    QList<spotData> addedSpots;
+    QList<spotData> removedSpots;
     bool skimmerSpots = false;
 };
 
@@ -19,6 +19,7 @@ bool database::open()
     {
         db = QSqlDatabase::database(name);
         qu = QSqlQuery(db);
+        prepare();
         return true;
     }
     else {
@@ -34,7 +35,12 @@ bool database::open()
     if (db.isValid())
     {
         db.open();
+        // WAL lets the UI read while the cluster thread writes, it is
+        // ignored (journal stays in memory) for the in-memory database.
+        qu.exec("PRAGMA journal_mode=WAL");
+        qu.exec("PRAGMA synchronous=NORMAL");
         if (check()) {
+            prepare();
             return true;
         }
     }
@@ -51,6 +57,80 @@ void database::close()
 
 
 
+void database::prepare()
+{
+    deleteCallQuery = QSqlQuery(db);
+    deleteCallQuery.prepare("DELETE FROM spots WHERE dxcall=?");
+    insertSpotQuery = QSqlQuery(db);
+    insertSpotQuery.prepare("INSERT INTO spots(type,spottercall,frequency,dxcall,mode,comment,timestamp) VALUES(?,?,?,?,?,?,?)");
+    deleteSpotQuery = QSqlQuery(db);
+    deleteSpotQuery.prepare("DELETE FROM spots WHERE dxcall=? AND frequency=?");
+    expireQuery = QSqlQuery(db);
+    expireQuery.prepare("DELETE FROM spots WHERE timestamp < ?");
+    rangeQuery = QSqlQuery(db);
+    rangeQuery.setForwardOnly(true);
+    rangeQuery.prepare("SELECT dxcall,frequency FROM spots WHERE frequency > ? AND frequency < ?");
+}
+
+bool database::transaction()
+{
+    return db.transaction();
+}
+
+bool database::commit()
+{
+    return db.commit();
+}
+
+bool database::addSpot(QString type, QString dxcall, QString spottercall, double frequency, QDateTime timestamp, QString mode, QString comment)
+{
+    // Only the latest spot of each call is kept.
+    deleteCallQuery.addBindValue(dxcall);
+    if (!deleteCallQuery.exec())
+    {
+        qWarning(logCluster()) << "Spot delete failed:" << deleteCallQuery.lastError().text();
+        return false;
+    }
+
+    insertSpotQuery.addBindValue(type);
+    insertSpotQuery.addBindValue(spottercall);
+    insertSpotQuery.addBindValue(frequency);
+    insertSpotQuery.addBindValue(dxcall);
+    insertSpotQuery.addBindValue(mode);
+    insertSpotQuery.addBindValue(comment);
+    insertSpotQuery.addBindValue(timestamp.toString("yyyy-MM-dd hh:mm:ss"));
+    if (!insertSpotQuery.exec())
+    {
+        qWarning(logCluster()) << "Spot insert failed:" << insertSpotQuery.lastError().text();
+        return false;
+    }
+    return true;
+}
+
+bool database::removeSpot(QString dxcall, double frequency)
+{
+    deleteSpotQuery.addBindValue(dxcall);
+    deleteSpotQuery.addBindValue(frequency);
+    return deleteSpotQuery.exec();
+}
+
+bool database::removeSpotsBefore(QDateTime timestamp)
+{
+    expireQuery.addBindValue(timestamp.toString("yyyy-MM-dd hh:mm:ss"));
+    return expireQuery.exec();
+}
+
+QSqlQuery& database::spotsInRange(double low, double high)
+{
+    rangeQuery.addBindValue(low);
+    rangeQuery.addBindValue(high);
+    if (!rangeQuery.exec())
+    {
+        qWarning(logCluster()) << "Spot query failed:" << rangeQuery.lastError().text();
+    }
+    return rangeQuery;
+}
+
 QSqlQuery database::query(QString query)
 {
     if (!db.isOpen())
@@ -94,7 +174,9 @@ bool database::check()
             "timestamp DATETIME,"
             "mode VARCHAR(30),"
             "comment VARCHAR(255) )");
-        qu.exec("CREATE INDEX spots_index ON spots(type,dxcall,frequency,timestamp)");
+        qu.exec("CREATE INDEX spots_frequency ON spots(frequency)");
+        qu.exec("CREATE INDEX spots_timestamp ON spots(timestamp)");
+        qu.exec("CREATE INDEX spots_dxcall ON spots(dxcall)");
         return true;
     }
     else {
@@ -9,6 +9,7 @@
 #include <QSqlDatabase>
 #include <QSqlQuery>
 #include <QSqlRecord>
+#include <QSqlError>
 #include <QThread>
 #include <QStandardPaths>
 
@@ -21,14 +22,30 @@ public:
     void close();
     QSqlQuery query(QString query);
 
+    // Spot table access through statements prepared once per connection.
+    bool transaction();
+    bool commit();
+    bool addSpot(QString type, QString dxcall, QString spottercall, double frequency, QDateTime timestamp, QString mode, QString comment);
+    bool removeSpot(QString dxcall, double frequency);
+    bool removeSpotsBefore(QDateTime timestamp);
+    // Selects dxcall (column 0) and frequency (column 1) of the spots in range.
+    QSqlQuery& spotsInRange(double low, double high);
+
 signals:
 
 public slots:
 private:
     bool check();
+    void prepare();
     QSqlDatabase db;
     QSqlQuery qu;
 
+    QSqlQuery deleteCallQuery;
+    QSqlQuery insertSpotQuery;
+    QSqlQuery deleteSpotQuery;
+    QSqlQuery expireQuery;
+    QSqlQuery rangeQuery;
+
 };
 
 #endif
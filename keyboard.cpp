@@ -4,6 +4,7 @@
 #include <QFile>
 #include <QTextStream>
 #include "keyboard.h"
+#include "tracerecorder.h"
 
 keyboard::keyboard(void)
 {
@@ -21,6 +22,9 @@ void keyboard::run()
         if (key == 'q') {
             QCoreApplication::quit();
         }
+        else if (key == 't') {
+            traceRecorder::dump("User request");
+        }
     }
     return;
 }
\ No newline at end of file
@@ -16,3 +16,4 @@ Q_LOGGING_CATEGORY(logTcpServer, "tcpserver")
 Q_LOGGING_CATEGORY(logUsbControl, "usbcontrol")
 Q_LOGGING_CATEGORY(logAudioConverter, "audioconverter")
 Q_LOGGING_CATEGORY(logCluster, "cluster")
+Q_LOGGING_CATEGORY(logMetrics, "metrics")
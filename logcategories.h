@@ -19,6 +19,7 @@ Q_DECLARE_LOGGING_CATEGORY(logTcpServer)
 Q_DECLARE_LOGGING_CATEGORY(logUsbControl)
 Q_DECLARE_LOGGING_CATEGORY(logAudioConverter)
 Q_DECLARE_LOGGING_CATEGORY(logCluster)
+Q_DECLARE_LOGGING_CATEGORY(logMetrics)
 
 
 #if defined(Q_OS_WIN) && !defined(__PRETTY_FUNCTION__)
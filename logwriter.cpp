@@ -0,0 +1,268 @@
+#include "logwriter.h"
+
+#include <QDateTime>
+#include <QCoreApplication>
+
+#include <algorithm>
+#include <cstdio>
+
+logWriter* logWriter::instance = Q_NULLPTR;
+std::atomic<bool> logWriter::debug{ false };
+QLoggingCategory::CategoryFilter logWriter::defaultFilter = Q_NULLPTR;
+
+bool logQueue::push(logEntry& entry)
+{
+    quint32 h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) >= LOG_QUEUE_SIZE)
+    {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    entries[h & (LOG_QUEUE_SIZE - 1)] = std::move(entry);
+    head.store(h + 1, std::memory_order_release);
+    return true;
+}
+
+bool logQueue::pop(logEntry& entry)
+{
+    quint32 t = tail.load(std::memory_order_relaxed);
+    if (t == head.load(std::memory_order_acquire))
+        return false;
+    entry = std::move(entries[t & (LOG_QUEUE_SIZE - 1)]);
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+}
+
+bool logWriter::start(const QString& fileName, bool console)
+{
+    if (instance != Q_NULLPTR)
+        return true;
+
+    logWriter* w = new logWriter();
+    w->file.setFileName(fileName);
+    if (!w->file.open(QFile::WriteOnly | QFile::Truncate | QFile::Text))
+    {
+        delete w;
+        return false;
+    }
+    w->console = console;
+    w->setObjectName("logWriter()");
+    instance = w;
+    w->QThread::start(QThread::LowPriority);
+
+    qInstallMessageHandler(messageHandler);
+    // Runs from ~QCoreApplication, after everything else has had its say.
+    qAddPostRoutine(stop);
+    return true;
+}
+
+void logWriter::stop()
+{
+    if (instance == Q_NULLPTR)
+        return;
+
+    qInstallMessageHandler(Q_NULLPTR);
+    logWriter* w = instance;
+    {
+        QMutexLocker locker(&w->waitMutex);
+        w->stopping = true;
+        w->wake.wakeAll();
+    }
+    w->wait();
+    instance = Q_NULLPTR;
+    delete w;
+}
+
+void logWriter::setDebug(bool enable)
+{
+    debug.store(enable);
+    // Re-running the filter updates every registered category.
+    QLoggingCategory::CategoryFilter old = QLoggingCategory::installFilter(categoryFilter);
+    if (old != categoryFilter)
+        defaultFilter = old;
+}
+
+void logWriter::categoryFilter(QLoggingCategory* category)
+{
+    if (defaultFilter != Q_NULLPTR)
+        defaultFilter(category);
+    if (!debug.load())
+        category->setEnabled(QtDebugMsg, false);
+}
+
+void logWriter::enableWindow(bool enable)
+{
+    if (instance != Q_NULLPTR)
+        instance->window = enable;
+}
+
+QStringList logWriter::takeWindowLines()
+{
+    QStringList lines;
+    if (instance != Q_NULLPTR)
+    {
+        QMutexLocker locker(&instance->windowMutex);
+        lines.swap(instance->windowLines);
+    }
+    return lines;
+}
+
+logQueue* logWriter::localQueue()
+{
+    static thread_local std::shared_ptr<logQueue> queue;
+    if (!queue)
+    {
+        queue = std::make_shared<logQueue>();
+        QMutexLocker locker(&instance->queuesMutex);
+        instance->queues.append(queue);
+    }
+    return queue.get();
+}
+
+void logWriter::messageHandler(QtMsgType type, const QMessageLogContext& context, const QString& msg)
+{
+    if (instance == Q_NULLPTR || (type == QtDebugMsg && !debug.load(std::memory_order_relaxed)))
+        return;
+
+    logEntry entry;
+    entry.time = QDateTime::currentMSecsSinceEpoch();
+    entry.type = type;
+    entry.category = context.category;
+    entry.message = msg;
+    localQueue()->push(entry);
+
+    if (type == QtFatalMsg)
+    {
+        // Qt aborts as soon as this returns, write everything out now.
+        instance->drain();
+    }
+}
+
+void logWriter::run()
+{
+    forever
+    {
+        bool last;
+        {
+            QMutexLocker locker(&waitMutex);
+            if (!stopping)
+                wake.wait(&waitMutex, LOG_FLUSH_MS);
+            last = stopping;
+        }
+        drain();
+        if (last)
+            break;
+    }
+}
+
+void logWriter::drain()
+{
+    QMutexLocker locker(&drainMutex);
+
+    QVector<std::shared_ptr<logQueue>> current;
+    {
+        QMutexLocker queuesLocker(&queuesMutex);
+        current = queues;
+    }
+
+    batch.clear();
+    quint32 dropped = 0;
+    for (const std::shared_ptr<logQueue>& q : current)
+    {
+        logEntry entry;
+        while (q->pop(entry))
+            batch.append(std::move(entry));
+        dropped += q->dropped.exchange(0, std::memory_order_relaxed);
+    }
+
+    // Queues of threads that have gone, once they are empty.
+    {
+        QMutexLocker queuesLocker(&queuesMutex);
+        for (int i = queues.size() - 1; i >= 0; i--)
+        {
+            // Held by this list, current and nothing else.
+            if (queues[i].use_count() == 2 && queues[i]->isEmpty())
+                queues.removeAt(i);
+        }
+    }
+
+    if (batch.isEmpty() && dropped == 0)
+        return;
+
+    // Each queue is in order already, merge them by time.
+    std::stable_sort(batch.begin(), batch.end(), [](const logEntry& a, const logEntry& b) { return a.time < b.time; });
+
+    fileData.clear();
+    consoleData.clear();
+    newWindowLines.clear();
+    for (const logEntry& entry : batch)
+        format(entry);
+
+    if (dropped > 0)
+    {
+        logEntry note;
+        note.time = QDateTime::currentMSecsSinceEpoch();
+        note.type = QtWarningMsg;
+        note.category = "logWriter";
+        note.message = QString("%1 log messages dropped, queue full").arg(dropped);
+        format(note);
+    }
+
+    file.write(fileData);
+    file.flush();
+    if (console)
+    {
+        fwrite(consoleData.constData(), 1, size_t(consoleData.size()), stdout);
+        fflush(stdout);
+    }
+    if (window)
+    {
+        QMutexLocker windowLocker(&windowMutex);
+        windowLines.append(newWindowLines);
+        if (windowLines.size() > LOG_WINDOW_LINES)
+            windowLines.erase(windowLines.begin(), windowLines.begin() + (windowLines.size() - LOG_WINDOW_LINES));
+    }
+}
+
+void logWriter::format(const logEntry& entry)
+{
+    // The date and time only change once a second, the milliseconds are added by hand.
+    qint64 second = entry.time / 1000;
+    if (second != cachedSecond)
+    {
+        cachedSecond = second;
+        cachedPrefix = QDateTime::fromMSecsSinceEpoch(second * 1000).toString("yyyy-MM-dd hh:mm:ss.").toLatin1();
+    }
+    int ms = int(entry.time % 1000);
+    char stamp[5] = { char('0' + ms / 100), char('0' + (ms / 10) % 10), char('0' + ms % 10), ' ', 0 };
+
+    const char* level = "DBG ";
+    switch (entry.type)
+    {
+        case QtDebugMsg:
+            level = "DBG ";
+            break;
+        case QtInfoMsg:
+            level = "INF ";
+            break;
+        case QtWarningMsg:
+            level = "WRN ";
+            break;
+        case QtCriticalMsg:
+            level = "CRT ";
+            break;
+        case QtFatalMsg:
+            level = "FTL ";
+            break;
+    }
+    const char* category = entry.category != Q_NULLPTR ? entry.category : "default";
+    QByteArray message = entry.message.toUtf8();
+
+    int lineStart = fileData.size();
+    fileData.append(cachedPrefix).append(stamp).append(level).append(category).append(": ").append(message).append('\n');
+
+    if (console)
+        consoleData.append(cachedPrefix).append(stamp).append(message).append('\n');
+    if (window)
+        newWindowLines.append(QString::fromUtf8(fileData.constData() + lineStart, fileData.size() - lineStart - 1));
+}
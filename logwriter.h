@@ -0,0 +1,101 @@
+#ifndef LOGWRITER_H
+#define LOGWRITER_H
+
+#include <QThread>
+#include <QFile>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QStringList>
+#include <QVector>
+#include <QLoggingCategory>
+
+#include <atomic>
+#include <memory>
+
+// Message handler that never does I/O on the logging thread. Each thread
+// that logs gets its own single producer queue, a background thread drains
+// all of them every LOG_FLUSH_MS, formats the batch and writes it to the log
+// file (and console/log window) with one write and one flush.
+//
+// Debug output is switched off at the QLoggingCategory level when debug
+// logging is disabled, so disabled qDebug() statements aren't even formatted.
+
+#define LOG_QUEUE_SIZE 4096        // Messages per thread, power of two. Extra messages are dropped and counted
+#define LOG_FLUSH_MS 100           // ms between writes
+#define LOG_WINDOW_LINES 5000      // Lines kept for the log window between checks
+
+struct logEntry {
+    qint64 time = 0;               // ms since epoch
+    QtMsgType type = QtDebugMsg;
+    const char* category = Q_NULLPTR;  // Category names are static strings
+    QString message;
+};
+
+class logQueue
+{
+public:
+    bool push(logEntry& entry);    // Producer thread only
+    bool pop(logEntry& entry);     // Writer only
+    bool isEmpty() const { return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire); }
+
+    std::atomic<quint32> dropped{ 0 };
+
+private:
+    logEntry entries[LOG_QUEUE_SIZE];
+    std::atomic<quint32> head{ 0 };  // Next slot the producer fills
+    std::atomic<quint32> tail{ 0 };  // Next slot the writer reads
+};
+
+class logWriter : public QThread
+{
+    Q_OBJECT
+
+public:
+    static bool start(const QString& fileName, bool console);
+    static void stop();
+    static void setDebug(bool enable);
+    static void enableWindow(bool enable);
+    static QStringList takeWindowLines();
+
+    static void messageHandler(QtMsgType type, const QMessageLogContext& context, const QString& msg);
+
+protected:
+    void run() override;
+
+private:
+    logWriter() {}
+    void drain();
+    void format(const logEntry& entry);
+    static void categoryFilter(QLoggingCategory* category);
+    static logQueue* localQueue();
+
+    QFile file;
+    bool console = false;
+    bool window = false;
+    bool stopping = false;
+    QMutex waitMutex;
+    QWaitCondition wake;
+
+    // Held while draining so a fatal message can flush from its own thread.
+    QMutex drainMutex;
+
+    QMutex queuesMutex;
+    QVector<std::shared_ptr<logQueue>> queues;
+
+    QMutex windowMutex;
+    QStringList windowLines;
+
+    // Formatting state, only touched while holding drainMutex.
+    QVector<logEntry> batch;
+    QByteArray fileData;
+    QByteArray consoleData;
+    QStringList newWindowLines;
+    qint64 cachedSecond = -1;
+    QByteArray cachedPrefix;
+
+    static logWriter* instance;
+    static std::atomic<bool> debug;
+    static QLoggingCategory::CategoryFilter defaultFilter;
+};
+
+#endif // LOGWRITER_H
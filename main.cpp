@@ -15,12 +15,7 @@
 
 // Copyright 2017-2022 Elliott H. Liggett
 #include "logcategories.h"
-
-#ifdef BUILD_WFSERVER
-// Smart pointer to log file
-QScopedPointer<QFile>   m_logFile;
-QMutex logMutex;
-#endif
+#include "logwriter.h"
 
 bool debugMode=false;
 
@@ -45,8 +40,6 @@ bool debugMode=false;
         #endif
     }
 
-
-void messageHandler(QtMsgType type, const QMessageLogContext& context, const QString& msg);
 #endif
 
 int main(int argc, char *argv[])
@@ -138,11 +131,8 @@ int main(int argc, char *argv[])
 #ifdef BUILD_WFSERVER
 
     // Set the logging file before doing anything else.
-    m_logFile.reset(new QFile(logFilename));
-    // Open the file logging
-    m_logFile.data()->open(QFile::WriteOnly | QFile::Truncate | QFile::Text);
-    // Set handler
-    qInstallMessageHandler(messageHandler);
+    logWriter::setDebug(debugMode);
+    logWriter::start(logFilename, true);
 
     qInfo(logSystem()) << version;
 
@@ -166,44 +156,3 @@ int main(int argc, char *argv[])
 
 }
 
-#ifdef BUILD_WFSERVER
-
-void messageHandler(QtMsgType type, const QMessageLogContext& context, const QString& msg)
-{
-    // Open stream file writes
-    if (type == QtDebugMsg && !debugMode)
-    {
-        return;
-    }
-    QMutexLocker locker(&logMutex);
-    QTextStream out(m_logFile.data());
-    QString text;
-
-    // Write the date of recording
-    out << QDateTime::currentDateTime().toString("yyyy-MM-dd hh:mm:ss.zzz ");
-    // By type determine to what level belongs message
-    
-    switch (type)
-    {
-        case QtDebugMsg:
-            out << "DBG ";
-            break;
-        case QtInfoMsg:
-            out << "INF ";
-            break;
-        case QtWarningMsg:
-            out << "WRN ";
-            break;
-        case QtCriticalMsg:
-            out << "CRT ";
-            break;
-        case QtFatalMsg:
-            out << "FTL ";
-            break;
-    } 
-    // Write to the output category of the message and the message itself
-    out << context.category << ": " << msg << "\n";
-    std::cout << QDateTime::currentDateTime().toString("yyyy-MM-dd hh:mm:ss.zzz ").toLocal8Bit().toStdString() << msg.toLocal8Bit().toStdString() << "\n";
-    out.flush();    // Clear the buffered data
-}
-#endif
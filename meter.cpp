@@ -44,8 +44,10 @@ meter::meter(QWidget *parent) : QWidget(parent)
     lowLineColor = lowTextColor;
 
     avgLevels.resize(averageBalisticLength, 0);
-    peakLevels.resize(peakBalisticLength, 0);
 
+    frameTimer = new QTimer(this);
+    frameTimer->setSingleShot(true);
+    connect(frameTimer, SIGNAL(timeout()), this, SLOT(frameTimeout()));
 }
 
 void meter::setColors(QColor current, QColor peakScale, QColor peakLevel,
@@ -65,6 +67,7 @@ void meter::setColors(QColor current, QColor peakScale, QColor peakLevel,
 
     lowLineColor = lowLine;
     lowTextColor = lowText;
+    scaleValid = false;
     this->update();
 }
 
@@ -90,10 +93,9 @@ void meter::clearMeter()
     average = 0;
     peak = 0;
 
-    avgLevels.clear();
-    peakLevels.clear();
-    avgLevels.resize(averageBalisticLength, 0);
-    peakLevels.resize(peakBalisticLength, 0);
+    avgLevels.assign(averageBalisticLength, 0);
+    avgSum = 0;
+    peakWindow.clear();
 
     peakPosition = 0;
     avgPosition = 0;
@@ -107,6 +109,7 @@ void meter::setMeterType(meterKind type)
         return;
 
     meterType = type;
+    scaleValid = false;
     // clear average and peak vectors:
     this->clearMeter();
 }
@@ -126,86 +129,142 @@ QString meter::getMeterShortString()
     return meterShortString;
 }
 
-void meter::paintEvent(QPaintEvent *)
+void meter::resizeEvent(QResizeEvent *)
 {
-    QPainter painter(this);
-    // This next line sets up a canvis within the
-    // space of the widget, and gives it coordinates.
-    // The end effect, is that the drawing functions will all
-    // scale to the window size.
-    painter.setRenderHint(QPainter::SmoothPixmapTransform);
-    painter.setFont(QFont(this->fontInfo().family(), fontSize));
-    widgetWindowHeight = this->height();
-    painter.setWindow(QRect(0, 0, 255+mXstart+15, widgetWindowHeight));
-    barHeight = widgetWindowHeight / 2;
+    scaleValid = false;
+}
+
+void meter::scheduleUpdate()
+{
+    // Paint straight away, then at most once per METER_FRAME_MS while levels keep coming.
+    if (frameTimer->isActive())
+    {
+        framePending = true;
+        return;
+    }
+    update();
+    frameTimer->start(METER_FRAME_MS);
+}
+
+void meter::frameTimeout()
+{
+    if (framePending)
+    {
+        framePending = false;
+        update();
+        frameTimer->start(METER_FRAME_MS);
+    }
+}
 
+void meter::drawScale(QPainter *qp)
+{
     switch(meterType)
     {
         case meterS:
             label = "S";
             peakRedLevel = 120; // S9+
-            drawScaleS(&painter);
+            drawScaleS(qp);
             break;
         case meterPower:
             label = "PWR";
             peakRedLevel = 210; // 100%
-            drawScalePo(&painter);
+            drawScalePo(qp);
             break;
         case meterALC:
             label = "ALC";
             peakRedLevel = 100;
-            drawScaleALC(&painter);
+            drawScaleALC(qp);
             break;
         case meterSWR:
             label = "SWR";
             peakRedLevel = 100; // SWR 2.5
-            drawScaleSWR(&painter);
+            drawScaleSWR(qp);
             break;
         case meterCenter:
             label = "CTR";
             peakRedLevel = 256; // No need for red here
-            drawScaleCenter(&painter);
+            drawScaleCenter(qp);
             break;
         case meterVoltage:
             label = "Vd";
             peakRedLevel = 241;
-            drawScaleVd(&painter);
+            drawScaleVd(qp);
             break;
         case meterCurrent:
             label = "Id";
             peakRedLevel = 120;
-            drawScaleId(&painter);
+            drawScaleId(qp);
             break;
         case meterComp:
             label = "CMP(dB)";
             peakRedLevel = 100;
-            drawScaleComp(&painter);
+            drawScaleComp(qp);
             break;
         case meterNone:
-            return;
             break;
         case meterAudio:
             label = "dBfs";
             peakRedLevel = 241;
-            drawScale_dBFs(&painter);
+            drawScale_dBFs(qp);
             break;
         case meterRxAudio:
             label = "Rx(dBfs)";
             peakRedLevel = 241;
-            drawScale_dBFs(&painter);
+            drawScale_dBFs(qp);
             break;
         case meterTxMod:
             label = "Tx(dBfs)";
             peakRedLevel = 241;
-            drawScale_dBFs(&painter);
+            drawScale_dBFs(qp);
             break;
 
         default:
             label = "DN";
             peakRedLevel = 241;
-            drawScaleRaw(&painter);
+            drawScaleRaw(qp);
             break;
     }
+}
+
+void meter::paintEvent(QPaintEvent *)
+{
+    if (meterType == meterNone)
+        return;
+
+    widgetWindowHeight = this->height();
+    barHeight = widgetWindowHeight / 2;
+    QFont font(this->fontInfo().family(), fontSize);
+    QRect window(0, 0, 255+mXstart+15, widgetWindowHeight);
+
+    qreal ratio = devicePixelRatioF();
+    if (!scaleValid || scaleCache.size() != this->size() * ratio)
+    {
+        // Scale text layout is the expensive part, so it is only redone when it changes.
+        scaleCache = QPixmap(this->size() * ratio);
+        scaleCache.setDevicePixelRatio(ratio);
+        scaleCache.fill(Qt::transparent);
+        QPainter scalePainter(&scaleCache);
+        scalePainter.setRenderHint(QPainter::SmoothPixmapTransform);
+        scalePainter.setFont(font);
+        scalePainter.setWindow(window);
+        drawScale(&scalePainter);
+        if(drawLabels)
+        {
+            drawLabel(&scalePainter);
+        }
+        scaleValid = true;
+    }
+
+    QPainter painter(this);
+    painter.drawPixmap(0, 0, scaleCache);
+
+    // This next line sets up a canvis within the
+    // space of the widget, and gives it coordinates.
+    // The end effect, is that the drawing functions will all
+    // scale to the window size.
+    painter.setRenderHint(QPainter::SmoothPixmapTransform);
+    painter.setFont(font);
+    painter.setWindow(window);
 
     // Current: the most-current value.
     // Draws a bar from start to value.
@@ -282,10 +341,6 @@ void meter::paintEvent(QPaintEvent *)
 
         painter.drawRect(mXstart+peak-1,mYstart,2,barHeight);
     }
-    if(drawLabels)
-    {
-        drawLabel(&painter);
-    }
 }
 
 void meter::drawLabel(QPainter *qp)
@@ -294,30 +349,34 @@ void meter::drawLabel(QPainter *qp)
     qp->drawText(0,scaleTextYstart, label );
 }
 
+void meter::addAverage(int level)
+{
+    // Running sum over the last averageBalisticLength samples.
+    int slot = avgPosition % averageBalisticLength;
+    if (avgPosition >= averageBalisticLength)
+        avgSum -= avgLevels[slot];
+    avgLevels[slot] = level;
+    avgSum += level;
+    avgPosition++;
+    this->average = avgSum / std::min(avgPosition, averageBalisticLength);
+}
+
 void meter::setLevel(int current)
 {
     this->current = current;
 
-    avgLevels[(avgPosition++)%averageBalisticLength] = current;
-    peakLevels[(peakPosition++)%peakBalisticLength] = current;
-
-    int sum=0;
+    addAverage(current);
 
-    for(unsigned int i=0; i < (unsigned int)std::min(avgPosition, (int)avgLevels.size()); i++)
-    {
-        sum += avgLevels.at(i);
-    }
-    this->average = sum / std::min(avgPosition, (int)avgLevels.size());
+    // Anything not above the new level can never be the peak again.
+    while (!peakWindow.empty() && peakWindow.back().second <= current)
+        peakWindow.pop_back();
+    peakWindow.emplace_back(peakPosition, current);
+    while (peakWindow.front().first <= peakPosition - peakBalisticLength)
+        peakWindow.pop_front();
+    peakPosition++;
+    this->peak = peakWindow.front().second;
 
-    this->peak = 0;
-
-    for(unsigned int i=0; i < peakLevels.size(); i++)
-    {
-        if( peakLevels.at(i) >  this->peak)
-            this->peak = peakLevels.at(i);
-    }
-
-    this->update();
+    scheduleUpdate();
 }
 
 void meter::setLevels(int current, int peak)
@@ -325,15 +384,9 @@ void meter::setLevels(int current, int peak)
     this->current = current;
     this->peak = peak;
 
-    avgLevels[(avgPosition++)%averageBalisticLength] = current;
-    int sum=0;
-    for(unsigned int i=0; i < (unsigned int)std::min(avgPosition, (int)avgLevels.size()); i++)
-    {
-        sum += avgLevels.at(i);
-    }
-    this->average = sum / std::min(avgPosition, (int)avgLevels.size());
+    addAverage(current);
 
-    this->update();
+    scheduleUpdate();
 }
 
 void meter::setLevels(int current, int peak, int average)
@@ -342,13 +395,14 @@ void meter::setLevels(int current, int peak, int average)
     this->peak = peak;
     this->average = average;
 
-    this->update();
+    scheduleUpdate();
 }
 
 void meter::updateDrawing(int num)
 {
     fontSize = num;
     length = num;
+    scaleValid = false;
 }
 
 // The drawScale functions draw the numbers and number unerline for each type of meter
@@ -3,7 +3,10 @@
 
 #include <QWidget>
 #include <QPainter>
+#include <QPixmap>
+#include <QTimer>
 #include <vector>
+#include <deque>
 #include <algorithm>
 #include <numeric>
 #include <cmath>
@@ -11,6 +14,8 @@
 #include "rigcommander.h" // for meter types
 #include "audiotaper.h"
 
+#define METER_FRAME_MS 33 // Minimum time between repaints, new levels in between are merged
+
 class meter : public QWidget
 {
     Q_OBJECT
@@ -21,6 +26,7 @@ signals:
 
 public slots:
     void paintEvent(QPaintEvent *);
+    void resizeEvent(QResizeEvent *);
 
     void updateDrawing(int num);
     void setLevels(int current, int peak, int average);
@@ -37,7 +43,14 @@ public slots:
                    QColor lowText);
 
 
+private slots:
+    void frameTimeout();
+
 private:
+    void scheduleUpdate();
+    void addAverage(int level);
+    void drawScale(QPainter *qp);
+
     //QPainter painter;
     meterKind meterType;
     QString meterShortString;
@@ -52,7 +65,16 @@ private:
     int avgPosition=0;
     int peakPosition=0;
     std::vector<unsigned char> avgLevels;
-    std::vector<unsigned char> peakLevels;
+    int avgSum = 0; // Sum of the samples in avgLevels
+    // Sliding window maximum: (position, level) with levels decreasing from the
+    // front, so the front is always the peak of the last peakBalisticLength samples.
+    std::deque<std::pair<int, int>> peakWindow;
+
+    // The scale and label only change with the meter type, colors or size.
+    QPixmap scaleCache;
+    bool scaleValid = false;
+    QTimer* frameTimer = Q_NULLPTR;
+    bool framePending = false;
 
     int peakRedLevel=0;
     bool drawLabels = true;
@@ -0,0 +1,217 @@
+#include "metrics.h"
+
+#include <QMutex>
+#include <QList>
+#include <QtAlgorithms>
+
+#include <cmath>
+
+void latencyHistogram::record(qint64 us)
+{
+    quint64 v = us < 0 ? 0 : quint64(us);
+    buckets[indexOf(v)].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+    totalUs.fetch_add(v, std::memory_order_relaxed);
+
+    quint64 m = maxUs.load(std::memory_order_relaxed);
+    while (v > m && !maxUs.compare_exchange_weak(m, v, std::memory_order_relaxed))
+    {
+    }
+}
+
+void latencyHistogram::recordSinceStamp(qint64 stampUs)
+{
+    if (stampUs != 0)
+        record(metrics::now() - stampUs);
+}
+
+int latencyHistogram::indexOf(quint64 us)
+{
+    if (us < METRIC_SUB_BUCKETS)
+        return int(us);
+    if (us >= (quint64(1) << METRIC_MAX_BITS))
+        us = (quint64(1) << METRIC_MAX_BITS) - 1;
+
+    // Keep the top METRIC_SUB_BITS + 1 bits, the shift picks the power of two.
+    int msb = 63 - int(qCountLeadingZeroBits(us));
+    int shift = msb - METRIC_SUB_BITS;
+    return (shift << METRIC_SUB_BITS) + int(us >> shift);
+}
+
+quint64 latencyHistogram::upperBound(int index)
+{
+    if (index < METRIC_SUB_BUCKETS)
+        return quint64(index) + 1;
+    int shift = (index >> METRIC_SUB_BITS) - 1;
+    quint64 top = quint64(index & (METRIC_SUB_BUCKETS - 1)) + METRIC_SUB_BUCKETS;
+    return (top + 1) << shift;
+}
+
+quint64 latencyHistogram::quantile(double q) const
+{
+    quint64 n = count();
+    if (n == 0)
+        return 0;
+    quint64 target = quint64(std::ceil(q * double(n)));
+    if (target == 0)
+        target = 1;
+
+    quint64 seen = 0;
+    for (int i = 0; i < METRIC_BUCKETS; i++)
+    {
+        seen += bucket(i);
+        if (seen >= target)
+            return qMin(upperBound(i) - 1, max());
+    }
+    return max();
+}
+
+enum metricType { metricTypeCounter, metricTypeGauge, metricTypeHistogram };
+
+struct metricEntry {
+    metricType type;
+    QByteArray name;
+    QByteArray help;
+    void* metric;
+};
+
+// Entries are never removed, the pointers handed out stay valid.
+static QMutex registryMutex;
+static QList<metricEntry> registry;
+
+static void* findOrCreate(metricType type, const char* name, const char* help)
+{
+    QMutexLocker locker(&registryMutex);
+    for (const metricEntry& e : registry)
+    {
+        if (e.name == name && e.type == type)
+            return e.metric;
+    }
+    metricEntry e;
+    e.type = type;
+    e.name = name;
+    e.help = help;
+    switch (type)
+    {
+    case metricTypeCounter:
+        e.metric = new metricCounter();
+        break;
+    case metricTypeGauge:
+        e.metric = new metricGauge();
+        break;
+    case metricTypeHistogram:
+        e.metric = new latencyHistogram();
+        break;
+    }
+    registry.append(e);
+    return e.metric;
+}
+
+qint64 metrics::now()
+{
+    // Function local statics are initialised once, even when several threads
+    // get here first at the same time.
+    struct monotonicClock {
+        monotonicClock() { timer.start(); }
+        QElapsedTimer timer;
+    };
+    static const monotonicClock clock;
+    // Starts at 1 so that 0 can mean "not stamped".
+    return clock.timer.nsecsElapsed() / 1000 + 1;
+}
+
+metricCounter* metrics::counter(const char* name, const char* help)
+{
+    return static_cast<metricCounter*>(findOrCreate(metricTypeCounter, name, help));
+}
+
+metricGauge* metrics::gauge(const char* name, const char* help)
+{
+    return static_cast<metricGauge*>(findOrCreate(metricTypeGauge, name, help));
+}
+
+latencyHistogram* metrics::histogram(const char* name, const char* help)
+{
+    return static_cast<latencyHistogram*>(findOrCreate(metricTypeHistogram, name, help));
+}
+
+QByteArray metrics::prometheus()
+{
+    QMutexLocker locker(&registryMutex);
+    QByteArray out;
+    for (const metricEntry& e : registry)
+    {
+        out.append("# HELP ").append(e.name).append(' ').append(e.help).append('\n');
+        switch (e.type)
+        {
+        case metricTypeCounter:
+            out.append("# TYPE ").append(e.name).append(" counter\n");
+            out.append(e.name).append(' ').append(QByteArray::number(static_cast<metricCounter*>(e.metric)->get())).append('\n');
+            break;
+        case metricTypeGauge:
+            out.append("# TYPE ").append(e.name).append(" gauge\n");
+            out.append(e.name).append(' ').append(QByteArray::number(static_cast<metricGauge*>(e.metric)->get())).append('\n');
+            break;
+        case metricTypeHistogram:
+        {
+            // Exported in seconds with one bucket per power of two, the fine
+            // buckets are summed into them.
+            latencyHistogram* h = static_cast<latencyHistogram*>(e.metric);
+            out.append("# TYPE ").append(e.name).append(" histogram\n");
+            quint64 cumulative = 0;
+            int index = 0;
+            for (int bits = METRIC_SUB_BITS; bits <= METRIC_MAX_BITS; bits++)
+            {
+                quint64 limit = quint64(1) << bits;
+                while (index < METRIC_BUCKETS && latencyHistogram::upperBound(index) <= limit)
+                    cumulative += h->bucket(index++);
+                out.append(e.name).append("_bucket{le=\"").append(QByteArray::number(double(limit) / 1e6, 'g', 9))
+                    .append("\"} ").append(QByteArray::number(cumulative)).append('\n');
+            }
+            out.append(e.name).append("_bucket{le=\"+Inf\"} ").append(QByteArray::number(h->count())).append('\n');
+            out.append(e.name).append("_sum ").append(QByteArray::number(double(h->sum()) / 1e6, 'g', 12)).append('\n');
+            out.append(e.name).append("_count ").append(QByteArray::number(h->count())).append('\n');
+            break;
+        }
+        }
+    }
+    return out;
+}
+
+QByteArray metrics::json()
+{
+    QMutexLocker locker(&registryMutex);
+    QByteArray out("{");
+    bool first = true;
+    for (const metricEntry& e : registry)
+    {
+        if (!first)
+            out.append(',');
+        first = false;
+        out.append("\n  \"").append(e.name).append("\": ");
+        switch (e.type)
+        {
+        case metricTypeCounter:
+            out.append(QByteArray::number(static_cast<metricCounter*>(e.metric)->get()));
+            break;
+        case metricTypeGauge:
+            out.append(QByteArray::number(static_cast<metricGauge*>(e.metric)->get()));
+            break;
+        case metricTypeHistogram:
+        {
+            latencyHistogram* h = static_cast<latencyHistogram*>(e.metric);
+            out.append("{\"count\": ").append(QByteArray::number(h->count()))
+                .append(", \"sum_us\": ").append(QByteArray::number(h->sum()))
+                .append(", \"p50_us\": ").append(QByteArray::number(h->quantile(0.5)))
+                .append(", \"p90_us\": ").append(QByteArray::number(h->quantile(0.9)))
+                .append(", \"p99_us\": ").append(QByteArray::number(h->quantile(0.99)))
+                .append(", \"p999_us\": ").append(QByteArray::number(h->quantile(0.999)))
+                .append(", \"max_us\": ").append(QByteArray::number(h->max()))
+                .append('}');
+            break;
+        }
+        }
+    }
+    out.append("\n}\n");
+    return out;
+}
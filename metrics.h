@@ -0,0 +1,90 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QtGlobal>
+#include <QByteArray>
+#include <QElapsedTimer>
+
+#include <atomic>
+
+// Process wide registry of counters, gauges and latency histograms for the
+// hot paths (audio, CI-V, spectrum, rigctld). Recording is lock free, the
+// registry lock is only taken when a metric is created or exported, so hot
+// paths look a metric up once and keep the pointer:
+//
+//     static latencyHistogram* h = metrics::histogram("name", "help");
+//     h->record(us);
+//
+// Histograms are log-linear (HDR style): values up to 16us are exact, above
+// that each power of two is split into METRIC_SUB_BUCKETS buckets, so any
+// quantile is within about 6% of the real value.
+
+#define METRIC_SUB_BITS 4                               // log2 of the buckets per power of two
+#define METRIC_SUB_BUCKETS (1 << METRIC_SUB_BITS)
+#define METRIC_MAX_BITS 36                              // Largest value kept is 2^36us, about 19 hours
+#define METRIC_BUCKETS (METRIC_SUB_BUCKETS * (METRIC_MAX_BITS - METRIC_SUB_BITS + 1))
+
+class metricCounter
+{
+public:
+    void add(quint64 n = 1) { value.fetch_add(n, std::memory_order_relaxed); }
+    quint64 get() const { return value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<quint64> value{ 0 };
+};
+
+class metricGauge
+{
+public:
+    void set(qint64 v) { value.store(v, std::memory_order_relaxed); }
+    void add(qint64 v) { value.fetch_add(v, std::memory_order_relaxed); }
+    qint64 get() const { return value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<qint64> value{ 0 };
+};
+
+class latencyHistogram
+{
+public:
+    void record(qint64 us);
+    void recordSince(const QElapsedTimer& timer) { record(timer.nsecsElapsed() / 1000); }
+    // stampUs is a metrics::now() value, 0 (not stamped) is ignored.
+    void recordSinceStamp(qint64 stampUs);
+
+    quint64 count() const { return total.load(std::memory_order_relaxed); }
+    quint64 sum() const { return totalUs.load(std::memory_order_relaxed); }
+    quint64 max() const { return maxUs.load(std::memory_order_relaxed); }
+    quint64 bucket(int index) const { return buckets[index].load(std::memory_order_relaxed); }
+
+    // Value (us) below which fraction q of the recorded values fall.
+    quint64 quantile(double q) const;
+
+    static int indexOf(quint64 us);
+    static quint64 upperBound(int index);
+
+private:
+    std::atomic<quint64> buckets[METRIC_BUCKETS] = {};
+    std::atomic<quint64> total{ 0 };
+    std::atomic<quint64> totalUs{ 0 };
+    std::atomic<quint64> maxUs{ 0 };
+};
+
+class metrics
+{
+public:
+    // Returns the metric with this name, creating it on first use. Metrics
+    // live until the process exits.
+    static metricCounter* counter(const char* name, const char* help);
+    static metricGauge* gauge(const char* name, const char* help);
+    static latencyHistogram* histogram(const char* name, const char* help);
+
+    // Microseconds on a monotonic clock, for stamping items that cross threads.
+    static qint64 now();
+
+    static QByteArray prometheus();
+    static QByteArray json();
+};
+
+#endif // METRICS_H
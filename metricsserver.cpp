@@ -0,0 +1,78 @@
+#include "metricsserver.h"
+#include "metrics.h"
+#include "logcategories.h"
+
+metricsServer::metricsServer(QObject* parent) :
+    QTcpServer(parent)
+{
+}
+
+int metricsServer::startServer(quint16 port)
+{
+    if (!listen(QHostAddress::LocalHost, port))
+    {
+        qInfo(logMetrics()) << "could not start metrics server on port" << port << errorString();
+        return -1;
+    }
+    qInfo(logMetrics()) << "metrics server started on port" << port;
+    return 0;
+}
+
+void metricsServer::incomingConnection(qintptr socketDescriptor)
+{
+    QTcpSocket* socket = new QTcpSocket(this);
+    if (!socket->setSocketDescriptor(socketDescriptor))
+    {
+        delete socket;
+        return;
+    }
+    connect(socket, SIGNAL(readyRead()), this, SLOT(readRequest()));
+    connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+}
+
+void metricsServer::readRequest()
+{
+    QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
+    if (socket == Q_NULLPTR)
+        return;
+
+    // Wait for the whole request header, the body (if any) is ignored.
+    QByteArray request = socket->peek(METRICS_MAX_REQUEST);
+    if (!request.contains("\r\n\r\n") && !request.contains("\n\n"))
+    {
+        if (request.size() >= METRICS_MAX_REQUEST)
+            socket->abort();
+        return;
+    }
+    socket->readAll();
+    disconnect(socket, SIGNAL(readyRead()), this, SLOT(readRequest()));
+
+    QList<QByteArray> line = request.left(request.indexOf('\n')).trimmed().split(' ');
+    if (line.size() < 2 || line[0] != "GET")
+    {
+        reply(socket, "405 Method Not Allowed", "text/plain", "GET only\n");
+        return;
+    }
+
+    QByteArray path = line[1];
+    int query = path.indexOf('?');
+    if (query >= 0)
+        path.truncate(query);
+
+    if (path == "/metrics")
+        reply(socket, "200 OK", "text/plain; version=0.0.4", metrics::prometheus());
+    else if (path == "/metrics.json")
+        reply(socket, "200 OK", "application/json", metrics::json());
+    else
+        reply(socket, "404 Not Found", "text/plain", "Try /metrics or /metrics.json\n");
+}
+
+void metricsServer::reply(QTcpSocket* socket, const char* status, const char* type, const QByteArray& body)
+{
+    QByteArray out("HTTP/1.1 ");
+    out.append(status).append("\r\nContent-Type: ").append(type)
+        .append("\r\nContent-Length: ").append(QByteArray::number(body.size()))
+        .append("\r\nConnection: close\r\n\r\n").append(body);
+    socket->write(out);
+    socket->disconnectFromHost();
+}
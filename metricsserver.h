@@ -0,0 +1,32 @@
+#ifndef METRICSSERVER_H
+#define METRICSSERVER_H
+
+#include <QObject>
+#include <QTcpServer>
+#include <QTcpSocket>
+
+// Minimal HTTP endpoint for the metrics registry, only listening on the
+// loopback interface. GET /metrics returns Prometheus text format and
+// GET /metrics.json a JSON summary with the histogram percentiles.
+
+#define METRICS_MAX_REQUEST 4096   // Bytes of request header accepted before the connection is dropped
+
+class metricsServer : public QTcpServer
+{
+    Q_OBJECT
+
+public:
+    explicit metricsServer(QObject* parent = Q_NULLPTR);
+    int startServer(quint16 port);
+
+protected:
+    void incomingConnection(qintptr socketDescriptor) override;
+
+private slots:
+    void readRequest();
+
+private:
+    void reply(QTcpSocket* socket, const char* status, const char* type, const QByteArray& body);
+};
+
+#endif // METRICSSERVER_H
@@ -0,0 +1,83 @@
+#include "noisefloor.h"
+#include <string.h>
+#include <cmath>
+
+noiseFloorTracker::noiseFloorTracker()
+{
+    reset();
+}
+
+void noiseFloorTracker::reset()
+{
+    memset(histogram, 0, sizeof(histogram));
+    primed = false;
+}
+
+void noiseFloorTracker::setAmpMax(unsigned char max)
+{
+    if (max == 0)
+        max = 160;
+    if (ampMax != max)
+    {
+        ampMax = max;
+        reset();
+    }
+}
+
+unsigned char noiseFloorTracker::percentile(const quint32 *hist, quint32 total, double fraction) const
+{
+    quint32 target = (quint32)(total * fraction);
+    quint32 count = 0;
+    for (int bin = 0; bin <= ampMax; bin++)
+    {
+        count += hist[bin];
+        if (count > target)
+            return (unsigned char)bin;
+    }
+    return ampMax;
+}
+
+bool noiseFloorTracker::addLine(const QByteArray &spectrum)
+{
+    const int len = spectrum.length();
+    if (len == 0)
+        return false;
+
+    memset(histogram, 0, sizeof(histogram));
+    const unsigned char *data = reinterpret_cast<const unsigned char *>(spectrum.constData());
+    for (int i = 0; i < len; i++)
+    {
+        histogram[data[i]]++;
+    }
+
+    // Anything above ampMax is invalid for this rig, fold it into the top bin
+    for (int bin = ampMax + 1; bin < 256; bin++)
+    {
+        histogram[ampMax] += histogram[bin];
+        histogram[bin] = 0;
+    }
+
+    double lineFloor = (double)percentile(histogram, len, floorPercentile) - floorMargin;
+    double lineCeiling = (double)percentile(histogram, len, ceilingPercentile) + ceilingMargin;
+
+    if (!primed)
+    {
+        smoothFloor = lineFloor;
+        smoothCeiling = lineCeiling;
+        primed = true;
+    } else {
+        smoothFloor += (lineFloor - smoothFloor) * smoothing;
+        smoothCeiling += (lineCeiling - smoothCeiling) * smoothing;
+    }
+
+    int newFloor = qBound(0, (int)std::lround(smoothFloor), qMax(0, (int)ampMax - minimumSpan));
+    int newCeiling = qBound(qMin(newFloor + minimumSpan, (int)ampMax), (int)std::lround(smoothCeiling), (int)ampMax);
+
+    if (newFloor != currentFloor || newCeiling != currentCeiling)
+    {
+        currentFloor = newFloor;
+        currentCeiling = newCeiling;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,52 @@
+#ifndef NOISEFLOOR_H
+#define NOISEFLOOR_H
+
+#include <QByteArray>
+#include <QtGlobal>
+
+// Tracks the noise floor and signal level of the incoming spectrum so that
+// the spectrum and waterfall ranges can follow band conditions automatically.
+//
+// Each spectrum line is binned into a 256-entry histogram (one bin per byte
+// value) which is walked once to find the requested percentiles. This is O(n)
+// in the line length plus a constant 256 bin walk, no sorting is needed.
+// The results are smoothed with a simple exponential filter so that the
+// display range does not jump around from line to line.
+
+class noiseFloorTracker
+{
+public:
+    noiseFloorTracker();
+
+    void reset();
+    void setAmpMax(unsigned char max);
+    // Returns true if the rounded floor or ceiling changed on this line
+    bool addLine(const QByteArray &spectrum);
+
+    int floor() const { return currentFloor; }
+    int ceiling() const { return currentCeiling; }
+
+private:
+    unsigned char percentile(const quint32 *hist, quint32 total, double fraction) const;
+
+    quint32 histogram[256];
+    unsigned char ampMax = 160;
+
+    double smoothFloor = 0.0;
+    double smoothCeiling = 160.0;
+    bool primed = false;
+
+    int currentFloor = 0;
+    int currentCeiling = 160;
+
+    // Tunables: the floor is taken from the lower part of the distribution
+    // (most bins of a scope line are noise), the ceiling from near the top.
+    const double floorPercentile = 0.20;
+    const double ceilingPercentile = 0.995;
+    const int floorMargin = 4;
+    const int ceilingMargin = 10;
+    const int minimumSpan = 30;
+    const double smoothing = 0.05; // weight of each new line
+};
+
+#endif // NOISEFLOOR_H
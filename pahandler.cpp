@@ -1,6 +1,7 @@
 #include "pahandler.h"
 
 #include "logcategories.h"
+#include "metrics.h"
 
 #if defined(Q_OS_WIN)
 #include <objbase.h>
@@ -268,6 +269,7 @@ int paHandler::writeData(const void* inputBuffer, void* outputBuffer,
 	Q_UNUSED(status);
 	audioPacket packet;
 	packet.time = QTime::currentTime();
+	packet.stamp = metrics::now();
 	packet.sent = 0;
 	packet.volume = volume;
 	memcpy(&packet.guid, setup.guid, GUIDLEN);
@@ -292,6 +294,8 @@ int paHandler::writeData(const void* inputBuffer, void* outputBuffer,
 
 void paHandler::convertedOutput(audioPacket packet) {
 
+	static latencyHistogram* toDevice = metrics::histogram("wfview_audio_rx_to_device_seconds", "Time from receiving an audio packet to writing it to the output device");
+
 	if (packet.data.size() > 0) {
 
 		if (Pa_IsStreamActive(audio) == 1) {
@@ -300,6 +304,7 @@ void paHandler::convertedOutput(audioPacket packet) {
 			if (err != paNoError) {
 				qDebug(logAudio()) << (setup.isinput ? "Input" : "Output") << "Error writing audio!";
 			}
+			toDevice->recordSinceStamp(packet.stamp);
 			const PaStreamInfo* info = Pa_GetStreamInfo(audio);
 			currentLatency = packet.time.msecsTo(QTime::currentTime()) + (info->outputLatency * 1000);
 		}
@@ -4,6 +4,7 @@
 #include <QString>
 #include <QColor>
 #include <QMap>
+#include <QList>
 #include "wfviewtypes.h"
 
 
@@ -23,9 +24,11 @@ struct preferences {
     int underlayBufferSize = 64;
     bool wfAntiAlias;
     bool wfInterpolate;
+    bool softwareSpectrum;
     int wftheme;
     int plotFloor;
     int plotCeiling;
+    bool plotAutoRange;
     QString stylesheetPath;
     unsigned int wflength;
     bool confirmExit;
@@ -41,6 +44,8 @@ struct preferences {
     QString serialPortRadio;
     quint32 serialPortBaud;
     QString virtualSerialPort;
+    QList<virtualPortConfig> virtualPorts;
+    quint8 arbiterCivAddr;
     unsigned char localAFgain;
     audioType audioSystem;
 
@@ -54,8 +59,10 @@ struct preferences {
     bool enableLAN;
     bool enableRigCtlD;
     quint16 rigCtlPort;
+    bool rigCtlSharedState;
     int currentColorPresetNumber = 0;
     quint16 tcpPort;
+    quint16 metricsPort;          // Local HTTP metrics endpoint, 0 = off
     quint8 waterfallFormat;
 
     // Cluster:
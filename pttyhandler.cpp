@@ -24,6 +24,11 @@ pttyHandler::pttyHandler(QString pty, QObject* parent) : QObject(parent)
 
     portName = pty;
 
+    inFrame.reserve(PTTY_MAX_FRAME);
+    flushTimer = new QTimer(this);
+    flushTimer->setSingleShot(true);
+    connect(flushTimer, SIGNAL(timeout()), this, SLOT(flushOut()));
+
 #ifdef Q_OS_WIN
     // TODO: The following should become arguments and/or functions
     // Add signal/slot everywhere for comm port setup.
@@ -119,156 +124,201 @@ pttyHandler::~pttyHandler()
 
 void pttyHandler::receiveDataFromRigToPtty(const QByteArray& data)
 {
-
-    int fePos=data.lastIndexOf((char)0xfe);
-    if (fePos > 0 && data.length() > fePos+2)
-        fePos=fePos-1;
-    else
+    // The rig side may hand over several frames at once, filter each.
+    int start = 0;
+    while (start < data.size())
     {
-        qDebug(logSerial()) << "Invalid command";
-        printHex(data,false,true);
+        int fd = data.indexOf((char)0xfd, start);
+        if (fd < 0)
+            break;
+        int fePos = start;
+        while (fePos < fd && (unsigned char)data[fePos] == 0xfe)
+            fePos++;
+        // fePos is now the destination address, fePos + 1 the source.
+        if (fePos == start || fd - fePos < 3)
+        {
+            qDebug(logSerial()) << "Invalid command";
+            printHex(data.mid(start, fd - start + 1), false, true);
+            start = fd + 1;
+            continue;
+        }
+        unsigned char to = (unsigned char)data[fePos];
+        unsigned char from = (unsigned char)data[fePos + 1];
+
+        if (disableTransceive && (to == 0x00 || from == 0x00))
+        {
+            // Ignore data that is sent to/from transceive address as client has requested transceive disabled.
+            qDebug(logSerial()) << "Transceive command filtered";
+        }
+        else if ((!scopeWanted || !scopeAllowed) && (unsigned char)data[fePos + 2] == 0x27 && (unsigned char)data[fePos + 3] == 0x00)
+        {
+            // Most CAT programs never ask for scope data and can't keep up with it.
+            scopeDropped++;
+        }
+        else if (isConnected && to != 0xE1 && from != 0xE1)
+        {
+            // send to the pseudo port as well
+            // index 2 is dest, 0xE1 is wfview, 0xE0 is assumed to be the other device.
+            // Changed to "Not 0xE1"
+            // 0xE1 = wfview
+            // 0xE0 = pseudo-term host
+            // 0x00 = broadcast to all
+            //qInfo(logSerial()) << "Sending data from radio to pseudo-terminal";
+            sendDataOut(QByteArray::fromRawData(data.constData() + start, fd - start + 1));
+        }
+        start = fd + 1;
     }
+}
 
-    if (disableTransceive && ((unsigned char)data[fePos + 2] == 0x00 || (unsigned char)data[fePos + 3] == 0x00))
-    {
-        // Ignore data that is sent to/from transceive address as client has requested transceive disabled.
-        qDebug(logSerial()) << "Transceive command filtered";
+void pttyHandler::sendDataOut(const QByteArray& writeData)
+{
+    if (!isConnected)
         return;
-    }
 
-    if (isConnected && (unsigned char)data[fePos + 2] != 0xE1 && (unsigned char)data[fePos + 3] != 0xE1)
+    if (outPortData.size() + writeData.size() > PTTY_MAX_PENDING)
     {
-        // send to the pseudo port as well
-        // index 2 is dest, 0xE1 is wfview, 0xE0 is assumed to be the other device.
-        // Changed to "Not 0xE1"
-        // 0xE1 = wfview
-        // 0xE0 = pseudo-term host
-        // 0x00 = broadcast to all
-        //qInfo(logSerial()) << "Sending data from radio to pseudo-terminal";        
-        sendDataOut(data);
+        qInfo(logSerial()) << "pseudo term not reading, dropping" << outPortData.size() << "bytes";
+        outPortData.clear();
     }
+    outPortData.append(writeData);
+    if (!flushTimer->isActive())
+        flushTimer->start(0);
 }
 
-void pttyHandler::sendDataOut(const QByteArray& writeData)
+void pttyHandler::flushOut()
 {
+    if (!isConnected || outPortData.isEmpty())
+        return;
+
     qint64 bytesWritten = 0;
 
     //qInfo(logSerial()) << "Data to pseudo term:";
-    //printHex(writeData, false, true);
-    if (isConnected) {
-        mutex.lock();
+    //printHex(outPortData, false, true);
+    mutex.lock();
 #ifdef Q_OS_WIN
-        bytesWritten = port->write(writeData);
+    bytesWritten = port->write(outPortData);
 #else
-        bytesWritten = ::write(ptfd, writeData.constData(), writeData.size());
+    bytesWritten = ::write(ptfd, outPortData.constData(), outPortData.size());
+    if (bytesWritten < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        bytesWritten = 0;
 #endif
-        if (bytesWritten != writeData.length()) {
-            qInfo(logSerial()) << "bytesWritten: " << bytesWritten << " length of byte array: " << writeData.length()\
-                << " size of byte array: " << writeData.size()\
-                << " Wrote all bytes? " << (bool)(bytesWritten == (qint64)writeData.size());
-        }
-        mutex.unlock();
+    mutex.unlock();
+
+    if (bytesWritten < 0)
+    {
+        qInfo(logSerial()) << "write to pseudo term failed, dropping" << outPortData.size() << "bytes";
+        outPortData.clear();
+        return;
+    }
+
+    outPortData.remove(0, (int)bytesWritten);
+    if (!outPortData.isEmpty())
+    {
+        // The pty buffer is full, try again shortly rather than spinning.
+        flushTimer->start(PTTY_RETRY_PERIOD);
     }
 }
 
 void pttyHandler::receiveDataIn(int fd) {
 
-#ifndef Q_OS_WIN
-    ssize_t available = 255; // Read up to 'available' bytes
-#else
+#ifdef Q_OS_WIN
     Q_UNUSED(fd);
 #endif
 
-   // Linux will correctly return the number of available bytes with the FIONREAD ioctl
-   // Sadly MacOS always returns zero!
-#ifdef Q_OS_LINUX
-    int ret = ::ioctl(fd, FIONREAD, (char *) &available);
-    if (ret != 0)
-        return;
-#endif
-
+    forever
+    {
 #ifdef Q_OS_WIN
-    port->startTransaction();
-    inPortData = port->readAll();
+        qint64 got = port->read((char*)buffer, sizeof(buffer));
 #else
-    inPortData.resize(available);
-    ssize_t got = ::read(fd, inPortData.data(), available);
-    int err = errno;
-    if (got < 0) {
-        qInfo(logSerial()) << tr("Read failed: %1").arg(QString::fromLatin1(strerror(err)));
-        return;
-    }
-    inPortData.resize(got);
+        ssize_t got = ::read(fd, buffer, sizeof(buffer));
+        if (got < 0) {
+            int err = errno;
+            if (err != EAGAIN && err != EWOULDBLOCK) {
+                qInfo(logSerial()) << tr("Read failed: %1").arg(QString::fromLatin1(strerror(err)));
+            }
+            return;
+        }
 #endif
+        if (got <= 0)
+            return;
 
-    if (inPortData.startsWith("\xFE\xFE"))
-    {
-        if (inPortData.endsWith("\xFD"))
+        // Assemble frames byte by byte, anything outside FE ... FD is dropped.
+        for (qint64 i = 0; i < got; i++)
         {
-            // good!
-#ifdef Q_OS_WIN
-            port->commitTransaction();
-#endif
-
-            int lastFE = inPortData.lastIndexOf((char)0xfe);
-            if (civId == 0 && inPortData.length() > lastFE + 2 && (quint8)inPortData[lastFE + 2] > (quint8)0xdf && (quint8)inPortData[lastFE + 2] < (quint8)0xef) {
-                // This is (should be) the remotes CIV id.
-                civId = (quint8)inPortData[lastFE + 2];
-                qInfo(logSerial()) << "pty detected remote CI-V:" << QString("0x%1").arg(civId,0,16);
-            }
-            else if (civId != 0 && inPortData.length() > lastFE + 2 && (quint8)inPortData[lastFE + 2] != civId)
+            unsigned char c = buffer[i];
+            if (inFrame.isEmpty() && c != 0xfe)
+                continue;
+            inFrame.append((char)c);
+            if (c == 0xfd)
             {
-                civId = (quint8)inPortData[lastFE + 2];
-                qInfo(logSerial()) << "pty remote CI-V changed:" << QString("0x%1").arg((quint8)civId,0,16);
+                processFrame(inFrame);
+                inFrame.truncate(0);
             }
-            // filter C-IV transceive command before forwarding on.
-            if (inPortData.contains(rigCaps.transceiveCommand))
+            else if (inFrame.size() > PTTY_MAX_FRAME)
             {
-                //qInfo(logSerial()) << "Filtered transceive command";
-                //printHex(inPortData, false, true);
-                QByteArray reply= QByteArrayLiteral("\xfe\xfe\x00\x00\xfb\xfd");
-                reply[2] = inPortData[3];
-                reply[3] = inPortData[2];
-                sendDataOut(inPortData); // Echo command back
-                sendDataOut(reply);
-                if (!disableTransceive) {
-                    qInfo(logSerial()) << "pty requested CI-V Transceive disable";
-                    disableTransceive = true;
-                }
-            }
-            else if (inPortData.length() > lastFE + 2 && ((quint8)inPortData[lastFE + 1] == civId || (quint8)inPortData[lastFE + 2] == civId))
-            {
-                emit haveDataFromPort(inPortData);
-                qDebug(logSerial()) << "Data from pseudo term:";
-                printHex(inPortData, false, true);
-            }
-
-            if (rolledBack)
-            {
-                // qInfo(logSerial()) << "Rolled back and was successful. Length: " << inPortData.length();
-                //printHex(inPortData, false, true);
-                rolledBack = false;
+                qInfo(logSerial()) << "pty discarding" << inFrame.size() << "bytes without a frame end";
+                inFrame.truncate(0);
             }
         }
-        else {
-            // did not receive the entire thing so roll back:
-            // qInfo(logSerial()) << "Rolling back transaction. End not detected. Length: " << inPortData.length();
-            //printHex(inPortData, false, true);
-            rolledBack = true;
-#ifdef Q_OS_WIN
-            port->rollbackTransaction();
-        }
+
+        if (got < (qint64)sizeof(buffer))
+            return;
     }
-    else {
-        port->commitTransaction(); // do not emit data, do not keep data.
-        //qInfo(logSerial()) << "Warning: received data with invalid start. Dropping data.";
-        //qInfo(logSerial()) << "THIS SHOULD ONLY HAPPEN ONCE!!";
-        // THIS SHOULD ONLY HAPPEN ONCE!
+}
+
+void pttyHandler::processFrame(const QByteArray& frame)
+{
+    if (!frame.startsWith("\xFE\xFE"))
+        return;
+
+    int lastFE = frame.lastIndexOf((char)0xfe);
+    if (civId == 0 && frame.length() > lastFE + 2 && (quint8)frame[lastFE + 2] > (quint8)0xdf && (quint8)frame[lastFE + 2] < (quint8)0xef) {
+        // This is (should be) the remotes CIV id.
+        civId = (quint8)frame[lastFE + 2];
+        qInfo(logSerial()) << "pty detected remote CI-V:" << QString("0x%1").arg(civId,0,16);
     }
-#else
+    else if (civId != 0 && frame.length() > lastFE + 2 && (quint8)frame[lastFE + 2] != civId)
+    {
+        civId = (quint8)frame[lastFE + 2];
+        qInfo(logSerial()) << "pty remote CI-V changed:" << QString("0x%1").arg((quint8)civId,0,16);
+    }
+
+    // A program that asks for scope output gets it, turning it off stops it again.
+    if (frame.length() > lastFE + 4 && (quint8)frame[lastFE + 3] == 0x27)
+    {
+        bool wanted = scopeWanted;
+        if ((quint8)frame[lastFE + 4] == 0x11 && frame.length() > lastFE + 5)
+            wanted = (quint8)frame[lastFE + 5] != 0x00;
+        else
+            wanted = true;
+        if (wanted != scopeWanted)
+        {
+            qInfo(logSerial()) << "pty scope data" << (wanted ? "enabled" : "disabled") << "dropped so far:" << scopeDropped;
+            scopeWanted = wanted;
         }
     }
-#endif
+
+    // filter C-IV transceive command before forwarding on.
+    if (frame.contains(rigCaps.transceiveCommand))
+    {
+        //qInfo(logSerial()) << "Filtered transceive command";
+        //printHex(frame, false, true);
+        QByteArray reply= QByteArrayLiteral("\xfe\xfe\x00\x00\xfb\xfd");
+        reply[2] = frame[3];
+        reply[3] = frame[2];
+        sendDataOut(frame); // Echo command back
+        sendDataOut(reply);
+        if (!disableTransceive) {
+            qInfo(logSerial()) << "pty requested CI-V Transceive disable";
+            disableTransceive = true;
+        }
+    }
+    else if (frame.length() > lastFE + 2 && ((quint8)frame[lastFE + 1] == civId || (quint8)frame[lastFE + 2] == civId))
+    {
+        emit haveDataFromPort(frame);
+        qDebug(logSerial()) << "Data from pseudo term:";
+        printHex(frame, false, true);
+    }
 }
 
 
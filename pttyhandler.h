@@ -7,6 +7,7 @@
 #include <QDataStream>
 #include <QIODevice>
 #include <QSocketNotifier>
+#include <QTimer>
 #include <QtSerialPort/QSerialPort>
 
 #include "rigidentities.h"
@@ -15,6 +16,10 @@
 // This class abstracts the comm port in a useful way and connects to
 // the command creator and command parser.
 
+#define PTTY_MAX_FRAME 1024        // Input discarded if no FD is seen within this many bytes
+#define PTTY_MAX_PENDING 65536     // Output dropped if the program stops reading the port
+#define PTTY_RETRY_PERIOD 5        // ms before retrying a write the pty didn't accept
+
 class pttyHandler : public QObject
 {
     Q_OBJECT
@@ -26,11 +31,17 @@ public:
 
     ~pttyHandler();
 
+    void setScopeAllowed(bool allowed) { scopeAllowed = allowed; }
+    quint8 remoteCivId() const { return civId; }
+
+public slots:
+    void receiveDataFromRigToPtty(const QByteArray& data);
+    void receiveFoundRigID(rigCapabilities rigCaps);
+
 private slots:
     void receiveDataIn(int fd); // from physical port
-    void receiveDataFromRigToPtty(const QByteArray& data);
     void debugThis();
-    void receiveFoundRigID(rigCapabilities rigCaps);
+    void flushOut();
 
 signals:
     void haveTextMessage(QString message); // status, debug only
@@ -43,7 +54,8 @@ private:
     void openPort();
     void closePort();
 
-    void sendDataOut(const QByteArray& writeData); // out to radio
+    void sendDataOut(const QByteArray& writeData); // queued for the pseudo term
+    void processFrame(const QByteArray& frame);
     void debugMe();
     void hexPrint();
 
@@ -54,13 +66,25 @@ private:
     //QDataStream outStream;
     //QDataStream inStream;
 
+    // Reads land in this fixed buffer and are assembled into inFrame, which
+    // keeps its capacity between frames.
     unsigned char buffer[256];
+    QByteArray inFrame;
+
+    // Output for the pseudo term is collected and written once per event
+    // loop pass, whatever the pty doesn't take is kept for the next try.
+    QTimer* flushTimer = Q_NULLPTR;
+
+    // Scope (27 00) frames are only forwarded once the program on the port
+    // has asked for scope output itself.
+    bool scopeWanted = false;
+    bool scopeAllowed = true;
+    quint64 scopeDropped = 0;
 
     QString portName;
     QSerialPort* port = Q_NULLPTR;
     qint32 baudRate;
     unsigned char stopBits;
-    bool rolledBack;
 
     int ptfd; // pseudo-terminal file desc.
     int ptKeepAlive=0; // Used to keep the pty alive after client disconnects.
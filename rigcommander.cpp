@@ -4,6 +4,8 @@
 #include "rigidentities.h"
 #include "logcategories.h"
 #include "printhex.h"
+#include "tracerecorder.h"
+#include "metrics.h"
 
 // Copyright 2017-2020 Elliott H. Liggett
 
@@ -61,7 +63,7 @@ void rigCommander::commSetup(unsigned char rigCivAddr, QString rigSerialPort, qu
     rigCaps.baudRate = rigBaudRate;
 
     comm = new commHandler(rigSerialPort, rigBaudRate,wf,this);
-    ptty = new pttyHandler(vsp,this);
+    makeArbiter(vsp);
 
     if (tcpPort > 0) {
         tcp = new tcpServer(this);
@@ -72,8 +74,8 @@ void rigCommander::commSetup(unsigned char rigCivAddr, QString rigSerialPort, qu
     // data from the comm port to the program:
     connect(comm, SIGNAL(haveDataFromPort(QByteArray)), this, SLOT(handleNewData(QByteArray)));
 
-    // data from the ptty to the rig:
-    connect(ptty, SIGNAL(haveDataFromPort(QByteArray)), comm, SLOT(receiveDataFromUserToRig(QByteArray)));
+    // data from the virtual ports to the rig:
+    connect(arbiter, SIGNAL(haveDataForRig(QByteArray)), comm, SLOT(receiveDataFromUserToRig(QByteArray)));
 
     // data from the program to the comm port:
     connect(this, SIGNAL(dataForComm(QByteArray)), comm, SLOT(receiveDataFromUserToRig(QByteArray)));
@@ -84,16 +86,16 @@ void rigCommander::commSetup(unsigned char rigCivAddr, QString rigSerialPort, qu
     }
     connect(this, SIGNAL(toggleRTS(bool)), comm, SLOT(setRTS(bool)));
 
-    // data from the rig to the ptty:
-    connect(comm, SIGNAL(haveDataFromPort(QByteArray)), ptty, SLOT(receiveDataFromRigToPtty(QByteArray)));
+    // data from the rig to the virtual ports:
+    connect(comm, SIGNAL(haveDataFromPort(QByteArray)), arbiter, SLOT(receiveDataFromRig(QByteArray)));
 
     connect(comm, SIGNAL(havePortError(errorType)), this, SLOT(handlePortError(errorType)));
-    connect(ptty, SIGNAL(havePortError(errorType)), this, SLOT(handlePortError(errorType)));
+    connect(arbiter, SIGNAL(havePortError(errorType)), this, SLOT(handlePortError(errorType)));
 
     connect(this, SIGNAL(getMoreDebug()), comm, SLOT(debugThis()));
-    connect(this, SIGNAL(getMoreDebug()), ptty, SLOT(debugThis()));
+    connect(this, SIGNAL(getMoreDebug()), arbiter, SLOT(debugThis()));
 
-    connect(this, SIGNAL(discoveredRigID(rigCapabilities)), ptty, SLOT(receiveFoundRigID(rigCapabilities)));
+    connect(this, SIGNAL(discoveredRigID(rigCapabilities)), arbiter, SLOT(receiveFoundRigID(rigCapabilities)));
 
     emit commReady();
     sendState(); // Send current rig state to rigctld
@@ -133,7 +135,7 @@ void rigCommander::commSetup(unsigned char rigCivAddr, udpPreferences prefs, aud
         //this->rigSerialPort = rigSerialPort;
         //this->rigBaudRate = rigBaudRate;
 
-        ptty = new pttyHandler(vsp,this);
+        makeArbiter(vsp);
 
         if (tcpPort > 0) {
             tcp = new tcpServer(this);
@@ -142,8 +144,8 @@ void rigCommander::commSetup(unsigned char rigCivAddr, udpPreferences prefs, aud
         // Data from UDP to the program
         connect(udp, SIGNAL(haveDataFromPort(QByteArray)), this, SLOT(handleNewData(QByteArray)));
 
-        // data from the rig to the ptty:
-        connect(udp, SIGNAL(haveDataFromPort(QByteArray)), ptty, SLOT(receiveDataFromRigToPtty(QByteArray)));
+        // data from the rig to the virtual ports:
+        connect(udp, SIGNAL(haveDataFromPort(QByteArray)), arbiter, SLOT(receiveDataFromRig(QByteArray)));
 
         // Audio from UDP
         connect(udp, SIGNAL(haveAudioData(audioPacket)), this, SLOT(receiveAudioData(audioPacket)));
@@ -151,8 +153,8 @@ void rigCommander::commSetup(unsigned char rigCivAddr, udpPreferences prefs, aud
         // data from the program to the rig:
         connect(this, SIGNAL(dataForComm(QByteArray)), udp, SLOT(receiveDataFromUserToRig(QByteArray)));
 
-        // data from the ptty to the rig:
-        connect(ptty, SIGNAL(haveDataFromPort(QByteArray)), udp, SLOT(receiveDataFromUserToRig(QByteArray)));
+        // data from the virtual ports to the rig:
+        connect(arbiter, SIGNAL(haveDataForRig(QByteArray)), udp, SLOT(receiveDataFromUserToRig(QByteArray)));
 
         if (tcpPort > 0) {
             // data from the tcp port to the rig:
@@ -170,10 +172,10 @@ void rigCommander::commSetup(unsigned char rigCivAddr, udpPreferences prefs, aud
         connect(udp, SIGNAL(haveNetworkAudioLevels(networkAudioLevels)), this, SLOT(handleNetworkAudioLevels(networkAudioLevels)));
 
 
-        connect(ptty, SIGNAL(havePortError(errorType)), this, SLOT(handlePortError(errorType)));
-        connect(this, SIGNAL(getMoreDebug()), ptty, SLOT(debugThis()));
+        connect(arbiter, SIGNAL(havePortError(errorType)), this, SLOT(handlePortError(errorType)));
+        connect(this, SIGNAL(getMoreDebug()), arbiter, SLOT(debugThis()));
 
-        connect(this, SIGNAL(discoveredRigID(rigCapabilities)), ptty, SLOT(receiveFoundRigID(rigCapabilities)));
+        connect(this, SIGNAL(discoveredRigID(rigCapabilities)), arbiter, SLOT(receiveFoundRigID(rigCapabilities)));
 
         connect(udp, SIGNAL(requestRadioSelection(QList<radio_cap_packet>)), this, SLOT(radioSelection(QList<radio_cap_packet>)));
         connect(udp, SIGNAL(setRadioUsage(quint8, quint8, QString, QString)), this, SLOT(radioUsage(quint8, quint8, QString, QString)));
@@ -205,10 +207,34 @@ void rigCommander::closeComm()
     }
     udp = Q_NULLPTR;
 
-    if (ptty != Q_NULLPTR) {
-        delete ptty;
+    if (arbiter != Q_NULLPTR) {
+        delete arbiter;
+    }
+    arbiter = Q_NULLPTR;
+}
+
+void rigCommander::setVirtualPorts(QList<virtualPortConfig> ports, quint8 civAddr)
+{
+    // Takes effect on the next commSetup()
+    virtualPorts = ports;
+    arbiterCivAddr = civAddr;
+}
+
+void rigCommander::makeArbiter(QString vsp)
+{
+    arbiter = new civArbiter(civAddr, arbiterCivAddr, &state, this);
+
+    // The main port keeps its old behaviour, scope data included.
+    virtualPortConfig main;
+    main.name = vsp;
+    main.scope = true;
+    main.priority = 1;
+    arbiter->addPort(main);
+
+    for (const virtualPortConfig& p : virtualPorts)
+    {
+        arbiter->addPort(p);
     }
-    ptty = Q_NULLPTR;
 }
 
 void rigCommander::setup()
@@ -314,6 +340,25 @@ void rigCommander::prepDataAndSend(QByteArray data)
         printHexNow(data, logRigTraffic());
     }
 
+    traceRecorder::record(traceCivToRig, data.constData(), data.size());
+
+    static metricCounter* sent = metrics::counter("wfview_civ_commands_total", "CI-V commands sent to the rig");
+    sent->add();
+    if (!civClock.isValid())
+        civClock.start();
+    if (data.size() > 5)
+    {
+        civLastIssued = civClock.nsecsElapsed() / 1000 + 1;
+        civIssued[(unsigned char)data[4]] = civLastIssued;
+
+        sentCommand c;
+        c.command = (unsigned char)data[4];
+        c.sent = civLastIssued;
+        sentCommands.append(c);
+        if (sentCommands.size() > SENT_COMMANDS_MAX)
+            sentCommands.removeFirst();
+    }
+
     emit dataForComm(data);
 }
 
@@ -1498,6 +1543,8 @@ void rigCommander::setCIVAddr(unsigned char civAddr)
     // the computer's CIV address is defined in the header file.
 
     this->civAddr = civAddr;
+    if (arbiter != Q_NULLPTR)
+        arbiter->setRigCivAddr(civAddr);
     payloadPrefix = QByteArray("\xFE\xFE");
     payloadPrefix.append(civAddr);
     payloadPrefix.append((char)compCivAddr);
@@ -1536,6 +1583,7 @@ void rigCommander::parseData(QByteArray dataInput)
     {
         data = dataList[index];
         data.append('\xFD'); // because we expect it to be there.
+        traceRecorder::record(traceCivFromRig, data.constData(), data.size());
     // foreach(listitem)
     // listitem.append('\xFD');
     // continue parsing...
@@ -1625,6 +1673,8 @@ void rigCommander::parseData(QByteArray dataInput)
                     //printHex(payloadIn);
                     break;
                 }
+                if (payloadIn.size() > 1 && !payloadIn.startsWith(QByteArray("\x27\x00", 2)))
+                    matchReply((unsigned char)payloadIn[0]); // Scope data is sent without being asked for
                 parseCommand();
                 break;
             case '\x00':
@@ -1662,6 +1712,29 @@ void rigCommander::parseData(QByteArray dataInput)
     */
 }
 
+void rigCommander::noteCivReply(unsigned char command)
+{
+    static latencyHistogram* latency = metrics::histogram("wfview_civ_reply_seconds", "Time from sending a CI-V command to the rig replying");
+    static metricCounter* replies = metrics::counter("wfview_civ_replies_total", "CI-V replies matched to a command");
+
+    qint64 issued;
+    if (command == 0xFB || command == 0xFA)
+    {
+        issued = civLastIssued;
+        civLastIssued = 0;
+    }
+    else
+    {
+        issued = civIssued[command];
+        civIssued[command] = 0;
+    }
+    if (issued == 0 || !civClock.isValid())
+        return; // Transceive data or a reply we already counted.
+
+    latency->record(civClock.nsecsElapsed() / 1000 + 1 - issued);
+    replies->add();
+}
+
 void rigCommander::parseCommand()
 {
     // note: data already is trimmed of the beginning FE FE E0 94 stuff.
@@ -1676,6 +1749,9 @@ void rigCommander::parseCommand()
         printHexNow(payloadIn, logRigTraffic());
     }
 
+    if (!payloadIn.isEmpty())
+        noteCivReply((unsigned char)payloadIn[0]);
+
     switch(payloadIn[00])
     {
 
@@ -1797,6 +1873,8 @@ void rigCommander::parseCommand()
     }
     // is any payload left?
 
+    if (!pendingSync.isEmpty())
+        checkSync();
 }
 
 void rigCommander::parseLevels()
@@ -4590,7 +4668,7 @@ void rigCommander::parseSpectrum()
             payloadIn.chop(1);
             //spectrumLine.append(payloadIn.mid(17,475)); // write over the FD, last one doesn't, oh well.
             spectrumLine.append(payloadIn.right(payloadIn.length()-17)); // write over the FD, last one doesn't, oh well.
-            emit haveSpectrumData(spectrumLine, spectrumStartFreq, spectrumEndFreq);
+            emit haveSpectrumData(spectrumLine, spectrumStartFreq, spectrumEndFreq, metrics::now());
         }
     } else if ((sequence > 1) && (sequence < rigCaps.spectSeqMax))
     {
@@ -4605,7 +4683,7 @@ void rigCommander::parseSpectrum()
         payloadIn.chop(1);
         spectrumLine.insert(spectrumLine.length(), payloadIn.right(payloadIn.length() - 5));
         //qInfo(logRig()) << "sequence: " << sequence << " spec index: " << (sequence-2)*55 << " payloadPosition: " << payloadIn.length() - 5 << " payload length: " << payloadIn.length();
-        emit haveSpectrumData(spectrumLine, spectrumStartFreq, spectrumEndFreq);
+        emit haveSpectrumData(spectrumLine, spectrumStartFreq, spectrumEndFreq, metrics::now());
     }
 }
 
@@ -5257,420 +5335,721 @@ void rigCommander::setCurrentRadio(quint8 radio) {
 
 void rigCommander::stateUpdated()
 {
-    // A remote process has updated the rigState
-    // First we need to find which item(s) have been updated and send the command(s) to the rig.
+    // A remote process has updated the rigState.
+    // Each changed item is sent to the rig once. Changes that arrive close
+    // together are coalesced so only the latest value goes out, the rig's
+    // acknowledgement (or its own report of the value) confirms it and we
+    // only resend on timeout.
+    state.applyQueued();
+
+    if (syncTimer == Q_NULLPTR)
+    {
+        syncTimer = new QTimer(this);
+        syncTimer->setSingleShot(true);
+        connect(syncTimer, SIGNAL(timeout()), this, SLOT(processSync()));
+    }
 
+    bool toSend = false;
     QMap<stateTypes, value>::iterator i = state.map.begin();
     while (i != state.map.end()) {
-        if (!i.value()._valid || i.value()._updated)
+        if (!i.value()._valid)
+        {
+            // Set value to valid as we have requested it (even if we haven't had a response)
+            i.value()._valid = true;
+            syncStateItem(i.key(), true);
+        }
+        else if (i.value()._updated)
         {
             i.value()._updated = false;
-            i.value()._valid = true; // Set value to valid as we have requested it (even if we haven't had a response)
             qDebug(logRigCtlD()) << "Got new value:" << i.key() << "=" << i.value()._value;
-            switch (i.key()) {
-            case VFOAFREQ:
-                if (i.value()._valid) {
-                    freqt freq;
-                    freq.Hz = state.getInt64(VFOAFREQ);
-                    setFrequency(0, freq);
-                    setFrequency(0, freq);
-                    setFrequency(0, freq);
-                }
-                getFrequency();
-                break;
-            case VFOBFREQ:
-                if (i.value()._valid) {
-                    freqt freq;
-                    freq.Hz = state.getInt64(VFOBFREQ);
-                    setFrequency(1, freq);
-                    setFrequency(1, freq);
-                    setFrequency(1, freq);
-                }
-                getFrequency();
-                break;
-            case CURRENTVFO:
-                // Work on VFOB - how do we do this?
-                break;
-            case PTT:
-                if (i.value()._valid) {
-                    setPTT(state.getBool(PTT));
-                    setPTT(state.getBool(PTT));
-                    setPTT(state.getBool(PTT));
-                }
-                getPTT();
-                break;
-            case MODE:
-            case FILTER:
-                if (state.isValid(MODE) && state.isValid(FILTER)) {
-                    setMode(state.getChar(MODE), state.getChar(FILTER));
-                }
-                getMode();
-                break;
-            case PASSBAND:
-                if (i.value()._valid && state.isValid(MODE)) {
-                    setPassband(state.getUInt16(PASSBAND));
-                }
-                getPassband();
-                break;
-            case DUPLEX:
-                if (i.value()._valid) {
-                    setDuplexMode(state.getDuplex(DUPLEX));
-                }
-                getDuplexMode();
-                break;
-            case DATAMODE:
-                if (i.value()._valid) {
-                    setDataMode(state.getBool(DATAMODE), state.getChar(FILTER));
-                }
-                getDataMode();
-                break;
-            case ANTENNA:
-            case RXANTENNA:
-                if (i.value()._valid) {
-                    setAntenna(state.getChar(ANTENNA), state.getBool(RXANTENNA));
-                }
-                getAntenna();
-                break;
-            case ANTENNATYPE:
-                if(i.value()._valid) {
-                    setAntennaType(state.getChar(ANTENNATYPE));
-                }
-                getAntennaType();
-                break;
-            case CTCSS:
-                if (i.value()._valid) {
-                    setTone(state.getChar(CTCSS));
-                }
-                getTone();
-                break;
-            case TSQL:
-                if (i.value()._valid) {
-                    setTSQL(state.getChar(TSQL));
-                }
-                getTSQL();
-                break;
-            case DTCS:
-                if (i.value()._valid) {
-                    setDTCS(state.getChar(DTCS), false, false); // Not sure about this?
-                }
-                getDTCS();
-                break;
-            case CSQL:
-                if (i.value()._valid) {
-                    setTone(state.getChar(CSQL));
-                }
-                getTone();
-                break;
-            case PREAMP:
-                if (i.value()._valid) {
-                    setPreamp(state.getChar(PREAMP));
-                }
-                getPreamp();
-                break;
-            case ATTENUATOR:
-                if (i.value()._valid) {
-                    setAttenuator(state.getChar(ATTENUATOR));
-                }
-                getAttenuator();
-                break;
-            case AFGAIN:
-                if (i.value()._valid) {
-                    setAfGain(state.getChar(AFGAIN));
-                }
-                getAfGain();
-                break;
-            case RFGAIN:
-                if (i.value()._valid) {
-                    setRfGain(state.getChar(RFGAIN));
-                }
-                getRfGain();
-                break;
-            case SQUELCH:
-                if (i.value()._valid) {
-                    setSquelch(state.getChar(SQUELCH));
-                }
-                getSql();
-                break;
-            case RFPOWER:
-                if (i.value()._valid) {
-                    setTxPower(state.getChar(RFPOWER));
-                }
-                getTxLevel();
-                break;
-            case MICGAIN:
-                if (i.value()._valid) {
-                    setMicGain(state.getChar(MICGAIN));
-                }
-                getMicGain();
-                break;
-            case COMPLEVEL:
-                if (i.value()._valid) {
-                    setCompLevel(state.getChar(COMPLEVEL));
-                }
-                getCompLevel();
-                break;
-            case MONITORLEVEL:
-                if (i.value()._valid) {
-                    setMonitorGain(state.getChar(MONITORLEVEL));
-                }
-                getMonitorGain();
-                break;
-            case VOXGAIN:
-                if (i.value()._valid) {
-                    setVoxGain(state.getChar(VOXGAIN));
-                }
-                getVoxGain();
-                break;
-            case ANTIVOXGAIN:
-                if (i.value()._valid) {
-                    setAntiVoxGain(state.getChar(ANTIVOXGAIN));
-                }
-                getAntiVoxGain();
-                break;
-            case NBFUNC:
-                if (i.value()._valid) {
-                    setNB(state.getBool(NBFUNC));
-                }
-                getNB();
-                break;
-            case NRFUNC:
-                if (i.value()._valid) {
-                    setNR(state.getBool(NRFUNC));
-                }
-                getNR();
-                break;
-            case ANFFUNC:
-                if (i.value()._valid) {
-                    setAutoNotch(state.getBool(ANFFUNC));
-                }
-                getAutoNotch();
-                break;
-            case TONEFUNC:
-                if (i.value()._valid) {
-                    setToneEnabled(state.getBool(TONEFUNC));
-                }
-                getToneEnabled();
-                break;
-            case TSQLFUNC:
-                if (i.value()._valid) {
-                    setToneSql(state.getBool(TSQLFUNC));
-                }
-                getToneSqlEnabled();
-                break;
-            case COMPFUNC:
-                if (i.value()._valid) {
-                    setCompressor(state.getBool(COMPFUNC));
-                }
-                getCompressor();
-                break;
-            case MONFUNC:
-                if (i.value()._valid) {
-                    setMonitor(state.getBool(MONFUNC));
-                }
-                getMonitor();
-                break;
-            case VOXFUNC:
-                if (i.value()._valid) {
-                    setVox(state.getBool(VOXFUNC));
-                }
-                getVox();
-                break;
-            case SBKINFUNC:
-                if (i.value()._valid) {
-                    setBreakIn(state.getBool(VOXFUNC));
-                }
-                getVox();
-                break;
-            case FBKINFUNC:
-                if (i.value()._valid) {
-                    setBreakIn(state.getBool(VOXFUNC) << 1);
-                }
-                getBreakIn();
-                break;
-            case MNFUNC:
-                if (i.value()._valid) {
-                    setManualNotch(state.getBool(MNFUNC));
-                }
-                getManualNotch();
-                break;
-            case SCOPEFUNC:
-                if (i.value()._valid) {
-                    if (state.getBool(SCOPEFUNC)) {
-                        enableSpectOutput();
-                    }
-                    else {
-                        disableSpectOutput();
-                    }
-                }
-                break;
-            case RIGINPUT:
-                if (i.value()._valid) {
-                    setModInput(state.getInput(RIGINPUT), state.getBool(DATAMODE));
-                }
-                getModInput(state.getBool(DATAMODE));
-                break;
-            case POWERONOFF:
-                if (i.value()._valid) {
-                    if (state.getBool(POWERONOFF)) {
-                        powerOn();
-                    }
-                    else {
-                        powerOff();
-                    }
-                }
-                break;
-            case RITVALUE:
-                if (i.value()._valid) {
-                    setRitValue(state.getInt32(RITVALUE));
-                }
-                getRitValue();
-                break;
-             case RITFUNC:
-                 if (i.value()._valid) {
-                     setRitEnable(state.getBool(RITFUNC));
-                 }
-                 getRitEnabled();
-                 break;
-                 // All meters can only be updated from the rig end.
-             case SMETER:
-             case SWRMETER:
-             case POWERMETER:
-             case ALCMETER:
-             case COMPMETER:
-             case VOLTAGEMETER:
-             case CURRENTMETER:
-                 break;
-             case AGC:
-                 break;
-             case MODINPUT:
-                 break;
-             case FAGCFUNC:
-                 break;
-             case AIPFUNC:
-                 break;
-             case APFFUNC:
-                 break;
-             case RFFUNC: // Should this set RF output power to 0?
-                 break;
-             case AROFUNC:
-                 break;
-             case MUTEFUNC:
-                 if (i.value()._valid) {
-                     setAfMute(state.getBool(MUTEFUNC));
-                 }
-                 getAfMute();
-                 break;
-             case VSCFUNC:
-                 break;
-             case REVFUNC:
-                 break;
-             case SQLFUNC:
-                 break;
-             case ABMFUNC:
-                 break;
-             case BCFUNC:
-                 break;
-             case MBCFUNC:
-                 break;
-             case AFCFUNC:
-                 break;
-             case SATMODEFUNC:
-                 break;
-             case NBDEPTH:
-                 break;
-             case NBWIDTH:
-                 break;
-             case NB:
-                 break;
-             case NR: {
-                 if (i.value()._valid) {
-                     QByteArray payload("\x14\x06");
-                     payload.append(bcdEncodeInt(state.getChar(NR)));
-                     prepDataAndSend(payload);
-                 }
-                 break;
-             }
-             case PBTIN: {
-                 if (i.value()._valid) {
-                     QByteArray payload("\x14\x07");
-                     payload.append(bcdEncodeInt(state.getChar(PBTIN)));
-                     prepDataAndSend(payload);
-                 }
-                 break;
-             }
-             case PBTOUT: {
-                 if (i.value()._valid) {
-                     QByteArray payload("\x14\x08");
-                     payload.append(bcdEncodeInt(state.getChar(PBTOUT)));
-                     prepDataAndSend(payload);
-                 }
-                 break;
-             }
-             case CWPITCH: {
-                 if (i.value()._valid) {
-                     QByteArray payload("\x14\x09");
-                     payload.append(bcdEncodeInt(state.getChar(CWPITCH)));
-                     prepDataAndSend(payload);
-                 }
-                 break;
-             }
-             case KEYSPD: {
-                 if (i.value()._valid) {
-                     QByteArray payload("\x14\x0c");
-                     payload.append(bcdEncodeInt(state.getChar(KEYSPD)));
-                     prepDataAndSend(payload);
-                 }
-                 break;
-             }
-             case NOTCHF: {
-                 if (i.value()._valid) {
-                     QByteArray payload("\x14\x0d");
-                     payload.append(bcdEncodeInt(state.getChar(NOTCHF)));
-                     prepDataAndSend(payload);
-                 }
-                 break;
-             }
-             case IF: {
-                 if (i.value()._valid) {
-                     setIFShift(state.getChar(IF));
-                 }
-                 getIFShift();
-                 break;
-             }
-             case APF:
-                 break;
-             case BAL:
-                 break;
-             case RESUMEFUNC:
-                 break;
-             case TBURSTFUNC:
-                 break;
-             case TUNERFUNC:
-                 if (i.value()._valid) {  
-                     setATU(state.getBool(TUNERFUNC));
-                 }
-                 getATUStatus();
-                 break;
-             case LOCKFUNC:
-                 if (i.value()._valid) {
-                     setDialLock(state.getBool(LOCKFUNC));
-                 }
-                 getDialLock();
-                 break;
-
-            case ANN:
-            case APO:
-            case BACKLIGHT:
-            case BEEP:
-            case TIME:
-            case BAT:
-            case KEYLIGHT:
-                break;
+            // Mode and filter (and both antenna values) go out in one command.
+            stateTypes key = i.key();
+            if (key == FILTER)
+                key = MODE;
+            else if (key == RXANTENNA)
+                key = ANTENNA;
+            stateSync& sync = pendingSync[key];
+            sync.target = state.getInt64(key);
+            sync.attempts = 0;
+            sync.needsSend = true;
+            toSend = true;
+        }
+        ++i;
+    }
+
+    if (toSend && (!syncTimer->isActive() || syncTimer->remainingTime() > STATE_SYNC_COALESCE))
+        syncTimer->start(STATE_SYNC_COALESCE);
+}
+
+void rigCommander::processSync()
+{
+    checkSync();
+
+    bool waiting = false;
+    QMap<stateTypes, stateSync>::iterator i = pendingSync.begin();
+    while (i != pendingSync.end())
+    {
+        stateSync& sync = i.value();
+        if (!sync.needsSend)
+        {
+            if (sync.sent.elapsed() < STATE_SYNC_TIMEOUT)
+            {
+                waiting = true;
+                ++i;
+                continue;
+            }
+            if (sync.attempts >= STATE_SYNC_ATTEMPTS)
+            {
+                qInfo(logRig()) << "No acknowledgement for state" << i.key() << "after" << sync.attempts << "attempts, reading it back";
+                syncStateItem(i.key(), true);
+                i = pendingSync.erase(i);
+                continue;
+            }
+            qDebug(logRig()) << "Timeout waiting for state" << i.key() << "resending";
+        }
 
+        sync.needsSend = false;
+        int first = sentCommands.size();
+        if (syncStateItem(i.key(), false))
+        {
+            sync.attempts++;
+            sync.generation++;
+            sync.sent.start();
+            for (int c = first; c < sentCommands.size(); c++)
+            {
+                sentCommands[c].sync = true;
+                sentCommands[c].key = i.key();
+                sentCommands[c].generation = sync.generation;
             }
+            waiting = true;
+            ++i;
         }
-        ++i;
+        else
+        {
+            // Nothing the rig acknowledges, don't wait for it.
+            i = pendingSync.erase(i);
+        }
+    }
+
+    if (waiting)
+        syncTimer->start(STATE_SYNC_TIMEOUT);
+}
+
+void rigCommander::checkSync()
+{
+    // The rig reporting a value we are waiting for confirms it. If it reports
+    // something else, the rig (or the operator at the front panel) wins.
+    quint64 reported[2];
+    state.takeReported(reported);
+    if (reported[0] == 0 && reported[1] == 0)
+        return;
+
+    QMap<stateTypes, stateSync>::iterator i = pendingSync.begin();
+    while (i != pendingSync.end())
+    {
+        if (!i.value().needsSend && rigstate::isChanged(reported, i.key()))
+        {
+            if (state.getInt64(i.key()) != i.value().target)
+                qDebug(logRig()) << "Rig reported a different value for state" << i.key() << "dropping our change";
+            i = pendingSync.erase(i);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+}
+
+void rigCommander::matchReply(unsigned char command)
+{
+    if (sentCommands.isEmpty())
+        return;
+
+    qint64 now = civClock.nsecsElapsed() / 1000 + 1;
+    bool ack = (command == 0xFB || command == 0xFA);
+
+    // Anything older than the sync timeout was never answered.
+    while (!sentCommands.isEmpty() && now - sentCommands.first().sent > STATE_SYNC_TIMEOUT * 1000)
+        sentCommands.removeFirst();
+
+    int match = -1;
+    for (int c = 0; c < sentCommands.size(); c++)
+    {
+        if (ack || sentCommands[c].command == command)
+        {
+            match = c;
+            break;
+        }
+    }
+    if (match < 0)
+        return;
+
+    // The rig answers in order, so commands before the match lost their reply.
+    for (int c = 0; c < match; c++)
+        sentCommands.removeFirst();
+    sentCommand answered = sentCommands.takeFirst();
+    if (ack && answered.sync)
+        confirmSync(answered, command == 0xFB);
+}
+
+void rigCommander::confirmSync(const sentCommand& c, bool ok)
+{
+    QMap<stateTypes, stateSync>::iterator i = pendingSync.find(c.key);
+    if (i == pendingSync.end() || i.value().needsSend || i.value().generation != c.generation)
+        return;
+
+    if (!ok)
+    {
+        // Leave it pending, the timeout resends it.
+        qInfo(logRig()) << "Rig rejected change to state" << c.key;
+        return;
+    }
+
+    // A change can take more than one command, wait for the last of them.
+    for (int n = 0; n < sentCommands.size(); n++)
+    {
+        if (sentCommands[n].sync && sentCommands[n].key == c.key && sentCommands[n].generation == c.generation)
+            return;
+    }
+    pendingSync.erase(i);
+}
+
+// Sends the set command for one state item, or the matching query when
+// query is true. Returns true if a command went out that the rig will
+// acknowledge with FB/FA.
+bool rigCommander::syncStateItem(stateTypes s, bool query)
+{
+    bool sent = false;
+    switch (s) {
+    case VFOAFREQ:
+        if (!query) {
+            sent = true;
+            freqt freq;
+            freq.Hz = state.getInt64(VFOAFREQ);
+            setFrequency(0, freq);
+        }
+        else {
+            getFrequency();
+        }
+        break;
+    case VFOBFREQ:
+        if (!query) {
+            sent = true;
+            freqt freq;
+            freq.Hz = state.getInt64(VFOBFREQ);
+            setFrequency(1, freq);
+        }
+        else {
+            getFrequency();
+        }
+        break;
+    case CURRENTVFO:
+        // Work on VFOB - how do we do this?
+        break;
+    case PTT:
+        if (!query) {
+            sent = true;
+            setPTT(state.getBool(PTT));
+        }
+        else {
+            getPTT();
+        }
+        break;
+    case MODE:
+    case FILTER:
+        if (!query && state.isValid(MODE) && state.isValid(FILTER)) {
+            sent = true;
+            setMode(state.getChar(MODE), state.getChar(FILTER));
+        }
+        else {
+            getMode();
+        }
+        break;
+    case PASSBAND:
+        if (!query && state.isValid(MODE)) {
+            sent = true;
+            setPassband(state.getUInt16(PASSBAND));
+        }
+        else {
+            getPassband();
+        }
+        break;
+    case DUPLEX:
+        if (!query) {
+            sent = true;
+            setDuplexMode(state.getDuplex(DUPLEX));
+        }
+        else {
+            getDuplexMode();
+        }
+        break;
+    case DATAMODE:
+        if (!query) {
+            sent = true;
+            setDataMode(state.getBool(DATAMODE), state.getChar(FILTER));
+        }
+        else {
+            getDataMode();
+        }
+        break;
+    case ANTENNA:
+    case RXANTENNA:
+        if (!query) {
+            sent = true;
+            setAntenna(state.getChar(ANTENNA), state.getBool(RXANTENNA));
+        }
+        else {
+            getAntenna();
+        }
+        break;
+    case ANTENNATYPE:
+        if (!query) {
+            sent = true;
+            setAntennaType(state.getChar(ANTENNATYPE));
+        }
+        else {
+            getAntennaType();
+        }
+        break;
+    case CTCSS:
+        if (!query) {
+            sent = true;
+            setTone(state.getChar(CTCSS));
+        }
+        else {
+            getTone();
+        }
+        break;
+    case TSQL:
+        if (!query) {
+            sent = true;
+            setTSQL(state.getChar(TSQL));
+        }
+        else {
+            getTSQL();
+        }
+        break;
+    case DTCS:
+        if (!query) {
+            sent = true;
+            setDTCS(state.getChar(DTCS), false, false); // Not sure about this?
+        }
+        else {
+            getDTCS();
+        }
+        break;
+    case CSQL:
+        if (!query) {
+            sent = true;
+            setTone(state.getChar(CSQL));
+        }
+        else {
+            getTone();
+        }
+        break;
+    case PREAMP:
+        if (!query) {
+            sent = true;
+            setPreamp(state.getChar(PREAMP));
+        }
+        else {
+            getPreamp();
+        }
+        break;
+    case ATTENUATOR:
+        if (!query) {
+            sent = true;
+            setAttenuator(state.getChar(ATTENUATOR));
+        }
+        else {
+            getAttenuator();
+        }
+        break;
+    case AFGAIN:
+        if (!query) {
+            sent = true;
+            setAfGain(state.getChar(AFGAIN));
+        }
+        else {
+            getAfGain();
+        }
+        break;
+    case RFGAIN:
+        if (!query) {
+            sent = true;
+            setRfGain(state.getChar(RFGAIN));
+        }
+        else {
+            getRfGain();
+        }
+        break;
+    case SQUELCH:
+        if (!query) {
+            sent = true;
+            setSquelch(state.getChar(SQUELCH));
+        }
+        else {
+            getSql();
+        }
+        break;
+    case RFPOWER:
+        if (!query) {
+            sent = true;
+            setTxPower(state.getChar(RFPOWER));
+        }
+        else {
+            getTxLevel();
+        }
+        break;
+    case MICGAIN:
+        if (!query) {
+            sent = true;
+            setMicGain(state.getChar(MICGAIN));
+        }
+        else {
+            getMicGain();
+        }
+        break;
+    case COMPLEVEL:
+        if (!query) {
+            sent = true;
+            setCompLevel(state.getChar(COMPLEVEL));
+        }
+        else {
+            getCompLevel();
+        }
+        break;
+    case MONITORLEVEL:
+        if (!query) {
+            sent = true;
+            setMonitorGain(state.getChar(MONITORLEVEL));
+        }
+        else {
+            getMonitorGain();
+        }
+        break;
+    case VOXGAIN:
+        if (!query) {
+            sent = true;
+            setVoxGain(state.getChar(VOXGAIN));
+        }
+        else {
+            getVoxGain();
+        }
+        break;
+    case ANTIVOXGAIN:
+        if (!query) {
+            sent = true;
+            setAntiVoxGain(state.getChar(ANTIVOXGAIN));
+        }
+        else {
+            getAntiVoxGain();
+        }
+        break;
+    case NBFUNC:
+        if (!query) {
+            sent = true;
+            setNB(state.getBool(NBFUNC));
+        }
+        else {
+            getNB();
+        }
+        break;
+    case NRFUNC:
+        if (!query) {
+            sent = true;
+            setNR(state.getBool(NRFUNC));
+        }
+        else {
+            getNR();
+        }
+        break;
+    case ANFFUNC:
+        if (!query) {
+            sent = true;
+            setAutoNotch(state.getBool(ANFFUNC));
+        }
+        else {
+            getAutoNotch();
+        }
+        break;
+    case TONEFUNC:
+        if (!query) {
+            sent = true;
+            setToneEnabled(state.getBool(TONEFUNC));
+        }
+        else {
+            getToneEnabled();
+        }
+        break;
+    case TSQLFUNC:
+        if (!query) {
+            sent = true;
+            setToneSql(state.getBool(TSQLFUNC));
+        }
+        else {
+            getToneSqlEnabled();
+        }
+        break;
+    case COMPFUNC:
+        if (!query) {
+            sent = true;
+            setCompressor(state.getBool(COMPFUNC));
+        }
+        else {
+            getCompressor();
+        }
+        break;
+    case MONFUNC:
+        if (!query) {
+            sent = true;
+            setMonitor(state.getBool(MONFUNC));
+        }
+        else {
+            getMonitor();
+        }
+        break;
+    case VOXFUNC:
+        if (!query) {
+            sent = true;
+            setVox(state.getBool(VOXFUNC));
+        }
+        else {
+            getVox();
+        }
+        break;
+    case SBKINFUNC:
+        if (!query) {
+            sent = true;
+            setBreakIn(state.getBool(VOXFUNC));
+        }
+        else {
+            getVox();
+        }
+        break;
+    case FBKINFUNC:
+        if (!query) {
+            sent = true;
+            setBreakIn(state.getBool(VOXFUNC) << 1);
+        }
+        else {
+            getBreakIn();
+        }
+        break;
+    case MNFUNC:
+        if (!query) {
+            sent = true;
+            setManualNotch(state.getBool(MNFUNC));
+        }
+        else {
+            getManualNotch();
+        }
+        break;
+    case SCOPEFUNC:
+        if (!query) {
+            sent = true;
+            if (state.getBool(SCOPEFUNC)) {
+                enableSpectOutput();
+            }
+            else {
+                disableSpectOutput();
+            }
+        }
+        break;
+    case RIGINPUT:
+        if (!query) {
+            sent = true;
+            setModInput(state.getInput(RIGINPUT), state.getBool(DATAMODE));
+        }
+        else {
+            getModInput(state.getBool(DATAMODE));
+        }
+        break;
+    case POWERONOFF:
+        // No acknowledgement to wait for while the rig powers up or down.
+        if (!query) {
+            if (state.getBool(POWERONOFF)) {
+                powerOn();
+            }
+            else {
+                powerOff();
+            }
+        }
+        break;
+    case RITVALUE:
+        if (!query) {
+            sent = true;
+            setRitValue(state.getInt32(RITVALUE));
+        }
+        else {
+            getRitValue();
+        }
+        break;
+    case RITFUNC:
+        if (!query) {
+            sent = true;
+            setRitEnable(state.getBool(RITFUNC));
+        }
+        else {
+            getRitEnabled();
+        }
+        break;
+        // All meters can only be updated from the rig end.
+    case SMETER:
+    case SWRMETER:
+    case POWERMETER:
+    case ALCMETER:
+    case COMPMETER:
+    case VOLTAGEMETER:
+    case CURRENTMETER:
+        break;
+    case AGC:
+        break;
+    case MODINPUT:
+        break;
+    case FAGCFUNC:
+        break;
+    case AIPFUNC:
+        break;
+    case APFFUNC:
+        break;
+    case RFFUNC: // Should this set RF output power to 0?
+        break;
+    case AROFUNC:
+        break;
+    case MUTEFUNC:
+        if (!query) {
+            sent = true;
+            setAfMute(state.getBool(MUTEFUNC));
+        }
+        else {
+            getAfMute();
+        }
+        break;
+    case VSCFUNC:
+        break;
+    case REVFUNC:
+        break;
+    case SQLFUNC:
+        break;
+    case ABMFUNC:
+        break;
+    case BCFUNC:
+        break;
+    case MBCFUNC:
+        break;
+    case AFCFUNC:
+        break;
+    case SATMODEFUNC:
+        break;
+    case NBDEPTH:
+        break;
+    case NBWIDTH:
+        break;
+    case NB:
+        break;
+    case NR: {
+        if (!query) {
+            sent = true;
+            QByteArray payload("\x14\x06");
+            payload.append(bcdEncodeInt(state.getChar(NR)));
+            prepDataAndSend(payload);
+        }
+        break;
+    }
+    case PBTIN: {
+        if (!query) {
+            sent = true;
+            QByteArray payload("\x14\x07");
+            payload.append(bcdEncodeInt(state.getChar(PBTIN)));
+            prepDataAndSend(payload);
+        }
+        break;
+    }
+    case PBTOUT: {
+        if (!query) {
+            sent = true;
+            QByteArray payload("\x14\x08");
+            payload.append(bcdEncodeInt(state.getChar(PBTOUT)));
+            prepDataAndSend(payload);
+        }
+        break;
+    }
+    case CWPITCH: {
+        if (!query) {
+            sent = true;
+            QByteArray payload("\x14\x09");
+            payload.append(bcdEncodeInt(state.getChar(CWPITCH)));
+            prepDataAndSend(payload);
+        }
+        break;
+    }
+    case KEYSPD: {
+        if (!query) {
+            sent = true;
+            QByteArray payload("\x14\x0c");
+            payload.append(bcdEncodeInt(state.getChar(KEYSPD)));
+            prepDataAndSend(payload);
+        }
+        break;
+    }
+    case NOTCHF: {
+        if (!query) {
+            sent = true;
+            QByteArray payload("\x14\x0d");
+            payload.append(bcdEncodeInt(state.getChar(NOTCHF)));
+            prepDataAndSend(payload);
+        }
+        break;
+    }
+    case IF: {
+        if (!query) {
+            sent = true;
+            setIFShift(state.getChar(IF));
+        }
+        else {
+            getIFShift();
+        }
+        break;
+    }
+    case APF:
+        break;
+    case BAL:
+        break;
+    case RESUMEFUNC:
+        break;
+    case TBURSTFUNC:
+        break;
+    case TUNERFUNC:
+        if (!query) {
+            sent = true;
+            setATU(state.getBool(TUNERFUNC));
+        }
+        else {
+            getATUStatus();
+        }
+        break;
+    case LOCKFUNC:
+        if (!query) {
+            sent = true;
+            setDialLock(state.getBool(LOCKFUNC));
+        }
+        else {
+            getDialLock();
+        }
+        break;
+
+    case ANN:
+    case APO:
+    case BACKLIGHT:
+    case BEEP:
+    case TIME:
+    case BAT:
+    case KEYLIGHT:
+        break;
+
     }
+    return sent;
 }
 
 void rigCommander::getDebug()
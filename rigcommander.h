@@ -4,10 +4,13 @@
 #include <QObject>
 #include <QMutexLocker>
 #include <QDebug>
+#include <QTimer>
+#include <QElapsedTimer>
 
 #include "wfviewtypes.h"
 #include "commhandler.h"
 #include "pttyhandler.h"
+#include "civarbiter.h"
 #include "udphandler.h"
 #include "rigidentities.h"
 #include "repeaterattributes.h"
@@ -23,6 +26,11 @@
 // note: using a define because switch case doesn't even work with const unsigned char. Surprised me.
 #define compCivAddr 0xE1
 
+#define STATE_SYNC_COALESCE 25   // ms to collect remote changes before sending
+#define STATE_SYNC_TIMEOUT 500   // ms to wait for the rig to acknowledge
+#define STATE_SYNC_ATTEMPTS 3
+#define SENT_COMMANDS_MAX 64     // Unanswered commands remembered for matching replies
+
 class rigCommander : public QObject
 {
     Q_OBJECT
@@ -40,8 +48,10 @@ public slots:
     void process();
     void commSetup(unsigned char rigCivAddr, QString rigSerialPort, quint32 rigBaudRate, QString vsp, quint16 tcp, quint8 wf);
     void commSetup(unsigned char rigCivAddr, udpPreferences prefs, audioSetup rxSetup, audioSetup txSetup, QString vsp, quint16 tcp);
+    void setVirtualPorts(QList<virtualPortConfig> ports, quint8 arbiterCivAddr);
     void closeComm();
     void stateUpdated();
+    void processSync();
     void setRTSforPTT(bool enabled);
 
     // Power:
@@ -293,7 +303,7 @@ signals:
     void haveBaudRate(quint32 baudrate);
 
     // Spectrum:
-    void haveSpectrumData(QByteArray spectrum, double startFreq, double endFreq); // pass along data to UI
+    void haveSpectrumData(QByteArray spectrum, double startFreq, double endFreq, qint64 stamp); // pass along data to UI, stamp is metrics::now() when parsed
     void haveSpectrumBounds();
     void haveScopeSpan(freqt span, bool isSub);
     void haveSpectrumMode(spectrumMode spectmode);
@@ -438,6 +448,7 @@ private:
     void setModInput(rigInput input, bool dataOn, bool isQuery);
     void sendDataOut();
     void prepDataAndSend(QByteArray data);
+    void makeArbiter(QString vsp);
     void debugMe();
     void printHex(const QByteArray &pdata);
     void printHex(const QByteArray &pdata, bool printVert, bool printHoriz);
@@ -445,12 +456,23 @@ private:
     centerSpanData createScopeCenter(centerSpansType s, QString name);
 
     commHandler* comm = Q_NULLPTR;
-    pttyHandler* ptty = Q_NULLPTR;
+    civArbiter* arbiter = Q_NULLPTR;
+    QList<virtualPortConfig> virtualPorts; // Extra ports besides the main vsp
+    quint8 arbiterCivAddr = ARBITER_CIV_ID;
     tcpServer* tcp = Q_NULLPTR;
     udpHandler* udp=Q_NULLPTR;
     QThread* udpHandlerThread = Q_NULLPTR;
 
     void determineRigCaps();
+    void noteCivReply(unsigned char command);
+
+    // When each command byte was sent and not yet answered (us, 0 = none),
+    // for the command to reply latency metric. FB/FA acks are matched to
+    // the last command sent.
+    QElapsedTimer civClock;
+    qint64 civIssued[256] = {};
+    qint64 civLastIssued = 0;
+
     QByteArray payloadIn;
     QByteArray echoPerfix;
     QByteArray replyPrefix;
@@ -469,6 +491,32 @@ private:
     
     rigstate state;
 
+    // Remote state changes waiting to be acknowledged by the rig
+    struct stateSync {
+        quint64 target = 0;
+        int attempts = 0;
+        quint32 generation = 0;
+        bool needsSend = false;
+        QElapsedTimer sent;
+    };
+    QMap<stateTypes, stateSync> pendingSync;
+    // Commands we sent that the rig hasn't answered yet, oldest first. The rig
+    // answers them in order, with data for a query or FB/FA for a set, so an
+    // FB/FA belongs to the oldest one still waiting.
+    struct sentCommand {
+        unsigned char command = 0;
+        qint64 sent = 0;            // civClock us
+        bool sync = false;          // Sent for pendingSync[key]
+        stateTypes key = VFOAFREQ;
+        quint32 generation = 0;
+    };
+    QList<sentCommand> sentCommands;
+    QTimer* syncTimer = Q_NULLPTR;
+    bool syncStateItem(stateTypes s, bool query);
+    void checkSync();
+    void matchReply(unsigned char command);
+    void confirmSync(const sentCommand& c, bool ok);
+
     bool haveRigCaps;
     model_kind model;
     quint8 spectSeqMax;
@@ -1,5 +1,9 @@
 #include "rigctld.h"
 #include "logcategories.h"
+#include "metrics.h"
+
+#include <algorithm>
+#include <QMutexLocker>
 
 
 static struct
@@ -53,6 +57,14 @@ rigCtlD::rigCtlD(QObject* parent) :
 rigCtlD::~rigCtlD()
 {
     qInfo(logRigCtlD()) << "closing rigctld";
+    emit onStopped();
+    for (QThread* thread : workers)
+    {
+        thread->quit();
+        thread->wait();
+        delete thread;
+    }
+    workers.clear();
 }
 
 
@@ -61,6 +73,40 @@ void rigCtlD::receiveStateInfo(rigstate* state)
 {
     qInfo("Setting rig state");
     rigState = state;
+    if (sharedState != Q_NULLPTR)
+        sharedState->setState(state);
+    if (changeTimer == Q_NULLPTR)
+    {
+        changeTimer = new QTimer(this);
+        connect(changeTimer, SIGNAL(timeout()), this, SLOT(checkStateChanges()));
+        changeTimer->start(RIGCTL_ASYNC_POLL);
+    }
+}
+
+void rigCtlD::checkStateChanges()
+{
+    if (rigState == Q_NULLPTR)
+        return;
+
+    quint64 bits[2];
+    rigState->takeChanges(bits);
+    if (sharedState != Q_NULLPTR)
+        sharedState->process(bits[0] != 0 || bits[1] != 0);
+    if (bits[0] == 0 && bits[1] == 0)
+        return;
+
+    quint32 events = asyncNone;
+    if (rigstate::isChanged(bits, VFOAFREQ) || rigstate::isChanged(bits, VFOBFREQ) || rigstate::isChanged(bits, CURRENTVFO))
+        events |= asyncFreq;
+    if (rigstate::isChanged(bits, MODE) || rigstate::isChanged(bits, DATAMODE) || rigstate::isChanged(bits, PASSBAND))
+        events |= asyncMode;
+    if (rigstate::isChanged(bits, PTT))
+        events |= asyncPtt;
+    if (rigstate::isChanged(bits, SMETER))
+        events |= asyncStrength;
+
+    if (events != asyncNone)
+        emit stateChanged(events);
 }
 
 
@@ -76,15 +122,62 @@ int rigCtlD::startServer(qint16 port)
         qInfo(logRigCtlD()) << "started on port " << port;
     }
 
+    if (workers.isEmpty())
+    {
+        // Sessions run on their own threads so busy clients don't compete
+        // with the UI event loop.
+        int count = qBound(1, QThread::idealThreadCount() - 1, RIGCTL_MAX_WORKERS);
+        for (int i = 0; i < count; i++)
+        {
+            QThread* thread = new QThread(this);
+            thread->setObjectName(QString("rigctld %1").arg(i));
+            thread->start();
+            workers.append(thread);
+        }
+        qInfo(logRigCtlD()) << "using" << count << "session threads";
+    }
+
     return 0;
 }
 
 void rigCtlD::incomingConnection(qintptr socket) {
     rigCtlClient* client = new rigCtlClient(socket, rigCaps, rigState, this);
+    if (!workers.isEmpty())
+    {
+        // Round robin, sessions are long lived and cost about the same.
+        QThread* thread = workers[nextWorker];
+        nextWorker = (nextWorker + 1) % workers.size();
+        client->moveToThread(thread);
+        connect(thread, SIGNAL(finished()), client, SLOT(deleteLater()));
+    }
     connect(this, SIGNAL(onStopped()), client, SLOT(closeSocket()));
+    connect(this, SIGNAL(stateChanged(quint32)), client, SLOT(receiveStateChange(quint32)));
+    connect(this, SIGNAL(sendData(QString)), client, SLOT(sendData(QString)));
+    // The socket has to be created on the session thread.
+    QMetaObject::invokeMethod(client, "start", Qt::QueuedConnection);
 }
 
 
+void rigCtlD::enableSharedState(bool enable)
+{
+    if (enable && sharedState == Q_NULLPTR)
+    {
+        sharedState = new rigStateShm(this);
+        sharedState->setState(rigState);
+        connect(sharedState, SIGNAL(stateUpdated()), this, SIGNAL(stateUpdated()));
+        if (!sharedState->start())
+        {
+            delete sharedState;
+            sharedState = Q_NULLPTR;
+        }
+    }
+    else if (!enable && sharedState != Q_NULLPTR)
+    {
+        delete sharedState;
+        sharedState = Q_NULLPTR;
+    }
+}
+
 void rigCtlD::stopServer()
 {
     qInfo(logRigCtlD()) << "stopping server";
@@ -94,18 +187,211 @@ void rigCtlD::stopServer()
 void rigCtlD::receiveRigCaps(rigCapabilities caps)
 {
     qInfo(logRigCtlD()) << "Got rigcaps for:" << caps.modelName;
+    QMutexLocker locker(&capsMutex);
     this->rigCaps = caps;
+    buildCapsResponses();
+}
+
+// Called from the session threads, the (implicitly shared) copy is taken
+// under the lock.
+QByteArray rigCtlD::dumpStateResponse()
+{
+    QMutexLocker locker(&capsMutex);
+    if (!capsResponsesValid)
+        buildCapsResponses();
+    return dumpState;
+}
+
+QByteArray rigCtlD::dumpStateVfoResponse()
+{
+    QMutexLocker locker(&capsMutex);
+    if (!capsResponsesValid)
+        buildCapsResponses();
+    return dumpStateVfo;
+}
+
+QByteArray rigCtlD::dumpCapsResponse()
+{
+    QMutexLocker locker(&capsMutex);
+    if (!capsResponsesValid)
+        buildCapsResponses();
+    return dumpCaps;
+}
+
+void rigCtlD::buildCapsResponses()
+{
+    // dump_state and dump_caps only depend on the rig capabilities, so build
+    // them once here rather than for every client request.
+    QByteArray* out = &dumpState;
+    auto line = [&out](const QByteArray& l) {
+        if (!l.isEmpty()) {
+            out->append(l);
+            out->append('\n');
+        }
+    };
+
+    dumpState.clear();
+    dumpStateVfo.clear();
+    dumpCaps.clear();
+
+    quint64 modes = getRadioModes();
+    QByteArray hexModes = "0x" + QByteArray::number(modes, 16);
+    QByteArray antennas = "0x" + QByteArray::number(getAntennas(), 16);
+
+    // rigctld protocol version
+    line("1");
+    // Radio model
+    line(QByteArray::number(rigCaps.rigctlModel));
+    // Print something (used to be ITU region)
+    line("0");
+    // Supported RX bands (startf,endf,modes,low_power,high_power,vfo,ant)
+    quint32 lowFreq = 0;
+    quint32 highFreq = 0;
+    for (const bandType &band : rigCaps.bands)
+    {
+        if (lowFreq == 0 || band.lowFreq < lowFreq)
+            lowFreq = band.lowFreq;
+        if (band.highFreq > highFreq)
+            highFreq = band.highFreq;
+    }
+    line(QByteArray::number(lowFreq) + ".000000 " + QByteArray::number(highFreq) + ".000000 "
+        + hexModes + " -1 -1 0x16000000 " + antennas);
+    line("0 0 0 0 0 0 0");
+
+    if (rigCaps.hasTransmit) {
+        // Supported TX bands (startf,endf,modes,low_power,high_power,vfo,ant)
+        for (const bandType &band : rigCaps.bands)
+        {
+            line(QByteArray::number(band.lowFreq) + ".000000 " + QByteArray::number(band.highFreq) + ".000000 "
+                + hexModes + " 2000 100000 0x16000000 " + antennas);
+        }
+    }
+    line("0 0 0 0 0 0 0");
+
+    static const char* steps[] = { "1", "10", "100", "1000", "2500", "5000", "6125", "8333", "10000",
+                                   "12500", "25000", "100000", "250000", "1000000" };
+    for (const char* step : steps)
+    {
+        line(hexModes + " " + step);
+    }
+    line("0 0");
+
+    static const struct { const char* mode; const char* widths[3]; } filters[] = {
+        { "SB", { "3000", "2400", "1800" } },
+        { "AM", { "9000", "6000", "3000" } },
+        { "CW", { "1200", "500", "200" } },
+        { "FM", { "15000", "10000", "7000" } },
+        { "RTTY", { "2400", "500", "250" } },
+        { "PSK", { "1200", "500", "250" } },
+    };
+    for (const auto &f : filters)
+    {
+        modes = getRadioModes(f.mode);
+        if (modes) {
+            QByteArray m = "0x" + QByteArray::number(modes, 16) + " ";
+            for (const char* w : f.widths)
+            {
+                line(m + w);
+            }
+        }
+    }
+    line("0 0");
+    line("9900");
+    line("9900");
+    line("10000");
+    line("0");
+    QByteArray preamps;
+    if (rigCaps.hasPreamp) {
+        for (quint8 pre : rigCaps.preamps)
+        {
+            if (pre == 0)
+                continue;
+            preamps.append(QByteArray::number(pre*10)).append(' ');
+        }
+        if (preamps.endsWith(' '))
+            preamps.chop(1);
+    }
+    else {
+        preamps = "0";
+    }
+    line(preamps);
+
+    QByteArray attens;
+    if (rigCaps.hasAttenuator) {
+        for (quint8 att : rigCaps.attenuators)
+        {
+            if (att == 0)
+                continue;
+            attens.append(QByteArray::number(att,16)).append(' ');
+        }
+        if (attens.endsWith(' '))
+            attens.chop(1);
+    }
+    else {
+        attens = "0";
+    }
+    line(attens);
+
+    for (int i = 0; i < 6; i++)
+    {
+        line("0xffffffffffffffff");
+    }
+
+    // Only sent to clients that have issued chk_vfo
+    out = &dumpStateVfo;
+    line("vfo_ops=0x" + QByteArray::number(255, 16));
+    line("ptt_type=0x" + QByteArray::number(rigCaps.hasTransmit, 16));
+    line("has_set_vfo=0x1");
+    line("has_get_vfo=0x1");
+    line("has_set_freq=0x1");
+    line("has_get_freq=0x1");
+    line("has_set_conf=0x1");
+    line("has_get_conf=0x1");
+    line("has_power2mW=0x1");
+    line("has_mW2power=0x1");
+    line("timeout=0x" + QByteArray::number(1000, 16));
+    line("done");
+
+    out = &dumpCaps;
+    line("Caps dump for model: " + QByteArray::number(rigCaps.modelID));
+    line("Model Name:\t" + rigCaps.modelName.toLatin1());
+    line("Mfg Name:\tIcom");
+    line("Backend version:\t0.1");
+    line("Backend copyright:\t2021");
+    if (rigCaps.hasTransmit) {
+        line("Rig type:\tTransceiver");
+    }
+    else
+    {
+        line("Rig type:\tReceiver");
+    }
+    if (rigCaps.hasPTTCommand) {
+        line("PTT type:\tRig capable");
+    }
+    line("DCD type:\tRig capable");
+    line("Port type:\tNetwork link");
+
+    capsResponsesValid = true;
 }
 
-rigCtlClient::rigCtlClient(int socketId, rigCapabilities caps, rigstate* state, rigCtlD* parent) : QObject(parent)
+// Not parented to the server as the client is moved to a session thread,
+// the thread's finished() signal cleans up any sessions still open.
+rigCtlClient::rigCtlClient(int socketId, rigCapabilities caps, rigstate* state, rigCtlD* parent) : QObject(Q_NULLPTR)
 {
 
     commandBuffer.clear();
     sessionId = socketId;
     rigCaps = caps;
     rigState = state;
-    socket = new QTcpSocket(this);
     this->parent = parent;
+    asyncTimer = new QTimer(this);
+    asyncTimer->setSingleShot(true);
+    connect(asyncTimer, SIGNAL(timeout()), this, SLOT(pushAsync()));
+}
+
+void rigCtlClient::start()
+{
+    socket = new QTcpSocket(this);
     if (!socket->setSocketDescriptor(sessionId))
     {
         qInfo(logRigCtlD()) << " error binding socket: " << sessionId;
@@ -113,1423 +399,1239 @@ rigCtlClient::rigCtlClient(int socketId, rigCapabilities caps, rigstate* state,
     }
     connect(socket, SIGNAL(readyRead()), this, SLOT(socketReadyRead()), Qt::DirectConnection);
     connect(socket, SIGNAL(disconnected()), this, SLOT(socketDisconnected()), Qt::DirectConnection);
-    connect(parent, SIGNAL(sendData(QString)), this, SLOT(sendData(QString)), Qt::DirectConnection);
-    qInfo(logRigCtlD()) << " session connected: " << sessionId;
+    qInfo(logRigCtlD()) << " session connected: " << sessionId << "on" << QThread::currentThread()->objectName();
     emit parent->stateUpdated(); // Get the current state.
 
 }
 
-void rigCtlClient::socketReadyRead()
+void rigCtlClient::setState(stateTypes s, quint64 x, bool updated)
 {
-    QByteArray data = socket->readAll();
-    commandBuffer.append(data);
-    QStringList commandList(commandBuffer.split('\n'));
-    QString sep = "\n";
-    static int num = 0;
+    // Applied later on the rig thread, keep our copy current so a read in
+    // the same batch sees the new value.
+    rigState->queueSet(s, x, updated);
+    snapshot.values[s] = x;
+    snapshot.valid[s] = true;
+    stateDirty = true;
+}
+
+// Command registry. Short names are looked up directly by byte, long names
+// by binary search over a table sorted once on first use.
+const rigCtlCommandDef rigCtlClient::commandTable[] = {
+    { "set_freq",       'F',    2, true,  &rigCtlClient::doSetFreq },
+    { "get_freq",       'f',    1, false, &rigCtlClient::doGetFreq },
+    { "set_mode",       'M',    1, true,  &rigCtlClient::doSetMode },
+    { "get_mode",       'm',    1, false, &rigCtlClient::doGetMode },
+    { "set_vfo",        'V',    2, true,  &rigCtlClient::doSetVfo },
+    { "get_vfo",        'v',    1, false, &rigCtlClient::doGetVfo },
+    { "set_rit",        'J',    2, true,  &rigCtlClient::doSetRit },
+    { "get_rit",        'j',    1, false, &rigCtlClient::doGetRit },
+    { "set_xit",        'Z',    1, true,  &rigCtlClient::doSetXit },
+    { "get_xit",        'z',    1, false, &rigCtlClient::doGetXit },
+    { "set_ptt",        'T',    2, true,  &rigCtlClient::doSetPtt },
+    { "get_ptt",        't',    1, false, &rigCtlClient::doGetPtt },
+    { "get_dcd",        0,      1, false, &rigCtlClient::doGetDcd },
+    { "0x0b",           0,      1, false, &rigCtlClient::doGetDcd },
+    { "set_rptr_shift", 'R',    1, false, &rigCtlClient::doNotImplemented },
+    { "get_rptr_shift", 'r',    1, false, &rigCtlClient::doNotImplemented },
+    { "set_rptr_offs",  'O',    1, false, &rigCtlClient::doNotImplemented },
+    { "get_rptr_offs",  'o',    1, false, &rigCtlClient::doNotImplemented },
+    { "set_ctcss_tone", 'C',    1, false, &rigCtlClient::doNotImplemented },
+    { "get_ctcss_tone", 'c',    1, false, &rigCtlClient::doNotImplemented },
+    { "set_dcs_tone",   'D',    1, false, &rigCtlClient::doNotImplemented },
+    { "get_dcs_tone",   'd',    1, false, &rigCtlClient::doNotImplemented },
+    { "set_ctcss_sql",  0x90,   1, false, &rigCtlClient::doNotImplemented },
+    { "get_ctcss_sql",  0x91,   1, false, &rigCtlClient::doNotImplemented },
+    { "set_dcs_sql",    0x92,   1, false, &rigCtlClient::doNotImplemented },
+    { "get_dcs_sql",    0x93,   1, false, &rigCtlClient::doNotImplemented },
+    { "set_split_freq", 'I',    2, true,  &rigCtlClient::doSetSplitFreq },
+    { "get_split_freq", 'i',    1, false, &rigCtlClient::doGetSplitFreq },
+    { "set_split_mode", 'X',    3, true,  &rigCtlClient::doSetSplitMode },
+    { "get_split_mode", 'x',    1, false, &rigCtlClient::doGetSplitMode },
+    { "set_split_vfo",  'S',    2, true,  &rigCtlClient::doSetSplitVfo },
+    { "get_split_vfo",  's',    1, false, &rigCtlClient::doGetSplitVfo },
+    { "set_ts",         'N',    1, false, &rigCtlClient::doNotImplemented },
+    { "get_ts",         'n',    1, false, &rigCtlClient::doNotImplemented },
+    { "set_func",       'U',    3, true,  &rigCtlClient::doSetFunc },
+    { "get_func",       'u',    2, false, &rigCtlClient::doGetFunc },
+    { "set_level",      'L',    3, true,  &rigCtlClient::doSetLevel },
+    { "get_level",      'l',    2, false, &rigCtlClient::doGetLevel },
+    { "set_parm",       'P',    3, true,  &rigCtlClient::doSetParm },
+    { "get_parm",       'p',    2, false, &rigCtlClient::doGetParm },
+    { "set_bank",       'B',    1, false, &rigCtlClient::doNotImplemented },
+    { "get_bank",       'b',    1, false, &rigCtlClient::doNotImplemented },
+    { "set_mem",        'E',    1, false, &rigCtlClient::doNotImplemented },
+    { "get_mem",        'e',    1, false, &rigCtlClient::doNotImplemented },
+    { "vfo_op",         'G',    1, false, &rigCtlClient::doNotImplemented },
+    { "scan",           'g',    1, false, &rigCtlClient::doNotImplemented },
+    { "set_channel",    'H',    1, false, &rigCtlClient::doNotImplemented },
+    { "set_trn",        'A',    1, false, &rigCtlClient::doNotImplemented },
+    { "get_trn",        'a',    1, false, &rigCtlClient::doNotImplemented },
+    { "set_ant",        'Y',    2, true,  &rigCtlClient::doSetAnt },
+    { "get_ant",        'y',    1, false, &rigCtlClient::doGetAnt },
+    { "reset",          '*',    1, false, &rigCtlClient::doNotImplemented },
+    { "send_morse",     0,      1, false, &rigCtlClient::doNotImplemented },
+    { "set_powerstat",  0x87,   2, true,  &rigCtlClient::doSetPowerstat },
+    { "get_powerstat",  0x88,   1, false, &rigCtlClient::doGetPowerstat },
+    { "send_dtmf",      0x89,   1, false, &rigCtlClient::doNotImplemented },
+    { "recv_dtmf",      0x8a,   1, false, &rigCtlClient::doNotImplemented },
+    { "get_info",       '_',    1, false, &rigCtlClient::doGetInfo },
+    { "get_rig_info",   0xf5,   1, false, &rigCtlClient::doGetRigInfo },
+    { "get_vfo_info",   0xf3,   1, false, &rigCtlClient::doGetVfoInfo },
+    { "dump_state",     0,      1, false, &rigCtlClient::doDumpState },
+    { "fmv",            0,      1, false, &rigCtlClient::doFmv }, // Fake command to resolve parsing error
+    { "dump_caps",      '1',    1, false, &rigCtlClient::doDumpCaps },
+    { "power2mW",       '2',    1, false, &rigCtlClient::doNotImplemented },
+    { "mW2power",       '3',    1, false, &rigCtlClient::doNotImplemented },
+    { "set_clock",      0,      1, false, &rigCtlClient::doNotImplemented },
+    { "get_clock",      0,      1, false, &rigCtlClient::doNotImplemented },
+    { "chk_vfo",        0xf0,   1, false, &rigCtlClient::doChkVfo },
+    { "set_vfo_opt",    0,      1, false, &rigCtlClient::doNotImplemented },
+    { "set_lock_mode",  0xa2,   1, false, &rigCtlClient::doNotImplemented },
+    { "get_lock_mode",  0xa3,   1, false, &rigCtlClient::doGetLockMode },
+    { "send_cmd",       'w',    1, false, &rigCtlClient::doNotImplemented },
+    { "subscribe",      0,      2, false, &rigCtlClient::doSubscribe },
+    { "unsubscribe",    0,      1, false, &rigCtlClient::doUnsubscribe },
+    { Q_NULLPTR,        0,      0, false, Q_NULLPTR },
+};
+
+const rigCtlCommandDef* rigCtlClient::findCommand(const QByteArray& name)
+{
+    struct registry {
+        const rigCtlCommandDef* shortNames[256];
+        std::vector<const rigCtlCommandDef*> longNames;
+        registry() {
+            std::fill(shortNames, shortNames + 256, Q_NULLPTR);
+            for (const rigCtlCommandDef* c = commandTable; c->name != Q_NULLPTR; c++)
+            {
+                // First entry wins if a short name is listed twice.
+                if (c->shortName != 0 && shortNames[c->shortName] == Q_NULLPTR)
+                    shortNames[c->shortName] = c;
+                longNames.push_back(c);
+            }
+            std::sort(longNames.begin(), longNames.end(),
+                [](const rigCtlCommandDef* a, const rigCtlCommandDef* b) { return qstrcmp(a->name, b->name) < 0; });
+        }
+    };
+    static const registry reg;
+
+    if (name.size() == 1)
+        return reg.shortNames[(unsigned char)name.at(0)];
+
+    auto it = std::lower_bound(reg.longNames.begin(), reg.longNames.end(), name,
+        [](const rigCtlCommandDef* c, const QByteArray& n) { return c->name < n; });
+    if (it != reg.longNames.end() && name == (*it)->name)
+        return *it;
+    return Q_NULLPTR;
+}
 
-    for (QString &commands : commandList)
+void rigCtlClient::socketReadyRead()
+{
+    static latencyHistogram* latency = metrics::histogram("wfview_rigctld_response_seconds", "Time from a rigctld request being read to its response being written");
+    QElapsedTimer timer;
+    timer.start();
+
+    commandBuffer.append(socket->readAll());
+    if (rigState != Q_NULLPTR)
+        rigState->snapshot(snapshot);
+
+    // Only complete lines are processed, anything after the last line end is
+    // kept for the next read as the command may be split across TCP segments.
+    const char* data = commandBuffer.constData();
+    const int size = commandBuffer.size();
+    int start = 0;
+    for (int i = 0; i < size; i++)
     {
-        bool longReply = false;
-        char responseCode = 0;
-        QStringList response;
-        bool setCommand = false;
-        //commands.chop(1); // Remove \n 
-        if (commands.endsWith('\r'))
+        if (data[i] != '\n' && data[i] != '\r')
+            continue;
+        if (!processLine(data + start, i - start))
         {
-            commands.chop(1); // Remove \n character
+            commandBuffer.clear();
+            commitState();
+            flushOutput();
+            latency->recordSince(timer);
+            return;
         }
+        start = i + 1;
+    }
+    commandBuffer.remove(0, start);
 
-        if (commands.isEmpty())
-        {
+    if (commandBuffer.size() > RIGCTL_MAX_LINE)
+    {
+        qInfo(logRigCtlD()) << sessionId << "discarding" << commandBuffer.size() << "bytes without a line end";
+        commandBuffer.clear();
+    }
+    commitState();
+    flushOutput();
+    latency->recordSince(timer);
+}
+
+void rigCtlClient::commitState()
+{
+    // One notification per input batch, however many set commands it held.
+    if (stateDirty)
+    {
+        stateDirty = false;
+        emit parent->stateUpdated();
+    }
+}
+
+bool rigCtlClient::processLine(const char* line, int len)
+{
+    // Extended protocol commands can be chained on one line, for example
+    // "+\get_freq +\get_mode". A new command starts at a token beginning
+    // with a backslash, or a response prefix followed by a backslash.
+    int start = 0;
+    for (int i = 1; i < len; i++)
+    {
+        if (line[i - 1] != ' ')
             continue;
+        bool prefixed = (line[i] == '+' || line[i] == ';' || line[i] == '|' || line[i] == ',')
+            && i + 1 < len && line[i + 1] == '\\';
+        if (line[i] == '\\' || prefixed)
+        {
+            if (!processCommand(line + start, i - start))
+                return false;
+            start = i;
         }
+    }
+    return processCommand(line + start, len - start);
+}
+
+bool rigCtlClient::processCommand(const char* line, int len)
+{
+    while (len > 0 && line[len - 1] == ' ')
+    {
+        len--;
+    }
+
+    if (len == 0)
+    {
+        return true;
+    }
+
+    qDebug(logRigCtlD()) << sessionId << "RX:" << QByteArray::fromRawData(line, len);
+
+    // We have a full line so process command.
+
+    if (rigState == Q_NULLPTR)
+    {
+        qInfo(logRigCtlD()) << "no rigState!";
+        return false;
+    }
 
-        qDebug(logRigCtlD()) << sessionId << "RX:" << commands;
+    sep = '\n';
+    longReply = false;
+    int num = 0;
+
+    if (line[num] == ';' || line[num] == '|' || line[num] == ',')
+    {
+        sep = line[num];
+        num++;
+    }
+    else if (line[num] == '+')
+    {
+        longReply = true;
+        num++;
+    }
+    else if (line[num] == '#')
+    {
+        return true;
+    }
+    else if (line[num] == 'q' || line[num] == 'Q')
+    {
+        closeSocket();
+        return false;
+    }
 
-        // We have a full line so process command.
+    if (num < len && line[num] == '\\')
+    {
+        num++;
+    }
 
-        if (rigState == Q_NULLPTR)
+    // Tokenize in place on spaces.
+    rigCtlArgs args;
+    int pos = num;
+    while (pos < len && args.count < RIGCTL_MAX_ARGS)
+    {
+        while (pos < len && line[pos] == ' ')
+            pos++;
+        int tokenStart = pos;
+        while (pos < len && line[pos] != ' ')
+            pos++;
+        if (pos > tokenStart)
         {
-            qInfo(logRigCtlD()) << "no rigState!";
-            return;
+            args.token[args.count++] = QByteArray::fromRawData(line + tokenStart, pos - tokenStart);
         }
+    }
+
+    if (args.count == 0)
+    {
+        return true;
+    }
+
+    const rigCtlCommandDef* cmd = findCommand(args[0]);
+    if (cmd == Q_NULLPTR || args.count < cmd->minArgs)
+    {
+        qInfo(logRigCtlD()) << "Unimplemented command" << QByteArray::fromRawData(line, len);
+        if (sep != '\n')
+            outBuffer.append('\n');
+        return true;
+    }
 
-        if (commands[num] == ';' || commands[num] == '|' || commands[num] == ',')
+    if (longReply && args.count > 1 && args.count < 5)
+    {
+        outBuffer.append(args[0]);
+        outBuffer.append(": ");
+        for (int i = 1; i < args.count; i++)
         {
-            sep = commands[num].toLatin1();
-            num++;
+            if (i > 1)
+                outBuffer.append(' ');
+            outBuffer.append(args[i]);
         }
-        else if (commands[num] == '+')
+        outBuffer.append(sep);
+    }
+
+    int responseCode = (this->*(cmd->handler))(args);
+
+
+    if (cmd->setCommand || responseCode != 0 || longReply) {
+        outBuffer.append("RPRT ");
+        outBuffer.append(QByteArray::number(responseCode));
+        outBuffer.append(sep);
+    }
+
+    if (sep != '\n') {
+        outBuffer.append('\n');
+    }
+    return true;
+}
+
+void rigCtlClient::addReply(const QByteArray& value)
+{
+    if (!value.isEmpty())
+    {
+        outBuffer.append(value);
+        outBuffer.append(sep);
+    }
+}
+
+void rigCtlClient::addReply(const char* label, const QByteArray& value)
+{
+    if (!longReply && value.isEmpty())
+        return;
+    if (longReply)
+        outBuffer.append(label);
+    outBuffer.append(value);
+    outBuffer.append(sep);
+}
+
+void rigCtlClient::addBlock(const QByteArray& block)
+{
+    // Cached blocks are stored newline separated, the common case.
+    if (sep == '\n')
+    {
+        outBuffer.append(block);
+    }
+    else
+    {
+        QByteArray b = block;
+        outBuffer.append(b.replace('\n', sep));
+    }
+}
+
+void rigCtlClient::flushOutput()
+{
+    if (outBuffer.isEmpty())
+        return;
+
+    //qDebug(logRigCtlD()) << sessionId << "TX:" << outBuffer;
+    if (socket != Q_NULLPTR && socket->isValid() && socket->isOpen())
+    {
+        socket->write(outBuffer);
+    }
+    else
+    {
+        qInfo(logRigCtlD()) << "socket not open!";
+    }
+    outBuffer.clear();
+}
+
+int rigCtlClient::doNotImplemented(const rigCtlArgs& args)
+{
+    Q_UNUSED(args);
+    return -11;
+}
+
+int rigCtlClient::doSetFreq(const rigCtlArgs& args)
+{
+    freqt freq;
+    bool ok=false;
+    double newFreq=0.0f;
+    quint8 vfo=0;
+    if (args.count == 2)
+    {
+        newFreq = args[1].toDouble(&ok);
+    }
+    else if (args.count == 3) // Includes VFO
+    {
+        newFreq = args[2].toDouble(&ok);
+        if (args[1] == "VFOB")
         {
-            longReply = true;
-            sep = "\n";
-            num++;
+            vfo = 1;
         }
-        else if (commands[num] == '#')
-        {
-            continue;
+    }
+
+    if (ok) {
+        freq.Hz = static_cast<int>(newFreq);
+        qDebug(logRigCtlD()) << "Set frequency:" << freq.Hz << args[1];
+        if (vfo == 0) {
+            setState(VFOAFREQ, freq.Hz);
         }
-        else if (commands[num].toLower() == 'q')
-        {
-            closeSocket();
-            return;
+        else {
+            setState(VFOBFREQ, freq.Hz);
         }
+    }
+    return 0;
+}
 
-        if (commands[num] == '\\')
-        {
-            num++;
-        }
+int rigCtlClient::doGetFreq(const rigCtlArgs& args)
+{
+    Q_UNUSED(args);
+    if (snapshot.getChar(CURRENTVFO)==0) {
+        addReply("Frequency: ", QByteArray::number(snapshot.getInt64(VFOAFREQ)));
+    }
+    else {
+        addReply("Frequency: ", QByteArray::number(snapshot.getInt64(VFOBFREQ)));
+    }
+    return 0;
+}
 
-        QStringList command = commands.mid(num).split(" ");
+int rigCtlClient::doSetMode(const rigCtlArgs& args)
+{
+    quint8 width = 0;
+    quint16 passband = 0;
+    QByteArray vfo = "VFOA";
+    QByteArray mode = "USB";
+    if (args.count == 2) {
+        mode = args[1];
+    }
+    else if (args.count == 3) {
+        passband = args[2].toInt();
+        mode = args[1];
+    }
+    else if (args.count == 4) {
+        passband = args[3].toInt();
+        mode = args[2];
+        vfo = args[1];
+    }
 
+    qDebug(logRigCtlD()) << "setting mode: VFO:" << vfo << getMode(mode) << mode << "passband" << passband;
 
-        if (command[0] == "F" || command[0] == "set_freq")
-        {
-            setCommand = true;
-            freqt freq;
-            bool ok=false;
-            double newFreq=0.0f;
-            quint8 vfo=0;
-            if (command.length() == 2)
-            {
-                newFreq = command[1].toDouble(&ok);
+    if (!mode.isEmpty())
+    {
+        setState(MODE, getMode(mode));
+        if (mode.startsWith("PKT")) {
+            setState(DATAMODE, true);
+        }
+        else {
+            setState(DATAMODE, false);
+        }
+    }
+
+    if (passband > 0)
+    {
+        switch ((mode_kind)getMode(mode)) {
+
+        case modeAM:
+            if (passband > 6000) {
+                width = 1;
             }
-            else if (command.length() == 3) // Includes VFO
-            {
-                newFreq = command[2].toDouble(&ok);
-                if (command[1] == "VFOB")
-                {
-                    vfo = 1;
-                }
+            else if (passband > 3000 && passband <= 6000) {
+                width = 2;
+            }
+            else if (passband <= 3000) {
+                width = 3;
             }
+            break;
 
-            if (ok) {
-                freq.Hz = static_cast<int>(newFreq);
-                qDebug(logRigCtlD()) << QString("Set frequency: %1 (%2)").arg(freq.Hz).arg(command[1]);
-                if (vfo == 0) {
-                    rigState->set(VFOAFREQ, (quint64)freq.Hz,true);
-                }
-                else {
-                    rigState->set(VFOBFREQ, (quint64)freq.Hz,true);
-                }
+        case modeFM:
+            if (passband > 10000) {
+                width = 1;
             }
-        }
-        else if (command[0] == "f" || command[0] == "get_freq")
-        {
-            QString resp;
-            if (longReply) {
-                resp.append(QString("Frequency: "));
+            else if (passband > 7000 && passband <= 10000) {
+                width = 2;
+            }
+            else if (passband <= 7000) {
+                width = 3;
             }
+            break;
 
-            if (rigState->getChar(CURRENTVFO)==0) {
-                resp.append(QString("%1").arg(rigState->getInt64(VFOAFREQ)));
+        case modeCW:
+        case modeRTTY:
+        case modeCW_R:
+        case modeRTTY_R:
+        case modePSK:
+            if (passband > 500) {
+                width = 1;
+            }
+            else if (passband > 250 && passband <= 500) {
+                width = 2;
             }
-            else {
-                resp.append(QString("%1").arg(rigState->getInt64(VFOBFREQ)));
+            else if (passband <= 250) {
+                width = 3;
             }
+            break;
 
-            response.append(resp);
-        }
-        else if (command[0] == "M" || command[0] == "set_mode")
-        {
-            // Set mode
-            setCommand = true;
-            quint8 width = 0;
-            quint16 passband = 0;
-            QString vfo = "VFOA";
-            QString mode = "USB";
-            if (command.length() == 2) {
-                mode = command[1];
+        default:
+            if (passband > 2400) {
+                width = 1;
             }
-            else if (command.length() == 3) {
-                passband = command[2].toInt();
-                mode = command[1];
+            else if (passband > 1800 && passband <= 2400) {
+                width = 2;
             }
-            else if (command.length() == 4) {
-                passband = command[3].toInt();
-                mode = command[2];
-                vfo = command[1];
+            else if (passband <= 1800) {
+                width = 3;
             }
+            break;
 
-            qDebug(logRigCtlD()) << "setting mode: VFO:" << vfo << getMode(mode) << mode << "passband" << passband << "command:" << commands;
+        }
+        setState(FILTER, width);
+        setState(PASSBAND, passband);
+    }
+    return 0;
+}
 
-            if (!mode.isEmpty())
-            {
-                rigState->set(MODE, getMode(mode), true);
-                if (mode.mid(0, 3) == "PKT") {
-                    rigState->set(DATAMODE, true, true);
-                }
-                else {
-                    rigState->set(DATAMODE, false, true);
-                }
-            }
+int rigCtlClient::doGetMode(const rigCtlArgs& args)
+{
+    Q_UNUSED(args);
+    addReply("TX Mode: ", getMode(snapshot.getChar(MODE), snapshot.getBool(DATAMODE)));
+    addReply("TX Passband: ", QByteArray::number(snapshot.getUInt16(PASSBAND)));
+    return 0;
+}
 
-            if (passband > 0)
-            {
-                switch ((mode_kind)getMode(mode)) {
+int rigCtlClient::doSetVfo(const rigCtlArgs& args)
+{
+    if (args[1] == "?") {
+        addReply("set_vfo: ?");
+        addReply("VFOA");
+        addReply("VFOB");
+        addReply("Sub");
+        addReply("Main");
+        addReply("MEM");
+    }
+    else if (args[1] == "VFOA" || args[1] == "Main")
+    {
+        setState(CURRENTVFO, 0);
+    }
+    else if (args[1] == "VFOB" || args[1] == "Sub")
+    {
+        setState(CURRENTVFO, 1);
+    }
+    else if (args[1] == "MEM")
+    {
+        setState(CURRENTVFO, 2);
+    }
+    return 0;
+}
 
-                case modeAM:
-                    if (passband > 6000) {
-                        width = 1;
-                    }
-                    else if (passband > 3000 && passband <= 6000) {
-                        width = 2;
-                    }
-                    else if (passband <= 3000) {
-                        width = 3;
-                    }
-                    break;
+int rigCtlClient::doGetVfo(const rigCtlArgs& args)
+{
+    Q_UNUSED(args);
+    quint8 vfo = snapshot.getChar(CURRENTVFO);
+    if (vfo <= 2) {
+        addReply("VFO: ", getVfoName(vfo));
+    }
+    else {
+        addReply(longReply ? QByteArray("VFO: ") : QByteArray());
+    }
+    return 0;
+}
 
-                case modeFM:
-                    if (passband > 10000) {
-                        width = 1;
-                    }
-                    else if (passband > 7000 && passband <= 10000) {
-                        width = 2;
-                    }
-                    else if (passband <= 7000) {
-                        width = 3;
-                    }
-                    break;
-
-                case modeCW:
-                case modeRTTY:
-                case modeCW_R:
-                case modeRTTY_R:
-                case modePSK:
-                    if (passband > 500) {
-                        width = 1;
-                    }
-                    else if (passband > 250 && passband <= 500) {
-                        width = 2;
-                    }
-                    else if (passband <= 250) {
-                        width = 3;
-                    }
-                    break;
+int rigCtlClient::doSetRit(const rigCtlArgs& args)
+{
+    setState(RITVALUE, quint64(args[1].toInt()));
+    return 0;
+}
 
-                default:
-                    if (passband > 2400) {
-                        width = 1;
-                    }
-                    else if (passband > 1800 && passband <= 2400) {
-                        width = 2;
-                    }
-                    else if (passband <= 1800) {
-                        width = 3;
-                    }
-                    break;
+int rigCtlClient::doGetRit(const rigCtlArgs& args)
+{
+    Q_UNUSED(args);
+    addReply("RIT: ", QByteArray::number(snapshot.getInt32(RITVALUE)));
+    return 0;
+}
 
-                }
-                rigState->set(FILTER, width, true);
-                rigState->set(PASSBAND, passband, true);
-            }
-        }
-        else if (command[0] == "m" || command[0] == "get_mode")
-        {
-            if (longReply) {
-                response.append(QString("TX Mode: %1").arg(getMode(rigState->getChar(MODE), rigState->getBool(DATAMODE))));
-                response.append(QString("TX Passband: %1").arg(rigState->getUInt16(PASSBAND)));
-            }
-            else {
-                response.append(QString("%1").arg(getMode(rigState->getChar(MODE), rigState->getBool(DATAMODE))));
-                response.append(QString("%1").arg(rigState->getUInt16(PASSBAND)));
-            }
-            //qDebug(logRigCtlD()) << QString("get_mode: %1 passband: %2").arg(getMode(rigState->getChar(MODE), rigState->getBool(DATAMODE))).arg(rigState->getUInt16(PASSBAND));
-        }
-        else if (command.length() > 1 && (command[0] == "V" || command[0] == "set_vfo"))
-        {
-        setCommand = true;
-            if (command[1] == "?") {
-                response.append("set_vfo: ?");
-                response.append("VFOA");
-                response.append("VFOB");
-                response.append("Sub");
-                response.append("Main");
-                response.append("MEM");
-            }
-            else if (command[1] == "VFOA" || command[1] == "Main")
-            {
-                rigState->set(CURRENTVFO, (quint8)0, true);
-            }
-            else if (command[1] == "VFOB" || command[1] == "Sub")
-            {
-                rigState->set(CURRENTVFO, (quint8)1, true);
-            }
-            else if (command[1] == "MEM")
-            {
-                rigState->set(CURRENTVFO, (quint8)2, true);
-            }
-        }
-        else if (command[0] == "v" || command[0] == "v\nv" || command[0] == "get_vfo")
-        {
-        QString resp;
-            if (longReply) {
-                resp.append("VFO: ");
-            }
+int rigCtlClient::doSetXit(const rigCtlArgs& args)
+{
+    Q_UNUSED(args);
+    return 0;
+}
 
-            if (rigState->getChar(CURRENTVFO) == 0) {
-                resp.append("VFOA");
-            }
-            else if (rigState->getChar(CURRENTVFO) == 1) {
-                resp.append("VFOB");
-            }
-            else if (rigState->getChar(CURRENTVFO) == 2) {
-                resp.append("MEM");
-            }
+int rigCtlClient::doGetXit(const rigCtlArgs& args)
+{
+    Q_UNUSED(args);
+    addReply("XIT: ", "0");
+    return 0;
+}
 
-            response.append(resp);
-        }
-        else if (command[0] == "J" || command[0] == "set_rit")
-        {
-            rigState->set(RITVALUE, command[1].toInt(),true);
-            setCommand = true;
-        }
-        else if (command[0] == "j" || command[0] == "get_rit")
-        {
-            QString resp;
-            if (longReply) {
-                resp.append("RIT: ");
-            }
-            resp.append(QString("%1").arg(rigState->getInt32(RITVALUE)));
-            response.append(resp);
-        }
-        else if (command[0] == "Z" || command[0] == "set_xit")
-        {
-            setCommand = true;
-        }
-        else if (command[0] == "z" || command[0] == "get_xit")
-        {
-            QString resp;
-            if (longReply) {
-                resp.append("XIT: ");
-            }
-            resp.append(QString("%1").arg(0));
-            response.append(resp);
-        }
-        else if (command.length() > 1 && (command[0] == "T" || command[0] == "set_ptt"))
-        {
-            setCommand = true;
-            if (rigCaps.hasPTTCommand) {
-                rigState->set(PTT, (bool)command[1].toInt(), true);
-            }
-            else
-            {
-                responseCode = -1;
-            }
-        }
-        else if (command[0] == "t" || command[0] == "get_ptt")
-        {
-            if (rigCaps.hasPTTCommand) {
-                QString resp;
-                if (longReply) {
-                    resp.append(QString("PTT: "));
-                }
-                resp.append(QString("%1").arg(rigState->getBool(PTT)));
-                response.append(resp);
-            }
-            else
-            {
-                responseCode = -1;
-            }
-        }
-        else if (command.length() > 0 && (command[0] == "0x0b" || command[0] == "get_dcd"))
-        {
-            response.append(QString("%1").arg((float)rigState->getChar(SQUELCH) / 255.0));
-        }
-        else if (command.length() > 0 && (command[0] == "R" || command[0] == "set_rptr_shift"))
-        {
-            responseCode = -11;
-        }
-        else if (command.length() > 0 && (command[0] == "r" || command[0] == "get_rptr_shift"))
-        {
-            responseCode = -11;
-        }
-        else if (command.length() > 0 && (command[0] == "O" || command[0] == "set_rptr_offs"))
-        {
-            responseCode = -11;
-        }
-        else if (command.length() > 0 && (command[0] == "o" || command[0] == "get_rptr_offs"))
-        {
-            responseCode = -11;
-        }
-        else if (command.length() > 0 && (command[0] == "C" || command[0] == "set_ctcss_tone"))
-        {
-            responseCode = -11;
-        }
-        else if (command.length() > 0 && (command[0] == "c" || command[0] == "get_ctcss_tone"))
-        {
-            responseCode = -11;
-        }
-        else if (command.length() > 0 && (command[0] == "D" || command[0] == "set_dcs_tone"))
-        {
-            responseCode = -11;
-        }
-        else if (command.length() > 0 && (command[0] == "d" || command[0] == "get_dcs_tone"))
-        {
-            responseCode = -11;
-        }
-        else if (command.length() > 0 && (command[0] == "\x90" || command[0] == "set_ctcss_sql"))
-        {
-            responseCode = -11;
-        }
-        else if (command.length() > 0 && (command[0] == "\x91" || command[0] == "get_ctcss_sql"))
-        {
-            responseCode = -11;
-        }
-        else if (command.length() > 0 && (command[0] == "\x92" || command[0] == "set_dcs_sql"))
-        {
-            responseCode = -11;
-        }
-        else if (command.length() > 0 && (command[0] == "\x93" || command[0] == "get_dcs_sql"))
-        {
-            responseCode = -11;
-        }
-        else if (command[0] == "i" || command[0] == "get_split_freq")
-        {
-            QString resp;
-            if (longReply) {
-                resp.append("TX VFO: ");
-            }
+int rigCtlClient::doSetPtt(const rigCtlArgs& args)
+{
+    if (rigCaps.hasPTTCommand) {
+        setState(PTT, (bool)args[1].toInt());
+        return 0;
+    }
+    return -1;
+}
 
-            if (rigState->getInt64(CURRENTVFO) == 0) {
-                resp.append(QString("%1").arg(rigState->getInt64(VFOBFREQ)));
-            }
-            else {
-                resp.append(QString("%1").arg(rigState->getInt64(VFOAFREQ)));
-            }
+int rigCtlClient::doGetPtt(const rigCtlArgs& args)
+{
+    Q_UNUSED(args);
+    if (rigCaps.hasPTTCommand) {
+        addReply("PTT: ", QByteArray::number(snapshot.getBool(PTT)));
+        return 0;
+    }
+    return -1;
+}
 
-            response.append(resp);
-        }
-        else if (command.length() > 1 && (command[0] == "I" || command[0] == "set_split_freq"))
-        {
-            setCommand = true;
-            bool ok = false;
-            double newFreq = 0.0f;
-            newFreq = command[1].toDouble(&ok);
-            if (ok) {
-                qDebug(logRigCtlD()) << QString("set_split_freq: %1 (%2)").arg(newFreq).arg(command[1]);
-                rigState->set(VFOBFREQ, static_cast<quint64>(newFreq),false);
-            }
-        }
-        else if (command.length() > 2 && (command[0] == "X" || command[0] == "set_split_mode"))
-        {
-            setCommand = true;
-        }
+int rigCtlClient::doGetDcd(const rigCtlArgs& args)
+{
+    Q_UNUSED(args);
+    addReply(QByteArray::number((float)snapshot.getChar(SQUELCH) / 255.0));
+    return 0;
+}
 
-        else if (command.length() > 0 && (command[0] == "x" || command[0] == "get_split_mode"))
-        {
-            if (longReply) {
-                response.append(QString("TX Mode: %1").arg(getMode(rigState->getChar(MODE), rigState->getBool(DATAMODE))));
-                response.append(QString("TX Passband: %1").arg(rigState->getUInt16(PASSBAND)));
-            }
-            else {
-                response.append(QString("%1").arg(getMode(rigState->getChar(MODE), rigState->getBool(DATAMODE))));
-                response.append(QString("%1").arg(rigState->getUInt16(PASSBAND)));
-            }
-        }
-        else if (command.length() > 1 && (command[0] == "S" || command[0] == "set_split_vfo"))
-        {
-            setCommand = true;
+int rigCtlClient::doGetSplitFreq(const rigCtlArgs& args)
+{
+    Q_UNUSED(args);
+    if (snapshot.getInt64(CURRENTVFO) == 0) {
+        addReply("TX VFO: ", QByteArray::number(snapshot.getInt64(VFOBFREQ)));
+    }
+    else {
+        addReply("TX VFO: ", QByteArray::number(snapshot.getInt64(VFOAFREQ)));
+    }
+    return 0;
+}
 
-            if (command[1] == "1")
-            {
-                rigState->set(DUPLEX, dmSplitOn, true);
-            }
-            else {
-                rigState->set(DUPLEX, dmSplitOff, true);
-            }
-        }
-        else if (command[0] == "s" || command[0] == "get_split_vfo")
-        {
+int rigCtlClient::doSetSplitFreq(const rigCtlArgs& args)
+{
+    bool ok = false;
+    double newFreq = args[1].toDouble(&ok);
+    if (ok) {
+        qDebug(logRigCtlD()) << "set_split_freq:" << newFreq << args[1];
+        setState(VFOBFREQ, static_cast<quint64>(newFreq), false);
+    }
+    return 0;
+}
 
-            if (longReply) {
-                response.append(QString("Split: %1").arg(rigState->getChar(DUPLEX)));
-            }
-            else {
-                response.append(QString("%1").arg(rigState->getChar(DUPLEX)));
-            }
+int rigCtlClient::doSetSplitMode(const rigCtlArgs& args)
+{
+    Q_UNUSED(args);
+    return 0;
+}
 
-            QString resp;
-            if (longReply) {
-                resp.append("TX VFO: ");
-            }
+int rigCtlClient::doGetSplitMode(const rigCtlArgs& args)
+{
+    return doGetMode(args);
+}
 
+int rigCtlClient::doSetSplitVfo(const rigCtlArgs& args)
+{
+    if (args[1] == "1")
+    {
+        setState(DUPLEX, dmSplitOn);
+    }
+    else {
+        setState(DUPLEX, dmSplitOff);
+    }
+    return 0;
+}
 
-            if (rigState->getChar(CURRENTVFO) == 0)
-            {
-                resp.append(QString("%1").arg("VFOB"));
-            }
-            else {
-                resp.append(QString("%1").arg("VFOA"));
-            }
+int rigCtlClient::doGetSplitVfo(const rigCtlArgs& args)
+{
+    Q_UNUSED(args);
+    addReply("Split: ", QByteArray::number(snapshot.getChar(DUPLEX)));
+    addReply("TX VFO: ", snapshot.getChar(CURRENTVFO) == 0 ? "VFOB" : "VFOA");
+    return 0;
+}
 
-            response.append(resp);
-        }
-        else if (command.length() > 0 && (command[0] == "N" || command[0] == "set_ts"))
-        {
-            responseCode = -11;
-        }
-        else if (command.length() > 0 && (command[0] == "n" || command[0] == "get_ts"))
-        {
-            responseCode = -11;
-        }
-        else if (command.length() >2 && (command[0] == "U" || command[0] == "set_func"))
-        {
-            setCommand = true;
+static const struct
+{
+    const char* name;
+    stateTypes state;
+} func_state[] =
+{
+    { "FAGC", FAGCFUNC },
+    { "NB", NBFUNC },
+    { "COMP", COMPFUNC },
+    { "VOX", VOXFUNC },
+    { "TONE", TONEFUNC },
+    { "TSQL", TSQLFUNC },
+    { "SBKIN", SBKINFUNC },
+    { "FBKIN", FBKINFUNC },
+    { "ANF", ANFFUNC },
+    { "NR", NRFUNC },
+    { "AIP", AIPFUNC },
+    { "APF", APFFUNC },
+    { "MON", MONFUNC },
+    { "MN", MNFUNC },
+    { "RF", RFFUNC },
+    { "ARO", AROFUNC },
+    { "MUTE", MUTEFUNC },
+    { "VSC", VSCFUNC },
+    { "REV", REVFUNC },
+    { "SQL", SQLFUNC },
+    { "ABM", ABMFUNC },
+    { "BC", BCFUNC },
+    { "MBC", MBCFUNC },
+    { "RIT", RITFUNC },
+    { "AFC", AFCFUNC },
+    { "SATMODE", SATMODEFUNC },
+    { "SCOPE", SCOPEFUNC },
+    { "RESUME", RESUMEFUNC },
+    { "TBURST", TBURSTFUNC },
+    { "TUNER", TUNERFUNC },
+    { "LOCK", LOCKFUNC },
+    { Q_NULLPTR, FAGCFUNC },
+};
 
-            if (command[1] == "FAGC")
-            {
-                rigState->set(FAGCFUNC, (quint8)command[2].toInt(), true);
-            }
-            else if (command[1] == "NB")
-            {
-                rigState->set(NBFUNC, (quint8)command[2].toInt(), true);
-            }
-            else if (command[1] == "COMP")
-            {
-                rigState->set(COMPFUNC, (quint8)command[2].toInt(), true);
-            }
-            else if (command[1] == "VOX")
-            {
-                rigState->set(VOXFUNC, (quint8)command[2].toInt(), true);
-            }
-            else if (command[1] == "TONE")
-            {
-                rigState->set(TONEFUNC, (quint8)command[2].toInt(), true);
-            }
-            else if (command[1] == "TSQL")
-            {
-                rigState->set(TSQLFUNC, (quint8)command[2].toInt(), true);
-            }
-            else if (command[1] == "SBKIN")
-            {
-                rigState->set(SBKINFUNC, (quint8)command[2].toInt(), true);
-            }
-            else if (command[1] == "FBKIN")
-            {
-                rigState->set(FBKINFUNC, (quint8)command[2].toInt(), true);
-            }
-            else if (command[1] == "ANF")
-            {
-                rigState->set(ANFFUNC, (quint8)command[2].toInt(), true);
-            }
-            else if (command[1] == "NR")
-            {
-                rigState->set(NRFUNC, (quint8)command[2].toInt(), true);
-            }
-            else if (command[1] == "AIP")
-            {
-                rigState->set(AIPFUNC, (quint8)command[2].toInt(), true);
-            }
-            else if (command[1] == "APF")
-            {
-                rigState->set(APFFUNC, (quint8)command[2].toInt(), true);
-            }
-            else if (command[1] == "MON")
-            {
-                rigState->set(MONFUNC, (quint8)command[2].toInt(), true);
-            }
-            else if (command[1] == "MN")
-            {
-                rigState->set(MNFUNC, (quint8)command[2].toInt(), true);
-            }
-            else if (command[1] == "RF")
-            {
-                rigState->set(RFFUNC, (quint8)command[2].toInt(), true);
-            }
-            else if (command[1] == "ARO")
-            {
-                rigState->set(AROFUNC, (quint8)command[2].toInt(), true);
-            }
-            else if (command[1] == "MUTE")
-            {
-                rigState->set(MUTEFUNC, (quint8)command[2].toInt(), true);
-            }
-            else if (command[1] == "VSC")
-            {
-                rigState->set(VSCFUNC, (quint8)command[2].toInt(), true);
-            }
-            else if (command[1] == "REV")
-            {
-                rigState->set(REVFUNC, (quint8)command[2].toInt(), true);
-            }
-            else if (command[1] == "SQL")
-            {
-                rigState->set(SQLFUNC, (quint8)command[2].toInt(), true);
-            }
-            else if (command[1] == "ABM")
-            {
-                rigState->set(ABMFUNC, (quint8)command[2].toInt(), true);
-            }
-            else if (command[1] == "BC")
-            {
-                rigState->set(BCFUNC, (quint8)command[2].toInt(), true);
-            }
-            else if (command[1] == "MBC")
-            {
-                rigState->set(MBCFUNC, (quint8)command[2].toInt(), true);
-            }
-            else if (command[1] == "RIT")
-            {
-                rigState->set(RITFUNC, (quint8)command[2].toInt(), true);
-            }
-            else if (command[1] == "AFC")
-            {
-                rigState->set(AFCFUNC, (quint8)command[2].toInt(), true);
-            }
-            else if (command[1] == "SATMODE")
-            {
-                rigState->set(SATMODEFUNC, (quint8)command[2].toInt(), true);
-            }
-            else if (command[1] == "SCOPE")
-            {
-                rigState->set(SCOPEFUNC, (quint8)command[2].toInt(), true);
-            }
-            else if (command[1] == "RESUME")
-            {
-                rigState->set(RESUMEFUNC, (quint8)command[2].toInt(), true);
-            }
-            else if (command[1] == "TBURST")
-            {
-                rigState->set(TBURSTFUNC, (quint8)command[2].toInt(), true);
-            }
-            else if (command[1] == "TUNER")
-            {
-                rigState->set(TUNERFUNC, (quint8)command[2].toInt(), true);
-            }
-            else if (command[1] == "LOCK")
-            {
-                rigState->set(LOCKFUNC, (quint8)command[2].toInt(), true);
-            }
-            else {
-                qInfo(logRigCtlD()) << "Unimplemented func:" << command[0] << command[1] << command[2];
-            }
+// How a level or parm value maps between hamlib and rigstate.
+enum levelKind { levelFloat, levelChar, levelInt, levelInt16, levelPreamp, levelKeySpeed, levelTime };
 
-            qInfo(logRigCtlD()) << "Setting:" << command[1] << command[2];
-        }
-        else if (command.length()>1 && (command[0] == "u" || command[0] == "get_func"))
-        {
-            QString resp="";
-            bool result = 0;
-            if (longReply) {
-                resp.append(QString("Func Status: "));
-            }
-            if (command[1] == "FAGC")
-            {
-                result=rigState->getBool(FAGCFUNC);
-            }
-            else if (command[1] == "NB")
-            {
-                result = rigState->getBool(NBFUNC);
-            }
-            else if (command[1] == "COMP")
-            {
-                result=rigState->getBool(COMPFUNC);
-            }
-            else if (command[1] == "VOX")
-            {
-                result = rigState->getBool(VOXFUNC);
-            }
-            else if (command[1] == "TONE")
-            {
-                result = rigState->getBool(TONEFUNC);
-            }
-            else if (command[1] == "TSQL")
-            {
-                result = rigState->getBool(TSQLFUNC);
-            }
-            else if (command[1] == "SBKIN")
-            {
-                result = rigState->getBool(SBKINFUNC);
-            }
-            else if (command[1] == "FBKIN")
-            {
-                result = rigState->getBool(FBKINFUNC);
-            }
-            else if (command[1] == "ANF")
-            {
-                result = rigState->getBool (ANFFUNC);
-            }
-            else if (command[1] == "NR")
-            {
-                result = rigState->getBool(NRFUNC);
-            }
-            else if (command[1] == "AIP")
-            {
-                result = rigState->getBool(AIPFUNC);
-            }
-            else if (command[1] == "APF")
-            {
-                result = rigState->getBool(APFFUNC);
-            }
-            else if (command[1] == "MON")
-            {
-                result = rigState->getBool(MONFUNC);
-            }
-            else if (command[1] == "MN")
-            {
-                result = rigState->getBool(MNFUNC);
-            }
-            else if (command[1] == "RF")
-            {
-                result = rigState->getBool(RFFUNC);
-            }
-            else if (command[1] == "ARO")
-            {
-                result = rigState->getBool(AROFUNC);
-            }
-            else if (command[1] == "MUTE")
-            {
-                result = rigState->getBool(MUTEFUNC);
-            }
-            else if (command[1] == "VSC")
-            {
-                result = rigState->getBool(VSCFUNC);
-            }
-            else if (command[1] == "REV")
-            {
-                result = rigState->getBool(REVFUNC);
-            }
-            else if (command[1] == "SQL")
-            {
-                result = rigState->getBool(SQLFUNC);
-            }
-            else if (command[1] == "ABM")
-            {
-                result = rigState->getBool(ABMFUNC);
-            }
-            else if (command[1] == "BC")
-            {
-                result = rigState->getBool(BCFUNC);
-            }
-            else if (command[1] == "MBC")
-            {
-                result = rigState->getBool(MBCFUNC);
-            }
-            else if (command[1] == "RIT")
-            {
-                result = rigState->getBool(RITFUNC);
-            }
-            else if (command[1] == "AFC")
-            {
-                result = rigState->getBool(AFCFUNC);
-            }
-            else if (command[1] == "SATMODE")
-            {
-                result = rigState->getBool(SATMODEFUNC);
-            }
-            else if (command[1] == "SCOPE")
-            {
-                result = rigState->getBool(SCOPEFUNC);
-            }
-            else if (command[1] == "RESUME")
-            {
-                result = rigState->getBool(RESUMEFUNC);
-            }
-            else if (command[1] == "TBURST")
-            {
-                result = rigState->getBool(TBURSTFUNC);
-            }
-            else if (command[1] == "TUNER")
-            {
-                result = rigState->getBool(TUNERFUNC);
-            }
-            else if (command[1] == "LOCK")
-            {
-            result = rigState->getBool(LOCKFUNC);
-            }
-            else {
-                qInfo(logRigCtlD()) << "Unimplemented func:" << command[0] << command[1];
-            }
+static const struct
+{
+    const char* name;
+    stateTypes state;
+    levelKind kind;
+    bool readable;
+} level_state[] =
+{
+    { "AF", AFGAIN, levelFloat, true },
+    { "RF", RFGAIN, levelFloat, true },
+    { "RFPOWER", RFPOWER, levelFloat, true },
+    { "SQL", SQUELCH, levelFloat, true },
+    { "COMP", COMPLEVEL, levelFloat, true },
+    { "MICGAIN", MICGAIN, levelFloat, true },
+    { "MON", MONITORLEVEL, levelFloat, true },
+    { "VOXGAIN", VOXGAIN, levelFloat, true },
+    { "ANTIVOX", ANTIVOXGAIN, levelFloat, true },
+    { "ATT", ATTENUATOR, levelChar, true },
+    { "PREAMP", PREAMP, levelPreamp, true },
+    { "AGC", AGC, levelFloat, false },
+    { "CWPITCH", CWPITCH, levelInt, true },
+    { "NOTCHF", NOTCHF, levelInt, true },
+    { "IF", IF, levelInt16, true },
+    { "PBT_IN", PBTIN, levelFloat, true },
+    { "PBT_OUT", PBTOUT, levelFloat, true },
+    { "APF", APF, levelFloat, true },
+    { "NR", NR, levelFloat, true },
+    { "BAL", BAL, levelFloat, true },
+    { "KEYSPD", KEYSPD, levelKeySpeed, true },
+    { Q_NULLPTR, AFGAIN, levelFloat, false },
+};
 
-            resp.append(QString("%1").arg(result));
-            response.append(resp);
-        }
-        else if (command.length() > 2 && (command[0] == "L" || command[0] == "set_level"))
-        {
-            int value=0;
-            setCommand = true;
-            if (command[1] == "AF") {
-                value = command[2].toFloat() * 255;
-                rigState->set(AFGAIN, quint8(value), true);
-            }
-            else if (command[1] == "RF") {
-                value = command[2].toFloat() * 255;
-                rigState->set(RFGAIN, quint8(value), true);
-            }
-            else if (command[1] == "RFPOWER") {
-                value = command[2].toFloat() * 255;
-                rigState->set(RFPOWER, quint8(value), true);
-            }
-            else if (command[1] == "SQL") {
-                value = command[2].toFloat() * 255;
-                rigState->set(SQUELCH, quint8(value), true);
-            }
-            else if (command[1] == "COMP") {
-                value = command[2].toFloat() * 255;
-                rigState->set(COMPLEVEL, quint8(value), true);
-            }
-            else if (command[1] == "MICGAIN") {
-                value = command[2].toFloat() * 255;
-                rigState->set(MICGAIN, quint8(value), true);
-            }
-            else if (command[1] == "MON") {
-                value = command[2].toFloat() * 255;
-                rigState->set(MONITORLEVEL, quint8(value), true);
-            }
-            else if (command[1] == "VOXGAIN") {
-                value = command[2].toFloat() * 255;
-                rigState->set(VOXGAIN, quint8(value), true);
-            }
-            else if (command[1] == "ANTIVOX") {
-                value = command[2].toFloat() * 255;
-                rigState->set(ANTIVOXGAIN, quint8(value), true);
-            }
-            else if (command[1] == "ATT") {
-                value = command[2].toInt();
-                rigState->set(ATTENUATOR, quint8(value), true);
-            }
-            else if (command[1] == "PREAMP") {
-                value = command[2].toFloat() / 10;
-                rigState->set(PREAMP, quint8(value), true);
-            }
-            else if (command[1] == "AGC") {
-                value = command[2].toFloat() * 255;
-                rigState->set(AGC, quint8(value), true);
-            }
-            else if (command[1] == "CWPITCH") {
-                value = command[2].toInt();
-                rigState->set(CWPITCH, value, true);
-            }
-            else if (command[1] == "NOTCHF") {
-                value = command[2].toInt();
-                rigState->set(NOTCHF, value, true);
-            }
-            else if (command[1] == "IF") {
-                value = command[2].toInt();
-                rigState->set(IF, qint16(value), true);
-            }
-            else if (command[1] == "PBT_IN") {
-                value = command[2].toFloat() * 255;
-                rigState->set(PBTIN, quint8(value), true);
-            }
-            else if (command[1] == "PBT_OUT") {
-                value = command[2].toFloat() * 255;
-                rigState->set(PBTOUT, quint8(value), true);
-            }
-            else if (command[1] == "APF") {
-                value = command[2].toFloat() * 255;
-                rigState->set(APF, quint8(value), true);
-            }
-            else if (command[1] == "NR") {
-                value = command[2].toFloat() * 255;
-                rigState->set(NR, quint8(value), true);
-            }
-            else if (command[1] == "BAL") {
-                value = command[2].toFloat() * 255;
-                rigState->set(BAL, quint8(value), true);
-            }
-            else if (command[1] == "KEYSPD") {
-                value = command[2].toInt() * 5.1;
-                rigState->set(KEYSPD, quint8(value), true);
-            }
+static const struct
+{
+    const char* name;
+    stateTypes state;
+    levelKind kind;
+} parm_state[] =
+{
+    { "ANN", ANN, levelChar },
+    { "APO", APO, levelChar },
+    { "BACKLIGHT", BACKLIGHT, levelFloat },
+    { "BEEP", BEEP, levelChar },
+    { "TIME", TIME, levelTime },
+    { "BAT", BAT, levelFloat },
+    { "KEYLIGHT", KEYLIGHT, levelFloat },
+    { Q_NULLPTR, ANN, levelChar },
+};
 
-            qInfo(logRigCtlD()) << "Setting:" << command[1] << command[2] << value;
+int rigCtlClient::doSetFunc(const rigCtlArgs& args)
+{
+    int i = 0;
+    while (func_state[i].name != Q_NULLPTR && args[1] != func_state[i].name)
+        i++;
 
-        }
-        else if (command.length() > 1 && (command[0] == "l" || command[0] == "get_level"))
-        {
-            QString resp;
-            int value = 0;
-            if (longReply) {
-                resp.append("Level Value: ");
-            }
+    if (func_state[i].name != Q_NULLPTR) {
+        setState(func_state[i].state, (quint8)args[2].toInt());
+    }
+    else {
+        qInfo(logRigCtlD()) << "Unimplemented func:" << args[0] << args[1] << args[2];
+    }
 
-            if (command[1] == "STRENGTH") {
+    qInfo(logRigCtlD()) << "Setting:" << args[1] << args[2];
+    return 0;
+}
 
-                if (rigCaps.model == model7610)
-                    value = getCalibratedValue(rigState->getChar(SMETER), IC7610_STR_CAL);
-                else if (rigCaps.model == model7850)
-                    value = getCalibratedValue(rigState->getChar(SMETER), IC7850_STR_CAL);
-                else
-                    value = getCalibratedValue(rigState->getChar(SMETER), IC7300_STR_CAL);
-                //qInfo(logRigCtlD()) << "Calibration IN:" << rigState->sMeter << "OUT" << value;
-                resp.append(QString("%1").arg(value));
-            }
+int rigCtlClient::doGetFunc(const rigCtlArgs& args)
+{
+    bool result = 0;
+    int i = 0;
+    while (func_state[i].name != Q_NULLPTR && args[1] != func_state[i].name)
+        i++;
 
-            else if (command[1] == "AF") {
-                resp.append(QString("%1").arg((float)rigState->getChar(AFGAIN) / 255.0));
-            }
-            else if (command[1] == "RF") {
-                resp.append(QString("%1").arg((float)rigState->getChar(RFGAIN) / 255.0));
-            }
-            else if (command[1] == "SQL") {
-                resp.append(QString("%1").arg((float)rigState->getChar(SQUELCH) / 255.0));
-            }
-            else if (command[1] == "COMP") {
-                resp.append(QString("%1").arg((float)rigState->getChar(COMPLEVEL) / 255.0));
-            }
-            else if (command[1] == "MICGAIN") {
-                resp.append(QString("%1").arg((float)rigState->getChar(MICGAIN) / 255.0));
-            }
-            else if (command[1] == "MON") {
-                resp.append(QString("%1").arg((float)rigState->getChar(MONITORLEVEL) / 255.0));
-            }
-            else if (command[1] == "VOXGAIN") {
-                resp.append(QString("%1").arg((float)rigState->getChar(VOXGAIN) / 255.0));
-            }
-            else if (command[1] == "ANTIVOX") {
-                resp.append(QString("%1").arg((float)rigState->getChar(ANTIVOXGAIN) / 255.0));
-            }
-            else if (command[1] == "RFPOWER") {
-                resp.append(QString("%1").arg((float)rigState->getChar(RFPOWER) / 255.0));
-            }
-            else if (command[1] == "PREAMP") {
-                resp.append(QString("%1").arg(rigState->getChar(PREAMP)*10));
-            }
-            else if (command[1] == "ATT") {
-                resp.append(QString("%1").arg(rigState->getChar(ATTENUATOR)));
-            }
-            else if (command[1] == "CWPITCH") {
-                resp.append(QString("%1").arg(rigState->getInt16(CWPITCH)));
-            }
-            else if (command[1] == "NOTCHF") {
-                resp.append(QString("%1").arg(rigState->getInt16(NOTCHF)));
-            }
-            else if (command[1] == "IF") {
-                resp.append(QString("%1").arg(rigState->getInt16(IF)));
-            }
-            else if (command[1] == "PBT_IN") {
-                resp.append(QString("%1").arg((float)rigState->getChar(PBTIN) / 255.0));
-            }
-            else if (command[1] == "PBT_OUT") {
-                resp.append(QString("%1").arg((float)rigState->getChar(PBTOUT) / 255.0));
-            }
-            else if (command[1] == "APF") {
-                resp.append(QString("%1").arg((float)rigState->getChar(APF) / 255.0));
-            }
-            else if (command[1] == "NR") {
-                resp.append(QString("%1").arg((float)rigState->getChar(NR) / 255.0));
-            }
-            else if (command[1] == "BAL") {
-                resp.append(QString("%1").arg((float)rigState->getChar(BAL) / 255.0));
-            }
-            else if (command[1] == "KEYSPD") {
-                resp.append(QString("%1").arg(rigState->getChar(KEYSPD)/5.1));
-            }
-            else {
-                resp.append(QString("%1").arg(value));
-            }
+    if (func_state[i].name != Q_NULLPTR) {
+        result = snapshot.getBool(func_state[i].state);
+    }
+    else {
+        qInfo(logRigCtlD()) << "Unimplemented func:" << args[0] << args[1];
+    }
 
-            response.append(resp);
-        }
+    addReply("Func Status: ", QByteArray::number(result));
+    return 0;
+}
+
+int rigCtlClient::doSetLevel(const rigCtlArgs& args)
+{
+    int value=0;
+    int i = 0;
+    while (level_state[i].name != Q_NULLPTR && args[1] != level_state[i].name)
+        i++;
 
-        else if (command.length() > 2 && (command[0] == "P" || command[0] == "set_parm"))
+    if (level_state[i].name != Q_NULLPTR)
+    {
+        stateTypes s = level_state[i].state;
+        switch (level_state[i].kind)
         {
-            int value=0;
-            setCommand = true;
-            if (command[1] == "ANN") {
-                value = command[2].toInt();
-                rigState->set(ANN, quint8(value), true);
-            }
-            else if (command[1] == "APO") {
-                value = command[2].toInt();
-                rigState->set(APO, quint8(value), true);
-            }
-            else if (command[1] == "BACKLIGHT") {
-                value = command[2].toFloat() * 255;
-                rigState->set(BACKLIGHT, quint8(value), true);
-            }
-            else if (command[1] == "BEEP") {
-                value = command[2].toInt();
-                rigState->set(BEEP, quint8(value), true);
-            }
-            else if (command[1] == "TIME") {
-                value = command[2].toLongLong();
-                rigState->set(TIME, value, true);
-            }
-            else if (command[1] == "BAT") {
-                value = command[2].toFloat() * 255;
-                rigState->set(BAT, quint8(value), true);
-            }
-            else if (command[1] == "KEYLIGHT") {
-                value = command[2].toFloat() * 255;
-                rigState->set(KEYLIGHT, quint8(value), true);
-            }
-            else {
-                qInfo(logRigCtlD()) << "Unimplemented parm:" << command[0] << command[1];
-            }
+        case levelFloat:
+            value = args[2].toFloat() * 255;
+            setState(s, quint8(value));
+            break;
+        case levelChar:
+            value = args[2].toInt();
+            setState(s, quint8(value));
+            break;
+        case levelInt:
+            value = args[2].toInt();
+            setState(s, quint64(value));
+            break;
+        case levelInt16:
+            value = args[2].toInt();
+            setState(s, quint64(qint16(value)));
+            break;
+        case levelPreamp:
+            value = args[2].toFloat() / 10;
+            setState(s, quint8(value));
+            break;
+        case levelKeySpeed:
+            value = args[2].toInt() * 5.1;
+            setState(s, quint8(value));
+            break;
+        default:
+            break;
+        }
+    }
 
-            qInfo(logRigCtlD()) << "Setting:" << command[1] << command[2] << value;
+    qInfo(logRigCtlD()) << "Setting:" << args[1] << args[2] << value;
+    return 0;
+}
 
-        }
-        else if (command.length() > 1 && (command[0] == "p" || command[0] == "get_parm"))
-        {
-            QString resp;
-            if (longReply) {
-                resp.append(QString("get_parm: %1%2").arg(command[1]).arg(sep));
-            }
+int rigCtlClient::getStrength()
+{
+    int value;
+    if (rigCaps.model == model7610)
+        value = getCalibratedValue(snapshot.getChar(SMETER), IC7610_STR_CAL);
+    else if (rigCaps.model == model7850)
+        value = getCalibratedValue(snapshot.getChar(SMETER), IC7850_STR_CAL);
+    else
+        value = getCalibratedValue(snapshot.getChar(SMETER), IC7300_STR_CAL);
+    //qInfo(logRigCtlD()) << "Calibration IN:" << rigState->sMeter << "OUT" << value;
+    return value;
+}
 
-            if (command[1] == "ANN") {
-                resp.append(QString("%1").arg(rigState->getChar(ANN)));
-            }
-            else if (command[1] == "APO") {
-                resp.append(QString("%1").arg(rigState->getChar(APO)));
-            }
-            else if (command[1] == "BACKLIGHT") {
-                resp.append(QString("%1").arg((float)rigState->getChar(BACKLIGHT) / 255.0));
-            }
-            else if (command[1] == "BEEP") {
-                resp.append(QString("%1").arg(rigState->getChar(BEEP)));
-            }
-            else if (command[1] == "TIME") {
-                resp.append(QString("%1").arg(rigState->getInt64(TIME)));
-            }
-            else if (command[1] == "BAT") {
-                resp.append(QString("%1").arg((float)rigState->getChar(BAT) / 255.0));
-            }
-            else if (command[1] == "KEYLIGHT") {
-                resp.append(QString("%1").arg((float)rigState->getChar(KEYLIGHT) / 255.0));
-            }
-            else {
-                qInfo(logRigCtlD()) << "Unimplemented parm:" << command[0] << command[1];
-            }
+int rigCtlClient::doGetLevel(const rigCtlArgs& args)
+{
+    QByteArray resp;
 
-            response.append(resp);
-        }
-        else if (command.length() > 0 && (command[0] == "B" || command[0] == "set_bank"))
-        {
-            responseCode = -11;
-        }
-        else if (command.length() > 0 && (command[0] == "b" || command[0] == "get_bank"))
-        {
-            responseCode = -11;
-        }
-        else if (command.length() > 0 && (command[0] == "E" || command[0] == "set_mem"))
-        {
-            responseCode = -11;
-        }
-        else if (command.length() > 0 && (command[0] == "e" || command[0] == "get_mem"))
-        {
-            responseCode = -11;
-        }
-        else if (command.length() > 0 && (command[0] == "G" || command[0] == "vfo_op"))
-        {
-            responseCode = -11;
-        }
-        else if (command.length() > 0 && (command[0] == "g" || command[0] == "scan"))
-        {
-            responseCode = -11;
-        }
-        else if (command.length() > 0 && (command[0] == "H" || command[0] == "set_channel"))
-        {
-            responseCode = -11;
-        }
-        else if (command.length() > 0 && (command[0] == "A" || command[0] == "set_trn"))
-        {
-            responseCode = -11;
-        }
-        else if (command.length() > 0 && (command[0] == "a" || command[0] == "get_trn"))
-        {
-            responseCode = -11;
-        }
-        else if (command.length() > 1 && (command[0] == "Y" || command[0] == "set_ant"))
-        {
-            setCommand = true;
-            qInfo(logRigCtlD()) << "set_ant:" << command[1];
-            rigState->set(ANTENNA,antFromName(command[1]),true);
-        }
-        else if (command[0] == "y" || command[0] == "get_ant")
-        {
-            qInfo(logRigCtlD()) << "get_ant:";
-
-            if (command.length() > 1) {
-                if (longReply) {
-                    response.append(QString("AntCurr: %1").arg(getAntName((quint8)command[1].toInt())));
-                    response.append(QString("Option: %1").arg(0));
-                    response.append(QString("AntTx: %1").arg(getAntName(rigState->getChar(ANTENNA))));
-                    response.append(QString("AntRx: %1").arg(getAntName(rigState->getChar(ANTENNA))));
-                }
-                else {
-                    response.append(QString("%1").arg(getAntName((quint8)command[1].toInt())));
-                    response.append(QString("%1").arg(0));
-                    response.append(QString("%1").arg(getAntName(rigState->getChar(ANTENNA))));
-                    response.append(QString("%1").arg(getAntName(rigState->getChar(ANTENNA))));
-                }
-            }
-        }
-        else if (command.length() > 0 && (command[0] == "*" || command[0] == "reset"))
-        {
-            responseCode = -11; //Unimplemented
-        }
-        else if (command.length() > 0 && (command[0] == "b" || command[0] == "send_morse"))
-        {
-            responseCode = -11; //Unimplemented
-        }
-        else if (command.length() > 1 && (command[0] == '\x87' || command[0] == "set_powerstat"))
-        {
-            setCommand = true;
-            if (command[1] == "0")
-            {
-                rigState->set(POWERONOFF, false, true);
-            }
-            else {
-                rigState->set(POWERONOFF, true, true);
-            }
-        }
-        else if (command.length() > 0 && (command[0] == '\x88' || command[0] == "get_powerstat"))
-        {
+    if (args[1] == "STRENGTH") {
+        addReply("Level Value: ", QByteArray::number(getStrength()));
+        return 0;
+    }
 
-            QString resp;
-            if (longReply) {
-                resp.append(QString("Power Status: "));
-            }
-            resp.append(QString("%1").arg(1)); // Always reply with ON
-            response.append(resp);
+    int i = 0;
+    while (level_state[i].name != Q_NULLPTR && args[1] != level_state[i].name)
+        i++;
 
-        }
-        else if (command.length() > 0 && (command[0] == "\x89" || command[0] == "send_dtmf"))
-        {
-            responseCode = -11; //Unimplemented
-        }
-        else if (command.length() > 0 && (command[0] == "\x8a" || command[0] == "recv_dtmf"))
+    if (level_state[i].name == Q_NULLPTR || !level_state[i].readable)
+    {
+        resp = "0";
+    }
+    else
+    {
+        stateTypes s = level_state[i].state;
+        switch (level_state[i].kind)
         {
-            responseCode = -11; //Unimplemented
+        case levelFloat:
+            resp = QByteArray::number((float)snapshot.getChar(s) / 255.0);
+            break;
+        case levelChar:
+            resp = QByteArray::number(snapshot.getChar(s));
+            break;
+        case levelInt:
+        case levelInt16:
+            resp = QByteArray::number(snapshot.getInt16(s));
+            break;
+        case levelPreamp:
+            resp = QByteArray::number(snapshot.getChar(s) * 10);
+            break;
+        case levelKeySpeed:
+            resp = QByteArray::number(snapshot.getChar(s) / 5.1);
+            break;
+        default:
+            resp = "0";
+            break;
         }
-        else if (command.length() > 0 && (command[0] == "_" || command[0] == "get_info"))
+    }
+
+    addReply("Level Value: ", resp);
+    return 0;
+}
+
+int rigCtlClient::doSetParm(const rigCtlArgs& args)
+{
+    int value=0;
+    int i = 0;
+    while (parm_state[i].name != Q_NULLPTR && args[1] != parm_state[i].name)
+        i++;
+
+    if (parm_state[i].name != Q_NULLPTR)
+    {
+        stateTypes s = parm_state[i].state;
+        switch (parm_state[i].kind)
         {
-            response.append("None");
+        case levelFloat:
+            value = args[2].toFloat() * 255;
+            setState(s, quint8(value));
+            break;
+        case levelTime:
+            value = args[2].toLongLong();
+            setState(s, quint64(value));
+            break;
+        default:
+            value = args[2].toInt();
+            setState(s, quint8(value));
+            break;
         }
-        else if (command.length() > 0 && (command[0] == '\xf5' || command[0] == "get_rig_info"))
+    }
+    else {
+        qInfo(logRigCtlD()) << "Unimplemented parm:" << args[0] << args[1];
+    }
+
+    qInfo(logRigCtlD()) << "Setting:" << args[1] << args[2] << value;
+    return 0;
+}
+
+int rigCtlClient::doGetParm(const rigCtlArgs& args)
+{
+    QByteArray resp;
+    if (longReply) {
+        resp.append("get_parm: ");
+        resp.append(args[1]);
+        resp.append(sep);
+    }
+
+    int i = 0;
+    while (parm_state[i].name != Q_NULLPTR && args[1] != parm_state[i].name)
+        i++;
+
+    if (parm_state[i].name != Q_NULLPTR)
+    {
+        stateTypes s = parm_state[i].state;
+        switch (parm_state[i].kind)
         {
-            duplexMode split = rigState->getDuplex(DUPLEX);
-            quint8 rxa = 1;
-            quint8 txa = split == 0;
-            quint8 rxb = !rxa;
-            quint8 txb = split == 1;
-            QString resp = QString("VFO=%0 Freq=%1 Mode=%2 Width=%3 RX=%4 TX=%5\nVFO=%6 Freq=%7 Mode=%8 Width=%9 RX=%10 TX=%11\nSplit=%12 SatMode=%13\nRig=%14\nApp=wfview\nVersion=%15\n")
-                .arg(getVfoName(0)).arg(rigState->getInt64(VFOAFREQ)).arg(getMode(rigState->getChar(MODE), rigState->getBool(DATAMODE))).arg(rigState->getUInt16(PASSBAND)).arg(rxa).arg(txa)
-                .arg(getVfoName(1)).arg(rigState->getInt64(VFOBFREQ)).arg(getMode(rigState->getChar(MODE), rigState->getBool(DATAMODE))).arg(rigState->getUInt16(PASSBAND)).arg(rxb).arg(txb)
-                .arg(split).arg(rigState->getChar(SATMODEFUNC)).arg(rigCaps.modelName).arg(WFVIEW_VERSION);
-            unsigned long crc = doCrc((unsigned char*)resp.toStdString().c_str(), resp.length());
-            resp = resp + QString("CRC=0x%0").arg(crc, 8, 16, QLatin1Char('0'));
-            response.append(resp);
+        case levelFloat:
+            resp.append(QByteArray::number((float)snapshot.getChar(s) / 255.0));
+            break;
+        case levelTime:
+            resp.append(QByteArray::number(snapshot.getInt64(s)));
+            break;
+        default:
+            resp.append(QByteArray::number(snapshot.getChar(s)));
+            break;
         }
-        else if (command[0] == "\xf3" || command[0] == "get_vfo_info")
-        {
-            if (longReply) {
-                if (command[1] == "?") {
-                    if (rigState->getChar(CURRENTVFO) == 0) {
-                        response.append(QString("set_vfo: VFOA"));
-                    }
-                    else
-                    {
-                        response.append(QString("set_vfo: VFOB"));
-                    }
-                }
-                if (command[1] == "VFOB") {
-                    response.append(QString("Freq: %1").arg(rigState->getInt64(VFOBFREQ)));
-                }
-                else {
-                    response.append(QString("Freq: %1").arg(rigState->getInt64(VFOAFREQ)));
-                }
-                response.append(QString("Mode: %1").arg(getMode(rigState->getChar(MODE), rigState->getBool(DATAMODE))));
-                response.append(QString("Width: %1").arg(rigState->getUInt16(PASSBAND)));
+    }
+    else {
+        qInfo(logRigCtlD()) << "Unimplemented parm:" << args[0] << args[1];
+    }
 
-                response.append(QString("Split: %1").arg(rigState->getDuplex(DUPLEX)));
-                response.append(QString("SatMode: %1").arg(0)); // Need to get satmode
-            }
-            else {
-                if (command[1] == "VFOB") {
-                    response.append(QString("%1").arg(rigState->getInt64(VFOBFREQ)));
-                }
-                else {
-                    response.append(QString("%1").arg(rigState->getInt64(VFOAFREQ)));
-                }
-                response.append(QString("%1").arg(getMode(rigState->getChar(MODE), rigState->getBool(DATAMODE))));
-                response.append(QString("%1").arg(rigState->getUInt16(PASSBAND)));
+    addReply(resp);
+    return 0;
+}
 
-            }
-        }
-        else if (command[0] == "dump_state")
-        {
-            quint64 modes = getRadioModes();
-
-            // rigctld protocol version
-            response.append("1");
-            // Radio model
-            response.append(QString("%1").arg(rigCaps.rigctlModel));
-            // Print something (used to be ITU region)
-            response.append("0");
-            // Supported RX bands (startf,endf,modes,low_power,high_power,vfo,ant)
-            quint32 lowFreq = 0;
-            quint32 highFreq = 0;
-            for (bandType band : rigCaps.bands)
-            {
-                if (lowFreq == 0 || band.lowFreq < lowFreq)
-                    lowFreq = band.lowFreq;
-                if (band.highFreq > highFreq)
-                    highFreq = band.highFreq;
-            }
-            response.append(QString("%1.000000 %2.000000 0x%3 %4 %5 0x%6 0x%7").arg(lowFreq).arg(highFreq)
-                .arg(modes, 0, 16).arg(-1).arg(-1).arg(0x16000000, 0, 16).arg(getAntennas(), 0, 16));
-            response.append("0 0 0 0 0 0 0");
+int rigCtlClient::doSetAnt(const rigCtlArgs& args)
+{
+    qInfo(logRigCtlD()) << "set_ant:" << args[1];
+    setState(ANTENNA, antFromName(args[1]));
+    return 0;
+}
 
-            if (rigCaps.hasTransmit) {
-                // Supported TX bands (startf,endf,modes,low_power,high_power,vfo,ant)
-                for (bandType band : rigCaps.bands)
-                {
-                    response.append(QString("%1.000000 %2.000000 0x%3 %4 %5 0x%6 0x%7").arg(band.lowFreq).arg(band.highFreq)
-                        .arg(modes, 0, 16).arg(2000).arg(100000).arg(0x16000000, 0, 16).arg(getAntennas(), 0, 16));
-                }
-            }
-            response.append("0 0 0 0 0 0 0");
-
-            response.append(QString("0x%1 1").arg(modes, 0, 16));
-            response.append(QString("0x%1 10").arg(modes, 0, 16));
-            response.append(QString("0x%1 100").arg(modes, 0, 16));
-            response.append(QString("0x%1 1000").arg(modes, 0, 16));
-            response.append(QString("0x%1 2500").arg(modes, 0, 16));
-            response.append(QString("0x%1 5000").arg(modes, 0, 16));
-            response.append(QString("0x%1 6125").arg(modes, 0, 16));
-            response.append(QString("0x%1 8333").arg(modes, 0, 16));
-            response.append(QString("0x%1 10000").arg(modes, 0, 16));
-            response.append(QString("0x%1 12500").arg(modes, 0, 16));
-            response.append(QString("0x%1 25000").arg(modes, 0, 16));
-            response.append(QString("0x%1 100000").arg(modes, 0, 16));
-            response.append(QString("0x%1 250000").arg(modes, 0, 16));
-            response.append(QString("0x%1 1000000").arg(modes, 0, 16));
-            response.append("0 0");
-
-            modes = getRadioModes("SB");
-            if (modes) {
-                response.append(QString("0x%1 3000").arg(modes, 0, 16));
-                response.append(QString("0x%1 2400").arg(modes, 0, 16));
-                response.append(QString("0x%1 1800").arg(modes, 0, 16));
-            }
-            modes = getRadioModes("AM");
-            if (modes) {
-                response.append(QString("0x%1 9000").arg(modes, 0, 16));
-                response.append(QString("0x%1 6000").arg(modes, 0, 16));
-                response.append(QString("0x%1 3000").arg(modes, 0, 16));
-            }
-            modes = getRadioModes("CW");
-            if (modes) {
-                response.append(QString("0x%1 1200").arg(modes, 0, 16));
-                response.append(QString("0x%1 500").arg(modes, 0, 16));
-                response.append(QString("0x%1 200").arg(modes, 0, 16));
-            }
-            modes = getRadioModes("FM");
-            if (modes) {
-                response.append(QString("0x%1 15000").arg(modes, 0, 16));
-                response.append(QString("0x%1 10000").arg(modes, 0, 16));
-                response.append(QString("0x%1 7000").arg(modes, 0, 16));
-            }
-            modes = getRadioModes("RTTY");
-            if (modes) {
-                response.append(QString("0x%1 2400").arg(modes, 0, 16));
-                response.append(QString("0x%1 500").arg(modes, 0, 16));
-                response.append(QString("0x%1 250").arg(modes, 0, 16));
-            }
-            modes = getRadioModes("PSK");
-            if (modes) {
-                response.append(QString("0x%1 1200").arg(modes, 0, 16));
-                response.append(QString("0x%1 500").arg(modes, 0, 16));
-                response.append(QString("0x%1 250").arg(modes, 0, 16));
-            }
-            response.append("0 0");
-            response.append("9900");
-            response.append("9900");
-            response.append("10000");
-            response.append("0");
-            QString preamps="";
-            if (rigCaps.hasPreamp) {
-                for (quint8 pre : rigCaps.preamps)
-                {
-                    if (pre == 0)
-                        continue;
-                    preamps.append(QString("%1 ").arg(pre*10));
-                }
-                if (preamps.endsWith(" "))
-                    preamps.chop(1);
-            }
-            else {
-                preamps = "0";
-            }
-            response.append(preamps);
+int rigCtlClient::doGetAnt(const rigCtlArgs& args)
+{
+    qInfo(logRigCtlD()) << "get_ant:";
 
-            QString attens = "";
-            if (rigCaps.hasAttenuator) {
-                for (quint8 att : rigCaps.attenuators)
-                {
-                    if (att == 0)
-                        continue;
-                    attens.append(QString("%1 ").arg(att,0,16));
-                }
-                if (attens.endsWith(" "))
-                    attens.chop(1);
-            }
-            else {
-                attens = "0";
-            }
-            response.append(attens);
-
-            response.append("0xffffffffffffffff");
-            response.append("0xffffffffffffffff");
-            response.append("0xffffffffffffffff");
-            response.append("0xffffffffffffffff");
-            response.append("0xffffffffffffffff");
-            response.append("0xffffffffffffffff");
-
-            if (chkVfoEecuted) {
-                response.append(QString("vfo_ops=0x%1").arg(255, 0, 16));
-                response.append(QString("ptt_type=0x%1").arg(rigCaps.hasTransmit, 0, 16));
-                response.append(QString("has_set_vfo=0x%1").arg(1, 0, 16));
-                response.append(QString("has_get_vfo=0x%1").arg(1, 0, 16));
-                response.append(QString("has_set_freq=0x%1").arg(1, 0, 16));
-                response.append(QString("has_get_freq=0x%1").arg(1, 0, 16));
-                response.append(QString("has_set_conf=0x%1").arg(1, 0, 16));
-                response.append(QString("has_get_conf=0x%1").arg(1, 0, 16));
-                response.append(QString("has_power2mW=0x%1").arg(1, 0, 16));
-                response.append(QString("has_mW2power=0x%1").arg(1, 0, 16));
-                response.append(QString("timeout=0x%1").arg(1000, 0, 16));
-                response.append("done");
-            }
-        }
+    if (args.count > 1) {
+        addReply("AntCurr: ", getAntName((quint8)args[1].toInt()));
+        addReply("Option: ", "0");
+        addReply("AntTx: ", getAntName(snapshot.getChar(ANTENNA)));
+        addReply("AntRx: ", getAntName(snapshot.getChar(ANTENNA)));
+    }
+    return 0;
+}
 
-        /* Fake command to resolve parsing error */
-        else if (command[0] == "fmv") {
-            QString resp;
+int rigCtlClient::doSetPowerstat(const rigCtlArgs& args)
+{
+    if (args[1] == "0")
+    {
+        setState(POWERONOFF, false);
+    }
+    else {
+        setState(POWERONOFF, true);
+    }
+    return 0;
+}
 
-            if (rigState->getChar(CURRENTVFO) == 0) {
-                resp.append(QString("%1").arg(rigState->getInt64(VFOAFREQ)));
-            }
-            else {
-                resp.append(QString("%1").arg(rigState->getInt64(VFOBFREQ)));
-            }
-            response.append(resp);
-            resp = "";
-            response.append(QString("%1").arg(getMode(rigState->getChar(MODE), rigState->getBool(DATAMODE))));
-            response.append(QString("%1").arg(rigState->getUInt16(PASSBAND)));
+int rigCtlClient::doGetPowerstat(const rigCtlArgs& args)
+{
+    Q_UNUSED(args);
+    addReply("Power Status: ", "1"); // Always reply with ON
+    return 0;
+}
 
-            if (rigState->getChar(CURRENTVFO) == 0) {
-                resp.append("VFOA");
-            }
-            else {
-                resp.append("VFOB");
-            }
-            response.append(resp);
-        }
-        else if (command[0] == "1" || command[0] == "dump_caps")
-        {
-            response.append(QString("Caps dump for model: %1").arg(rigCaps.modelID));
-            response.append(QString("Model Name:\t%1").arg(rigCaps.modelName));
-            response.append(QString("Mfg Name:\tIcom"));
-            response.append(QString("Backend version:\t0.1"));
-            response.append(QString("Backend copyright:\t2021"));
-            if (rigCaps.hasTransmit) {
-                response.append(QString("Rig type:\tTransceiver"));
+int rigCtlClient::doGetInfo(const rigCtlArgs& args)
+{
+    Q_UNUSED(args);
+    addReply("None");
+    return 0;
+}
+
+int rigCtlClient::doGetRigInfo(const rigCtlArgs& args)
+{
+    Q_UNUSED(args);
+    duplexMode split = snapshot.getDuplex(DUPLEX);
+    quint8 rxa = 1;
+    quint8 txa = split == 0;
+    quint8 rxb = !rxa;
+    quint8 txb = split == 1;
+    QByteArray mode = getMode(snapshot.getChar(MODE), snapshot.getBool(DATAMODE));
+    QByteArray width = QByteArray::number(snapshot.getUInt16(PASSBAND));
+
+    QByteArray resp;
+    resp.reserve(256);
+    resp.append("VFO=").append(getVfoName(0)).append(" Freq=").append(QByteArray::number(snapshot.getInt64(VFOAFREQ)))
+        .append(" Mode=").append(mode).append(" Width=").append(width)
+        .append(" RX=").append(QByteArray::number(rxa)).append(" TX=").append(QByteArray::number(txa)).append('\n');
+    resp.append("VFO=").append(getVfoName(1)).append(" Freq=").append(QByteArray::number(snapshot.getInt64(VFOBFREQ)))
+        .append(" Mode=").append(mode).append(" Width=").append(width)
+        .append(" RX=").append(QByteArray::number(rxb)).append(" TX=").append(QByteArray::number(txb)).append('\n');
+    resp.append("Split=").append(QByteArray::number(split)).append(" SatMode=").append(QByteArray::number(snapshot.getChar(SATMODEFUNC))).append('\n');
+    resp.append("Rig=").append(rigCaps.modelName.toLatin1()).append('\n');
+    resp.append("App=wfview\n");
+    resp.append("Version=").append(WFVIEW_VERSION).append('\n');
+    unsigned long crc = doCrc((unsigned char*)resp.data(), resp.length());
+    resp.append("CRC=0x").append(QByteArray::number((qulonglong)crc, 16).rightJustified(8, '0'));
+    addReply(resp);
+    return 0;
+}
+
+int rigCtlClient::doGetVfoInfo(const rigCtlArgs& args)
+{
+    QByteArray mode = getMode(snapshot.getChar(MODE), snapshot.getBool(DATAMODE));
+    if (longReply) {
+        if (args[1] == "?") {
+            if (snapshot.getChar(CURRENTVFO) == 0) {
+                addReply("set_vfo: VFOA");
             }
             else
             {
-                response.append(QString("Rig type:\tReceiver"));
-            }
-            if (rigCaps.hasPTTCommand) {
-                response.append(QString("PTT type:\tRig capable"));
-            }
-            response.append(QString("DCD type:\tRig capable"));
-            response.append(QString("Port type:\tNetwork link"));
-        }
-        else if (command.length() > 0 && (command[0] == "2" || command[0] == "power2mW"))
-        {
-            responseCode = -11; //Unimplemented
-        }
-        else if (command.length() > 0 && (command[0] == "3" || command[0] == "mW2power"))
-        {
-            responseCode = -11; //Unimplemented
-        }
-        else if (command.length() > 0 && (command[0] == "set_clock"))
-        {
-            responseCode = -11; //Unimplemented
-        }
-        else if (command.length() > 0 && (command[0] == "get_clock"))
-        {
-            responseCode = -11; //Unimplemented
-        }
-        else if (command[0] == '\xf0' || command[0] == "chk_vfo")
-        {
-            chkVfoEecuted = true;
-            QString resp;
-            if (longReply) {
-                resp.append(QString("ChkVFO: "));
+                addReply("set_vfo: VFOB");
             }
-            resp.append(QString("%1").arg(rigState->getChar(CURRENTVFO)));
-            response.append(resp);
-        }
-        else if (command.length() > 0 && (command[0] == "set_vfo_opt"))
-        {
-            responseCode = -11; //Unimplemented
         }
-        else if (command.length() > 0 && (command[0] == '\xa2' || command[0] == "set_lock_mode"))
-        {
-            responseCode = -11; //Unimplemented
+        if (args[1] == "VFOB") {
+            addReply("Freq: ", QByteArray::number(snapshot.getInt64(VFOBFREQ)));
         }
-        else if (command.length() > 0 && (command[0] == '\xa3' || command[0] == "get_lock_mode"))
-        {
-            QString resp;
-            if (longReply) {
-                resp.append(QString("Locked: "));
-            }
-            resp.append(QString("%1").arg(0)); // Always reply with RIG_OK (0)
-            response.append(resp);
+        else {
+            addReply("Freq: ", QByteArray::number(snapshot.getInt64(VFOAFREQ)));
         }
+        addReply("Mode: ", mode);
+        addReply("Width: ", QByteArray::number(snapshot.getUInt16(PASSBAND)));
 
-        else if (command.length() > 0 && (command[0] == "w" || command[0] == "send_cmd"))
-        {
-            responseCode = -11; //Unimplemented
+        addReply("Split: ", QByteArray::number(snapshot.getDuplex(DUPLEX)));
+        addReply("SatMode: ", "0"); // Need to get satmode
+    }
+    else {
+        if (args[1] == "VFOB") {
+            addReply(QByteArray::number(snapshot.getInt64(VFOBFREQ)));
         }
         else {
-            qInfo(logRigCtlD()) << "Unimplemented command" << commands;
-        }
-        if (longReply) {
-            if (command.length() == 2)
-                sendData(QString("%1: %2%3").arg(command[0]).arg(command[1]).arg(sep));
-            if (command.length() == 3)
-                sendData(QString("%1: %2 %3%4").arg(command[0]).arg(command[1]).arg(command[2]).arg(sep));
-            if (command.length() == 4)
-                sendData(QString("%1: %2 %3 %4%5").arg(command[0]).arg(command[1]).arg(command[2]).arg(command[3]).arg(sep));
+            addReply(QByteArray::number(snapshot.getInt64(VFOAFREQ)));
         }
+        addReply(mode);
+        addReply(QByteArray::number(snapshot.getUInt16(PASSBAND)));
+    }
+    return 0;
+}
 
-        if (setCommand)
-        {
-            // This was a set command so state has likely been updated.
-            emit parent->stateUpdated();
-        }
+int rigCtlClient::doDumpState(const rigCtlArgs& args)
+{
+    Q_UNUSED(args);
+    addBlock(parent->dumpStateResponse());
+    if (chkVfoEecuted) {
+        addBlock(parent->dumpStateVfoResponse());
+    }
+    return 0;
+}
 
-        if (setCommand || responseCode != 0 || longReply) {
-            if (responseCode == 0) {
-                response.append(QString("RPRT 0"));
-            }
-            else {
-                response.append(QString("RPRT %1").arg(responseCode));
-            }
-        }
+int rigCtlClient::doFmv(const rigCtlArgs& args)
+{
+    Q_UNUSED(args);
+    if (snapshot.getChar(CURRENTVFO) == 0) {
+        addReply(QByteArray::number(snapshot.getInt64(VFOAFREQ)));
+    }
+    else {
+        addReply(QByteArray::number(snapshot.getInt64(VFOBFREQ)));
+    }
+    addReply(getMode(snapshot.getChar(MODE), snapshot.getBool(DATAMODE)));
+    addReply(QByteArray::number(snapshot.getUInt16(PASSBAND)));
 
-        for (QString str : response)
-        {
-            if (str != "")
-                sendData(QString("%1%2").arg(str).arg(sep));
-        }
-        if (sep != "\n") {
-            sendData(QString("\n"));
-        }
+    if (snapshot.getChar(CURRENTVFO) == 0) {
+        addReply("VFOA");
+    }
+    else {
+        addReply("VFOB");
+    }
+    return 0;
+}
+
+int rigCtlClient::doDumpCaps(const rigCtlArgs& args)
+{
+    Q_UNUSED(args);
+    addBlock(parent->dumpCapsResponse());
+    return 0;
+}
+
+int rigCtlClient::doChkVfo(const rigCtlArgs& args)
+{
+    Q_UNUSED(args);
+    chkVfoEecuted = true;
+    addReply("ChkVFO: ", QByteArray::number(snapshot.getChar(CURRENTVFO)));
+    return 0;
+}
+
+int rigCtlClient::doGetLockMode(const rigCtlArgs& args)
+{
+    Q_UNUSED(args);
+    addReply("Locked: ", "0"); // Always reply with RIG_OK (0)
+    return 0;
+}
+
+// \subscribe FREQ MODE PTT STRENGTH [interval_ms]
+// Enables asynchronous "ASYNC ..." lines for the listed items, sent only when
+// the rig state changes. ALL selects everything, NONE clears the set.
+int rigCtlClient::doSubscribe(const rigCtlArgs& args)
+{
+    quint32 events = asyncNone;
+    int interval = asyncInterval;
+    for (int i = 1; i < args.count; i++)
+    {
+        const QByteArray item = args[i].toUpper();
+        bool isNumber = false;
+        int ms = item.toInt(&isNumber);
+        if (isNumber)
+            interval = qMax(RIGCTL_ASYNC_POLL, ms);
+        else if (item == "FREQ")
+            events |= asyncFreq;
+        else if (item == "MODE")
+            events |= asyncMode;
+        else if (item == "PTT")
+            events |= asyncPtt;
+        else if (item == "STRENGTH")
+            events |= asyncStrength;
+        else if (item == "ALL")
+            events |= asyncFreq | asyncMode | asyncPtt | asyncStrength;
+        else if (item == "NONE")
+            events = asyncNone;
+        else
+            return -1;
+    }
+
+    asyncSubscribed = events;
+    asyncInterval = interval;
+    asyncPending = asyncSubscribed; // Send the current values straight away
+    asyncLastPush.invalidate();
+    qInfo(logRigCtlD()) << sessionId << "async subscription" << asyncSubscribed << "interval" << asyncInterval;
+    if (!longReply)
+        addReply("RPRT 0"); // Long replies get RPRT from processCommand()
+    if (asyncPending != asyncNone)
+        asyncTimer->start(0);
+    return 0;
+}
+
+int rigCtlClient::doUnsubscribe(const rigCtlArgs& args)
+{
+    Q_UNUSED(args);
+    asyncSubscribed = asyncNone;
+    asyncPending = asyncNone;
+    asyncTimer->stop();
+    if (!longReply)
+        addReply("RPRT 0"); // Long replies get RPRT from processCommand()
+    return 0;
+}
+
+void rigCtlClient::receiveStateChange(quint32 events)
+{
+    events &= asyncSubscribed;
+    if (events == asyncNone)
+        return;
+
+    asyncPending |= events;
+    if (asyncTimer->isActive())
+        return; // Already scheduled, the pending mask coalesces the changes.
+
+    qint64 wait = 0;
+    if (asyncLastPush.isValid())
+        wait = qMax<qint64>(0, asyncInterval - asyncLastPush.elapsed());
+    asyncTimer->start(int(wait));
+}
 
-        sep = "\n";
-        num = 0;
+void rigCtlClient::pushAsync()
+{
+    if (rigState == Q_NULLPTR || asyncPending == asyncNone)
+        return;
 
+    rigState->snapshot(snapshot);
+
+    // Pushed lines are always newline terminated, independent of the
+    // separator the client last used for a command.
+    if (asyncPending & asyncFreq)
+    {
+        quint64 freq = snapshot.getChar(CURRENTVFO) == 0 ? snapshot.getInt64(VFOAFREQ) : snapshot.getInt64(VFOBFREQ);
+        outBuffer.append("ASYNC Frequency: ");
+        outBuffer.append(QByteArray::number(freq));
+        outBuffer.append('\n');
     }
-    commandBuffer.clear();
+    if (asyncPending & asyncMode)
+    {
+        outBuffer.append("ASYNC Mode: ");
+        outBuffer.append(getMode(snapshot.getChar(MODE), snapshot.getBool(DATAMODE)));
+        outBuffer.append(' ');
+        outBuffer.append(QByteArray::number(snapshot.getUInt16(PASSBAND)));
+        outBuffer.append('\n');
+    }
+    if (asyncPending & asyncPtt)
+    {
+        outBuffer.append("ASYNC PTT: ");
+        outBuffer.append(QByteArray::number(snapshot.getBool(PTT)));
+        outBuffer.append('\n');
+    }
+    if (asyncPending & asyncStrength)
+    {
+        outBuffer.append("ASYNC Level STRENGTH: ");
+        outBuffer.append(QByteArray::number(getStrength()));
+        outBuffer.append('\n');
+    }
+
+    asyncPending = asyncNone;
+    asyncLastPush.start();
+    flushOutput();
 }
 
 void rigCtlClient::socketDisconnected()
@@ -1541,7 +1643,8 @@ void rigCtlClient::socketDisconnected()
 
 void rigCtlClient::closeSocket()
 {
-    socket->close();
+    if (socket != Q_NULLPTR)
+        socket->close();
 }
 
 void rigCtlClient::sendData(QString data)
@@ -1615,9 +1718,9 @@ QString rigCtlClient::getFilter(quint8 mode, quint8 filter) {
     return QString("");
 }
 
-QString rigCtlClient::getMode(quint8 mode, bool datamode) {
+QByteArray rigCtlClient::getMode(quint8 mode, bool datamode) {
 
-    QString ret;
+    QByteArray ret;
 
 
     switch (mode) {
@@ -1668,42 +1771,42 @@ QString rigCtlClient::getMode(quint8 mode, bool datamode) {
     return ret;
 }
 
-quint8 rigCtlClient::getMode(QString modeString) {
+quint8 rigCtlClient::getMode(const QByteArray& modeString) {
 
-    if (modeString == QString("LSB")) {
+    if (modeString == QByteArray("LSB")) {
         return 0;
     }
-    else if (modeString == QString("USB")) {
+    else if (modeString == QByteArray("USB")) {
         return 1;
     }
-    else if (modeString == QString("AM")) {
+    else if (modeString == QByteArray("AM")) {
         return 2;
     }
-    else if (modeString == QString("CW")) {
+    else if (modeString == QByteArray("CW")) {
         return 3;
     }
-    else if (modeString == QString("RTTY")) {
+    else if (modeString == QByteArray("RTTY")) {
         return 4;
     }
-    else if (modeString == QString("FM")) {
+    else if (modeString == QByteArray("FM")) {
         return 5;
     }
-    else if (modeString == QString("WFM")) {
+    else if (modeString == QByteArray("WFM")) {
         return 6;
     }
-    else if (modeString == QString("CWR")) {
+    else if (modeString == QByteArray("CWR")) {
         return 7;
     }
-    else if (modeString == QString("RTTYR")) {
+    else if (modeString == QByteArray("RTTYR")) {
         return 8;
     }
-    else if (modeString == QString("PKTUSB")) {
+    else if (modeString == QByteArray("PKTUSB")) {
         return 1;
     }
-    else if (modeString == QString("PKTLSB")) {
+    else if (modeString == QByteArray("PKTLSB")) {
         return 0;
     }
-    else if (modeString == QString("PKTFM")) {
+    else if (modeString == QByteArray("PKTFM")) {
         return 22;
     }
     else {
@@ -1713,7 +1816,7 @@ quint8 rigCtlClient::getMode(QString modeString) {
 }
 
 
-quint8 rigCtlClient::getAntennas()
+quint8 rigCtlD::getAntennas()
 {
     quint8 ant=0;
     for (quint8 i : rigCaps.antennas)
@@ -1723,7 +1826,7 @@ quint8 rigCtlClient::getAntennas()
     return ant;
 }
 
-quint64 rigCtlClient::getRadioModes(QString md) 
+quint64 rigCtlD::getRadioModes(QString md) 
 {
     quint64 modes = 0;
     for (mode_info mode : rigCaps.modes)
@@ -1753,9 +1856,9 @@ quint64 rigCtlClient::getRadioModes(QString md)
     return modes;
 }
 
-QString rigCtlClient::getAntName(quint8 ant)
+QByteArray rigCtlClient::getAntName(quint8 ant)
 {
-    QString ret;
+    QByteArray ret;
     switch (ant)
     {
         case 0: ret = "ANT1"; break;
@@ -1770,7 +1873,7 @@ QString rigCtlClient::getAntName(quint8 ant)
     return ret;
 }
 
-quint8 rigCtlClient::antFromName(QString name) {
+quint8 rigCtlClient::antFromName(const QByteArray& name) {
     quint8 ret;
 
     if (name.toUpper() == "ANT1")
@@ -1800,9 +1903,9 @@ quint8 rigCtlClient::vfoFromName(QString vfo) {
     return 0;
 }
 
-QString rigCtlClient::getVfoName(quint8 vfo)
+QByteArray rigCtlClient::getVfoName(quint8 vfo)
 {
-    QString ret;
+    QByteArray ret;
     switch (vfo) {
     case 0: ret = "VFOA"; break;
     case 1: ret = "VFOB"; break;
@@ -13,6 +13,10 @@
 #include <QTcpSocket>
 #include <QSet>
 #include <QDataStream>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QMutex>
 
 #include <map>
 #include <vector>
@@ -20,6 +24,7 @@
 
 #include "rigcommander.h"
 #include "rigstate.h"
+#include "rigstateshm.h"
 
 #define CONSTANT_64BIT_FLAG(BIT) (1ull << (BIT))
 
@@ -321,6 +326,19 @@ typedef struct cal_table cal_table_t;
         { 241,  64 } \
     } }
 
+// State groups a client can subscribe to for asynchronous push.
+enum rigCtlAsyncEvent {
+    asyncNone = 0x00,
+    asyncFreq = 0x01,
+    asyncMode = 0x02,
+    asyncPtt = 0x04,
+    asyncStrength = 0x08
+};
+
+#define RIGCTL_ASYNC_POLL 20            // ms between rig state change scans
+#define RIGCTL_ASYNC_DEFAULT_INTERVAL 100  // ms minimum between pushes to one client
+#define RIGCTL_MAX_WORKERS 4            // Session threads
+
 class rigCtlD : public QTcpServer
 {
     Q_OBJECT
@@ -331,6 +349,7 @@ public:
 
     int startServer(qint16 port);
     void stopServer();
+    void enableSharedState(bool enable);
     rigCapabilities rigCaps;
 
 signals:
@@ -345,6 +364,7 @@ signals:
     void setSplit(quint8 split);
     void setDuplexMode(duplexMode dm);
     void stateUpdated();
+    void stateChanged(quint32 events);
     // Power
     void sendPowerOn();
     void sendPowerOff();
@@ -372,11 +392,60 @@ public slots:
     void receiveStateInfo(rigstate* state);
 //    void receiveFrequency(freqt freq);
 
+private slots:
+    void checkStateChanges();
+
+public:
+    // Prebuilt capability responses, newline separated. Safe to call from
+    // the session threads.
+    QByteArray dumpStateResponse();
+    QByteArray dumpStateVfoResponse();
+    QByteArray dumpCapsResponse();
+
 private: 
     rigstate* rigState = Q_NULLPTR;
+    QTimer* changeTimer = Q_NULLPTR;
+    rigStateShm* sharedState = Q_NULLPTR;
+    QVector<QThread*> workers;
+    int nextWorker = 0;
+    QMutex capsMutex;
+
+    void buildCapsResponses();
+    quint8 getAntennas();
+    quint64 getRadioModes(QString mode = "");
+    bool capsResponsesValid = false;
+    QByteArray dumpState;
+    QByteArray dumpStateVfo;
+    QByteArray dumpCaps;
 };
 
 
+class rigCtlClient;
+
+#define RIGCTL_MAX_ARGS 8
+#define RIGCTL_MAX_LINE 4096
+
+// One tokenized command line. Tokens are raw views into the client's input
+// buffer so no copies are made while the command is dispatched.
+struct rigCtlArgs {
+    int count = 0;
+    QByteArray token[RIGCTL_MAX_ARGS];
+    const QByteArray& operator[](int i) const {
+        static const QByteArray empty;
+        return (i < count) ? token[i] : empty;
+    }
+};
+
+// Entry in the command registry. Short names are single bytes, some of
+// them (like hamlib) outside the printable range.
+struct rigCtlCommandDef {
+    const char* name;
+    unsigned char shortName;
+    int minArgs;        // including the command itself
+    bool setCommand;    // Sends RPRT and marks the rig state as updated
+    int (rigCtlClient::*handler)(const rigCtlArgs& args);
+};
+
 class rigCtlClient : public QObject
 {
         Q_OBJECT
@@ -388,33 +457,109 @@ public:
 
 
 public slots:
+    void start();
     void socketReadyRead(); 
     void socketDisconnected();
     void closeSocket();
     void sendData(QString data);
+    void receiveStateChange(quint32 events);
+
+private slots:
+    void pushAsync();
 
 protected:
     int sessionId;
     QTcpSocket* socket = Q_NULLPTR;
-    QString commandBuffer;
+    QByteArray commandBuffer;
 
 private:
+    static const rigCtlCommandDef commandTable[];
+    static const rigCtlCommandDef* findCommand(const QByteArray& name);
+
+    bool processLine(const char* line, int len);
+    bool processCommand(const char* line, int len);
+    void flushOutput();
+    void addReply(const QByteArray& value);
+    void addReply(const char* label, const QByteArray& value);
+    void addBlock(const QByteArray& block);
+    void setState(stateTypes s, quint64 x, bool updated = true);
+    void commitState();
+
+    // Command handlers, return the hamlib RPRT code
+    int doNotImplemented(const rigCtlArgs& args);
+    int doSetFreq(const rigCtlArgs& args);
+    int doGetFreq(const rigCtlArgs& args);
+    int doSetMode(const rigCtlArgs& args);
+    int doGetMode(const rigCtlArgs& args);
+    int doSetVfo(const rigCtlArgs& args);
+    int doGetVfo(const rigCtlArgs& args);
+    int doSetRit(const rigCtlArgs& args);
+    int doGetRit(const rigCtlArgs& args);
+    int doSetXit(const rigCtlArgs& args);
+    int doGetXit(const rigCtlArgs& args);
+    int doSetPtt(const rigCtlArgs& args);
+    int doGetPtt(const rigCtlArgs& args);
+    int doGetDcd(const rigCtlArgs& args);
+    int doSetSplitFreq(const rigCtlArgs& args);
+    int doGetSplitFreq(const rigCtlArgs& args);
+    int doSetSplitMode(const rigCtlArgs& args);
+    int doGetSplitMode(const rigCtlArgs& args);
+    int doSetSplitVfo(const rigCtlArgs& args);
+    int doGetSplitVfo(const rigCtlArgs& args);
+    int doSetFunc(const rigCtlArgs& args);
+    int doGetFunc(const rigCtlArgs& args);
+    int doSetLevel(const rigCtlArgs& args);
+    int doGetLevel(const rigCtlArgs& args);
+    int doSetParm(const rigCtlArgs& args);
+    int doGetParm(const rigCtlArgs& args);
+    int doSetAnt(const rigCtlArgs& args);
+    int doGetAnt(const rigCtlArgs& args);
+    int doSetPowerstat(const rigCtlArgs& args);
+    int doGetPowerstat(const rigCtlArgs& args);
+    int doGetInfo(const rigCtlArgs& args);
+    int doGetRigInfo(const rigCtlArgs& args);
+    int doGetVfoInfo(const rigCtlArgs& args);
+    int doDumpState(const rigCtlArgs& args);
+    int doDumpCaps(const rigCtlArgs& args);
+    int doFmv(const rigCtlArgs& args);
+    int doChkVfo(const rigCtlArgs& args);
+    int doGetLockMode(const rigCtlArgs& args);
+    int doSubscribe(const rigCtlArgs& args);
+    int doUnsubscribe(const rigCtlArgs& args);
+
+    int getStrength();
+
+    // Asynchronous push state, only events in asyncSubscribed are sent and
+    // no more often than asyncInterval ms.
+    quint32 asyncSubscribed = asyncNone;
+    quint32 asyncPending = asyncNone;
+    int asyncInterval = RIGCTL_ASYNC_DEFAULT_INTERVAL;
+    QElapsedTimer asyncLastPush;
+    QTimer* asyncTimer = Q_NULLPTR;
+
+    // Output for the current input batch, written to the socket in one go.
+    QByteArray outBuffer;
+    char sep = '\n';
+    bool longReply = false;
+
     rigCapabilities rigCaps;
+    // Reads go through this copy, refreshed for each input batch. Writes are
+    // queued to the rig thread through rigstate::queueSet().
     rigstate* rigState = Q_NULLPTR;
+    rigStateSnapshot snapshot;
+    bool stateDirty = false;
     rigCtlD* parent;
     bool chkVfoEecuted=false;
     unsigned long crcTable[256];
     unsigned long doCrc(unsigned char* p, size_t n);
     void genCrc(unsigned long crcTable[]);
-    QString getMode(quint8 mode, bool datamode);
-    quint8 getMode(QString modeString);
+    QByteArray getMode(quint8 mode, bool datamode);
+    quint8 getMode(const QByteArray& modeString);
     QString getFilter(quint8 mode, quint8 filter);
-    quint8 getAntennas();
-    quint64 getRadioModes(QString mode = "");
-    QString getAntName(quint8 ant);
-    quint8 antFromName(QString name);
+    QByteArray getAntName(quint8 ant);
+    quint8 antFromName(const QByteArray& name);
     quint8 vfoFromName(QString vfo);
-    QString getVfoName(quint8 vfo);
+    QByteArray getVfoName(quint8 vfo);
 
     int getCalibratedValue(quint8 meter,cal_table_t cal);
 };
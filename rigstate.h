@@ -7,6 +7,8 @@
 #include <QVariant>
 #include <QMap>
 #include <QCache>
+#include <QVector>
+#include <QMutexLocker>
 
 #include "rigcommander.h"
 #include "rigidentities.h"
@@ -21,6 +23,8 @@ enum stateTypes { VFOAFREQ, VFOBFREQ, CURRENTVFO, PTT, MODE, FILTER, PASSBAND, D
                   RESUMEFUNC, TBURSTFUNC, TUNERFUNC, LOCKFUNC, SMETER, POWERMETER, SWRMETER, ALCMETER, COMPMETER, VOLTAGEMETER, CURRENTMETER,
 };
 
+#define NUM_STATE_TYPES (CURRENTMETER + 1)
+
 struct value {
     quint64 _value=0;
     bool _valid = false;
@@ -28,111 +32,196 @@ struct value {
     QDateTime _dateUpdated;
 };
 
+// Plain copy of the state values for readers on other threads, filled by
+// rigstate::snapshot() so the live map is only read under the lock.
+struct rigStateSnapshot {
+    quint64 values[NUM_STATE_TYPES] = {};
+    bool valid[NUM_STATE_TYPES] = {};
+
+    bool getBool(stateTypes s) const { return values[s] != 0; }
+    quint8 getChar(stateTypes s) const { return quint8(values[s]); }
+    qint16 getInt16(stateTypes s) const { return qint16(values[s]); }
+    quint16 getUInt16(stateTypes s) const { return quint16(values[s]); }
+    qint32 getInt32(stateTypes s) const { return qint32(values[s]); }
+    quint32 getUInt32(stateTypes s) const { return quint32(values[s]); }
+    quint64 getInt64(stateTypes s) const { return values[s]; }
+    duplexMode getDuplex(stateTypes s) const { return duplexMode(values[s]); }
+    rigInput getInput(stateTypes s) const { return rigInput(values[s]); }
+};
+
 class rigstate
 {
 
 public:
 
-    void invalidate(stateTypes s) { map[s]._valid = false; }
-    bool isValid(stateTypes s) { return map[s]._valid; }
-    bool isUpdated(stateTypes s) { return map[s]._updated; }
-    QDateTime whenUpdated(stateTypes s) { return map[s]._dateUpdated; }
+    void invalidate(stateTypes s) { QMutexLocker locker(&_mutex); map[s]._valid = false; }
+    bool isValid(stateTypes s) { return map.value(s)._valid; }
+    bool isUpdated(stateTypes s) { return map.value(s)._updated; }
+    QDateTime whenUpdated(stateTypes s) { return map.value(s)._dateUpdated; }
 
     void set(stateTypes s, quint64 x, bool u) {
+        QMutexLocker locker(&_mutex);
+        if (!u)
+            reported[s >> 6] |= (1ull << (s & 63));
         if ((x != (quint64)map[s]._value) && ((!u && !map[s]._updated) || (u))) {
-            _mutex.lock();
             map[s]._value = quint64(x);
             map[s]._valid = true;
             map[s]._updated = u;
             map[s]._dateUpdated = QDateTime::currentDateTime();
-            _mutex.unlock();
+            changed[s >> 6] |= (1ull << (s & 63));
         }
     }
     void set(stateTypes s, qint32 x, bool u) {
+        QMutexLocker locker(&_mutex);
+        if (!u)
+            reported[s >> 6] |= (1ull << (s & 63));
         if ((x != (qint32)map[s]._value) && ((!u && !map[s]._updated) || (u))) {
-            _mutex.lock();
             map[s]._value = quint64(x);
             map[s]._valid = true;
             map[s]._updated = u;
             map[s]._dateUpdated = QDateTime::currentDateTime();
-            _mutex.unlock();
+            changed[s >> 6] |= (1ull << (s & 63));
         }
     }
     void set(stateTypes s, qint16 x, bool u) {
+        QMutexLocker locker(&_mutex);
+        if (!u)
+            reported[s >> 6] |= (1ull << (s & 63));
         if ((x != (qint16)map[s]._value) && ((!u && !map[s]._updated) || (u))) {
-            _mutex.lock();
             map[s]._value = quint64(x);
             map[s]._valid = true;
             map[s]._updated = u;
             map[s]._dateUpdated = QDateTime::currentDateTime();
-            _mutex.unlock();
+            changed[s >> 6] |= (1ull << (s & 63));
         }
     }
     void set(stateTypes s, quint16 x, bool u) {
+        QMutexLocker locker(&_mutex);
+        if (!u)
+            reported[s >> 6] |= (1ull << (s & 63));
         if ((x != (quint16)map[s]._value) && ((!u && !map[s]._updated) || (u))) {
-            _mutex.lock();
             map[s]._value = quint64(x);
             map[s]._valid = true;
             map[s]._updated = u;
             map[s]._dateUpdated = QDateTime::currentDateTime();
-            _mutex.unlock();
+            changed[s >> 6] |= (1ull << (s & 63));
         }
     }
     void set(stateTypes s, quint8 x, bool u) {
+        QMutexLocker locker(&_mutex);
+        if (!u)
+            reported[s >> 6] |= (1ull << (s & 63));
         if ((x != (quint8)map[s]._value) && ((!u && !map[s]._updated) || (u))) {
-            _mutex.lock();
             map[s]._value = quint64(x);
             map[s]._valid = true;
             map[s]._updated = u;
             map[s]._dateUpdated = QDateTime::currentDateTime();
-            _mutex.unlock();
+            changed[s >> 6] |= (1ull << (s & 63));
         }
     }
     void set(stateTypes s, bool x, bool u) {
+        QMutexLocker locker(&_mutex);
+        if (!u)
+            reported[s >> 6] |= (1ull << (s & 63));
         if ((x != (bool)map[s]._value) && ((!u && !map[s]._updated) || (u))) {
-            _mutex.lock();
             map[s]._value = quint64(x);
             map[s]._valid = true;
             map[s]._updated = u;
             map[s]._dateUpdated = QDateTime::currentDateTime();
-            _mutex.unlock();
+            changed[s >> 6] |= (1ull << (s & 63));
         }
     }
     void set(stateTypes s, duplexMode x, bool u) {
+        QMutexLocker locker(&_mutex);
+        if (!u)
+            reported[s >> 6] |= (1ull << (s & 63));
         if ((x != (duplexMode)map[s]._value) && ((!u && !map[s]._updated) || (u))) {
-            _mutex.lock();
             map[s]._value = quint64(x);
             map[s]._valid = true;
             map[s]._updated = u;
             map[s]._dateUpdated = QDateTime::currentDateTime();
-            _mutex.unlock();
+            changed[s >> 6] |= (1ull << (s & 63));
         }
     }
 
     void set(stateTypes s, rigInput x, bool u) {
+        QMutexLocker locker(&_mutex);
+        if (!u)
+            reported[s >> 6] |= (1ull << (s & 63));
         if ((x != map[s]._value) && ((!u && !map[s]._updated) || (u))) {
-            _mutex.lock();
             map[s]._value = quint64(x);
             map[s]._valid = true;
             map[s]._updated = u;
             map[s]._dateUpdated = QDateTime::currentDateTime();
-            _mutex.unlock();
+            changed[s >> 6] |= (1ull << (s & 63));
         }
     }
 
-    bool getBool(stateTypes s) { return map[s]._value != 0; }
-    quint8 getChar(stateTypes s) { return quint8(map[s]._value); }
-    qint16 getInt16(stateTypes s) { return qint16(map[s]._value); }
-    quint16 getUInt16(stateTypes s) { return quint16(map[s]._value); }
-    qint32 getInt32(stateTypes s) { return qint32(map[s]._value); }
-    quint32 getUInt32(stateTypes s) { return quint32(map[s]._value); }
-    quint64 getInt64(stateTypes s) { return map[s]._value; }
-    duplexMode getDuplex(stateTypes s) { return duplexMode(map[s]._value); }
-    rigInput getInput(stateTypes s) { return rigInput(map[s]._value); }
+    bool getBool(stateTypes s) { return map.value(s)._value != 0; }
+    quint8 getChar(stateTypes s) { return quint8(map.value(s)._value); }
+    qint16 getInt16(stateTypes s) { return qint16(map.value(s)._value); }
+    quint16 getUInt16(stateTypes s) { return quint16(map.value(s)._value); }
+    qint32 getInt32(stateTypes s) { return qint32(map.value(s)._value); }
+    quint32 getUInt32(stateTypes s) { return quint32(map.value(s)._value); }
+    quint64 getInt64(stateTypes s) { return map.value(s)._value; }
+    duplexMode getDuplex(stateTypes s) { return duplexMode(map.value(s)._value); }
+    rigInput getInput(stateTypes s) { return rigInput(map.value(s)._value); }
     QMap<stateTypes, value> map;
 
+    // Returns a bit per stateTypes value (s >> 6 selects the word) for every
+    // value that set() has changed since the last call, and clears them.
+    void takeChanges(quint64 out[2]) {
+        _mutex.lock();
+        out[0] = changed[0];
+        out[1] = changed[1];
+        changed[0] = 0;
+        changed[1] = 0;
+        _mutex.unlock();
+    }
+    // Same layout, but set for every value the rig reported (u == false)
+    // whether or not it changed.
+    void takeReported(quint64 out[2]) {
+        _mutex.lock();
+        out[0] = reported[0];
+        out[1] = reported[1];
+        reported[0] = 0;
+        reported[1] = 0;
+        _mutex.unlock();
+    }
+    static bool isChanged(const quint64 bits[2], stateTypes s) { return (bits[s >> 6] >> (s & 63)) & 1; }
+
+    void snapshot(rigStateSnapshot& out) {
+        QMutexLocker locker(&_mutex);
+        for (auto i = map.cbegin(); i != map.cend(); ++i) {
+            out.values[i.key()] = i.value()._value;
+            out.valid[i.key()] = i.value()._valid;
+        }
+    }
+
+    // Writers on other threads queue their changes, the owner of the state
+    // (rigCommander) applies them in order with applyQueued().
+    void queueSet(stateTypes s, quint64 x, bool u) {
+        QMutexLocker locker(&_mutex);
+        queued.append(queuedSet{ s, x, u });
+    }
+    void applyQueued() {
+        QVector<queuedSet> pending;
+        _mutex.lock();
+        pending.swap(queued);
+        _mutex.unlock();
+        for (const queuedSet& q : pending)
+            set(q.s, q.x, q.u);
+    }
 
 private:
+    struct queuedSet {
+        stateTypes s;
+        quint64 x;
+        bool u;
+    };
+    QVector<queuedSet> queued;
+    quint64 changed[2] = { 0, 0 };
+    quint64 reported[2] = { 0, 0 };
     //std::map<stateTypes, std::unique_ptr<valueBase> > values;
     QMutex _mutex;
 };
@@ -0,0 +1,172 @@
+#include "rigstateshm.h"
+#include "logcategories.h"
+
+#include <cstring>
+#include <QCoreApplication>
+#include <QDateTime>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <signal.h>
+#include <errno.h>
+#endif
+
+rigStateShm::rigStateShm(QObject* parent) :
+    QObject(parent)
+{
+    shm.setKey(RIGSHM_KEY);
+}
+
+rigStateShm::~rigStateShm()
+{
+    stop();
+}
+
+bool rigStateShm::start()
+{
+    if (layout != Q_NULLPTR)
+        return true;
+
+    quint32 pid = quint32(QCoreApplication::applicationPid());
+    if (!shm.create(sizeof(rigShmLayout)))
+    {
+        if (shm.error() != QSharedMemory::AlreadyExists || !shm.attach())
+        {
+            qInfo(logRigCtlD()) << "could not create shared memory state:" << shm.errorString();
+            return false;
+        }
+        if (shm.size() < (int)sizeof(rigShmLayout))
+        {
+            qInfo(logRigCtlD()) << "existing shared memory state is too small:" << shm.size();
+            shm.detach();
+            return false;
+        }
+
+        // Only take it over if it was left behind by an instance that has gone.
+        shm.lock();
+        const rigShmLayout* existing = static_cast<const rigShmLayout*>(shm.constData());
+        quint32 owner = existing->magic == RIGSHM_MAGIC ? existing->owner : 0;
+        if (owner != 0 && owner != pid && processAlive(owner))
+        {
+            shm.unlock();
+            shm.detach();
+            qInfo(logRigCtlD()) << "shared memory state is in use by another wfview, process" << owner;
+            return false;
+        }
+        shm.unlock();
+        qInfo(logRigCtlD()) << "reusing existing shared memory state";
+    }
+
+    shm.lock();
+    layout = static_cast<rigShmLayout*>(shm.data());
+    memset(static_cast<void*>(layout), 0, sizeof(rigShmLayout));
+    layout->magic = RIGSHM_MAGIC;
+    layout->owner = pid;
+    layout->version = RIGSHM_VERSION;
+    layout->size = sizeof(rigShmLayout);
+    layout->numStates = NUM_STATE_TYPES;
+    for (quint32 i = 0; i < RIGSHM_RING_SIZE; i++)
+        layout->ring[i].sequence.store(i, std::memory_order_relaxed);
+    layout->ringHead.store(0, std::memory_order_relaxed);
+    layout->ringTail.store(0, std::memory_order_relaxed);
+    layout->sequence.store(0, std::memory_order_release);
+    shm.unlock();
+
+    published = false;
+
+    qInfo(logRigCtlD()) << "shared memory state started, key" << RIGSHM_KEY << "size" << sizeof(rigShmLayout);
+    return true;
+}
+
+void rigStateShm::stop()
+{
+    if (layout != Q_NULLPTR)
+    {
+        shm.lock();
+        layout->magic = 0; // Tell readers the data is no longer maintained.
+        layout->owner = 0;
+        shm.unlock();
+        layout = Q_NULLPTR;
+        shm.detach();
+        qInfo(logRigCtlD()) << "shared memory state stopped";
+    }
+}
+
+void rigStateShm::process(bool changed)
+{
+    if (layout == Q_NULLPTR || rigState == Q_NULLPTR)
+        return;
+
+    if (readCommands())
+        emit stateUpdated();
+    if (changed || !published)
+        publish();
+}
+
+bool rigStateShm::processAlive(quint32 pid)
+{
+#ifdef Q_OS_WIN
+    HANDLE process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, DWORD(pid));
+    if (process == NULL)
+        return GetLastError() == ERROR_ACCESS_DENIED;
+    DWORD code = 0;
+    bool alive = GetExitCodeProcess(process, &code) && code == STILL_ACTIVE;
+    CloseHandle(process);
+    return alive;
+#else
+    return kill(pid_t(pid), 0) == 0 || errno == EPERM;
+#endif
+}
+
+void rigStateShm::publish()
+{
+    rigStateSnapshot current;
+    rigState->snapshot(current);
+
+    // Nothing to do if no value changed, readers keep their last copy.
+    if (published && memcmp(current.values, last.values, sizeof(current.values)) == 0 &&
+        memcmp(current.valid, last.valid, sizeof(current.valid)) == 0)
+        return;
+
+    quint32 seq = layout->sequence.load(std::memory_order_relaxed);
+    layout->sequence.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    memcpy(layout->values, current.values, sizeof(layout->values));
+    for (int i = 0; i < NUM_STATE_TYPES; i++)
+        layout->valid[i] = current.valid[i] ? 1 : 0;
+    layout->timestamp = QDateTime::currentMSecsSinceEpoch();
+
+    layout->sequence.store(seq + 2, std::memory_order_release);
+
+    last = current;
+    published = true;
+}
+
+bool rigStateShm::readCommands()
+{
+    bool applied = false;
+    quint32 pos = layout->ringTail.load(std::memory_order_relaxed);
+    forever
+    {
+        rigShmCommand& slot = layout->ring[pos & (RIGSHM_RING_SIZE - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != pos + 1)
+            break; // Empty, or the writer hasn't finished filling it.
+
+        if (slot.state < SMETER)
+        {
+            rigState->queueSet(stateTypes(slot.state), slot.value, true);
+            applied = true;
+        }
+        else
+        {
+            qDebug(logRigCtlD()) << "shared memory command for read only state" << slot.state << "ignored";
+        }
+        // Hand the slot back to writers for the next lap of the ring.
+        slot.sequence.store(pos + RIGSHM_RING_SIZE, std::memory_order_release);
+        pos++;
+    }
+    layout->ringTail.store(pos, std::memory_order_release);
+    return applied;
+}
@@ -0,0 +1,96 @@
+#ifndef RIGSTATESHM_H
+#define RIGSTATESHM_H
+
+#include <QObject>
+#include <QSharedMemory>
+
+#include <atomic>
+
+#include "rigstate.h"
+
+// Binary view of the full rig state (including meters) in shared memory, for
+// local consumers that read at a high rate and would otherwise poll rigctld.
+//
+// Readers attach to the QSharedMemory key RIGSHM_KEY, check magic, version
+// and size, then copy the values under the seqlock:
+//
+//   do {
+//       s1 = sequence (acquire);          // retry while odd
+//       copy values[] / valid[]
+//       s2 = sequence (acquire fence first);
+//   } while (s1 != s2 || (s1 & 1));
+//
+// Writers use the command ring, a bounded queue in the style of Vyukov's
+// MPMC queue with wfview as the only consumer. To queue a set:
+//
+//   pos = ringHead; slot = ring[pos % RIGSHM_RING_SIZE];
+//   slot.sequence == pos : CAS ringHead pos -> pos + 1, then fill state and
+//                          value and store slot.sequence = pos + 1 (release)
+//   slot.sequence <  pos : ring is full, try again later
+//   otherwise            : another writer got there first, reload ringHead
+//
+// Commands are applied exactly as a rigctld set command would be. Meter
+// states are read only and ignored.
+//
+// owner holds the process id of the wfview instance maintaining the
+// segment. Another instance only takes the segment over once that process
+// has gone, so only one instance publishes at a time.
+
+#define RIGSHM_KEY "wfview-rigstate"
+#define RIGSHM_MAGIC 0x53564657 // "WFVS"
+#define RIGSHM_VERSION 1
+#define RIGSHM_RING_SIZE 64     // Must be a power of two
+
+struct rigShmCommand {
+    std::atomic<quint32> sequence;
+    quint32 state;              // stateTypes
+    quint64 value;
+};
+
+struct rigShmLayout {
+    quint32 magic;
+    quint32 version;
+    quint32 size;               // sizeof(rigShmLayout)
+    quint32 numStates;          // NUM_STATE_TYPES
+    std::atomic<quint32> sequence;  // Odd while an update is in progress
+    quint32 owner;              // Process id of the instance maintaining it, 0 once stopped
+    qint64 timestamp;           // ms since epoch of the last update
+    quint64 values[NUM_STATE_TYPES];
+    quint8 valid[NUM_STATE_TYPES];
+
+    alignas(64) std::atomic<quint32> ringHead;  // Next slot for writers
+    alignas(64) std::atomic<quint32> ringTail;  // Next slot wfview reads
+    rigShmCommand ring[RIGSHM_RING_SIZE];
+};
+
+class rigStateShm : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit rigStateShm(QObject* parent = nullptr);
+    ~rigStateShm();
+
+    bool start();
+    void stop();
+    void setState(rigstate* state) { rigState = state; }
+    // Called on every rigctld state change scan, changed is true when the
+    // scan found something new to publish.
+    void process(bool changed);
+
+signals:
+    void stateUpdated();
+
+private:
+    void publish();
+    bool readCommands();
+    static bool processAlive(quint32 pid);
+
+    QSharedMemory shm;
+    rigShmLayout* layout = Q_NULLPTR;
+    rigstate* rigState = Q_NULLPTR;
+    rigStateSnapshot last;
+    bool published = false;
+};
+
+#endif // RIGSTATESHM_H
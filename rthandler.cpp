@@ -1,6 +1,7 @@
 #include "rthandler.h"
 
 #include "logcategories.h"
+#include "metrics.h"
 
 #if defined(Q_OS_WIN)
 #include <objbase.h>
@@ -338,6 +339,7 @@ int rtHandler::writeData(void* outputBuffer, void* inputBuffer,
 	Q_UNUSED(status);
 	audioPacket packet;
 	packet.time = QTime::currentTime();
+	packet.stamp = metrics::now();
 	packet.sent = 0;
 	packet.volume = volume;
 	memcpy(&packet.guid, setup.guid, GUIDLEN);
@@ -362,9 +364,13 @@ int rtHandler::writeData(void* outputBuffer, void* inputBuffer,
 
 void rtHandler::convertedOutput(audioPacket packet) 
 {
+	static latencyHistogram* toDevice = metrics::histogram("wfview_audio_rx_to_device_seconds", "Time from receiving an audio packet to writing it to the output device");
+
 	audioMutex.lock();
 	arrayBuffer.append(packet.data);
 	audioMutex.unlock();
+	// Queued for the RtAudio callback, which pulls it out of arrayBuffer.
+	toDevice->recordSinceStamp(packet.stamp);
 	amplitude = packet.amplitudePeak;
 	currentLatency = packet.time.msecsTo(QTime::currentTime()) + (nativeFormat.durationForBytes(audio->getStreamLatency() * nativeFormat.bytesPerFrame()) / 1000);
 	emit haveLevels(getAmplitude(), packet.amplitudeRMS, setup.latency, currentLatency, isUnderrun, isOverrun);
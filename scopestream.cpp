@@ -0,0 +1,323 @@
+#include "scopestream.h"
+#include "logcategories.h"
+
+static inline quint8 bcdToUChar(quint8 in)
+{
+    return (in & 0x0f) + ((in & 0xf0) >> 4) * 10;
+}
+
+void scopeStreamEncoder::setSettings(scopeStreamSettings s)
+{
+    settings = s;
+    held.clear();
+    previous.clear();
+    previousInfo.clear();
+    sinceKeyframe = 0;
+    lastSent.invalidate();
+}
+
+QByteArray scopeStreamEncoder::request(quint8 rigCiv, quint8 ourCiv, scopeStreamSettings s)
+{
+    QByteArray r("\xFE\xFE", 2);
+    r.append((char)rigCiv);
+    r.append((char)ourCiv);
+    r.append((char)SCOPESTREAM_CMD);
+    r.append((char)SCOPESTREAM_REQUEST);
+    r.append((char)qMin((int)s.maxRate, SCOPESTREAM_MAX_ARG));
+    r.append((char)((s.width >> 7) & 0x7f));
+    r.append((char)(s.width & 0x7f));
+    r.append((char)(s.delta ? SCOPESTREAM_FLAG_DELTA : 0x00));
+    r.append((char)0xFD);
+    return r;
+}
+
+bool scopeStreamEncoder::isRequest(const QByteArray& d, scopeStreamSettings& s)
+{
+    if (d.size() != 11 || (quint8)d[0] != 0xFE || (quint8)d[1] != 0xFE ||
+        (quint8)d[4] != SCOPESTREAM_CMD || (quint8)d[5] != SCOPESTREAM_REQUEST)
+    {
+        return false;
+    }
+    s.maxRate = (quint8)d[6];
+    s.width = ((quint8)d[7] << 7) | (quint8)d[8];
+    s.delta = (quint8)d[9] & SCOPESTREAM_FLAG_DELTA;
+    return true;
+}
+
+bool scopeStreamEncoder::encode(const QByteArray& d, QByteArray& out)
+{
+    // Only standalone 27 00 00 (main scope) frames are handled, anything else is sent as is.
+    if (d.size() < 11 || (quint8)d[0] != 0xFE || (quint8)d[1] != 0xFE ||
+        (quint8)d[4] != 0x27 || (quint8)d[5] != 0x00 || (quint8)d[6] != 0x00 ||
+        d.indexOf((char)0xFD) != d.size() - 1)
+    {
+        return false;
+    }
+
+    quint8 seq = bcdToUChar((quint8)d[7]);
+    quint8 max = bcdToUChar((quint8)d[8]);
+
+    if ((max <= 1 || seq == 1) && d.size() < 22)
+        return false;
+
+    out.clear();
+
+    if (max <= 1)
+    {
+        // Single (combined) waterfall packet
+        out = encodeLine(d.left(4), d.mid(9, 12) + d.mid(21, d.size() - 22));
+        return true;
+    }
+
+    // Individual divisions, assemble them into a single line first
+    if (seq == 1)
+    {
+        assembly = d.left(4) + d.mid(9, 12);
+        assemblyNext = 2;
+    }
+    else if (seq == assemblyNext && !assembly.isEmpty())
+    {
+        assembly.append(d.mid(9, d.size() - 10));
+        assemblyNext++;
+        if (seq == max)
+        {
+            out = encodeLine(assembly.left(4), assembly.mid(4));
+            assembly.clear();
+            assemblyNext = 0;
+        }
+    }
+    else
+    {
+        // Lost a division, wait for the next line.
+        assembly.clear();
+        assemblyNext = 0;
+    }
+    return true;
+}
+
+QByteArray scopeStreamEncoder::encodeLine(const QByteArray& prefix, const QByteArray& line)
+{
+    // line is the 12 byte wave information followed by the pixels.
+    QByteArray info = line.left(12);
+    const QByteArray pixels = line.mid(12);
+    const int full = pixels.size();
+
+    if (full == 0)
+        return QByteArray();
+
+    // Max-hold any lines that were dropped by the rate limit.
+    if (held.size() == full)
+    {
+        for (int i = 0; i < full; i++)
+        {
+            if ((quint8)pixels[i] > (quint8)held[i])
+                held[i] = pixels[i];
+        }
+    }
+    else
+    {
+        held = pixels;
+    }
+
+    if (settings.maxRate && lastSent.isValid() && lastSent.elapsed() < (1000 / settings.maxRate))
+    {
+        return QByteArray();
+    }
+    lastSent.start();
+
+    // Decimate (max-hold) to the requested width
+    const int width = (settings.width && settings.width < full) ? settings.width : full;
+    QByteArray dec(width, 0);
+    const quint8* src = reinterpret_cast<const quint8*>(held.constData());
+    for (int j = 0; j < width; j++)
+    {
+        int first = (j * full) / width;
+        int last = ((j + 1) * full) / width;
+        quint8 m = src[first];
+        for (int i = first + 1; i < last; i++)
+        {
+            if (src[i] > m)
+                m = src[i];
+        }
+        dec[j] = (char)qMin((int)m, SCOPESTREAM_MAX_ARG);
+    }
+    held.clear();
+
+    bool delta = settings.delta && previous.size() == width && info == previousInfo &&
+        sinceKeyframe < SCOPESTREAM_KEYFRAME;
+    sinceKeyframe = delta ? sinceKeyframe + 1 : 0;
+
+    QByteArray out = prefix;
+    out.reserve(prefix.size() + 21 + width);
+    out.append((char)SCOPESTREAM_CMD);
+    out.append((char)SCOPESTREAM_DATA);
+    out.append((char)(delta ? SCOPESTREAM_FLAG_DELTA : 0x00));
+    out.append((char)lineNumber);
+    lineNumber = (lineNumber + 1) & 0x7f;
+    out.append((char)((full >> 7) & 0x7f));
+    out.append((char)(full & 0x7f));
+    out.append((char)((width >> 7) & 0x7f));
+    out.append((char)(width & 0x7f));
+    out.append(info);
+
+    const quint8* cur = reinterpret_cast<const quint8*>(dec.constData());
+    const quint8* prev = reinterpret_cast<const quint8*>(previous.constData());
+    int i = 0;
+    while (i < width)
+    {
+        if (delta)
+        {
+            int same = 0;
+            while (i + same < width && same < SCOPESTREAM_MAX_ARG && cur[i + same] == prev[i + same])
+                same++;
+            if (same > 1)
+            {
+                out.append((char)0xE0);
+                out.append((char)same);
+                i += same;
+                continue;
+            }
+            int diff = (int)cur[i] - (int)prev[i];
+            if (diff >= -7 && diff <= 7)
+            {
+                out.append((char)(0xD7 + diff));
+                i++;
+                continue;
+            }
+        }
+
+        int run = 1;
+        while (i + run < width && run < SCOPESTREAM_MAX_ARG && cur[i + run] == cur[i])
+            run++;
+        if (run > 2)
+        {
+            out.append((char)0xE1);
+            out.append((char)cur[i]);
+            out.append((char)run);
+            i += run;
+        }
+        else
+        {
+            out.append((char)cur[i]);
+            i++;
+        }
+    }
+    out.append((char)0xFD);
+
+    previous = dec;
+    previousInfo = info;
+    return out;
+}
+
+bool scopeStreamDecoder::isEncoded(const QByteArray& d)
+{
+    return d.size() >= 25 && (quint8)d[0] == 0xFE && (quint8)d[1] == 0xFE &&
+        (quint8)d[4] == SCOPESTREAM_CMD && (quint8)d[5] == SCOPESTREAM_DATA;
+}
+
+bool scopeStreamDecoder::takeKeyframeRequest()
+{
+    bool wanted = keyframeWanted;
+    keyframeWanted = false;
+    return wanted;
+}
+
+void scopeStreamDecoder::lost()
+{
+    // Only ask once, further lines until the keyframe arrives are just dropped.
+    if (lastLine >= 0)
+        keyframeWanted = true;
+    previous.clear();
+    lastLine = -1;
+}
+
+QByteArray scopeStreamDecoder::decode(const QByteArray& d)
+{
+    if (!isEncoded(d) || (quint8)d[d.size() - 1] != 0xFD)
+        return QByteArray();
+
+    const bool delta = (quint8)d[6] & SCOPESTREAM_FLAG_DELTA;
+    const int line = (quint8)d[7] & 0x7f;
+    const int full = ((quint8)d[8] << 7) | (quint8)d[9];
+    const int width = ((quint8)d[10] << 7) | (quint8)d[11];
+
+    if (lastLine >= 0)
+    {
+        int ahead = (line - lastLine) & 0x7f;
+        if (ahead == 0 || ahead >= 0x40)
+        {
+            return QByteArray(); // Duplicate or late retransmit of a line already passed.
+        }
+        if (delta && ahead != 1)
+        {
+            qDebug(logUdp()) << "Scope stream lost" << ahead - 1 << "lines, waiting for keyframe";
+            lost();
+            return QByteArray();
+        }
+    }
+
+    if (full == 0 || width == 0 || width > full || (delta && (lastLine < 0 || previous.size() != width)))
+    {
+        lost();
+        return QByteArray();
+    }
+
+    QByteArray pixels(width, 0);
+    const quint8* in = reinterpret_cast<const quint8*>(d.constData());
+    const int end = d.size() - 1;
+    int p = 24;
+    int i = 0;
+    while (p < end && i < width)
+    {
+        quint8 t = in[p++];
+        if (t <= SCOPESTREAM_MAX_ARG)
+        {
+            pixels[i++] = (char)t;
+        }
+        else if (t >= 0xD0 && t <= 0xDE && delta)
+        {
+            int v = (int)(quint8)previous[i] + (int)t - 0xD7;
+            if (v < 0 || v > SCOPESTREAM_MAX_ARG)
+                break; // Can't happen with a correct base line.
+            pixels[i++] = (char)v;
+        }
+        else if (t == 0xE0 && delta && p < end)
+        {
+            int n = in[p++];
+            for (int k = 0; k < n && i < width; k++, i++)
+                pixels[i] = previous[i];
+        }
+        else if (t == 0xE1 && p + 1 < end)
+        {
+            char v = (char)in[p++];
+            int n = in[p++];
+            for (int k = 0; k < n && i < width; k++)
+                pixels[i++] = v;
+        }
+        else
+        {
+            qDebug(logUdp()) << "Invalid scope stream token" << t;
+            break;
+        }
+    }
+
+    if (i != width || p != end)
+    {
+        lost();
+        return QByteArray();
+    }
+    previous = pixels;
+    lastLine = line;
+
+    // Rebuild a single (combined) 27 00 00 frame at the full width.
+    QByteArray out = d.left(4);
+    out.reserve(22 + full);
+    out.append("\x27\x00\x00\x01\x01", 5);
+    out.append(d.mid(12, 12));
+    for (int j = 0; j < full; j++)
+    {
+        out.append(pixels.at((j * width) / full));
+    }
+    out.append((char)0xFD);
+    return out;
+}
@@ -0,0 +1,98 @@
+#ifndef SCOPESTREAM_H
+#define SCOPESTREAM_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QDebug>
+
+// Server side scope stream reduction for remote (LAN) clients.
+//
+// A wfview client can ask the server to limit the scope line rate, reduce the
+// number of pixels per line and optionally delta/RLE encode each line against
+// the previous one. The request is a private CI-V command which the server
+// consumes (it is never sent to the rig):
+//
+//   FE FE <rig> <client> 27 F1 <rate> <width hi> <width lo> <flags> FD
+//
+// rate is the maximum number of lines per second (0 = unlimited), width is the
+// number of pixels per line (0 = full width, 7 bits per byte) and flags bit 0
+// enables delta encoding.
+//
+// Reduced lines are sent as:
+//
+//   FE FE <to> <from> 27 F0 <flags> <line> <full hi> <full lo> <enc hi> <enc lo>
+//      <12 byte wave information, as 27 00 00 sequence 1> <payload> FD
+//
+// flags bit 0 = payload is relative to the previous line. line counts the lines
+// sent (7 bits, wrapping), a delta line is only applied if it follows the last
+// line decoded, otherwise the client waits for (and asks for) a keyframe by
+// sending its request again. Payload tokens:
+//   0x00-0xCF        absolute amplitude for the next pixel
+//   0xD0-0xDE        previous line value + (token - 0xD7) for the next pixel
+//   0xE0 n           n pixels unchanged from the previous line
+//   0xE1 v n         n pixels of amplitude v
+// None of the tokens or arguments can be 0xFD/0xFE so framing is preserved.
+//
+// The client decoder expands the line back to full width and rebuilds a normal
+// single (combined) 27 00 00 frame, so rigCommander needs no changes.
+
+#define SCOPESTREAM_CMD 0x27
+#define SCOPESTREAM_DATA 0xF0
+#define SCOPESTREAM_REQUEST 0xF1
+#define SCOPESTREAM_FLAG_DELTA 0x01
+#define SCOPESTREAM_MAX_ARG 0xCF
+#define SCOPESTREAM_KEYFRAME 32 // Send an absolute line at least this often
+
+struct scopeStreamSettings {
+    quint8 maxRate = 0;     // Lines per second, 0 = unlimited
+    quint16 width = 0;      // Pixels per line, 0 = full width
+    bool delta = false;
+    bool enabled() const { return maxRate != 0 || width != 0 || delta; }
+};
+
+class scopeStreamEncoder
+{
+public:
+    void setSettings(scopeStreamSettings s);
+    scopeStreamSettings getSettings() { return settings; }
+    bool enabled() { return settings.enabled(); }
+
+    // Returns true if d is a scope frame that has been consumed by the encoder,
+    // out will then contain the frame to send (empty if this line is dropped).
+    bool encode(const QByteArray& d, QByteArray& out);
+
+    static QByteArray request(quint8 rigCiv, quint8 ourCiv, scopeStreamSettings s);
+    static bool isRequest(const QByteArray& d, scopeStreamSettings& s);
+
+private:
+    QByteArray encodeLine(const QByteArray& prefix, const QByteArray& line);
+
+    scopeStreamSettings settings;
+    QElapsedTimer lastSent;
+    QByteArray held;        // Max-hold of lines dropped by the rate limit
+    QByteArray previous;    // Last line sent, decimated
+    QByteArray previousInfo;
+    QByteArray assembly;    // Combined line being assembled from divisions
+    quint8 assemblyNext = 0;
+    int sinceKeyframe = 0;
+    quint8 lineNumber = 0;  // Not reset by setSettings so a client can't mistake a new line for an old one
+};
+
+class scopeStreamDecoder
+{
+public:
+    static bool isEncoded(const QByteArray& d);
+    // Returns a combined 27 00 00 frame or an empty array if the line can't be decoded.
+    QByteArray decode(const QByteArray& d);
+    // True once after a line was lost, the request should then be sent again to get a keyframe.
+    bool takeKeyframeRequest();
+
+private:
+    void lost();
+
+    QByteArray previous;
+    int lastLine = -1;      // Number of the line in previous, -1 while waiting for a keyframe
+    bool keyframeWanted = false;
+};
+
+#endif // SCOPESTREAM_H
@@ -3,6 +3,7 @@
 #include "commhandler.h"
 #include "rigidentities.h"
 #include "logcategories.h"
+#include "tracerecorder.h"
 #include <iostream>
 
 // This code is copyright 2017-2020 Elliott H. Liggett
@@ -334,6 +335,7 @@ void servermain::receiveFoundRigID(rigCapabilities rigCaps)
 void servermain::receivePortError(errorType err)
 {
     qInfo(logSystem()) << "servermain: received error for device: " << err.device << " with message: " << err.message;
+    traceRecorder::dump(QString("%1: %2").arg(err.device).arg(err.message));
 }
 
 
@@ -405,7 +407,6 @@ void servermain::setServerToPrefs()
 
             if (radio->rig != Q_NULLPTR) {
                 connect(radio->rig, SIGNAL(haveAudioData(audioPacket)), udp, SLOT(receiveAudioData(audioPacket)));
-                connect(radio->rig, SIGNAL(haveDataForServer(QByteArray)), udp, SLOT(dataForServer(QByteArray)));
                 //connect(udp, SIGNAL(haveDataFromServer(QByteArray)), radio->rig, SLOT(dataFromServer(QByteArray)));
                 connect(this, SIGNAL(sendRigCaps(rigCapabilities)), udp, SLOT(receiveRigCaps(rigCapabilities)));
             }
@@ -429,6 +430,7 @@ void servermain::setDefPrefs()
     defPrefs.serialPortBaud = 115200;
     defPrefs.localAFgain = 255;
     defPrefs.tcpPort = 0;
+    defPrefs.metricsPort = 0;
     defPrefs.audioSystem = qtAudio;
     defPrefs.rxAudio.name = QString("default");
     defPrefs.txAudio.name = QString("default");
@@ -554,6 +556,12 @@ void servermain::loadSettings()
     serverConfig.controlPort = settings->value("ServerControlPort", 50001).toInt();
     serverConfig.civPort = settings->value("ServerCivPort", 50002).toInt();
     serverConfig.audioPort = settings->value("ServerAudioPort", 50003).toInt();
+    prefs.metricsPort = settings->value("MetricsPort", defPrefs.metricsPort).toInt();
+    if (prefs.metricsPort > 0 && metricsHttp == Q_NULLPTR)
+    {
+        metricsHttp = new metricsServer(this);
+        metricsHttp->startServer(prefs.metricsPort);
+    }
 
     serverConfig.users.clear();
 
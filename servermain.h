@@ -24,6 +24,7 @@
 
 #include "udpserver.h"
 #include "rigctld.h"
+#include "metricsserver.h"
 #include "signal.h"
 
 #include <qserialportinfo.h>
@@ -250,6 +251,7 @@ private:
         rigCapabilities rigCaps;
         bool haveRigCaps = false;
         quint16 tcpPort;
+        quint16 metricsPort;
         audioType audioSystem;
     } prefs;
 
@@ -280,6 +282,7 @@ private:
 
     udpServer* udp = Q_NULLPTR;
     rigCtlD* rigCtl = Q_NULLPTR;
+    metricsServer* metricsHttp = Q_NULLPTR;
     QThread* serverThread = Q_NULLPTR;
 
     rigstate* rigState = Q_NULLPTR;
@@ -0,0 +1,321 @@
+#include "spectrumrecorder.h"
+#include "logcategories.h"
+#include "metrics.h"
+
+#include <string.h>
+#include <algorithm>
+
+spectrumRecorder::spectrumRecorder(QObject* parent) :
+    QObject(parent)
+{
+}
+
+spectrumRecorder::~spectrumRecorder()
+{
+    stopRecording();
+}
+
+bool spectrumRecorder::startRecording(QString filename, quint16 length)
+{
+    if (recording)
+        stopRecording();
+
+    file.setFileName(filename);
+    if (!file.open(QIODevice::ReadWrite | QIODevice::Truncate))
+    {
+        qWarning(logSystem()) << "Spectrum recorder unable to open" << filename << file.errorString();
+        return false;
+    }
+
+    lineLength = length;
+    recordSize = (sizeof(spectrumRecord) + lineLength + 7) & ~7;
+    lineCount = 0;
+    chunkFirst = 0;
+
+    if (!file.resize(sizeof(spectrumFileHeader)))
+    {
+        qWarning(logSystem()) << "Spectrum recorder unable to size" << filename << file.errorString();
+        file.close();
+        return false;
+    }
+
+    header = file.map(0, sizeof(spectrumFileHeader));
+    if (header == Q_NULLPTR)
+    {
+        qWarning(logSystem()) << "Spectrum recorder unable to map" << filename << file.errorString();
+        file.close();
+        return false;
+    }
+
+    spectrumFileHeader* h = reinterpret_cast<spectrumFileHeader*>(header);
+    memset(h, 0, sizeof(spectrumFileHeader));
+    memcpy(h->magic, SPECTRUM_FILE_MAGIC, sizeof(h->magic));
+    h->version = SPECTRUM_FILE_VERSION;
+    h->lineLength = lineLength;
+    h->recordSize = recordSize;
+
+    if (!mapChunk())
+    {
+        file.unmap(header);
+        header = Q_NULLPTR;
+        file.close();
+        return false;
+    }
+
+    recording = true;
+    qInfo(logSystem()) << "Spectrum recording started:" << filename;
+    return true;
+}
+
+bool spectrumRecorder::mapChunk()
+{
+    // Grow the file by one chunk and map it, the previous chunk (if any) is
+    // unmapped so that its pages can be written back and released by the OS.
+    if (chunk != Q_NULLPTR)
+    {
+        file.unmap(chunk);
+        chunk = Q_NULLPTR;
+    }
+
+    chunkFirst = lineCount;
+    qint64 offset = sizeof(spectrumFileHeader) + (qint64)chunkFirst * recordSize;
+    qint64 size = (qint64)SPECTRUM_CHUNK_RECORDS * recordSize;
+
+    if (!file.resize(offset + size))
+    {
+        qWarning(logSystem()) << "Spectrum recorder unable to grow" << file.fileName() << file.errorString();
+        return false;
+    }
+
+    chunk = file.map(offset, size);
+    if (chunk == Q_NULLPTR)
+    {
+        qWarning(logSystem()) << "Spectrum recorder unable to map" << file.fileName() << file.errorString();
+        return false;
+    }
+    return true;
+}
+
+void spectrumRecorder::stopRecording()
+{
+    if (!recording)
+        return;
+
+    recording = false;
+
+    if (chunk != Q_NULLPTR)
+    {
+        file.unmap(chunk);
+        chunk = Q_NULLPTR;
+    }
+    if (header != Q_NULLPTR)
+    {
+        file.unmap(header);
+        header = Q_NULLPTR;
+    }
+
+    // Remove unused space at the end of the last chunk
+    file.resize(sizeof(spectrumFileHeader) + (qint64)lineCount * recordSize);
+    file.close();
+    qInfo(logSystem()) << "Spectrum recording stopped:" << file.fileName() << "lines:" << lineCount;
+}
+
+void spectrumRecorder::addLine(QByteArray spectrum, double startFreq, double endFreq)
+{
+    if (!recording)
+        return;
+
+    if (lineCount - chunkFirst >= SPECTRUM_CHUNK_RECORDS && !mapChunk())
+    {
+        QString reason = file.errorString();
+        stopRecording();
+        emit recordingFailed(reason);
+        return;
+    }
+
+    spectrumRecord* r = reinterpret_cast<spectrumRecord*>(chunk + (lineCount - chunkFirst) * recordSize);
+    r->timestamp = QDateTime::currentMSecsSinceEpoch();
+    r->startFreq = startFreq;
+    r->endFreq = endFreq;
+    r->length = (quint16)qMin(spectrum.length(), (int)lineLength);
+    memcpy(reinterpret_cast<uchar*>(r) + sizeof(spectrumRecord), spectrum.constData(), r->length);
+
+    spectrumFileHeader* h = reinterpret_cast<spectrumFileHeader*>(header);
+    if (lineCount == 0)
+        h->startTime = r->timestamp;
+    lineCount++;
+    // Header count is only updated once the record is complete
+    h->lineCount = lineCount;
+}
+
+
+spectrumReplay::spectrumReplay(QObject* parent) :
+    QObject(parent)
+{
+    timer.setSingleShot(true);
+    timer.setTimerType(Qt::PreciseTimer);
+    connect(&timer, SIGNAL(timeout()), this, SLOT(sendNext()));
+}
+
+spectrumReplay::~spectrumReplay()
+{
+    close();
+}
+
+bool spectrumReplay::open(QString filename)
+{
+    close();
+
+    file.setFileName(filename);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        qWarning(logSystem()) << "Spectrum replay unable to open" << filename << file.errorString();
+        return false;
+    }
+
+    if (file.size() < (qint64)sizeof(spectrumFileHeader))
+    {
+        qWarning(logSystem()) << "Spectrum replay file too short" << filename;
+        file.close();
+        return false;
+    }
+
+    dataSize = file.size();
+    data = file.map(0, dataSize);
+    if (data == Q_NULLPTR)
+    {
+        qWarning(logSystem()) << "Spectrum replay unable to map" << filename << file.errorString();
+        file.close();
+        return false;
+    }
+
+    const spectrumFileHeader* h = reinterpret_cast<const spectrumFileHeader*>(data);
+    if (memcmp(h->magic, SPECTRUM_FILE_MAGIC, sizeof(h->magic)) || h->version != SPECTRUM_FILE_VERSION ||
+        h->recordSize < sizeof(spectrumRecord) + h->lineLength)
+    {
+        qWarning(logSystem()) << "Spectrum replay invalid file" << filename;
+        close();
+        return false;
+    }
+
+    recordSize = h->recordSize;
+    lineLength = h->lineLength;
+    // A recording that was not stopped cleanly may be longer than the header says, or
+    // (if the last chunk could not be written) shorter; trust whichever is smaller.
+    lineCount = qMin(h->lineCount, (quint64)((file.size() - sizeof(spectrumFileHeader)) / recordSize));
+    position = 0;
+
+    qInfo(logSystem()) << "Spectrum replay opened:" << filename << "lines:" << lineCount;
+    return true;
+}
+
+void spectrumReplay::close()
+{
+    pause();
+    if (data != Q_NULLPTR)
+    {
+        file.unmap(data);
+        data = Q_NULLPTR;
+    }
+    if (file.isOpen())
+        file.close();
+    dataSize = 0;
+    lineCount = 0;
+    position = 0;
+}
+
+const spectrumRecord* spectrumReplay::record(quint64 index)
+{
+    return reinterpret_cast<const spectrumRecord*>(data + sizeof(spectrumFileHeader) + index * recordSize);
+}
+
+QDateTime spectrumReplay::startTime()
+{
+    if (!lineCount)
+        return QDateTime();
+    return QDateTime::fromMSecsSinceEpoch(record(0)->timestamp);
+}
+
+QDateTime spectrumReplay::endTime()
+{
+    if (!lineCount)
+        return QDateTime();
+    return QDateTime::fromMSecsSinceEpoch(record(lineCount - 1)->timestamp);
+}
+
+void spectrumReplay::setSpeed(double s)
+{
+    if (s > 0.0)
+        speed = s;
+}
+
+void spectrumReplay::seek(QDateTime time)
+{
+    if (!lineCount)
+        return;
+
+    // Records are in timestamp order, so binary search for the first line at or after time.
+    qint64 target = time.toMSecsSinceEpoch();
+    quint64 low = 0;
+    quint64 high = lineCount;
+    while (low < high)
+    {
+        quint64 mid = low + (high - low) / 2;
+        if (record(mid)->timestamp < target)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    position = qMin(low, lineCount - 1);
+}
+
+void spectrumReplay::play()
+{
+    if (data == Q_NULLPTR || !lineCount)
+        return;
+    if (position >= lineCount)
+        position = 0;
+    playing = true;
+    timer.start(0);
+}
+
+void spectrumReplay::pause()
+{
+    playing = false;
+    timer.stop();
+}
+
+void spectrumReplay::sendNext()
+{
+    if (!playing)
+        return;
+
+    if (position >= lineCount)
+    {
+        playing = false;
+        emit finished();
+        return;
+    }
+
+    const spectrumRecord* r = record(position);
+    const uchar* line = reinterpret_cast<const uchar*>(r) + sizeof(spectrumRecord);
+    if (r->length > lineLength || line + r->length > data + dataSize)
+    {
+        // Corrupt record, don't read past it (or the end of the file).
+        qWarning(logSystem()) << "Spectrum replay bad record" << position << "length" << r->length << "max" << lineLength;
+        playing = false;
+        emit replayFailed(QString("Bad record %1 in %2").arg(position).arg(file.fileName()));
+        return;
+    }
+    QByteArray spectrum(reinterpret_cast<const char*>(line), r->length);
+    emit haveSpectrumData(spectrum, r->startFreq, r->endFreq, metrics::now());
+    position++;
+
+    if (position < lineCount)
+    {
+        qint64 delay = record(position)->timestamp - r->timestamp;
+        timer.start(qBound((qint64)0, (qint64)(delay / speed), (qint64)5000));
+    } else {
+        timer.start(0);
+    }
+}
@@ -0,0 +1,123 @@
+#ifndef SPECTRUMRECORDER_H
+#define SPECTRUMRECORDER_H
+
+#include <QObject>
+#include <QFile>
+#include <QTimer>
+#include <QDateTime>
+#include <QByteArray>
+#include <QDebug>
+
+// Waterfall history recorder and replay.
+//
+// Every assembled spectrum line is appended to a file as a fixed size record
+// (timestamp, start/end frequency, raw amplitude bytes). The file is grown in
+// chunks which are memory mapped while being written, so hours of waterfall can
+// be captured at full line rate without growing the process heap.
+//
+// As records are fixed size and timestamps only ever increase, the record array
+// itself is the time index: seeking to a time is a binary search over it.
+
+#define SPECTRUM_FILE_MAGIC "WFVSPEC1"
+#define SPECTRUM_FILE_VERSION 1
+#define SPECTRUM_CHUNK_RECORDS 1024
+
+#pragma pack(push, 1)
+struct spectrumFileHeader {
+    char magic[8];
+    quint32 version;
+    quint32 lineLength;     // Maximum number of amplitude bytes per line
+    quint32 recordSize;     // Size of each record including padding
+    quint32 reserved;
+    quint64 lineCount;      // Number of valid records, updated on every line
+    qint64 startTime;       // ms since epoch of first line
+    char unused[24];
+};
+
+struct spectrumRecord {
+    qint64 timestamp;       // ms since epoch
+    double startFreq;       // MHz
+    double endFreq;         // MHz
+    quint16 length;         // Number of valid bytes in data
+    quint8 pad[6];
+    // followed by lineLength bytes of data, padded to 8 bytes
+};
+#pragma pack(pop)
+
+class spectrumRecorder : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit spectrumRecorder(QObject* parent = nullptr);
+    ~spectrumRecorder();
+
+    bool startRecording(QString filename, quint16 lineLength);
+    void stopRecording();
+    bool isRecording() { return recording; }
+    QString fileName() { return file.fileName(); }
+    quint64 lines() { return lineCount; }
+
+signals:
+    void recordingFailed(QString reason);
+
+public slots:
+    void addLine(QByteArray spectrum, double startFreq, double endFreq);
+
+private:
+    bool mapChunk();
+    QFile file;
+    bool recording = false;
+    quint32 recordSize = 0;
+    quint16 lineLength = 0;
+    quint64 lineCount = 0;
+    quint64 chunkFirst = 0;   // First record number in the mapped chunk
+    uchar* header = Q_NULLPTR;
+    uchar* chunk = Q_NULLPTR;
+};
+
+class spectrumReplay : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit spectrumReplay(QObject* parent = nullptr);
+    ~spectrumReplay();
+
+    bool open(QString filename);
+    void close();
+    bool isOpen() { return data != Q_NULLPTR; }
+    bool isPlaying() { return playing; }
+    quint64 lines() { return lineCount; }
+    QDateTime startTime();
+    QDateTime endTime();
+
+signals:
+    void haveSpectrumData(QByteArray spectrum, double startFreq, double endFreq, qint64 stamp);
+    void finished();
+    void replayFailed(QString reason);
+
+public slots:
+    void play();
+    void pause();
+    void setSpeed(double s);
+    void seek(QDateTime time);
+
+private slots:
+    void sendNext();
+
+private:
+    const spectrumRecord* record(quint64 index);
+    QFile file;
+    QTimer timer;
+    uchar* data = Q_NULLPTR;
+    qint64 dataSize = 0;
+    quint32 recordSize = 0;
+    quint32 lineLength = 0;
+    quint64 lineCount = 0;
+    quint64 position = 0;
+    double speed = 1.0;
+    bool playing = false;
+};
+
+#endif // SPECTRUMRECORDER_H
@@ -0,0 +1,452 @@
+#include "spectrumwidget.h"
+
+#include <cmath>
+#include <algorithm>
+
+// Composite src over dst, both treated as straight (non premultiplied) colors.
+static inline QRgb blendOver(QRgb dst, QRgb src)
+{
+    int a = qAlpha(src);
+    if (a == 255)
+        return src;
+    if (a == 0)
+        return dst;
+    int r = (qRed(src) * a + qRed(dst) * (255 - a)) / 255;
+    int g = (qGreen(src) * a + qGreen(dst) * (255 - a)) / 255;
+    int b = (qBlue(src) * a + qBlue(dst) * (255 - a)) / 255;
+    return qRgb(r, g, b);
+}
+
+spectrumWidget::spectrumWidget(QWidget *parent) : QWidget(parent)
+{
+    // Everything inside plotRect is painted from the image, no need for Qt to clear it first.
+    setAttribute(Qt::WA_OpaquePaintEvent);
+    setMinimumHeight(60);
+
+    backgroundColor = QColor(Qt::black);
+    gridColor = QColor(Qt::darkGray);
+    axisColor = QColor(Qt::gray);
+    textColor = QColor(Qt::white);
+    lineColor = QColor(Qt::yellow);
+    fillColor = QColor(Qt::transparent);
+    underlayLineColor = QColor(20+200/4.0*1,70*(1.6-1/4.0), 150, 150).lighter(200);
+    underlayFillColor = QColor(20+200/4.0*1,70*(1.6-1/4.0), 150, 150);
+    tuningColor = QColor(Qt::blue);
+    passbandColor = QColor(255, 0, 0, 64);
+    pbtColor = QColor(255, 0, 0, 64);
+    spotColor = QColor(Qt::red);
+
+    for (int i = 0; i < 256; i++)
+        levelY[i] = 0;
+}
+
+void spectrumWidget::setColors(QColor background, QColor grid, QColor axis, QColor text,
+                               QColor line, QColor fill, QColor underlayLine, QColor underlayFill,
+                               QColor tuning, QColor passband, QColor pbt, QColor spots)
+{
+    backgroundColor = background;
+    gridColor = grid;
+    axisColor = axis;
+    textColor = text;
+    lineColor = line;
+    fillColor = fill;
+    underlayLineColor = underlayLine;
+    underlayFillColor = underlayFill;
+    tuningColor = tuning;
+    passbandColor = passband;
+    pbtColor = pbt;
+    spotColor = spots;
+    dirty = true;
+    update();
+}
+
+void spectrumWidget::setFrequencyRange(double start, double end)
+{
+    if (start == startFreq && end == endFreq)
+        return;
+    startFreq = start;
+    endFreq = end;
+    update();
+}
+
+void spectrumWidget::setLevelRange(int floor, int ceiling)
+{
+    if (floor == levelFloor && ceiling == levelCeiling)
+        return;
+    levelFloor = floor;
+    levelCeiling = ceiling;
+    buildLevelMap();
+    dirty = true;
+    update();
+}
+
+void spectrumWidget::setTrace(const QByteArray &line)
+{
+    trace = line;
+    if (trace.length() != mappedLength)
+        buildColumnMap();
+    dirty = true;
+    update();
+}
+
+void spectrumWidget::setUnderlay(const QByteArray &line)
+{
+    underlay = line;
+    dirty = true;
+    update();
+}
+
+void spectrumWidget::setUnderlay(const QVector<double> &line)
+{
+    underlay.resize(line.size());
+    char *out = underlay.data();
+    for (int i = 0; i < line.size(); i++)
+    {
+        out[i] = (char)(unsigned char)qBound(0.0, line.at(i), 255.0);
+    }
+    dirty = true;
+    update();
+}
+
+void spectrumWidget::clearUnderlay()
+{
+    if (underlay.isEmpty())
+        return;
+    underlay.clear();
+    dirty = true;
+    update();
+}
+
+void spectrumWidget::setTuning(double freq)
+{
+    tuningFreq = freq;
+}
+
+void spectrumWidget::setPassband(double start, double end)
+{
+    passbandStart = start;
+    passbandEnd = end;
+}
+
+void spectrumWidget::setPbt(double start, double end, bool visible)
+{
+    pbtStart = start;
+    pbtEnd = end;
+    pbtVisible = visible;
+}
+
+void spectrumWidget::setSpots(const QList<spectrumLabel> &spots)
+{
+    // drawSpots() stacks labels left to right, so keep them in frequency order.
+    this->spots = spots;
+    std::sort(this->spots.begin(), this->spots.end(),
+              [](const spectrumLabel &a, const spectrumLabel &b) { return a.frequency < b.frequency; });
+    update();
+}
+
+double spectrumWidget::pixelToFrequency(int x) const
+{
+    if (plotRect.width() < 2)
+        return startFreq;
+    return startFreq + (endFreq - startFreq) * (x - plotRect.left()) / (double)(plotRect.width() - 1);
+}
+
+int spectrumWidget::frequencyToPixel(double freq) const
+{
+    if (endFreq <= startFreq)
+        return plotRect.left();
+    return plotRect.left() + (int)std::lround((freq - startFreq) * (plotRect.width() - 1) / (endFreq - startFreq));
+}
+
+void spectrumWidget::resizeEvent(QResizeEvent *)
+{
+    layoutPlot();
+}
+
+void spectrumWidget::layoutPlot()
+{
+    QFontMetrics fm(font());
+    leftMargin = fm.boundingRect("-000").width() + 6;
+    bottomMargin = fm.height() + 4;
+    plotRect = QRect(leftMargin, 0, qMax(1, width() - leftMargin), qMax(1, height() - bottomMargin));
+
+    image = QImage(plotRect.size(), QImage::Format_RGB32);
+    buildColumnMap();
+    buildLevelMap();
+    dirty = true;
+}
+
+void spectrumWidget::buildColumnMap()
+{
+    // Each pixel column covers a contiguous run of bins, at least one. With fewer
+    // bins than columns neighbouring columns simply share a bin.
+    int columns = image.width();
+    mappedLength = trace.length();
+    binStart.resize(columns);
+    binEnd.resize(columns);
+    traceTop.resize(columns);
+    traceBottom.resize(columns);
+    underlayTop.resize(columns);
+    underlayBottom.resize(columns);
+
+    if (mappedLength == 0)
+        return;
+
+    for (int col = 0; col < columns; col++)
+    {
+        int start = (int)((qint64)col * mappedLength / columns);
+        int end = (int)((qint64)(col + 1) * mappedLength / columns);
+        binStart[col] = qMin(start, mappedLength - 1);
+        binEnd[col] = qMax(end, binStart[col] + 1);
+    }
+}
+
+void spectrumWidget::buildLevelMap()
+{
+    int h = image.height();
+    double span = qMax(1, levelCeiling - levelFloor);
+    for (int v = 0; v < 256; v++)
+    {
+        int y = (h - 1) - (int)std::lround((v - levelFloor) * (h - 1) / span);
+        levelY[v] = qBound(0, y, h);
+    }
+}
+
+void spectrumWidget::reduceColumns(const QByteArray &line, QVector<int> &top, QVector<int> &bottom)
+{
+    // Min/max of every column's bins. The inner loop is branch free so the
+    // compiler can vectorise it for the wide (many bins per pixel) case.
+    const unsigned char *d = reinterpret_cast<const unsigned char *>(line.constData());
+    int columns = top.size();
+    for (int col = 0; col < columns; col++)
+    {
+        unsigned char lo = 255;
+        unsigned char hi = 0;
+        const int end = binEnd[col];
+        for (int i = binStart[col]; i < end; i++)
+        {
+            lo = qMin(lo, d[i]);
+            hi = qMax(hi, d[i]);
+        }
+        top[col] = levelY[hi];
+        bottom[col] = levelY[lo];
+    }
+}
+
+void spectrumWidget::drawSpan(int col, int top, int bottom, QRgb color)
+{
+    int h = image.height();
+    top = qMax(0, top);
+    bottom = qMin(h - 1, bottom);
+    uchar *bits = image.bits();
+    const int stride = image.bytesPerLine();
+    for (int y = top; y <= bottom; y++)
+    {
+        QRgb *px = reinterpret_cast<QRgb *>(bits + y * stride) + col;
+        *px = blendOver(*px, color);
+    }
+}
+
+void spectrumWidget::rasterize()
+{
+    dirty = false;
+    const int columns = image.width();
+    const int rows = image.height();
+    const bool haveTrace = !trace.isEmpty() && trace.length() == mappedLength;
+    const bool haveUnderlay = haveTrace && underlay.length() == trace.length();
+
+    if (haveTrace)
+        reduceColumns(trace, traceTop, traceBottom);
+    else
+        traceTop.fill(rows);
+
+    if (haveUnderlay)
+        reduceColumns(underlay, underlayTop, underlayBottom);
+    else
+        underlayTop.fill(rows);
+
+    // Fill pass, one lookup per pixel: bit 1 = under the trace, bit 0 = under the underlay.
+    const QRgb bg = backgroundColor.rgb();
+    const QRgb ulFill = blendOver(bg, underlayFillColor.rgba());
+    const QRgb palette[4] = {
+        bg,
+        ulFill,
+        blendOver(bg, fillColor.rgba()),
+        blendOver(ulFill, fillColor.rgba())
+    };
+    const int *tt = traceTop.constData();
+    const int *ut = underlayTop.constData();
+    for (int y = 0; y < rows; y++)
+    {
+        QRgb *row = reinterpret_cast<QRgb *>(image.scanLine(y));
+        for (int col = 0; col < columns; col++)
+        {
+            row[col] = palette[((y >= tt[col]) << 1) | (y >= ut[col])];
+        }
+    }
+
+    // Line pass: each column draws its min..max span, stretched to meet the
+    // previous column so that steep edges stay connected.
+    if (haveUnderlay)
+    {
+        const QRgb c = underlayLineColor.rgba();
+        for (int col = 0; col < columns; col++)
+        {
+            int prev = col > 0 ? col - 1 : 0;
+            drawSpan(col, qMin(underlayTop[col], underlayBottom[prev]),
+                     qMax(underlayBottom[col], underlayTop[prev]), c);
+        }
+    }
+    if (haveTrace)
+    {
+        const QRgb c = lineColor.rgba();
+        for (int col = 0; col < columns; col++)
+        {
+            int prev = col > 0 ? col - 1 : 0;
+            drawSpan(col, qMin(traceTop[col], traceBottom[prev]),
+                     qMax(traceBottom[col], traceTop[prev]), c);
+        }
+    }
+}
+
+void spectrumWidget::paintEvent(QPaintEvent *)
+{
+    if (image.isNull())
+        layoutPlot();
+    if (dirty)
+        rasterize();
+
+    QPainter painter(this);
+    painter.fillRect(rect(), backgroundColor);
+    painter.drawImage(plotRect.topLeft(), image);
+
+    painter.setClipRect(plotRect);
+
+    if (passbandEnd > passbandStart)
+    {
+        int l = frequencyToPixel(passbandStart);
+        int r = frequencyToPixel(passbandEnd);
+        painter.fillRect(QRect(l, plotRect.top(), qMax(1, r - l), plotRect.height()), passbandColor);
+    }
+    if (pbtVisible && pbtEnd > pbtStart)
+    {
+        int l = frequencyToPixel(pbtStart);
+        int r = frequencyToPixel(pbtEnd);
+        painter.fillRect(QRect(l, plotRect.top(), qMax(1, r - l), plotRect.height()), pbtColor);
+    }
+    if (tuningFreq > startFreq && tuningFreq < endFreq)
+    {
+        int x = frequencyToPixel(tuningFreq);
+        painter.setPen(tuningColor);
+        painter.drawLine(x, plotRect.top(), x, plotRect.bottom());
+    }
+
+    drawSpots(&painter);
+
+    painter.setClipping(false);
+    drawFrequencyAxis(&painter);
+    drawLevelAxis(&painter);
+}
+
+void spectrumWidget::drawFrequencyAxis(QPainter *qp)
+{
+    double span = endFreq - startFreq;
+    if (span <= 0.0)
+        return;
+
+    // Aim for a tick every ~100 pixels, rounded to 1, 2 or 5 x 10^n MHz.
+    double raw = span * 100.0 / qMax(1, plotRect.width());
+    double mag = std::pow(10.0, std::floor(std::log10(raw)));
+    double step = mag;
+    if (raw / mag > 5.0)
+        step = 10.0 * mag;
+    else if (raw / mag > 2.0)
+        step = 5.0 * mag;
+    else if (raw / mag > 1.0)
+        step = 2.0 * mag;
+
+    int decimals = qBound(0, (int)std::ceil(-std::log10(step)), 6);
+    QFontMetrics fm(qp->font());
+    int y = plotRect.bottom();
+
+    qp->setPen(axisColor);
+    qp->drawLine(plotRect.left(), y, plotRect.right(), y);
+
+    for (double f = std::ceil(startFreq / step) * step; f <= endFreq; f += step)
+    {
+        int x = frequencyToPixel(f);
+        qp->setPen(gridColor);
+        qp->drawLine(x, plotRect.top(), x, y);
+        qp->setPen(axisColor);
+        qp->drawLine(x, y, x, y + 3);
+        QString label = QString::number(f, 'f', decimals);
+        qp->setPen(textColor);
+        qp->drawText(x - fm.boundingRect(label).width() / 2, y + 3 + fm.ascent(), label);
+    }
+}
+
+void spectrumWidget::drawLevelAxis(QPainter *qp)
+{
+    QFontMetrics fm(qp->font());
+    int x = plotRect.left();
+    qp->setPen(axisColor);
+    qp->drawLine(x, plotRect.top(), x, plotRect.bottom());
+
+    int span = levelCeiling - levelFloor;
+    if (span <= 0)
+        return;
+    int step = span > 100 ? 50 : (span > 40 ? 20 : 10);
+    for (int v = (levelFloor / step) * step; v <= levelCeiling; v += step)
+    {
+        if (v < levelFloor)
+            continue;
+        int y = plotRect.top() + (plotRect.height() - 1) - (v - levelFloor) * (plotRect.height() - 1) / span;
+        qp->setPen(gridColor);
+        qp->drawLine(x, y, plotRect.right(), y);
+        QString label = QString::number(v);
+        qp->setPen(textColor);
+        qp->drawText(x - 3 - fm.boundingRect(label).width(), y + fm.ascent() / 2, label);
+    }
+}
+
+void spectrumWidget::drawSpots(QPainter *qp)
+{
+    if (spots.isEmpty())
+        return;
+
+    // Greedy stacking: each label goes into the first row it does not overlap.
+    QFontMetrics fm(qp->font());
+    int rowHeight = fm.height();
+    int maxRows = qMax(1, plotRect.height() / rowHeight - 1);
+    QVector<int> rowEnd;
+    qp->setPen(spotColor);
+    for (const spectrumLabel &s : spots)
+    {
+        if (s.frequency < startFreq || s.frequency > endFreq)
+            continue;
+        int w = fm.boundingRect(s.text).width();
+        int left = frequencyToPixel(s.frequency) - w / 2;
+        int row = 0;
+        while (row < rowEnd.size() && rowEnd[row] > left)
+            row++;
+        if (row >= maxRows)
+            continue;
+        if (row == rowEnd.size())
+            rowEnd.append(0);
+        rowEnd[row] = left + w + 4;
+        qp->drawText(left, plotRect.top() + (row + 1) * rowHeight, s.text);
+    }
+}
+
+void spectrumWidget::mouseDoubleClickEvent(QMouseEvent *me)
+{
+    if (me->button() == Qt::LeftButton && plotRect.contains(me->pos()))
+    {
+        emit frequencyDoubleClicked(pixelToFrequency(me->pos().x()));
+    }
+}
+
+void spectrumWidget::wheelEvent(QWheelEvent *we)
+{
+    emit mouseWheel(we);
+}
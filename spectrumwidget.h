@@ -0,0 +1,120 @@
+#ifndef SPECTRUMWIDGET_H
+#define SPECTRUMWIDGET_H
+
+#include <QWidget>
+#include <QPainter>
+#include <QImage>
+#include <QVector>
+#include <QList>
+#include <QByteArray>
+#include <QMouseEvent>
+#include <QWheelEvent>
+#include <QResizeEvent>
+
+// Software rendered spectrum display. The trace and underlay are rasterized
+// straight into a QImage, only the overlays (passband, PBT, tuning line,
+// grid and cluster spots) go through QPainter. Needs no OpenGL, so it is
+// cheap on VNC/remote desktops where QCustomPlot is slow to replot.
+
+struct spectrumLabel {
+    double frequency;
+    QString text;
+};
+
+class spectrumWidget : public QWidget
+{
+    Q_OBJECT
+public:
+    explicit spectrumWidget(QWidget *parent = nullptr);
+
+    void setColors(QColor background, QColor grid, QColor axis, QColor text,
+                   QColor line, QColor fill, QColor underlayLine, QColor underlayFill,
+                   QColor tuning, QColor passband, QColor pbt, QColor spots);
+    void setFrequencyRange(double start, double end);
+    void setLevelRange(int floor, int ceiling);
+    void setTrace(const QByteArray &line);
+    void setUnderlay(const QByteArray &line);
+    void setUnderlay(const QVector<double> &line);
+    void clearUnderlay();
+    void setTuning(double freq);
+    void setPassband(double start, double end);
+    void setPbt(double start, double end, bool visible);
+    void setSpots(const QList<spectrumLabel> &spots);
+
+    double pixelToFrequency(int x) const;
+    int frequencyToPixel(double freq) const;
+
+signals:
+    void frequencyDoubleClicked(double freq);
+    void mouseWheel(QWheelEvent *we);
+
+protected:
+    void paintEvent(QPaintEvent *);
+    void resizeEvent(QResizeEvent *);
+    void mouseDoubleClickEvent(QMouseEvent *me);
+    void wheelEvent(QWheelEvent *we);
+
+private:
+    void layoutPlot();
+    void buildColumnMap();
+    void buildLevelMap();
+    void reduceColumns(const QByteArray &line, QVector<int> &top, QVector<int> &bottom);
+    void drawSpan(int col, int top, int bottom, QRgb color);
+    void rasterize();
+    void drawFrequencyAxis(QPainter *qp);
+    void drawLevelAxis(QPainter *qp);
+    void drawSpots(QPainter *qp);
+
+    QImage image;
+    QRect plotRect;
+    bool dirty = true;
+
+    QByteArray trace;
+    QByteArray underlay;
+
+    // Precomputed mapping of each pixel column to the bins it covers
+    QVector<int> binStart;
+    QVector<int> binEnd;
+    int mappedLength = 0;
+
+    // Pixel row for every possible amplitude byte
+    int levelY[256];
+
+    // Per column results from reduceColumns()
+    QVector<int> traceTop;
+    QVector<int> traceBottom;
+    QVector<int> underlayTop;
+    QVector<int> underlayBottom;
+
+    double startFreq = 0.0;
+    double endFreq = 1.0;
+    int levelFloor = 0;
+    int levelCeiling = 160;
+
+    double tuningFreq = 0.0;
+    double passbandStart = 0.0;
+    double passbandEnd = 0.0;
+    double pbtStart = 0.0;
+    double pbtEnd = 0.0;
+    bool pbtVisible = false;
+
+    QList<spectrumLabel> spots;
+
+    QColor backgroundColor;
+    QColor gridColor;
+    QColor axisColor;
+    QColor textColor;
+    QColor lineColor;
+    QColor fillColor;
+    QColor underlayLineColor;
+    QColor underlayFillColor;
+    QColor tuningColor;
+    QColor passbandColor;
+    QColor pbtColor;
+    QColor spotColor;
+
+    int leftMargin = 30;
+    int bottomMargin = 18;
+};
+
+#endif // SPECTRUMWIDGET_H
@@ -0,0 +1,121 @@
+#include "spotoverlay.h"
+
+spotOverlay::spotOverlay(QCustomPlot* plot, QObject* parent) :
+    QObject(parent),
+    plot(plot),
+    color(Qt::red)
+{
+    // Zoom, span and floor/ceiling changes all move the labels.
+    connect(plot->xAxis, SIGNAL(rangeChanged(QCPRange)), this, SLOT(layout()));
+    connect(plot->yAxis, SIGNAL(rangeChanged(QCPRange)), this, SLOT(layout()));
+}
+
+spotOverlay::~spotOverlay()
+{
+    // The items themselves belong to the plot.
+    labels.clear();
+    pool.clear();
+}
+
+QCPItemText* spotOverlay::add(double frequency, const QString& text)
+{
+    QCPItemText* item;
+    if (!pool.isEmpty())
+    {
+        item = pool.takeLast();
+    }
+    else
+    {
+        item = new QCPItemText(plot);
+        item->setAntialiased(true);
+        item->setPositionAlignment(Qt::AlignVCenter | Qt::AlignHCenter);
+        item->position->setType(QCPItemPosition::ptPlotCoords);
+    }
+    item->setSelectable(true);
+    item->setColor(color);
+    item->setFont(font);
+    item->setText(text);
+    item->position->setCoords(frequency, top); // remove() finds the label by its key
+    item->setVisible(false); // Shown by layout() once it has a row.
+
+    label l;
+    l.item = item;
+    l.width = QFontMetrics(font).boundingRect(text).width();
+    labels.insert(frequency, l);
+    return item;
+}
+
+void spotOverlay::remove(QCPItemText* item)
+{
+    if (item == Q_NULLPTR)
+        return;
+
+    double frequency = item->position->key();
+    QMultiMap<double, label>::iterator it = labels.find(frequency);
+    while (it != labels.end() && it.key() == frequency)
+    {
+        if (it.value().item == item)
+        {
+            labels.erase(it);
+            break;
+        }
+        ++it;
+    }
+    // Hidden items are still hit by QCustomPlot::itemAt(), keep clicks off them.
+    item->setVisible(false);
+    item->setSelected(false);
+    item->setSelectable(false);
+    pool.append(item);
+}
+
+void spotOverlay::setColor(QColor color)
+{
+    this->color = color;
+    for (const label& l : labels)
+    {
+        l.item->setColor(color);
+    }
+}
+
+void spotOverlay::setFont(QFont font)
+{
+    this->font = font;
+    QFontMetrics fm(font);
+    for (label& l : labels)
+    {
+        l.item->setFont(font);
+        l.width = fm.boundingRect(l.item->text()).width();
+        l.row = -1;
+    }
+}
+
+void spotOverlay::layout()
+{
+    double newTop = plot->yAxis->range().upper - SPOT_TOP_OFFSET;
+    bool moved = newTop != top;
+    top = newTop;
+
+    // rowEnd holds the right hand pixel of the last label placed in each row.
+    rowEnd.clear();
+    for (QMultiMap<double, label>::iterator it = labels.begin(); it != labels.end(); ++it)
+    {
+        label& l = it.value();
+        double x = plot->xAxis->coordToPixel(it.key());
+        double left = x - l.width / 2.0;
+
+        int row = 0;
+        while (row < rowEnd.size() && rowEnd[row] + SPOT_LABEL_GAP > left)
+            row++;
+        if (row == rowEnd.size())
+            rowEnd.append(0.0);
+        rowEnd[row] = x + l.width / 2.0;
+
+        if (row != l.row || moved)
+        {
+            l.item->position->setCoords(it.key(), top - row * SPOT_ROW_STEP);
+            l.row = row;
+        }
+        if (!l.item->visible())
+            l.item->setVisible(true);
+    }
+}
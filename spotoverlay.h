@@ -0,0 +1,57 @@
+#ifndef SPOTOVERLAY_H
+#define SPOTOVERLAY_H
+
+#include <QObject>
+#include <QMultiMap>
+#include <QVector>
+#include <QList>
+#include <QFont>
+#include <QColor>
+
+#include <qcustomplot.h>
+
+// Cluster spot labels on the spectrum plot. Labels are laid out in rows by
+// a single sweep over the spots in frequency order, each label going into
+// the first row with room for it, so there is no hit testing against the
+// other plot items. Only labels whose row actually changes are moved and
+// removed labels are hidden and kept for reuse. The labels are laid out
+// again whenever either axis range of the plot changes.
+
+#define SPOT_LABEL_GAP 4           // Pixels between labels in the same row
+#define SPOT_ROW_STEP 5.0          // Plot units between rows
+#define SPOT_TOP_OFFSET 15.0       // Plot units from the top of the plot to the first row
+
+class spotOverlay : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit spotOverlay(QCustomPlot* plot, QObject* parent = nullptr);
+    ~spotOverlay();
+
+    QCPItemText* add(double frequency, const QString& text);
+    void remove(QCPItemText* item);
+    void setColor(QColor color);
+    void setFont(QFont font);
+
+public slots:
+    // Places the labels, call once after a batch of add()/remove().
+    void layout();
+
+private:
+    struct label {
+        QCPItemText* item;
+        int width;
+        int row = -1;
+    };
+
+    QCustomPlot* plot;
+    QMultiMap<double, label> labels;
+    QList<QCPItemText*> pool;
+    QVector<double> rowEnd;
+    double top = 0.0;
+    QColor color;
+    QFont font;
+};
+
+#endif // SPOTOVERLAY_H
@@ -28,9 +28,15 @@ int tcpServer::startServer(qint16 port) {
 void tcpServer::incomingConnection(qintptr socket) {
     tcpServerClient* client = new tcpServerClient(socket, this);
     connect(this, SIGNAL(onStopped()), client, SLOT(closeSocket()));
+    clients.append(client);
     emit newClient(socket); // Signal par
 }
 
+void tcpServer::removeClient(tcpServerClient* client)
+{
+    clients.removeAll(client);
+}
+
 void tcpServer::stopServer()
 {
     qInfo(logTcpServer()) << "stopping server";
@@ -43,10 +49,103 @@ void tcpServer::receiveDataFromClient(QByteArray data)
     emit receiveData(data);
 }
 
+QList<QByteArray> tcpServer::takeFrames(QByteArray& buffer)
+{
+    QList<QByteArray> frames;
+    int start = 0;
+    forever
+    {
+        int fd = buffer.indexOf((char)0xfd, start);
+        if (fd < 0)
+            break;
+        int fe = buffer.indexOf((char)0xfe, start);
+        if (fe >= 0 && fe < fd)
+            frames.append(buffer.mid(fe, fd - fe + 1));
+        start = fd + 1;
+    }
+    buffer.remove(0, start);
+    if (buffer.size() > TCP_MAX_FRAME)
+    {
+        qInfo(logTcpServer()) << "discarding" << buffer.size() << "bytes without a frame end";
+        buffer.clear();
+    }
+    return frames;
+}
+
+bool tcpServer::isScopeFrame(const QByteArray& frame)
+{
+    int pos = 0;
+    while (pos < frame.size() && (quint8)frame[pos] == 0xfe)
+        pos++;
+    return frame.size() > pos + 3 && (quint8)frame[pos + 2] == 0x27 && (quint8)frame[pos + 3] == 0x00;
+}
+
+QByteArray tcpServer::buildBatch(const QList<QByteArray>& frames, quint8 civId, bool scope)
+{
+    QByteArray batch;
+    for (const QByteArray& frame : frames)
+    {
+        int pos = 0;
+        while (pos < frame.size() && (quint8)frame[pos] == 0xfe)
+            pos++;
+        if (frame.size() < pos + 3)
+            continue;
+        quint8 to = (quint8)frame[pos];
+        quint8 from = (quint8)frame[pos + 1];
+
+        // Same rule as the UDP server: frames for this client, broadcasts and
+        // anything to/from the default controller address.
+        if (civId != 0 && to != civId && from != civId && to != 0x00 && from != 0x00 && to != 0xE1 && from != 0xE1)
+            continue;
+
+        if (!scope && isScopeFrame(frame))
+            continue;
+
+        batch.append(frame);
+    }
+    return batch;
+}
+
 void tcpServer::sendData(QByteArray data) {
 
-    emit sendDataToClient(data);
+    rigBuffer.append(data);
+    QList<QByteArray> frames = takeFrames(rigBuffer);
+    if (frames.isEmpty() || clients.isEmpty())
+        return;
 
+    // Clients with the same address and backlog state share one buffer, the
+    // socket writes only take a reference to it.
+    QHash<quint16, QByteArray> batches;
+    int scopeFrames = -1;
+    for (tcpServerClient* client : clients)
+    {
+        qint64 backlog = client->backlog();
+        if (backlog >= TCP_MAX_BACKLOG)
+        {
+            client->setDropLevel(2);
+            client->countDropped(1, 0);
+            continue;
+        }
+        bool scope = backlog < TCP_SCOPE_BACKLOG;
+        client->setDropLevel(scope ? 0 : 1);
+        if (!scope)
+        {
+            if (scopeFrames < 0)
+            {
+                scopeFrames = 0;
+                for (const QByteArray& frame : frames)
+                    scopeFrames += isScopeFrame(frame) ? 1 : 0;
+            }
+            client->countDropped(0, quint64(scopeFrames));
+        }
+
+        quint16 key = (quint16(client->civId()) << 1) | (scope ? 1 : 0);
+        QHash<quint16, QByteArray>::iterator batch = batches.find(key);
+        if (batch == batches.end())
+            batch = batches.insert(key, buildBatch(frames, client->civId(), scope));
+        if (!batch.value().isEmpty())
+            client->send(batch.value());
+    }
 }
 
 tcpServerClient::tcpServerClient(int socketId, tcpServer* parent) : QObject(parent)
@@ -61,32 +160,88 @@ tcpServerClient::tcpServerClient(int socketId, tcpServer* parent) : QObject(pare
     }
     connect(socket, SIGNAL(readyRead()), this, SLOT(socketReadyRead()), Qt::DirectConnection);
     connect(socket, SIGNAL(disconnected()), this, SLOT(socketDisconnected()), Qt::DirectConnection);
-    connect(parent, SIGNAL(sendDataToClient(QByteArray)), this, SLOT(receiveDataToClient(QByteArray)), Qt::DirectConnection);
     connect(this, SIGNAL(sendDataFromClient(QByteArray)), parent, SLOT(receiveDataFromClient(QByteArray)), Qt::DirectConnection);
     qInfo(logTcpServer()) << " session connected: " << sessionId;
 
 }
 
 void tcpServerClient::socketReadyRead() {
+    if (!socket->bytesAvailable())
+        return;
+
+    inBuffer.append(socket->readAll());
+    QList<QByteArray> frames = tcpServer::takeFrames(inBuffer);
+    if (frames.isEmpty())
+        return;
+
     QByteArray data;
-    if (socket->bytesAvailable()) {
-        data=socket->readAll();
-        emit sendDataFromClient(data);
+    for (const QByteArray& frame : frames)
+    {
+        int pos = 0;
+        while (pos < frame.size() && (quint8)frame[pos] == 0xfe)
+            pos++;
+        // The sender address of the client's own commands tells us which
+        // replies it wants.
+        if (frame.size() > pos + 2)
+        {
+            quint8 from = (quint8)frame[pos + 1];
+            if (from != remoteCivId && from != 0xE1 && from > 0xdf && from < 0xef)
+            {
+                remoteCivId = from;
+                qInfo(logTcpServer()) << sessionId << "detected remote CI-V:" << QString("0x%1").arg(remoteCivId, 0, 16);
+            }
+        }
+        data.append(frame);
     }
+    emit sendDataFromClient(data);
 }
 
 void tcpServerClient::socketDisconnected() {
     qInfo(logTcpServer()) << sessionId << "disconnected";
+    parent->removeClient(this);
     socket->deleteLater();
     this->deleteLater();
 }
 
+qint64 tcpServerClient::backlog() const
+{
+    if (socket == Q_NULLPTR)
+        return 0;
+    return socket->bytesToWrite();
+}
+
+void tcpServerClient::countDropped(quint64 batches, quint64 scopeFrames)
+{
+    droppedBatches += batches;
+    thinnedFrames += scopeFrames;
+}
+
+void tcpServerClient::setDropLevel(int level)
+{
+    if (level == dropLevel)
+        return;
+
+    if (level == 0)
+        qInfo(logTcpServer()) << sessionId << "caught up, dropped" << droppedBatches << "batches and"
+                              << thinnedFrames << "scope frames while slow";
+    else if (level == 1)
+        qInfo(logTcpServer()) << sessionId << "slow client, dropping scope data";
+    else
+        qInfo(logTcpServer()) << sessionId << "slow client, dropping all data";
+    if (level == 0)
+    {
+        droppedBatches = 0;
+        thinnedFrames = 0;
+    }
+    dropLevel = level;
+}
+
 void tcpServerClient::closeSocket()
 {
     socket->close();
 }
 
-void tcpServerClient::receiveDataToClient(QByteArray data) {
+void tcpServerClient::send(const QByteArray& data) {
 
     if (socket != Q_NULLPTR && socket->isValid() && socket->isOpen())
     {
@@ -7,11 +7,19 @@
 #include <QTcpSocket>
 #include <QSet>
 #include <QDataStream>
+#include <QList>
+#include <QHash>
 
 #include <map>
 #include <vector>
 #include <typeindex>
 
+#define TCP_SCOPE_BACKLOG 16384    // Bytes queued for a client before its scope frames are dropped
+#define TCP_MAX_BACKLOG 262144     // Bytes queued before everything for the client is dropped
+#define TCP_MAX_FRAME 4096         // Partial input discarded if no FD is seen within this many bytes
+
+class tcpServerClient;
+
 class tcpServer : public QTcpServer
 {
     Q_OBJECT
@@ -21,6 +29,11 @@ public:
     ~tcpServer();
     int startServer(qint16 port);
     void stopServer();
+    void removeClient(tcpServerClient* client);
+
+    // Splits complete CI-V frames (FE FE ... FD) off the front of buffer, any
+    // partial frame is left in place for the next read.
+    static QList<QByteArray> takeFrames(QByteArray& buffer);
 
 public slots:
     virtual void incomingConnection(qintptr socketDescriptor);
@@ -30,12 +43,16 @@ signals:
     void onStarted();
     void onStopped();
     void receiveData(QByteArray data); // emit this when we have data from tcp client, connect to rigcommander
-    void sendDataToClient(QByteArray data);
     void newClient(int socketId);
 
 private:
+    QByteArray buildBatch(const QList<QByteArray>& frames, quint8 civId, bool scope);
+    static bool isScopeFrame(const QByteArray& frame);
+
     QTcpServer* server;
     QTcpSocket* socket = Q_NULLPTR;
+    QList<tcpServerClient*> clients;
+    QByteArray rigBuffer;
 };
 
 class tcpServerClient : public QObject 
@@ -44,11 +61,16 @@ class tcpServerClient : public QObject
 
 public: 
     explicit tcpServerClient(int socket, tcpServer* parent = Q_NULLPTR);
+    quint8 civId() const { return remoteCivId; }
+    qint64 backlog() const;
+    void send(const QByteArray& data);
+    void setDropLevel(int level);
+    void countDropped(quint64 batches, quint64 scopeFrames);
+
 public slots:
     void socketReadyRead();
     void socketDisconnected();
     void closeSocket();
-    void receiveDataToClient(QByteArray);
 
 signals:
     void sendDataFromClient(QByteArray data);
@@ -58,6 +80,11 @@ protected:
 
 private:
     tcpServer* parent;
+    QByteArray inBuffer;
+    quint8 remoteCivId = 0;     // Learned from the client's own commands, 0 = not known yet
+    int dropLevel = 0;          // 0 none, 1 scope frames, 2 everything
+    quint64 droppedBatches = 0;     // Batches withheld completely (level 2)
+    quint64 thinnedFrames = 0;      // Scope frames left out of batches that were sent (level 1)
 };
 
 #endif
\ No newline at end of file
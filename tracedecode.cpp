@@ -0,0 +1,165 @@
+// Prints the contents of a trace file written by traceRecorder.
+//
+// Usage: tracedecode [-k kind] trace.bin
+//   kind is one of civ, udp, audio, marker and may be repeated.
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QDateTime>
+#include <QTextStream>
+#include <QStringList>
+#include <QSet>
+
+#include <cstring>
+
+#include "tracerecorder.h"
+
+static const char* kindName(quint8 kind)
+{
+    switch (kind)
+    {
+    case traceCivToRig:
+        return "CIV>RIG";
+    case traceCivFromRig:
+        return "CIV<RIG";
+    case traceUdpRx:
+        return "UDP RX ";
+    case traceUdpTx:
+        return "UDP TX ";
+    case traceAudioRx:
+        return "AUD RX ";
+    case traceAudioTx:
+        return "AUD TX ";
+    case traceMarker:
+        return "MARKER ";
+    }
+    return "UNKNOWN";
+}
+
+static QString kindGroup(quint8 kind)
+{
+    switch (kind)
+    {
+    case traceCivToRig:
+    case traceCivFromRig:
+        return "civ";
+    case traceUdpRx:
+    case traceUdpTx:
+        return "udp";
+    case traceAudioRx:
+    case traceAudioTx:
+        return "audio";
+    }
+    return "marker";
+}
+
+static QString hex(const quint8* data, int length)
+{
+    QString out;
+    out.reserve(length * 3);
+    for (int i = 0; i < length; i++)
+    {
+        if (i)
+            out.append(' ');
+        out.append(QString("%1").arg(data[i], 2, 16, QChar('0')).toUpper());
+    }
+    return out;
+}
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication a(argc, argv);
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    QStringList args = a.arguments();
+    QSet<QString> kinds;
+    QString fileName;
+    for (int i = 1; i < args.size(); i++)
+    {
+        if ((args[i] == "-k" || args[i] == "--kind") && i + 1 < args.size())
+            kinds.insert(args[++i].toLower());
+        else
+            fileName = args[i];
+    }
+    if (fileName.isEmpty())
+    {
+        err << "Usage: tracedecode [-k civ|udp|audio|marker] trace.bin\n";
+        return 1;
+    }
+
+    QFile file(fileName);
+    if (!file.open(QFile::ReadOnly))
+    {
+        err << "Unable to open " << fileName << ": " << file.errorString() << "\n";
+        return 1;
+    }
+
+    traceFileHeader header;
+    if (file.read(reinterpret_cast<char*>(&header), sizeof(header)) != qint64(sizeof(header)) ||
+        memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0)
+    {
+        err << fileName << " is not a trace file\n";
+        return 1;
+    }
+    if (header.version != TRACE_VERSION || header.recordSize != sizeof(traceRecord))
+    {
+        err << "Unsupported trace version " << header.version << " record size " << header.recordSize << "\n";
+        return 1;
+    }
+
+    header.reason[sizeof(header.reason) - 1] = 0;
+    QDateTime start = QDateTime::fromMSecsSinceEpoch(header.startMs);
+    out << "Trace started " << start.toString("yyyy-MM-dd hh:mm:ss.zzz") << ", " << header.records
+        << " records, reason: " << header.reason << "\n";
+
+    qint64 lastAudioRx = -1;
+    traceRecord r;
+    while (file.read(reinterpret_cast<char*>(&r), sizeof(r)) == qint64(sizeof(r)))
+    {
+        if (!kinds.isEmpty() && !kinds.contains(kindGroup(r.kind)))
+            continue;
+
+        int stored = qMin(int(r.stored), TRACE_DATA);
+        QDateTime when = start.addMSecs(qint64(r.time / 1000));
+        out << when.toString("hh:mm:ss.zzz") << QString("%1").arg(r.time % 1000, 3, 10, QChar('0'))
+            << " " << kindName(r.kind) << " ";
+
+        switch (r.kind)
+        {
+        case traceUdpRx:
+        case traceUdpTx:
+        {
+            quint32 len = 0;
+            quint16 type = 0;
+            if (stored >= 8)
+            {
+                memcpy(&len, r.data, 4);
+                memcpy(&type, r.data + 4, 2);
+            }
+            out << QString("len=%1 type=0x%2 seq=0x%3").arg(len).arg(type, 2, 16, QChar('0')).arg(r.seq, 4, 16, QChar('0'));
+            break;
+        }
+        case traceAudioRx:
+        case traceAudioTx:
+            out << QString("len=%1 seq=%2").arg(r.length).arg(r.seq);
+            if (r.kind == traceAudioRx)
+            {
+                if (lastAudioRx >= 0 && qint64(r.seq) != lastAudioRx + 1)
+                    out << " GAP " << (qint64(r.seq) - lastAudioRx - 1);
+                lastAudioRx = r.seq;
+            }
+            break;
+        case traceMarker:
+            out << QString::fromUtf8(reinterpret_cast<const char*>(r.data), stored);
+            break;
+        default:
+            out << QString("len=%1 ").arg(r.length) << hex(r.data, stored);
+            if (r.length > stored)
+                out << " ...";
+            break;
+        }
+        out << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,18 @@
+#-------------------------------------------------
+#
+# Offline decoder for wfview/wfserver trace files
+#
+#-------------------------------------------------
+
+QT       += core
+QT       -= gui
+
+TARGET = tracedecode
+TEMPLATE = app
+
+CONFIG += console
+CONFIG -= app_bundle
+
+SOURCES += tracedecode.cpp
+
+HEADERS += tracerecorder.h
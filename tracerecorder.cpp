@@ -0,0 +1,115 @@
+#include "tracerecorder.h"
+
+#include <QFile>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QStandardPaths>
+#include <QCoreApplication>
+#include <QVector>
+
+#include <cstring>
+
+#include "logcategories.h"
+
+traceRecord traceRecorder::ring[TRACE_SLOTS];
+std::atomic<quint64> traceRecorder::committed[TRACE_SLOTS];
+std::atomic<quint64> traceRecorder::next{ 0 };
+std::atomic<bool> traceRecorder::enabled{ true };
+
+struct traceClock {
+    traceClock() : startMs(QDateTime::currentMSecsSinceEpoch()) { timer.start(); }
+    qint64 startMs;
+    QElapsedTimer timer;
+};
+
+static traceClock& recorderClock()
+{
+    static traceClock c;
+    return c;
+}
+
+void traceRecorder::record(traceKind kind, const char* data, int length, quint32 seq)
+{
+    if (!enabled.load(std::memory_order_relaxed))
+        return;
+
+    quint64 index = next.fetch_add(1, std::memory_order_relaxed);
+    quint32 slot = index & (TRACE_SLOTS - 1);
+
+    // Mark the slot as being written so a dump in progress skips it.
+    committed[slot].store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    traceRecord& r = ring[slot];
+    r.time = quint64(recorderClock().timer.nsecsElapsed() / 1000);
+    r.seq = seq;
+    r.length = quint16(qMin(length, 0xffff));
+    r.kind = kind;
+    r.stored = quint8(qMin(length, TRACE_DATA));
+    memcpy(r.data, data, r.stored);
+
+    committed[slot].store(index + 1, std::memory_order_release);
+}
+
+void traceRecorder::marker(const QString& text)
+{
+    QByteArray utf8 = text.toUtf8();
+    record(traceMarker, utf8.constData(), utf8.size());
+}
+
+bool traceRecorder::dump(const QString& fileName, const QString& reason)
+{
+    marker(reason);
+
+    quint64 end = next.load(std::memory_order_acquire);
+    quint64 begin = end > TRACE_SLOTS ? end - TRACE_SLOTS : 0;
+
+    QVector<traceRecord> records;
+    records.reserve(int(end - begin));
+    for (quint64 i = begin; i < end; i++)
+    {
+        quint32 slot = i & (TRACE_SLOTS - 1);
+        if (committed[slot].load(std::memory_order_acquire) != i + 1)
+            continue; // Still being written or already overwritten.
+        traceRecord r = ring[slot];
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (committed[slot].load(std::memory_order_relaxed) != i + 1)
+            continue;
+        records.append(r);
+    }
+
+    QFile file(fileName);
+    if (!file.open(QFile::WriteOnly | QFile::Truncate))
+    {
+        qWarning(logSystem()) << "Unable to write trace file" << fileName << file.errorString();
+        return false;
+    }
+
+    traceFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.recordSize = sizeof(traceRecord);
+    header.startMs = recorderClock().startMs;
+    header.records = quint64(records.size());
+    QByteArray why = reason.toUtf8().left(sizeof(header.reason) - 1);
+    memcpy(header.reason, why.constData(), size_t(why.size()));
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(records.constData()), qint64(records.size()) * qint64(sizeof(traceRecord)));
+    file.close();
+
+    qInfo(logSystem()) << "Wrote" << records.size() << "trace records to" << fileName << "reason:" << reason;
+    return true;
+}
+
+QString traceRecorder::dump(const QString& reason)
+{
+    QString fileName = QString("%1/%2-trace-%3.bin")
+        .arg(QStandardPaths::standardLocations(QStandardPaths::TempLocation)[0])
+        .arg(QCoreApplication::applicationName())
+        .arg(QDateTime::currentDateTime().toString("yyyyMMddhhmmsszzz"));
+    if (!dump(fileName, reason))
+        return QString();
+    return fileName;
+}
@@ -0,0 +1,73 @@
+#ifndef TRACERECORDER_H
+#define TRACERECORDER_H
+
+#include <QtGlobal>
+#include <QString>
+
+#include <atomic>
+
+// Always-on flight recorder for protocol traffic. CI-V frames, UDP packet
+// headers and audio sequence numbers are copied into a fixed ring of 64 byte
+// records in memory, which costs one atomic increment and a small copy per
+// packet. The ring is only written to disk when something asks for it (an
+// error, the dump shortcut or 't' on the wfserver console), and the file
+// is decoded offline with tracedecode.
+//
+// The file is a traceFileHeader followed by its records, oldest first, in
+// the byte order of the machine that wrote it.
+
+#define TRACE_SLOTS 8192           // Records kept, power of two
+#define TRACE_DATA 48              // Bytes of each packet kept in a record
+#define TRACE_MAGIC "WFTRACE1"
+#define TRACE_VERSION 1
+
+enum traceKind : quint8 {
+    traceCivToRig = 0,    // CI-V frame sent to the rig
+    traceCivFromRig,      // CI-V frame received from the rig
+    traceUdpRx,           // UDP packet header received
+    traceUdpTx,           // UDP packet header sent
+    traceAudioRx,         // Audio packet received, seq is the extended sequence
+    traceAudioTx,         // Audio packet sent
+    traceMarker           // Text, for example the reason of a dump
+};
+
+struct traceRecord {
+    quint64 time;         // us since the recorder started
+    quint32 seq;          // Packet sequence number where there is one
+    quint16 length;       // Original length of the packet
+    quint8 kind;          // traceKind
+    quint8 stored;        // Bytes of data that are valid
+    quint8 data[TRACE_DATA];
+};
+
+struct traceFileHeader {
+    char magic[8];        // TRACE_MAGIC
+    quint32 version;      // TRACE_VERSION
+    quint32 recordSize;   // sizeof(traceRecord)
+    qint64 startMs;       // ms since epoch when the recorder started
+    quint64 records;      // Records following the header
+    char reason[64];      // Why the dump was made, null terminated
+};
+
+class traceRecorder
+{
+public:
+    static void record(traceKind kind, const char* data, int length, quint32 seq = 0);
+    static void marker(const QString& text);
+
+    // Writes the ring to fileName, returns false if the file can't be written.
+    static bool dump(const QString& fileName, const QString& reason);
+    // Writes the ring to a time stamped file in the temp directory and returns its name.
+    static QString dump(const QString& reason);
+
+    static void setEnabled(bool on) { enabled.store(on, std::memory_order_relaxed); }
+
+private:
+    static traceRecord ring[TRACE_SLOTS];
+    // Index + 1 of the record each slot holds once it is complete.
+    static std::atomic<quint64> committed[TRACE_SLOTS];
+    static std::atomic<quint64> next;
+    static std::atomic<bool> enabled;
+};
+
+#endif // TRACERECORDER_H
@@ -1,5 +1,6 @@
 #include "udpaudio.h"
 #include "logcategories.h"
+#include "metrics.h"
 
 // Audio stream
 udpAudio::udpAudio(QHostAddress local, QHostAddress ip, quint16 audioPort, quint16 lport, audioSetup rxSetup, audioSetup txSetup)
@@ -143,6 +144,7 @@ void udpAudio::receiveAudioData(audioPacket audio) {
             len = len + partial.length();
             //qInfo(logUdp()) << "Sending audio packet length: " << tx.length();
             sendTrackedPacket(tx);
+            traceRecorder::record(traceAudioTx, tx.constData(), sizeof(p), sendAudioSeq);
             sendAudioSeq++;
             counter++;
         }
@@ -175,6 +177,7 @@ void udpAudio::dataReceived()
         QNetworkDatagram datagram = udp->receiveDatagram();
         //qInfo(logUdp()) << "Received: " << datagram.data().mid(0,10);
         QByteArray r = datagram.data();
+        trace(traceUdpRx, r);
 
         switch (r.length())
         {
@@ -206,8 +209,10 @@ void udpAudio::dataReceived()
                 audioPacket tempAudio;
                 tempAudio.seq = (quint32)seqPrefix << 16 | in->seq;
                 tempAudio.time = lastReceived;
+                tempAudio.stamp = metrics::now();
                 tempAudio.sent = 0;
                 tempAudio.data = r.mid(0x18);
+                traceRecorder::record(traceAudioRx, r.constData(), 0x18, tempAudio.seq);
                 // Prefer signal/slot to forward audio as it is thread/safe
                 // Need to do more testing but latency appears fine.
                 //rxaudio->incomingAudio(tempAudio);
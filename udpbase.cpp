@@ -1,5 +1,6 @@
 #include "udpbase.h"
 #include "logcategories.h"
+#include "metrics.h"
 
 void udpBase::init(quint16 lport)
 {
@@ -318,6 +319,9 @@ void udpBase::sendRetransmitRequest()
 
     if (missingSeqs.length() != 0)
     {
+        static metricCounter* requested = metrics::counter("wfview_udp_retransmit_requests_total", "Missing UDP packets asked for again");
+        requested->add(missingSeqs.length() / 4);
+
         control_packet p;
         memset(p.packet, 0x0, sizeof(p)); // We can't be sure it is initialized with 0x00!
         p.len = sizeof(p);
@@ -363,6 +367,7 @@ void udpBase::sendControl(bool tracked = true, quint8 type = 0, quint16 seq = 0)
 
     if (!tracked) {
         p.seq = seq;
+        traceRecorder::record(traceUdpTx, p.packet, sizeof(p), seq);
         udpMutex.lock();
         udp->writeDatagram(QByteArray::fromRawData((const char*)p.packet, sizeof(p)), radioIP, port);
         udpMutex.unlock();
@@ -386,6 +391,7 @@ void udpBase::sendPing()
     QTime now = QTime::currentTime();
     p.time = (quint32)now.msecsSinceStartOfDay();
     lastPingSentTime = QDateTime::currentDateTime();
+    traceRecorder::record(traceUdpTx, p.packet, CONTROL_SIZE, p.seq);
     udpMutex.lock();
     udp->writeDatagram(QByteArray::fromRawData((const char*)p.packet, sizeof(p)), radioIP, port);
     udpMutex.unlock();
@@ -427,6 +433,7 @@ void udpBase::sendTrackedPacket(QByteArray d)
     //purgeOldEntries(); // Delete entries older than PURGE_SECONDS seconds (currently 5)
     sendSeq++;
 
+    trace(traceUdpTx, d);
     udpMutex.lock();
     udp->writeDatagram(d, radioIP, port);
 
@@ -507,6 +514,16 @@ void udpBase::purgeOldEntries()
     }
 }
 
+void udpBase::trace(traceKind kind, const QByteArray& packet)
+{
+    // Only the common header is kept, the payload is traced where it is understood.
+    if (packet.size() >= CONTROL_SIZE)
+    {
+        control_packet_t p = (control_packet_t)packet.constData();
+        traceRecorder::record(kind, packet.constData(), CONTROL_SIZE, p->seq);
+    }
+}
+
 void udpBase::printHex(const QByteArray& pdata)
 {
     printHex(pdata, false, true);
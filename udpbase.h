@@ -23,6 +23,8 @@
 #include <QDebug>
 
 #include "packettypes.h"
+#include "scopestream.h"
+#include "tracerecorder.h"
 
 
 
@@ -36,6 +38,7 @@ struct udpPreferences {
 	QString clientName;
 	quint8 waterfallFormat;
 	bool halfDuplex;
+	scopeStreamSettings scopeStream; // Only honoured by a wfview server
 };
 
 struct networkAudioLevels {
@@ -87,6 +90,7 @@ public:
 	void sendControl(bool tracked, quint8 id, quint16 seq);
 
 	void printHex(const QByteArray& pdata);
+	void trace(traceKind kind, const QByteArray& packet);
 	void printHex(const QByteArray& pdata, bool printVert, bool printHoriz);
 
 
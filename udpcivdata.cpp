@@ -141,6 +141,7 @@ void udpCivData::dataReceived()
         QNetworkDatagram datagram = udp->receiveDatagram();
         //qInfo(logUdp()) << "Received: " << datagram.data();
         QByteArray r = datagram.data();
+        trace(traceUdpRx, r);
 
 
         switch (r.length())
@@ -177,12 +178,35 @@ void udpCivData::dataReceived()
                         startCivDataTimer->stop();
                     }
                     lastReceived = QTime::currentTime();
+                    if (scopeStream.enabled() && !scopeStreamRequested)
+                    {
+                        // Only a wfview server understands this, a radio will just reply NG.
+                        send(scopeStreamEncoder::request(0x00, 0xE1, scopeStream));
+                        scopeStreamRequested = true;
+                    }
                     if (quint16(in->datalen + 0x15) == (quint16)in->len)
                     {
+                        QByteArray civData = r;
+                        if (scopeStreamDecoder::isEncoded(r.mid(0x15)))
+                        {
+                            // Reduced scope line from a wfview server, rebuild the full frame.
+                            QByteArray decoded = scopeDecoder.decode(r.mid(0x15));
+                            if (scopeDecoder.takeKeyframeRequest())
+                            {
+                                // Sending the request again makes the server start with a keyframe.
+                                send(scopeStreamEncoder::request(0x00, 0xE1, scopeStream));
+                            }
+                            if (decoded.isEmpty() || decoded.indexOf((char)0xFD) != decoded.size() - 1)
+                            {
+                                break;
+                            }
+                            civData = r.left(0x15) + decoded;
+                        }
+
                         //if (r.mid(0x15).length() != 157)
                         // Find data length
-                        int pos = r.indexOf(QByteArrayLiteral("\x27\x00\x00")) + 2;
-                        int len = r.mid(pos).indexOf(QByteArrayLiteral("\xfd"));
+                        int pos = civData.indexOf(QByteArrayLiteral("\x27\x00\x00")) + 2;
+                        int len = civData.mid(pos).indexOf(QByteArrayLiteral("\xfd"));
                         //splitWaterfall = false;
                         if (splitWaterfall && pos > 1 && len > 100) {
                             // We need to split waterfall data into its component parts
@@ -213,12 +237,17 @@ void udpCivData::dataReceived()
                             // "DATA:  27 00 00 11 11 0b 13 21 23 1a 1b 22 1e 1a 1d 13 21 1d 26 28 1f 19 1a 18 09 2c 2c 2c 1a 1b fd "
 
                             int divSize = (len / numDivisions) + 6;
+                            if (pos + 15 + ((numDivisions - 2) * divSize) >= civData.length())
+                            {
+                                qInfo(logUdp()) << "Short spectrum packet" << civData.length();
+                                break;
+                            }
                             QByteArray wfPacket;
+                            const char* raw = civData.constData();
                             for (int i = 0; i < numDivisions; i++) {
 
-                                wfPacket = r.mid(pos - 6, 9); // First part of packet 
-
-                                wfPacket = r.mid(pos - 6, 9); // First part of packet 
+                                wfPacket.reserve(divSize + 10);
+                                wfPacket.append(raw + pos - 6, 9); // First part of packet 
                                 char tens = ((i + 1) / 10);
                                 char units = ((i + 1) - (10 * tens));
                                 wfPacket[7] = units | (tens << 4);
@@ -229,11 +258,12 @@ void udpCivData::dataReceived()
 
                                 if (i == 0) {
                                     //Just send initial data, first BCD encode the max number:
-                                    wfPacket.append(r.mid(pos + 3, 12));
+                                    wfPacket.append(raw + pos + 3, 12);
                                 }
                                 else
                                 {
-                                    wfPacket.append(r.mid((pos + 15) + ((i - 1) * divSize), divSize));
+                                    int start = (pos + 15) + ((i - 1) * divSize);
+                                    wfPacket.append(raw + start, qMin(divSize, civData.length() - start));
                                 }
                                 if (i < numDivisions - 1) {
                                     wfPacket.append('\xfd');
@@ -248,7 +278,7 @@ void udpCivData::dataReceived()
                         }
                         else {
                             // Not waterfall data or split not enabled.
-                            emit receive(r.mid(0x15));
+                            emit receive(civData.mid(0x15));
                         }
                         //qDebug(logUdp()) << "Got incoming CIV datagram" << r.mid(0x15).length();
 
@@ -26,6 +26,7 @@
 #include "packettypes.h"
 
 #include "udpbase.h"
+#include "scopestream.h"
 
 class udpCivData : public udpBase
 {
@@ -35,6 +36,7 @@ public:
 	udpCivData(QHostAddress local, QHostAddress ip, quint16 civPort, bool splitWf, quint16 lport);
 	~udpCivData();
 	QMutex serialmutex;
+	void setScopeStream(scopeStreamSettings s) { scopeStream = s; scopeDecoder = scopeStreamDecoder(); scopeStreamRequested = false; }
 
 signals:
 	int receive(QByteArray);
@@ -50,6 +52,9 @@ private:
 
 	QTimer* startCivDataTimer = Q_NULLPTR;
 	bool splitWaterfall = false;
+	scopeStreamSettings scopeStream;
+	scopeStreamDecoder scopeDecoder;
+	bool scopeStreamRequested = false;
 };
 
 
@@ -17,6 +17,7 @@ udpHandler::udpHandler(udpPreferences prefs, audioSetup rx, audioSetup tx) :
     this->username = prefs.username;
     this->password = prefs.password;
     this->compName = prefs.clientName.mid(0,8) + "-wfview";
+    this->scopeStream = prefs.scopeStream;
 
     if (prefs.waterfallFormat == 2)
     {
@@ -216,6 +217,7 @@ void udpHandler::dataReceived()
         lastReceived = QTime::currentTime();
         QNetworkDatagram datagram = udp->receiveDatagram();
         QByteArray r = datagram.data();
+        trace(traceUdpRx, r);
 
         switch (r.length())
         {
@@ -353,6 +355,7 @@ void udpHandler::dataReceived()
                         if (!streamOpened) {
 
                             civ = new udpCivData(localIP, radioIP, civPort, splitWf, civLocalPort);
+                            civ->setScopeStream(scopeStream);
                             QObject::connect(civ, SIGNAL(receive(QByteArray)), this, SLOT(receiveFromCivStream(QByteArray)));
 
                             // TX is not supported
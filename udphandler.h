@@ -122,6 +122,7 @@ private:
 	quint16 txSampleRates = 0;
 	networkStatus status;
 	bool splitWf = false;
+	scopeStreamSettings scopeStream;
 
     unsigned char audioLevelsTxPeak[audioLevelBufferSize];
     unsigned char audioLevelsRxPeak[audioLevelBufferSize];
@@ -1,5 +1,6 @@
 #include "udpserver.h"
 #include "logcategories.h"
+#include "metrics.h"
 
 #define STALE_CONNECTION 15
 #define LOCK_PERIOD 10 // time to attempt to lock Mutex in ms
@@ -9,6 +10,8 @@ udpServer::udpServer(SERVERCONFIG* config, QObject* parent) :
     config(config)
 {
     qInfo(logUdpServer()) << "Starting udp server";
+    qRegisterMetaType<SERVERCIVPAYLOAD>();
+    qRegisterMetaType<QList<SERVERCIVPAYLOAD>>();
 }
 
 void udpServer::init()
@@ -91,12 +94,39 @@ void udpServer::init()
     wdTimer = new QTimer();
     connect(wdTimer, &QTimer::timeout, this, &udpServer::watchdog);
     wdTimer->start(500);
+
+    // Each rig gets its own worker thread for CI-V/scope fan-out to its clients.
+    for (RIGCONFIG* radio : config->rigs)
+    {
+        if (radio->rig == Q_NULLPTR)
+            continue;
+
+        udpServerRigWorker* worker = new udpServerRigWorker(radio);
+        QThread* thread = new QThread(this);
+        thread->setObjectName(QString("udpServerRig(%1)").arg(radio->rigName));
+        worker->moveToThread(thread);
+        connect(thread, SIGNAL(finished()), worker, SLOT(deleteLater()));
+        connect(radio->rig, SIGNAL(haveDataForServer(QByteArray)), worker, SLOT(dataForClients(QByteArray)));
+        connect(worker, SIGNAL(havePayloads(QList<SERVERCIVPAYLOAD>)), this, SLOT(sendCivPayloads(QList<SERVERCIVPAYLOAD>)));
+        rigWorkers.insert(radio, worker);
+        rigWorkerThreads.append(thread);
+        thread->start();
+    }
 }
 
 udpServer::~udpServer()
 {
     qInfo(logUdpServer()) << "Closing udpServer";
 
+    // Stop the rig workers first so that none of them are using a client.
+    for (QThread* thread : rigWorkerThreads)
+    {
+        thread->quit();
+        thread->wait();
+    }
+    rigWorkerThreads.clear();
+    rigWorkers.clear();
+
     foreach(CLIENT * client, controlClients)
     {
         deleteConnection(&controlClients, client);
@@ -525,6 +555,7 @@ void udpServer::civReceived()
 
             current->type = "CIV";
             current->civId = 0;
+            current->clientId = ++lastClientId;
             current->connected = true;
             current->timeConnected = QDateTime::currentDateTime();
             current->ipAddress = datagram.senderAddress();
@@ -550,6 +581,8 @@ void udpServer::civReceived()
             if (connMutex.try_lock_for(std::chrono::milliseconds(LOCK_PERIOD)))
             {
                 civClients.append(current);
+                civClientsById.insert(current->clientId, current);
+                updateRigClients();
                 connMutex.unlock();
             }
             else {
@@ -613,8 +646,19 @@ void udpServer::civReceived()
                             qDebug(logUdpServer()) << current->ipAddress.toString() << ": Detected invalid remote CI-V:" << QString("0x%1").arg((quint8)r[lastFE+2],0,16);
 			            }
 
+                        scopeStreamSettings scopeSettings;
+                        bool scopeRequest = scopeStreamEncoder::isRequest(r.mid(0x15), scopeSettings);
+                        if (scopeRequest)
+                        {
+                            // Private wfview request, this is not forwarded to the rig.
+                            qInfo(logUdpServer()) << current->ipAddress.toString() << ": Scope stream requested, max rate:" << scopeSettings.maxRate
+                                << "width:" << scopeSettings.width << "delta:" << scopeSettings.delta;
+                            QMutexLocker scopeLocker(&current->scopeMutex);
+                            current->scope.setSettings(scopeSettings);
+                        }
+
                         for (RIGCONFIG* radio : config->rigs) {
-                            if (!memcmp(radio->guid, current->guid, sizeof(radio->guid)) || config->rigs.size()==1)
+                            if (!scopeRequest && (!memcmp(radio->guid, current->guid, sizeof(radio->guid)) || config->rigs.size()==1))
                             {
                                 // Only send to the rig that it belongs to!
                                 //qDebug(logUdpServer()) << "Sending data" << r.mid(0x15);
@@ -771,6 +815,7 @@ void udpServer::audioReceived()
                     audioPacket tempAudio;
                     tempAudio.seq = (quint32)current->seqPrefix << 16 | in->seq;
                     tempAudio.time = QTime::currentTime();;
+                    tempAudio.stamp = metrics::now();
                     tempAudio.sent = 0;
                     tempAudio.data = r.mid(0x18);
                     //qInfo(logUdpServer()) << "sending tx audio " << in->seq;
@@ -1588,44 +1633,48 @@ void udpServer::sendStatus(CLIENT* c)
 }
 
 
-void udpServer::dataForServer(QByteArray d)
+void udpServer::updateRigClients()
 {
-    rigCommander* sender = qobject_cast<rigCommander*>(QObject::sender());
-
-    if (sender == Q_NULLPTR)
+    // Rebuild the rig->clients index, only called with connMutex held.
+    for (auto it = rigWorkers.begin(); it != rigWorkers.end(); ++it)
     {
-        return;
+        QList<CLIENT*> clients;
+        for (CLIENT* client : civClients)
+        {
+            if (client != Q_NULLPTR && (!memcmp(it.key()->guid, client->guid, GUIDLEN) || config->rigs.size() == 1))
+            {
+                clients.append(client);
+            }
+        }
+        it.value()->setClients(clients);
     }
+}
 
-    for (CLIENT* client : civClients)
+void udpServer::sendCivPayloads(QList<SERVERCIVPAYLOAD> payloads)
+{
+    // Sequence numbers and the retransmit buffer are only ever touched on this thread.
+    for (const SERVERCIVPAYLOAD& payload : payloads)
     {
+        CLIENT* client = civClientsById.value(payload.clientId, Q_NULLPTR);
         if (client == Q_NULLPTR || !client->connected)
         {
-            continue;
-        }
-        // Use the GUID to determine which radio the response is from
-        if (memcmp(sender->getGUID(), client->guid, GUIDLEN) && config->rigs.size()>1)
-        {
-            continue; // Rig guid doesn't match the one requested by the client.
+            continue; // Client has gone since the payload was built.
         }
 
-        int lastFE = d.lastIndexOf((quint8)0xfe);
-        //qInfo(logUdpServer()) << "Server got CIV data from" << config->rigs.first()->rigName << "length" << d.length() << d.toHex();
-        if (client->connected && d.length() > lastFE + 2 &&
-                ((quint8)d[lastFE + 1] == client->civId || (quint8)d[lastFE + 2] == client->civId ||
-                (quint8)d[lastFE + 1] == 0x00 || (quint8)d[lastFE + 2] == 0x00 || (quint8)d[lastFE + 1] == 0xE1 || (quint8)d[lastFE + 2] == 0xE1))
+        data_packet p;
+        memset(p.packet, 0x0, sizeof(p)); // We can't be sure it is initialized with 0x00!
+        p.len = (quint16)payload.data.length() + sizeof(p);
+        p.sentid = client->myId;
+        p.rcvdid = client->remoteId;
+        p.reply = (char)0xc1;
+        p.datalen = (quint16)payload.data.length();
+        p.sendseq = client->innerSeq;
+
+        if (client->txMutex.try_lock_for(std::chrono::milliseconds(LOCK_PERIOD)))
         {
-            data_packet p;
-            memset(p.packet, 0x0, sizeof(p)); // We can't be sure it is initialized with 0x00!
-            p.len = (quint16)d.length() + sizeof(p);
             p.seq = client->txSeq;
-            p.sentid = client->myId;
-            p.rcvdid = client->remoteId;
-            p.reply = (char)0xc1;
-            p.datalen = (quint16)d.length();
-            p.sendseq = client->innerSeq;
             QByteArray t = QByteArray::fromRawData((const char*)p.packet, sizeof(p));
-            t.append(d);
+            t.append(payload.data);
 
             SEQBUFENTRY s;
             s.seqNum = p.seq;
@@ -1633,24 +1682,16 @@ void udpServer::dataForServer(QByteArray d)
             s.retransmitCount = 0;
             s.data = t;
 
-            if (client->txMutex.try_lock_for(std::chrono::milliseconds(LOCK_PERIOD)))
-            {
-                if (client->txSeq == 0) {
-                    client->txSeqBuf.clear();
-                }
-                else if (client->txSeqBuf.size() > BUFSIZE)
-                {
-                    client->txSeqBuf.remove(client->txSeqBuf.firstKey());
-                }
-                client->txSeqBuf.insert(client->txSeq, s);
-                client->txSeq++;
-                //client->innerSeq = (qToBigEndian(qFromBigEndian(client->innerSeq) + 1));
-                client->txMutex.unlock();
+            if (client->txSeq == 0) {
+                client->txSeqBuf.clear();
             }
-            else {
-                qInfo(logUdpServer()) << "Unable to lock txMutex()";
+            else if (client->txSeqBuf.size() > BUFSIZE)
+            {
+                client->txSeqBuf.remove(client->txSeqBuf.firstKey());
             }
-
+            client->txSeqBuf.insert(client->txSeq, s);
+            client->txSeq++;
+            client->txMutex.unlock();
 
             if (udpMutex.try_lock_for(std::chrono::milliseconds(LOCK_PERIOD)))
             {
@@ -1662,11 +1703,64 @@ void udpServer::dataForServer(QByteArray d)
             }
         }
         else {
-            qInfo(logUdpServer()) << "Got data for different ID" << 
+            qInfo(logUdpServer()) << "Unable to lock txMutex()";
+        }
+    }
+}
+
+
+udpServerRigWorker::udpServerRigWorker(RIGCONFIG* rig, QObject* parent) :
+    QObject(parent),
+    rig(rig)
+{
+}
+
+void udpServerRigWorker::setClients(QList<udpServer::CLIENT*> c)
+{
+    QMutexLocker locker(&clientsMutex);
+    clients = c;
+}
+
+void udpServerRigWorker::dataForClients(QByteArray d)
+{
+    QList<SERVERCIVPAYLOAD> payloads;
+    int lastFE = d.lastIndexOf((quint8)0xfe);
+
+    QMutexLocker locker(&clientsMutex);
+    for (udpServer::CLIENT* client : clients)
+    {
+        if (client == Q_NULLPTR || !client->connected)
+        {
+            continue;
+        }
+
+        //qInfo(logUdpServer()) << "Server got CIV data from" << rig->rigName << "length" << d.length() << d.toHex();
+        if (d.length() > lastFE + 2 &&
+                ((quint8)d[lastFE + 1] == client->civId || (quint8)d[lastFE + 2] == client->civId ||
+                (quint8)d[lastFE + 1] == 0x00 || (quint8)d[lastFE + 2] == 0x00 || (quint8)d[lastFE + 1] == 0xE1 || (quint8)d[lastFE + 2] == 0xE1))
+        {
+            SERVERCIVPAYLOAD payload;
+            payload.clientId = client->clientId;
+            payload.data = d;
+            {
+                QMutexLocker scopeLocker(&client->scopeMutex);
+                if (client->scope.enabled() && client->scope.encode(d, payload.data) && payload.data.isEmpty())
+                {
+                    continue; // Scope line dropped (rate limited or partial) for this client.
+                }
+            }
+            payloads.append(payload);
+        }
+        else {
+            qInfo(logUdpServer()) << "Got data for different ID" <<
                 QString("0x%1").arg((quint8)d[lastFE + 1],0,16) << ":" << QString("0x%1").arg((quint8)d[lastFE + 2],0,16);
         }
     }
-    return;
+
+    if (!payloads.isEmpty())
+    {
+        emit havePayloads(payloads);
+    }
 }
 
 
@@ -1921,6 +2015,10 @@ void udpServer::deleteConnection(QList<CLIENT*>* l, CLIENT* c)
                 ++it;
             }
         }
+        if (l == &civClients) {
+            civClientsById.remove(c->clientId);
+            updateRigClients(); // Waits for the rig worker to finish with this client.
+        }
         delete c; // Is this needed or will the erase have done it?
         c = Q_NULLPTR;
         qInfo(logUdpServer()) << "Current Number of clients connected: " << l->length();
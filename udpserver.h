@@ -13,6 +13,7 @@
 #include <QList>
 #include <QVector>
 #include <QMap>
+#include <QHash>
 
 // Allow easy endian-ness conversions
 #include <QtEndian>
@@ -24,6 +25,7 @@
 #include "udphandler.h"
 #include "audiohandler.h"
 #include "rigcommander.h"
+#include "scopestream.h"
 
 extern void passcode(QString in,QByteArray& out);
 extern QByteArray parseNullTerminatedString(QByteArray c, int s);
@@ -80,6 +82,16 @@ struct RIGCONFIG {
 };
 
 
+// CI-V payload for one client, built by a rig worker and sent by the server.
+// clientId is looked up in the server's own index as the client may have gone
+// in the meantime. Ids are never reused, unlike the client's address.
+struct SERVERCIVPAYLOAD {
+	quint32 clientId;
+	QByteArray data;
+};
+Q_DECLARE_METATYPE(SERVERCIVPAYLOAD)
+
+
 struct SERVERCONFIG {
 	bool enabled;
 	bool lan;
@@ -95,9 +107,12 @@ struct SERVERCONFIG {
 };
 
 
+class udpServerRigWorker;
+
 class udpServer : public QObject
 {
 	Q_OBJECT
+	friend class udpServerRigWorker;
 
 public:
 	explicit udpServer(SERVERCONFIG* config, QObject* parent = nullptr);
@@ -105,7 +120,7 @@ public:
 
 public slots:
 	void init();
-	void dataForServer(QByteArray);
+	void sendCivPayloads(QList<SERVERCIVPAYLOAD> payloads);
 	void receiveAudioData(const audioPacket &data);
 	void receiveRigCaps(rigCapabilities caps);
 
@@ -175,11 +190,14 @@ private:
 		quint16 seqPrefix;
 
 		quint8 civId;
+		quint32 clientId = 0; // Identifies CI-V clients to the rig workers, see SERVERCIVPAYLOAD
 		bool isAuthenticated;
 		CLIENT* controlClient = Q_NULLPTR;
 		CLIENT* civClient = Q_NULLPTR;
 		CLIENT* audioClient = Q_NULLPTR;
 		quint8 guid[GUIDLEN];
+		scopeStreamEncoder scope;
+		QMutex scopeMutex; // scope is used by the rig worker as well as the server thread
 	};
 
 	void controlReceived();
@@ -197,6 +215,7 @@ private:
 	void sendRetransmitRequest(CLIENT* c);
 	void watchdog();
 	void deleteConnection(QList<CLIENT*> *l, CLIENT* c);
+	void updateRigClients();
 
 	SERVERCONFIG *config;
 
@@ -216,6 +235,8 @@ private:
 
 	QList <CLIENT*> controlClients = QList<CLIENT*>();
 	QList <CLIENT*> civClients = QList<CLIENT*>();
+	QHash <quint32, CLIENT*> civClientsById; // Kept with civClients
+	quint32 lastClientId = 0;
 	QList <CLIENT*> audioClients = QList<CLIENT*>();
 
     //QTime timeStarted;
@@ -232,8 +253,36 @@ private:
 	QHostAddress hasTxAudio;
 	QTimer* wdTimer;
 
+	// One CI-V fan-out worker (and thread) per rig
+	QMap<RIGCONFIG*, udpServerRigWorker*> rigWorkers;
+	QList<QThread*> rigWorkerThreads;
+
 	networkStatus status;
 };
 
 
+
+// Takes CI-V data from a single rig and performs scope reduction for every CI-V
+// client of that rig on its own thread. The payloads are handed back to the
+// server thread, which owns the socket and all per-client sequence state.
+class udpServerRigWorker : public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit udpServerRigWorker(RIGCONFIG* rig, QObject* parent = nullptr);
+	void setClients(QList<udpServer::CLIENT*> c);
+
+public slots:
+	void dataForClients(QByteArray d);
+
+signals:
+	void havePayloads(QList<SERVERCIVPAYLOAD> payloads);
+
+private:
+	RIGCONFIG* rig;
+	QMutex clientsMutex;
+	QList<udpServer::CLIENT*> clients; // Only the CI-V clients of this rig
+};
+
 #endif // UDPSERVER_H
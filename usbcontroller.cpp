@@ -7,6 +7,12 @@
 
 #include <QDebug>
 
+#if defined(Q_OS_LINUX)
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#endif
+
 #include "logcategories.h"
 
 usbController::usbController()
@@ -50,8 +56,7 @@ usbController::~usbController()
             if (dev->type.model == RC28) {
                 sendRequest(dev,usbFeatureType::featureLEDControl,4,"0");
             }
-            hid_close(dev->handle);
-            dev->handle = NULL;
+            closeDevice(dev);
             dev->connected = false;
             dev->detected = false;
             dev->uiCreated = false;
@@ -59,7 +64,14 @@ usbController::~usbController()
         }
         ++devIt;
     }
-    
+
+    if (lcdThread != Q_NULLPTR) {
+        lcdThread->quit();
+        lcdThread->wait();
+        delete lcdEncoder;
+        lcdEncoder = Q_NULLPTR;
+    }
+
     hid_exit();
 #if (QT_VERSION < QT_VERSION_CHECK(6,0,0))
     if (gamepad != Q_NULLPTR)
@@ -322,6 +334,7 @@ void usbController::run()
                 {
                     qInfo(logUsbControl()) << QString("Connected to device: %0 from %1 S/N %2").arg(dev->product,dev->manufacturer,dev->serial);
                     hid_set_nonblocking(dev->handle, 1);
+                    openEvents(dev);
                     devicesConnected++;
                     dev->connected=true;
 
@@ -446,10 +459,17 @@ void usbController::run()
         }
     }
     
-    if (devicesConnected>0 && dataTimer == Q_NULLPTR) {
+    // Only devices that can't signal when they have data need polling.
+    bool needPolling = false;
+    for (auto devIt = devices->begin(); devIt != devices->end(); devIt++)
+    {
+        if (devIt->connected && devIt->handle && devIt->notifier == Q_NULLPTR)
+            needPolling = true;
+    }
+    if (needPolling && dataTimer == Q_NULLPTR) {
         dataTimer = new QTimer(this);
         connect(dataTimer, &QTimer::timeout, this, &usbController::runTimer);
-        dataTimer->start(25);
+        dataTimer->start(USB_POLL_MS);
     }
     
 #ifndef USB_HOTPLUG
@@ -460,8 +480,8 @@ void usbController::run()
 
 
 /*
- * runTimer is called every 25ms once a connection to a supported controller is established
- * It will then step through each connected controller and request any data
+ * runTimer is called every USB_POLL_MS while a device is connected that has to be polled.
+ * Devices read through hidraw are read by readDevice() as soon as a report arrives.
 */
 
 void usbController::runTimer()
@@ -472,342 +492,450 @@ void usbController::runTimer()
     {
         auto dev = &devIt.value();
 
-        if (dev->disabled || !dev->detected || !dev->connected || !dev->handle) {
-            // This device isn't currently connected.
+        if (dev->disabled || !dev->detected || !dev->connected || !dev->handle || dev->notifier != Q_NULLPTR) {
+            // This device isn't currently connected or doesn't need polling.
             continue;
         }
+        readDevice(dev);
+    }
+}
 
-        int res=1;
-        
-        while (res > 0) {
-            quint32 tempButtons = 0;
-            QByteArray data(HIDDATALENGTH, 0x0);
-            res = hid_read(dev->handle, (unsigned char*)data.data(), HIDDATALENGTH);
-            if (res < 0)
-            {
-                qInfo(logUsbControl()) << "USB Device disconnected" << dev->product;
-                hid_close(dev->handle);
-                dev->handle = NULL;
-                dev->detected = false;
-                dev->connected = false;
-                dev->detected = false;
-                dev->remove = true;
-                dev->uiCreated = false;
-                devicesConnected--;
-                if (devicesConnected == 0) {
-                    dataTimer->stop();
-                    delete dataTimer;
-                    dataTimer = Q_NULLPTR;
-                }
-                emit removeDevice(dev);
-                QTimer::singleShot(250, this, SLOT(run())); // Cleanup
-                break;
-            }
+void usbController::openEvents(USBDEVICE* dev)
+{
+#if defined(Q_OS_LINUX)
+    // The hidraw backend of hidapi opens /dev/hidrawN. Every open file gets
+    // its own copy of each input report, so reports are read from our own
+    // descriptor when it is ready and hidapi is only used for output and
+    // feature reports.
+    if (!dev->path.startsWith("/dev/hidraw"))
+        return;
 
-            if (res == 5 && (dev->type.model == shuttleXpress || dev->type.model == shuttlePro2))
-            {
-                tempButtons = ((quint8)data[4] << 8) | ((quint8)data[3] & 0xff);
-                unsigned char tempJogpos = (unsigned char)data[1];
-                unsigned char tempShutpos = (unsigned char)data[0];
-
-                /* Button matrix:
-                    1000000000000000 = button15
-                    0100000000000000 = button14
-                    0010000000000000 = button13
-                    0001000000000000 = button12
-                    0000100000000000 = button11
-                    0000010000000000 = button10
-                    0000001000000000 = button9
-                    0000000100000000 = button8 - xpress0
-                    0000000010000000 = button7 - xpress1
-                    0000000001000000 = button6 - xpress2
-                    0000000000100000 = button5 - xpress3
-                    0000000000010000 = button4 - xpress4
-                    0000000000001000 = button3
-                    0000000000000100 = button2
-                    0000000000000010 = button1
-                    0000000000000001 = button0
-                */
-
-                if (tempJogpos == dev->jogpos + 1 || (tempJogpos == 0 && dev->jogpos == 0xff))
-                {
-                    dev->knobValues[0].value++;
-                }
-                else if (tempJogpos != dev->jogpos) {
-                    dev->knobValues[0].value--;
-                }
+    dev->fd = ::open(dev->path.toLocal8Bit().constData(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (dev->fd < 0)
+    {
+        qInfo(logUsbControl()) << "Unable to open" << dev->path << "for events, polling instead:" << strerror(errno);
+        return;
+    }
+    dev->notifier = new QSocketNotifier(dev->fd, QSocketNotifier::Read, this);
+    connect(dev->notifier, &QSocketNotifier::activated, this, [this, dev]() {
+        QMutexLocker locker(mutex);
+        readDevice(dev);
+    });
+#else
+    Q_UNUSED(dev)
+#endif
+}
+
+void usbController::closeDevice(USBDEVICE* dev)
+{
+#if defined(Q_OS_LINUX)
+    if (dev->notifier != Q_NULLPTR)
+    {
+        dev->notifier->setEnabled(false);
+        dev->notifier->deleteLater(); // We may be inside its activated() signal
+        dev->notifier = Q_NULLPTR;
+    }
+    if (dev->fd >= 0)
+    {
+        ::close(dev->fd);
+        dev->fd = -1;
+    }
+#endif
+    if (dev->handle)
+    {
+        hid_close(dev->handle);
+        dev->handle = NULL;
+    }
+    // Whatever the keys and LCD were showing has gone with the handle.
+    dev->keyImages.clear();
+    lcdLast.remove(dev->path);
+    lcdPending.remove(dev->path);
+}
 
-                dev->jogpos = tempJogpos;
-                dev->shutpos = tempShutpos;
+void usbController::readDevice(USBDEVICE* dev)
+{
+    // Called with mutex held. Reads every report that is waiting into the
+    // preallocated reportBuffer.
+    while (dev->handle)
+    {
+        int res;
+#if defined(Q_OS_LINUX)
+        if (dev->fd >= 0)
+        {
+            res = ::read(dev->fd, reportBuffer, HIDDATALENGTH);
+            if (res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+                res = 0;
+        }
+        else
+#endif
+        {
+            res = hid_read(dev->handle, (unsigned char*)reportBuffer, HIDDATALENGTH);
+        }
+
+        if (res < 0)
+        {
+            qInfo(logUsbControl()) << "USB Device disconnected" << dev->product;
+            closeDevice(dev);
+            dev->detected = false;
+            dev->connected = false;
+            dev->remove = true;
+            dev->uiCreated = false;
+            devicesConnected--;
+            if (devicesConnected == 0 && dataTimer != Q_NULLPTR) {
+                dataTimer->stop();
+                delete dataTimer;
+                dataTimer = Q_NULLPTR;
             }
-            else if ((res > 31) && dev->type.model == RC28)
+            emit removeDevice(dev);
+            QTimer::singleShot(250, this, SLOT(run())); // Cleanup
+            return;
+        }
+        if (res == 0)
+            break;
+
+        // Decoders expect unused bytes to be zero, as they were with a fresh buffer per read.
+        memset(reportBuffer + res, 0, HIDDATALENGTH - res);
+        processReport(dev, reportBuffer, res);
+    }
+
+    // Knob movement is sent at the next frame, the first one straight away.
+    if (frameTimer == Q_NULLPTR)
+    {
+        frameTimer = new QTimer(this);
+        connect(frameTimer, &QTimer::timeout, this, &usbController::frameTimeout);
+    }
+    if (!frameTimer->isActive() && sendFrames())
+        frameTimer->start(USB_FRAME_MS);
+}
+
+void usbController::frameTimeout()
+{
+    QMutexLocker locker(mutex);
+    if (!sendFrames())
+        frameTimer->stop();
+}
+
+bool usbController::sendFrames()
+{
+    bool active = false;
+    for (auto devIt = devices->begin(); devIt != devices->end(); devIt++)
+    {
+        auto dev = &devIt.value();
+        if (dev->connected && dev->handle)
+            active |= sendFrame(dev);
+    }
+    return active;
+}
+
+void usbController::processReport(USBDEVICE* dev, const char* data, int res)
+{
+    quint32 tempButtons = 0;
+
+    if (res == 5 && (dev->type.model == shuttleXpress || dev->type.model == shuttlePro2))
+    {
+        tempButtons = ((quint8)data[4] << 8) | ((quint8)data[3] & 0xff);
+        unsigned char tempJogpos = (unsigned char)data[1];
+        unsigned char tempShutpos = (unsigned char)data[0];
+
+        /* Button matrix:
+            1000000000000000 = button15
+            0100000000000000 = button14
+            0010000000000000 = button13
+            0001000000000000 = button12
+            0000100000000000 = button11
+            0000010000000000 = button10
+            0000001000000000 = button9
+            0000000100000000 = button8 - xpress0
+            0000000010000000 = button7 - xpress1
+            0000000001000000 = button6 - xpress2
+            0000000000100000 = button5 - xpress3
+            0000000000010000 = button4 - xpress4
+            0000000000001000 = button3
+            0000000000000100 = button2
+            0000000000000010 = button1
+            0000000000000001 = button0
+        */
+
+        if (tempJogpos == dev->jogpos + 1 || (tempJogpos == 0 && dev->jogpos == 0xff))
+        {
+            dev->knobValues[0].value++;
+        }
+        else if (tempJogpos != dev->jogpos) {
+            dev->knobValues[0].value--;
+        }
+
+        dev->jogpos = tempJogpos;
+        dev->shutpos = tempShutpos;
+    }
+    else if ((res > 31) && dev->type.model == RC28)
+    {
+        // This is a response from the Icom RC28
+        if ((unsigned char)data[0] == 0x02) {
+            QByteArray report(data, res);
+            qInfo(logUsbControl()) << QString("Received RC-28 Firmware Version: %0").arg(QString(report.mid(1,report.indexOf(" ")-1)));
+        }
+        else
+        {
+            tempButtons |= !((quint8)data[5] ^ 0x06) << 0;
+            tempButtons |= !((quint8)data[5] ^ 0x05) << 1;
+            tempButtons |= !((quint8)data[5] ^ 0x03) << 2;
+            if ((unsigned char)data[5] == 0x07)
             {
-                // This is a response from the Icom RC28
-                if ((unsigned char)data[0] == 0x02) {
-                    qInfo(logUsbControl()) << QString("Received RC-28 Firmware Version: %0").arg(QString(data.mid(1,data.indexOf(" ")-1)));
+                if ((unsigned char)data[3] == 0x01)
+                {
+                    dev->knobValues[0].value = dev->knobValues[0].value + data[1];
                 }
-                else
+                else if ((unsigned char)data[3] == 0x02)
                 {
-                    tempButtons |= !((quint8)data[5] ^ 0x06) << 0;
-                    tempButtons |= !((quint8)data[5] ^ 0x05) << 1;
-                    tempButtons |= !((quint8)data[5] ^ 0x03) << 2;
-                    if ((unsigned char)data[5] == 0x07)
-                    {
-                        if ((unsigned char)data[3] == 0x01)
-                        {
-                            dev->knobValues[0].value = dev->knobValues[0].value + data[1];
-                        }
-                        else if ((unsigned char)data[3] == 0x02)
-                        {
-                            dev->knobValues[0].value = dev->knobValues[0].value - data[1];
-                        }
-                    }
+                    dev->knobValues[0].value = dev->knobValues[0].value - data[1];
                 }
             }
-            else if (res > 15 && dev->type.model == eCoderPlus && (quint8)data[0] == 0xff) {
-                tempButtons = ((quint8)data[3] << 16) | ((quint8)data[2] << 8) | ((quint8)data[1] & 0xff);
-                quint32 tempKnobs = ((quint8)data[16] << 24) | ((quint8)data[15] << 16) | ((quint8)data[14] << 8) | ((quint8)data[13]  & 0xff);
-                
-                for (unsigned char i = 0; i < dev->knobValues.size(); i++)
-                {
-                    if (dev->knobs != tempKnobs) {
-                        // One of the knobs has moved
-                        for (unsigned char i = 0; i < 4; i++) {
-                            if ((tempKnobs >> (i * 8) & 0xff) != (dev->knobs >> (i * 8) & 0xff)) {
-                                dev->knobValues[i].value = dev->knobValues[i].value + (qint8)((dev->knobs >> (i * 8)) & 0xff);
-                            }
-                        }
-                        dev->knobs = tempKnobs;
+        }
+    }
+    else if (res > 15 && dev->type.model == eCoderPlus && (quint8)data[0] == 0xff) {
+        tempButtons = ((quint8)data[3] << 16) | ((quint8)data[2] << 8) | ((quint8)data[1] & 0xff);
+        quint32 tempKnobs = ((quint8)data[16] << 24) | ((quint8)data[15] << 16) | ((quint8)data[14] << 8) | ((quint8)data[13]  & 0xff);
+        
+        for (unsigned char i = 0; i < dev->knobValues.size(); i++)
+        {
+            if (dev->knobs != tempKnobs) {
+                // One of the knobs has moved
+                for (unsigned char i = 0; i < 4; i++) {
+                    if ((tempKnobs >> (i * 8) & 0xff) != (dev->knobs >> (i * 8) & 0xff)) {
+                        dev->knobValues[i].value = dev->knobValues[i].value + (qint8)((dev->knobs >> (i * 8)) & 0xff);
                     }
                 }
+                dev->knobs = tempKnobs;
             }
-            else if (res > 5 && dev->type.model == QuickKeys && (quint8)data[0] == 0x02) {
+        }
+    }
+    else if (res > 5 && dev->type.model == QuickKeys && (quint8)data[0] == 0x02) {
 
-                if ((quint8)data[1] == 0xf0) {
-                    
-                    //qInfo(logUsbControl()) << "Received:" << data;
-                    tempButtons = (data[3] << 8) | (data[2] & 0xff);
+        if ((quint8)data[1] == 0xf0) {
+            
+            //qInfo(logUsbControl()) << "Received:" << data;
+            tempButtons = (data[3] << 8) | (data[2] & 0xff);
 
-                    if (data[7] & 0x01) {
-                        dev->knobValues[0].value++;
-                    }
-                    else if (data[7] & 0x02) {
-                        dev->knobValues[0].value--;
-                    }
-                    
-                }
-                else if ((quint8)data[1] == 0xf2 && (quint8)data[2] == 0x01)
-                {
-                    // Battery level
-                    quint8 battery = (quint8)data[3];
-                    qDebug(logUsbControl()) << QString("Battery level %1 %").arg(battery);
-                }
+            if (data[7] & 0x01) {
+                dev->knobValues[0].value++;
             }
-            // Is it any model of StreamDeck?
-            else if (res>=dev->type.buttons && dev->type.model != usbNone)
-            {
-                // Main buttons
-                if (dev->type.model == usbDeviceType::StreamDeckOriginal)
-                {
+            else if (data[7] & 0x02) {
+                dev->knobValues[0].value--;
+            }
+            
+        }
+        else if ((quint8)data[1] == 0xf2 && (quint8)data[2] == 0x01)
+        {
+            // Battery level
+            quint8 battery = (quint8)data[3];
+            qDebug(logUsbControl()) << QString("Battery level %1 %").arg(battery);
+        }
+    }
+    // Is it any model of StreamDeck?
+    else if (res>=dev->type.buttons && dev->type.model != usbNone)
+    {
+        // Main buttons
+        if (dev->type.model == usbDeviceType::StreamDeckOriginal)
+        {
 
-                    for (int i = dev->type.buttons-1;i>=0;i--) {
-                        quint8 val = ((i - (i % dev->type.cols)) + (dev->type.cols-1)) - (i % dev->type.cols);
-                        tempButtons |= ((quint8)data[val+1] & 0x01) << (i);
-                    }
+            for (int i = dev->type.buttons-1;i>=0;i--) {
+                quint8 val = ((i - (i % dev->type.cols)) + (dev->type.cols-1)) - (i % dev->type.cols);
+                tempButtons |= ((quint8)data[val+1] & 0x01) << (i);
+            }
 
-                    qInfo(logUsbControl()) << "RX:" << data.toHex(' ');
+            qInfo(logUsbControl()) << "RX:" << QByteArray(data, res).toHex(' ');
+        }
+        else
+        {
+            if ((quint8)data[1] == 0x00)
+            {
+                for (int i = dev->type.buttons - dev->type.knobs;i>0;i--) {
+                    tempButtons |= ((quint8)data[i+3] & 0x01) << (i-1);
                 }
-                else
+            }
+
+            // Knobs and secondary buttons
+            if (dev->type.model == StreamDeckPlus) {
+                if ((quint8)data[1] == 0x03 && (quint8)data[2] == 0x05)
                 {
-                    if ((quint8)data[1] == 0x00)
+                    // Knob action!
+                    switch ((quint8)data[4])
                     {
-                        for (int i = dev->type.buttons - dev->type.knobs;i>0;i--) {
-                            tempButtons |= ((quint8)data[i+3] & 0x01) << (i-1);
-                        }
-                    }
-
-                    // Knobs and secondary buttons
-                    if (dev->type.model == StreamDeckPlus) {
-                        if ((quint8)data[1] == 0x03 && (quint8)data[2] == 0x05)
+                    case 0x00:
+                        // Knob button
+                        for (int i=dev->type.buttons;i>7;i--)
                         {
-                            // Knob action!
-                            switch ((quint8)data[4])
-                            {
-                            case 0x00:
-                                // Knob button
-                                for (int i=dev->type.buttons;i>7;i--)
-                                {
-                                    tempButtons |= ((quint8)data[i-4] & 0x01) << (i-1);
-                                }
-                                break;
-                            case 0x01:
-                                // Knob moved
-                                for (int i=0;i<dev->type.knobs;i++)
-                                {
-                                    dev->knobValues[i].value += (qint8)data[i+5];
-                                }
-                                break;
-                            }
+                            tempButtons |= ((quint8)data[i-4] & 0x01) << (i-1);
                         }
-                        else if ((quint8)data[1] == 0x02 && (quint8)data[2] == 0x0E)
+                        break;
+                    case 0x01:
+                        // Knob moved
+                        for (int i=0;i<dev->type.knobs;i++)
                         {
-                            // LCD touch event
-                            int x = ((quint8)data[7] << 8) | ((quint8)data[6] & 0xff);
-                            int y = ((quint8)data[9] << 8) | ((quint8)data[8] & 0xff);
-                            int x2=0;
-                            int y2=0;
-                            QString tt="";
-                            switch ((quint8)data[4])
-                            {
-                            case 0x01:
-                                tt="Short";
-                                break;
-                            case 0x02:
-                                tt="Long";
-                                break;
-                            case 0x03:
-                                tt="Swipe";
-                                x2 = ((quint8)data[11] << 8) | ((quint8)data[10] & 0xff);
-                                y2 = ((quint8)data[13] << 8) | ((quint8)data[12] & 0xff);
-                                break;
-                            }
-                            qInfo(logUsbControl()) << QString("%0 touch: %1,%2 to %3,%4").arg(tt).arg(x).arg(y).arg(x2).arg(y2);
+                            dev->knobValues[i].value += (qint8)data[i+5];
                         }
+                        break;
                     }
                 }
-            }
-
-            // Step through all buttons and emit ones that have been pressed.
-            // Only do it if actual data has been received.
-            if (res > 0 && dev->buttons != tempButtons)
-            {
-                qDebug(logUsbControl()) << "Got Buttons:" << QString::number(tempButtons,2);
-                // Step through all buttons and emit ones that have been pressed.
-                for (unsigned char i = 0; i <dev->type.buttons; i++)
+                else if ((quint8)data[1] == 0x02 && (quint8)data[2] == 0x0E)
                 {
-                    auto but = std::find_if(buttonList->begin(), buttonList->end(), [dev, i](const BUTTON& b)
-                    { return (b.path == dev->path && b.page == dev->currentPage && b.num == i); });
-                    if (but != buttonList->end()) {
-                        if ((!but->isOn) && ((tempButtons >> i & 1) && !(dev->buttons >> i & 1)))
-                        {
-                            qDebug(logUsbControl()) << QString("On Button event for button %0: %1").arg(but->num).arg(but->onCommand->text);
-                            if (but->onCommand->command == cmdPageUp)
-                                emit changePage(dev, dev->currentPage+1);
-                            else if (but->onCommand->command == cmdPageDown)
-                                emit changePage(dev, dev->currentPage-1);
-                            else if (but->onCommand->command == cmdLCDSpectrum)
-                                dev->lcd = cmdLCDSpectrum;
-                            else if (but->onCommand->command == cmdLCDWaterfall)
-                                dev->lcd = cmdLCDWaterfall;
-                            else if (but->onCommand->command == cmdLCDNothing) {
-                                dev->lcd = cmdLCDNothing;
-                                QTimer::singleShot(0, this, [=]() { sendRequest(dev,usbFeatureType::featureColor,i,"",Q_NULLPTR, &dev->color); });
-                            }else {
-                                emit button(but->onCommand);
-                            }
-                            // Change the button text to reflect the off Button
-                            if (but->offCommand->index != 0) {
-                                QTimer::singleShot(0, this, [=]() { sendRequest(dev,usbFeatureType::featureButton,i,but->offCommand->text, but->icon, &but->backgroundOff); });
-                            }
-                            but->isOn=true;
-                        }
-                        else if ((but->toggle && but->isOn) && ((tempButtons >> i & 1) && !(dev->buttons >> i & 1)))
-                        {
-                            qDebug(logUsbControl()) << QString("Off Button (toggle) event for button %0: %1").arg(but->num).arg(but->onCommand->text);
-                            if (but->offCommand->command == cmdPageUp)
-                                emit changePage(dev, dev->currentPage+1);
-                            else if (but->offCommand->command == cmdPageDown)
-                                emit changePage(dev, dev->currentPage-1);
-                            else if (but->offCommand->command == cmdLCDSpectrum)
-                                dev->lcd = cmdLCDSpectrum;
-                            else if (but->offCommand->command == cmdLCDWaterfall)
-                                dev->lcd = cmdLCDWaterfall;
-                            else if (but->offCommand->command == cmdLCDNothing) {
-                                dev->lcd = cmdLCDNothing;
-                                QTimer::singleShot(0, this, [=]() { sendRequest(dev,usbFeatureType::featureColor,i,"",Q_NULLPTR, &dev->color); });
-                            } else {
-                                emit button(but->offCommand);
-                            }
-                            QTimer::singleShot(0, this, [=]() { sendRequest(dev,usbFeatureType::featureButton,i,but->onCommand->text, but->icon, &but->backgroundOn); });
-                            but->isOn=false;
-                        }
-                        else if ((!but->toggle && but->isOn) && ((dev->buttons >> i & 1) && !(tempButtons >> i & 1)))
-                        {
-                            if (but->offCommand->command == cmdLCDSpectrum)
-                                dev->lcd = cmdLCDSpectrum;
-                            else if (but->offCommand->command == cmdLCDWaterfall)
-                                dev->lcd = cmdLCDWaterfall;
-                            else if (but->offCommand->command == cmdLCDNothing) {
-                                QTimer::singleShot(0, this, [=]() { sendRequest(dev,usbFeatureType::featureColor,i,"",Q_NULLPTR, &dev->color); });
-                                dev->lcd = cmdLCDNothing;
-                            } else
-                            {
-                                qDebug(logUsbControl()) << QString("Off Button event for button %0: %1").arg(but->num).arg(but->offCommand->text);
-                                emit button(but->offCommand);
-                            }
-                            // Change the button text to reflect the on Button
-                            QTimer::singleShot(0, this, [=]() { sendRequest(dev,usbFeatureType::featureButton,i,but->onCommand->text, but->icon, &but->backgroundOn); });
-                            but->isOn=false;
-                        }
+                    // LCD touch event
+                    int x = ((quint8)data[7] << 8) | ((quint8)data[6] & 0xff);
+                    int y = ((quint8)data[9] << 8) | ((quint8)data[8] & 0xff);
+                    int x2=0;
+                    int y2=0;
+                    QString tt="";
+                    switch ((quint8)data[4])
+                    {
+                    case 0x01:
+                        tt="Short";
+                        break;
+                    case 0x02:
+                        tt="Long";
+                        break;
+                    case 0x03:
+                        tt="Swipe";
+                        x2 = ((quint8)data[11] << 8) | ((quint8)data[10] & 0xff);
+                        y2 = ((quint8)data[13] << 8) | ((quint8)data[12] & 0xff);
+                        break;
                     }
+                    qInfo(logUsbControl()) << QString("%0 touch: %1,%2 to %3,%4").arg(tt).arg(x).arg(y).arg(x2).arg(y2);
                 }
-                dev->buttons = tempButtons;
             }
+        }
+    }
 
-            // As the knobs can move very fast, only send every 100ms so the rig isn't overwhelmed
-            if (dev->lastusbController.msecsTo(QTime::currentTime()) >= 100 || dev->lastusbController > QTime::currentTime())
-            {
-                if (dev->type.model == shuttleXpress || dev->type.model == shuttlePro2)
+    // Step through all buttons and emit ones that have been pressed.
+    // Only do it if actual data has been received.
+    if (dev->buttons != tempButtons)
+    {
+        qDebug(logUsbControl()) << "Got Buttons:" << QString::number(tempButtons,2);
+        // Step through all buttons and emit ones that have been pressed.
+        for (unsigned char i = 0; i <dev->type.buttons; i++)
+        {
+            auto but = std::find_if(buttonList->begin(), buttonList->end(), [dev, i](const BUTTON& b)
+            { return (b.path == dev->path && b.page == dev->currentPage && b.num == i); });
+            if (but != buttonList->end()) {
+                if ((!but->isOn) && ((tempButtons >> i & 1) && !(dev->buttons >> i & 1)))
                 {
-                    if (dev->shutpos > 0  && dev->shutpos < 0x08)
-                    {
-                        dev->shutMult = dev->shutpos;
-                        emit doShuttle(true, dev->shutMult);
-                        qDebug(logUsbControl()) << "Shuttle PLUS" << dev->shutMult;
-                        
+                    qDebug(logUsbControl()) << QString("On Button event for button %0: %1").arg(but->num).arg(but->onCommand->text);
+                    if (but->onCommand->command == cmdPageUp)
+                        emit changePage(dev, dev->currentPage+1);
+                    else if (but->onCommand->command == cmdPageDown)
+                        emit changePage(dev, dev->currentPage-1);
+                    else if (but->onCommand->command == cmdLCDSpectrum)
+                        dev->lcd = cmdLCDSpectrum;
+                    else if (but->onCommand->command == cmdLCDWaterfall)
+                        dev->lcd = cmdLCDWaterfall;
+                    else if (but->onCommand->command == cmdLCDNothing) {
+                        dev->lcd = cmdLCDNothing;
+                        QTimer::singleShot(0, this, [=]() { sendRequest(dev,usbFeatureType::featureColor,i,"",Q_NULLPTR, &dev->color); });
+                    }else {
+                        emit button(but->onCommand);
                     }
-                    else if (dev->shutpos > 0xEF) {
-                        dev->shutMult = abs(dev->shutpos - 0xff) + 1;
-                        emit doShuttle(false, dev->shutMult);
-                        qDebug(logUsbControl()) << "Shuttle MINUS" << dev->shutMult;
+                    // Change the button text to reflect the off Button
+                    if (but->offCommand->index != 0) {
+                        QTimer::singleShot(0, this, [=]() { sendRequest(dev,usbFeatureType::featureButton,i,but->offCommand->text, but->icon, &but->backgroundOff); });
                     }
+                    but->isOn=true;
                 }
-                
-                for (unsigned char i = 0; i < dev->knobValues.size(); i++)
+                else if ((but->toggle && but->isOn) && ((tempButtons >> i & 1) && !(dev->buttons >> i & 1)))
                 {
-                    auto kb = std::find_if(knobList->begin(), knobList->end(), [dev, i](const KNOB& k)
-                    { return (k.command && k.path == dev->path && k.page == dev->currentPage && k.num == i && dev->knobValues[i].value != dev->knobValues[i].previous); });
-
-                    if (kb != knobList->end()) {
-                        // sendCommand mustn't be deleted so we ensure it stays in-scope by declaring it private (we will only ever send one command).
-                        sendCommand = *kb->command;
-                        if (sendCommand.command != cmdSetFreq) {
-                            int tempVal = dev->knobValues[i].value * dev->sensitivity;
-                            tempVal = qMin(qMax(tempVal,0),255);
-                            sendCommand.suffix = quint8(tempVal);
-                            dev->knobValues[i].value=tempVal/dev->sensitivity; // This ensures that dial can't go outside 0-255
-                            dev->knobValues[i].name = kb->command->text;
-                            QTimer::singleShot(0, this, [=]() { sendRequest(dev,usbFeatureType::featureGraph,i,"",Q_NULLPTR,&dev->color); });
-                        }
-                        else
-                        {
-                            sendCommand.value = dev->knobValues[i].value/dev->sensitivity;
-                        }
-                        
-                        emit button(&sendCommand);
-
-                        if (sendCommand.command == cmdSetFreq) {
-                            dev->knobValues[i].value = 0;
-                        }
-                        dev->knobValues[i].previous=dev->knobValues[i].value;
+                    qDebug(logUsbControl()) << QString("Off Button (toggle) event for button %0: %1").arg(but->num).arg(but->onCommand->text);
+                    if (but->offCommand->command == cmdPageUp)
+                        emit changePage(dev, dev->currentPage+1);
+                    else if (but->offCommand->command == cmdPageDown)
+                        emit changePage(dev, dev->currentPage-1);
+                    else if (but->offCommand->command == cmdLCDSpectrum)
+                        dev->lcd = cmdLCDSpectrum;
+                    else if (but->offCommand->command == cmdLCDWaterfall)
+                        dev->lcd = cmdLCDWaterfall;
+                    else if (but->offCommand->command == cmdLCDNothing) {
+                        dev->lcd = cmdLCDNothing;
+                        QTimer::singleShot(0, this, [=]() { sendRequest(dev,usbFeatureType::featureColor,i,"",Q_NULLPTR, &dev->color); });
+                    } else {
+                        emit button(but->offCommand);
                     }
+                    QTimer::singleShot(0, this, [=]() { sendRequest(dev,usbFeatureType::featureButton,i,but->onCommand->text, but->icon, &but->backgroundOn); });
+                    but->isOn=false;
                 }
-                
-                dev->lastusbController = QTime::currentTime();
+                else if ((!but->toggle && but->isOn) && ((dev->buttons >> i & 1) && !(tempButtons >> i & 1)))
+                {
+                    if (but->offCommand->command == cmdLCDSpectrum)
+                        dev->lcd = cmdLCDSpectrum;
+                    else if (but->offCommand->command == cmdLCDWaterfall)
+                        dev->lcd = cmdLCDWaterfall;
+                    else if (but->offCommand->command == cmdLCDNothing) {
+                        QTimer::singleShot(0, this, [=]() { sendRequest(dev,usbFeatureType::featureColor,i,"",Q_NULLPTR, &dev->color); });
+                        dev->lcd = cmdLCDNothing;
+                    } else
+                    {
+                        qDebug(logUsbControl()) << QString("Off Button event for button %0: %1").arg(but->num).arg(but->offCommand->text);
+                        emit button(but->offCommand);
+                    }
+                    // Change the button text to reflect the on Button
+                    QTimer::singleShot(0, this, [=]() { sendRequest(dev,usbFeatureType::featureButton,i,but->onCommand->text, but->icon, &but->backgroundOn); });
+                    but->isOn=false;
+                }
+            }
+        }
+        dev->buttons = tempButtons;
+    }
+}
+
+bool usbController::sendFrame(USBDEVICE* dev)
+{
+    // Everything the knobs did since the last frame goes out as one command
+    // per knob, the shuttle repeats every frame while it is held.
+    bool active = false;
+    if (dev->type.model == shuttleXpress || dev->type.model == shuttlePro2)
+    {
+        if (dev->shutpos > 0  && dev->shutpos < 0x08)
+        {
+            dev->shutMult = dev->shutpos;
+            emit doShuttle(true, dev->shutMult);
+            qDebug(logUsbControl()) << "Shuttle PLUS" << dev->shutMult;
+            active = true;
+        }
+        else if (dev->shutpos > 0xEF) {
+            dev->shutMult = abs(dev->shutpos - 0xff) + 1;
+            emit doShuttle(false, dev->shutMult);
+            qDebug(logUsbControl()) << "Shuttle MINUS" << dev->shutMult;
+            active = true;
+        }
+    }
+    
+    for (unsigned char i = 0; i < dev->knobValues.size(); i++)
+    {
+        auto kb = std::find_if(knobList->begin(), knobList->end(), [dev, i](const KNOB& k)
+        { return (k.command && k.path == dev->path && k.page == dev->currentPage && k.num == i && dev->knobValues[i].value != dev->knobValues[i].previous); });
+
+        if (kb != knobList->end()) {
+            // sendCommand mustn't be deleted so we ensure it stays in-scope by declaring it private (we will only ever send one command).
+            sendCommand = *kb->command;
+            if (sendCommand.command != cmdSetFreq) {
+                int tempVal = dev->knobValues[i].value * dev->sensitivity;
+                tempVal = qMin(qMax(tempVal,0),255);
+                sendCommand.suffix = quint8(tempVal);
+                dev->knobValues[i].value=tempVal/dev->sensitivity; // This ensures that dial can't go outside 0-255
+                dev->knobValues[i].name = kb->command->text;
+                QTimer::singleShot(0, this, [=]() { sendRequest(dev,usbFeatureType::featureGraph,i,"",Q_NULLPTR,&dev->color); });
+            }
+            else
+            {
+                sendCommand.value = dev->knobValues[i].value/dev->sensitivity;
             }
+            
+            emit button(&sendCommand);
 
+            if (sendCommand.command == cmdSetFreq) {
+                dev->knobValues[i].value = 0;
+            }
+            dev->knobValues[i].previous=dev->knobValues[i].value;
+            active = true;
         }
     }
+    return active;
 }
 
 void usbController::receivePTTStatus(bool on) {
@@ -844,6 +972,129 @@ void usbController::sendToLCD(QImage* img)
     }
 }
 
+void usbController::receiveLCD(USBDEVICE* dev, QImage image)
+{
+    if (dev == Q_NULLPTR || !dev->connected || dev->disabled || !dev->handle || dev->type.model != usbDeviceType::StreamDeckPlus)
+        return;
+
+    QMutexLocker locker(mutex);
+    queueLCD(dev, image);
+}
+
+/* Hand a frame to the LCD encoder. Only one frame is with the encoder at a time,
+ * while it is busy the newest frame for each device replaces any older one, so a
+ * slow encode drops frames rather than building a backlog.
+*/
+void usbController::queueLCD(USBDEVICE* dev, QImage image)
+{
+    // Frames should already be rendered at the LCD resolution.
+    if (image.width() != USB_LCD_WIDTH || image.height() != USB_LCD_HEIGHT)
+        image = image.scaled(USB_LCD_WIDTH,USB_LCD_HEIGHT,Qt::IgnoreAspectRatio,Qt::SmoothTransformation);
+    if (image.format() != QImage::Format_RGB888)
+        image = image.convertToFormat(QImage::Format_RGB888);
+
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    for (int i=0;i<dev->type.knobs && i<dev->knobValues.size();i++) {
+        if (now < dev->knobValues[i].lastChanged + 2000)
+        {
+            QPainter paint(&image);
+            paint.fillRect(200*i,75,200,25, Qt::black);
+            int x=qMin(190,(dev->knobValues[i].value * dev->sensitivity) * 190 / 255);
+            paint.fillRect((200*i)+5,80,x,20, Qt::darkGreen);
+            paint.setFont(QFont("times",10));
+            paint.setPen(Qt::white);
+            int perc=qMin(100,(dev->knobValues[i].value * dev->sensitivity) * 100 / 255);
+            paint.drawText((200*i)+5,80,190,20, Qt::AlignCenter | Qt::AlignVCenter, QString("%0 %1%").arg(dev->knobValues[i].name).arg(perc));
+        }
+    }
+
+    // Nothing to do if the LCD is already showing this frame.
+    auto last = lcdLast.find(dev->path);
+    if (last != lcdLast.end() && last.value() == image)
+        return;
+    lcdLast.insert(dev->path, image);
+
+    if (lcdThread == Q_NULLPTR)
+    {
+        lcdEncoder = new usbLcdEncoder();
+        lcdThread = new QThread(this);
+        lcdThread->setObjectName("usbLcd()");
+        lcdEncoder->moveToThread(lcdThread);
+        connect(this, SIGNAL(encodeLCD(QString,QImage)), lcdEncoder, SLOT(encode(QString,QImage)));
+        connect(lcdEncoder, SIGNAL(encoded(QString,QByteArray)), this, SLOT(lcdEncoded(QString,QByteArray)));
+        lcdThread->start(QThread::LowestPriority);
+    }
+
+    if (lcdBusy)
+    {
+        lcdPending.insert(dev->path, image);
+        return;
+    }
+    lcdBusy = true;
+    emit encodeLCD(dev->path, image);
+}
+
+void usbController::lcdEncoded(QString path, QByteArray jpeg)
+{
+    QMutexLocker locker(mutex);
+    lcdBusy = false;
+
+    auto it = devices->find(path);
+    if (it != devices->end() && it.value().connected && !it.value().disabled && it.value().handle)
+        writeLCD(&it.value(), jpeg, 0, 0, USB_LCD_WIDTH, USB_LCD_HEIGHT);
+
+    if (!lcdPending.isEmpty())
+    {
+        auto next = lcdPending.begin();
+        QString nextPath = next.key();
+        QImage image = next.value();
+        lcdPending.erase(next);
+        lcdBusy = true;
+        emit encodeLCD(nextPath, image);
+    }
+}
+
+void usbController::writeLCD(USBDEVICE* dev, const QByteArray& jpeg, int x, int y, int width, int height)
+{
+    int payload = dev->type.maxPayload - int(sizeof(streamdeck_lcd_header));
+    QByteArray data;
+    quint32 rem = jpeg.size();
+    quint32 offset = 0;
+    quint16 index = 0;
+
+    streamdeck_lcd_header h;
+    memset(h.packet, 0x0, sizeof(h)); // We can't be sure it is initialized with 0x00!
+    h.cmd = 0x02;
+    h.suffix = 0x0c;
+    h.x=x;
+    h.y=y;
+    h.width=width;
+    h.height=height;
+
+    while (rem > 0)
+    {
+        quint16 length = qMin(quint16(rem),quint16(payload));
+        h.isLast = (quint8)(rem <= quint32(payload) ? 1 : 0);
+        h.length = length;
+        h.index = index;
+        data.fill(0x0, dev->type.maxPayload);
+        memcpy(data.data(), h.packet, sizeof(h));
+        memcpy(data.data()+sizeof(h), jpeg.constData()+offset, length);
+        hid_write(dev->handle, (const unsigned char*)data.constData(), data.size());
+        rem -= length;
+        offset += length;
+        index++;
+    }
+}
+
+void usbLcdEncoder::encode(QString path, QImage image)
+{
+    QByteArray jpeg;
+    QBuffer buffer(&jpeg);
+    image.save(&buffer, "JPG");
+    emit encoded(path, jpeg);
+}
+
 
 // We rely on being able to fallthrough case
 #if defined __GNUC__
@@ -1011,12 +1262,15 @@ void usbController::sendRequest(USBDEVICE *dev, usbFeatureType feature, int val,
                 data[1] = (qint8)0x02;
             }
             hid_send_feature_report(dev->handle, (const unsigned char*)data.constData(), data.size());
+            dev->keyImages.clear();
+            lcdLast.remove(dev->path);
             break;
         case usbFeatureType::featureResetKeys:
             data.resize(dev->type.maxPayload);
             memset(data.data(),0x0,data.size());
             data[0] = (qint8)0x02;
             res=hid_write(dev->handle, (const unsigned char*)data.constData(), data.size());
+            dev->keyImages.clear();
             break;
         case usbFeatureType::featureBrightness:
             if (sdv1) {
@@ -1062,36 +1316,9 @@ void usbController::sendRequest(USBDEVICE *dev, usbFeatureType feature, int val,
                 data2.clear();
                 QBuffer buffer(&data2);
                 image.save(&buffer, "JPG");
+                writeLCD(dev, data2, val*200, 75, 200, 25);
+                lcdLast.remove(dev->path);
 
-                quint32 rem = data2.size();
-                quint16 index = 0;
-
-                streamdeck_lcd_header h;
-                memset(h.packet, 0x0, sizeof(h)); // We can't be sure it is initialized with 0x00!
-                h.cmd = 0x02;
-                h.suffix = 0x0c;
-                h.x=val*200;
-                h.y=75;
-                h.width=200;
-                h.height=25;
-
-                while (rem > 0)
-                {
-                    quint16 length = qMin(quint16(rem),quint16(dev->type.maxPayload-sizeof(h)));
-                    data.clear();
-                    h.isLast = (quint8)(rem <= dev->type.maxPayload-sizeof(h) ? 1 : 0); // isLast ? 1 : 0,3
-                    h.length = length;
-                    h.index = index;
-                    rem -= length;
-                    data.append(QByteArray::fromRawData((const char*)h.packet,sizeof(h)));
-                    data.append(data2.mid(0,length));
-                    data.resize(dev->type.maxPayload);
-                    memset(data.data()+length+sizeof(h),0x0,data.size()-(length+sizeof(h)));
-                    res=hid_write(dev->handle, (const unsigned char*)data.constData(), data.size());
-                    //qInfo(logUsbControl()) << "Sending" << (((quint8)data[7] << 8) | ((quint8)data[6] & 0xff)) << "total=" << data.size()  << "payload=" << (((quint8)data[5] << 8) | ((quint8)data[4] & 0xff)) << "last" << (quint8)data[3];
-                    data2.remove(0,length);
-                    index++;
-                }
                 if (text != "**REMOVE**") {
                     dev->knobValues[val].lastChanged = QDateTime::currentMSecsSinceEpoch();
                     if (dev->lcd != cmdLCDSpectrum && dev->lcd != cmdLCDWaterfall)
@@ -1128,53 +1355,13 @@ void usbController::sendRequest(USBDEVICE *dev, usbFeatureType feature, int val,
             {
                 if (img != Q_NULLPTR)
                 {
-                    QImage image = img->scaled(800,100,Qt::IgnoreAspectRatio,Qt::SmoothTransformation);
-                    QPainter paint(&image);
-
-                    for (int i=0;i<dev->type.knobs;i++) {
-                        if (QDateTime::currentMSecsSinceEpoch() < dev->knobValues[i].lastChanged + 2000)
-                        {
-                            paint.fillRect(200*i,75,200,25, Qt::black);
-                            int x=qMin(190,(dev->knobValues[i].value * dev->sensitivity) * 190 / 255);
-                            paint.fillRect((200*i)+5,80,x,20, Qt::darkGreen);
-                            paint.setFont(QFont("times",10));
-                            paint.setPen(Qt::white);
-                            int perc=qMin(100,(dev->knobValues[i].value * dev->sensitivity) * 100 / 255);
-                            paint.drawText((200*i)+5,80,190,20, Qt::AlignCenter | Qt::AlignVCenter, QString("%0 %1%").arg(dev->knobValues[i].name).arg(perc));
-                        }
-                    }
-                    data2.clear();
-                    QBuffer buffer(&data2);
-                    image.save(&buffer, "JPG");
+                    queueLCD(dev, *img);
                 }
-                quint32 rem = data2.size();
-                quint16 index = 0;
-
-                streamdeck_lcd_header h;
-                memset(h.packet, 0x0, sizeof(h)); // We can't be sure it is initialized with 0x00!
-                h.cmd = 0x02;
-                h.suffix = 0x0c;
-                h.x=0;
-                h.y=0;
-                h.width=800;
-                h.height=100;
-
-                while (rem > 0)
+                else if (!data2.isEmpty())
                 {
-                    quint16 length = qMin(quint16(rem),quint16(dev->type.maxPayload-sizeof(h)));
-                    data.clear();
-                    h.isLast = (quint8)(rem <= dev->type.maxPayload-sizeof(h) ? 1 : 0); // isLast ? 1 : 0,3
-                    h.length = length;
-                    h.index = index;
-                    rem -= length;
-                    data.append(QByteArray::fromRawData((const char*)h.packet,sizeof(h)));
-                    data.append(data2.mid(0,length));
-                    data.resize(dev->type.maxPayload);
-                    memset(data.data()+length+sizeof(h),0x0,data.size()-(length+sizeof(h)));
-                    res=hid_write(dev->handle, (const unsigned char*)data.constData(), data.size());
-                    //qInfo(logUsbControl()) << "Sending" << (((quint8)data[7] << 8) | ((quint8)data[6] & 0xff)) << "total=" << data.size()  << "payload=" << (((quint8)data[5] << 8) | ((quint8)data[4] & 0xff)) << "last" << (quint8)data[3];
-                    data2.remove(0,length);
-                    index++;
+                    // Falling through from featureOverlay/featureColor with the JPG already in data2.
+                    writeLCD(dev, data2, 0, 0, USB_LCD_WIDTH, USB_LCD_HEIGHT);
+                    lcdLast.remove(dev->path);
                 }
             }
             break;
@@ -1208,7 +1395,6 @@ void usbController::sendRequest(USBDEVICE *dev, usbFeatureType feature, int val,
                         butPaint.drawImage(0, 0, *img);
                     }
 
-                    QBuffer butBuffer(&data2);
                     QTransform myTransform;
                     if (dev->type.model == usbDeviceType::StreamDeckOriginal || dev->type.model == usbDeviceType::StreamDeckXL)
                     {
@@ -1216,10 +1402,41 @@ void usbController::sendRequest(USBDEVICE *dev, usbFeatureType feature, int val,
                     }
                     QImage myImage = butImage.transformed(myTransform);
 
-                    if (sdv1)
+                    // Keys already showing this image are left alone, otherwise the encoded
+                    // image is reused if any key has shown it before. Images are compared
+                    // in full, the hash only finds the candidates.
+                    auto shown = dev->keyImages.find(val);
+                    if (shown != dev->keyImages.end() && shown.value() == myImage)
+                        break;
+                    dev->keyImages.insert(val, myImage);
+
+                    uint hash = uint(qHashBits(myImage.constBits(), size_t(myImage.bytesPerLine()) * size_t(myImage.height()), sdv1 ? 1 : 0));
+                    bool found = false;
+                    const QList<keyCacheEntry> candidates = keyCache.values(hash);
+                    for (const keyCacheEntry& cached : candidates)
                     {
+                        if (cached.bmp == sdv1 && cached.image == myImage)
+                        {
+                            data2 = cached.encoded;
+                            found = true;
+                            break;
+                        }
+                    }
+                    if (!found)
+                    {
+                        QBuffer butBuffer(&data2);
+                        myImage.save(&butBuffer, sdv1 ? "BMP" : "JPG");
+                        if (keyCache.size() >= USB_KEY_CACHE)
+                            keyCache.clear();
+                        keyCacheEntry entry;
+                        entry.image = myImage;
+                        entry.bmp = sdv1;
+                        entry.encoded = data2;
+                        keyCache.insert(hash, entry);
+                    }
 
-                        myImage.save(&butBuffer, "BMP");
+                    if (sdv1)
+                    {
                         quint16 payloadLen = dev->type.maxPayload - sizeof(streamdeck_v1_image_header);
 
                         if (dev->type.model == usbDeviceType::StreamDeckOriginal) {
@@ -1254,7 +1471,6 @@ void usbController::sendRequest(USBDEVICE *dev, usbFeatureType feature, int val,
                     }
                     else
                     {
-                        myImage.save(&butBuffer, "JPG");
                         quint32 rem = data2.size();
                         quint16 index = 0;
                         streamdeck_image_header h;
@@ -1340,9 +1556,8 @@ void usbController::programDisable(USBDEVICE* dev, bool disabled)
 
             QMutexLocker locker(mutex);
 
-            hid_close(dev->handle);
+            closeDevice(dev);
             dev->connected=false;
-            dev->handle=NULL;
         }
     } else {
         qInfo(logUsbControl()) << "Enabling device:" << dev->product;
@@ -2106,8 +2321,7 @@ void usbController::restoreController(USBDEVICE* dev, QString file)
     delete settings;
 
     qInfo(logUsbControl()) << "Disconnecting device" << dev->product;
-    hid_close(dev->handle);
-    dev->handle = NULL;
+    closeDevice(dev);
     dev->connected = false;
     dev->uiCreated = false;
     devicesConnected--;
@@ -13,6 +13,7 @@
 #include <QVector>
 #include <QList>
 #include <QMap>
+#include <QHash>
 #include <QMutex>
 #include <QIODevice>
 #include <QtEndian>
@@ -24,6 +25,7 @@
 #include <QBuffer>
 #include <QSettings>
 #include <QMessageBox>
+#include <QSocketNotifier>
 #include <memory>
 
 
@@ -67,6 +69,12 @@ using namespace std;
 
 #define HIDDATALENGTH 64
 #define MAX_STR 255
+#define USB_POLL_MS 25             // Poll interval for devices that can't be waited on (not hidraw)
+#define USB_FRAME_MS 100           // Knob movement is accumulated and sent at most once per frame
+#define USB_LCD_WIDTH 800          // StreamDeck+ LCD resolution
+#define USB_LCD_HEIGHT 100
+#define USB_LCD_FRAME_MS 100       // The LCD is sent a new spectrum/waterfall frame at most this often
+#define USB_KEY_CACHE 256          // Encoded key images kept before the cache is emptied
 
 struct USBTYPE {
     USBTYPE() {}
@@ -112,6 +120,8 @@ struct USBDEVICE {
     cmds lcd=cmdNone;
 
     hid_device* handle = NULL;
+    int fd = -1;                                // Own hidraw descriptor for input reports (Linux)
+    QSocketNotifier* notifier = Q_NULLPTR;      // Set when input is event driven rather than polled
     QString product = "";
     QString manufacturer = "";
     QString serial = "<none>";
@@ -137,6 +147,7 @@ struct USBDEVICE {
     QSpinBox* pageSpin = Q_NULLPTR;
     QImage image;
     quint8 ledStatus=0x07;
+    QHash<int,QImage> keyImages;   // Image each key is showing, so it isn't sent again
 };
 
 struct COMMAND {
@@ -220,6 +231,19 @@ typedef QMap<QString,USBDEVICE> usbDevMap;
 
 
 #if defined(USB_CONTROLLER)
+// Encodes StreamDeck+ LCD frames in its own thread so the JPEG compression
+// doesn't hold up the controller thread.
+class usbLcdEncoder : public QObject
+{
+    Q_OBJECT
+
+public slots:
+    void encode(QString path, QImage image);
+
+signals:
+    void encoded(QString path, QByteArray jpeg);
+};
+
 class usbController : public QObject
 {
     Q_OBJECT
@@ -240,10 +264,12 @@ public slots:
 
     void sendRequest(USBDEVICE *dev, usbFeatureType feature, int val=0, QString text="", QImage* img=Q_NULLPTR, QColor* color=Q_NULLPTR);
     void sendToLCD(QImage *img);
+    void receiveLCD(USBDEVICE* dev, QImage image);
     void backupController(USBDEVICE* dev, QString file);
     void restoreController(USBDEVICE* dev, QString file);
 
 signals:
+    void encodeLCD(QString path, QImage image);
     void jogPlus();
     void jogMinus();
     void sendJog(int counter);
@@ -256,11 +282,24 @@ signals:
     void setConnected(USBDEVICE* dev);
     void changePage(USBDEVICE* dev, int page);
 
+private slots:
+    void frameTimeout();
+    void lcdEncoded(QString path, QByteArray jpeg);
+
 private:
     void loadButtons();
     void loadKnobs();
     void loadCommands();
 
+    void openEvents(USBDEVICE* dev);
+    void closeDevice(USBDEVICE* dev);
+    void readDevice(USBDEVICE* dev);
+    void processReport(USBDEVICE* dev, const char* data, int res);
+    bool sendFrames();
+    bool sendFrame(USBDEVICE* dev);
+    void queueLCD(USBDEVICE* dev, QImage image);
+    void writeLCD(USBDEVICE* dev, const QByteArray& jpeg, int x, int y, int width, int height);
+
 
     int hidStatus = 1;
     bool isOpen=false;
@@ -285,6 +324,20 @@ private:
     COMMAND sendCommand;
 
     QTimer* dataTimer = Q_NULLPTR;
+    QTimer* frameTimer = Q_NULLPTR;
+    char reportBuffer[HIDDATALENGTH];
+
+    QThread* lcdThread = Q_NULLPTR;
+    usbLcdEncoder* lcdEncoder = Q_NULLPTR;
+    bool lcdBusy = false;                   // A frame is with the encoder
+    QMap<QString,QImage> lcdPending;        // Newest frame for each device waiting for the encoder
+    QHash<QString,QImage> lcdLast;          // Last frame each LCD was sent
+    struct keyCacheEntry {
+        QImage image;
+        bool bmp;               // Encoded as BMP for first generation devices, otherwise JPG
+        QByteArray encoded;
+    };
+    QMultiHash<uint,keyCacheEntry> keyCache; // Encoded key images by content hash, compared in full before use
 protected:
 };
 
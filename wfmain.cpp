@@ -4,22 +4,13 @@
 #include "commhandler.h"
 #include "rigidentities.h"
 #include "logcategories.h"
+#include "logwriter.h"
+#include "tracerecorder.h"
+#include "metrics.h"
 
 // This code is copyright 2017-2022 Elliott H. Liggett
 // All rights reserved
 
-// Log support:
-//static void messageHandler(QtMsgType type, const QMessageLogContext& context, const QString& msg);
-QScopedPointer<QFile> m_logFile;
-QMutex logMutex;
-QMutex logTextMutex;
-QVector<QString> logStringBuffer;
-#ifdef QT_DEBUG
-bool debugModeLogging = true;
-#else
-bool debugModeLogging = false;
-#endif
-
 wfmain::wfmain(const QString settingsFile, const QString logFile, bool debugMode, QWidget *parent ) :
     QMainWindow(parent),
     ui(new Ui::wfmain),
@@ -30,7 +21,7 @@ wfmain::wfmain(const QString settingsFile, const QString logFile, bool debugMode
 
     setWindowIcon(QIcon( QString(":resources/wfview.png")));
     this->debugMode = debugMode;
-    debugModeLogging = debugMode;
+    logWriter::setDebug(debugMode);
     version = QString("wfview version: %1 (Git:%2 on %3 at %4 by %5@%6). Operating System: %7 (%8). Build Qt Version %9. Current Qt Version: %10")
         .arg(QString(WFVIEW_VERSION))
         .arg(GITSHORT).arg(__DATE__).arg(__TIME__).arg(UNAME).arg(HOST)
@@ -83,6 +74,7 @@ wfmain::wfmain(const QString settingsFile, const QString logFile, bool debugMode
     qRegisterMetaType<networkAudioLevels>();
     qRegisterMetaType<codecType>();
     qRegisterMetaType<errorType>();
+    qRegisterMetaType<QList<virtualPortConfig>>();
     qRegisterMetaType<usbFeatureType>();
     qRegisterMetaType<cmds>();
 
@@ -143,7 +135,7 @@ wfmain::wfmain(const QString settingsFile, const QString logFile, bool debugMode
     connect(this, SIGNAL(setFrequencyRange(double, double)), cluster, SLOT(freqRange(double, double)));
     connect(this, SIGNAL(setClusterSkimmerSpots(bool)), cluster, SLOT(enableSkimmerSpots(bool)));
 
-    connect(cluster, SIGNAL(sendSpots(QList<spotData>)), this, SLOT(receiveSpots(QList<spotData>)));
+    connect(cluster, SIGNAL(spotsChanged(QList<spotData>, QList<spotData>)), this, SLOT(receiveSpotChanges(QList<spotData>, QList<spotData>)));
     connect(cluster, SIGNAL(sendOutput(QString)), this, SLOT(receiveClusterOutput(QString)));
 
     connect(clusterThread, SIGNAL(finished()), cluster, SLOT(deleteLater()));
@@ -228,6 +220,9 @@ wfmain::~wfmain()
     if (prefs.audioSystem == portAudio) {
         Pa_Terminate();
     }
+    if (spotLabels != Q_NULLPTR) {
+        delete spotLabels;
+    }
     delete rpt;
     delete ui;
     delete settings;
@@ -309,6 +304,8 @@ void wfmain::openRig()
 
     makeRig();
 
+    emit sendVirtualPorts(prefs.virtualPorts, prefs.arbiterCivAddr);
+
     if (prefs.enableLAN)
     {
         ui->lanEnableBtn->setChecked(true);
@@ -521,7 +518,7 @@ void wfmain::rigConnections()
     connect(rig, SIGNAL(haveModInput(rigInput,bool)), this, SLOT(receiveModInput(rigInput, bool)));
     connect(this, SIGNAL(setModInput(rigInput, bool)), rig, SLOT(setModInput(rigInput,bool)));
 
-    connect(rig, SIGNAL(haveSpectrumData(QByteArray, double, double)), this, SLOT(receiveSpectrumData(QByteArray, double, double)));
+    connect(rig, SIGNAL(haveSpectrumData(QByteArray, double, double, qint64)), this, SLOT(receiveSpectrumData(QByteArray, double, double, qint64)));
     connect(rig, SIGNAL(haveSpectrumMode(spectrumMode)), this, SLOT(receiveSpectrumMode(spectrumMode)));
     connect(rig, SIGNAL(haveScopeOutOfRange(bool)), this, SLOT(handleScopeOutOfRange(bool)));
     connect(this, SIGNAL(setScopeMode(spectrumMode)), rig, SLOT(setSpectrumMode(spectrumMode)));
@@ -681,6 +678,7 @@ void wfmain::makeRig()
         // Rig comm setup:
         connect(this, SIGNAL(sendCommSetup(unsigned char, udpPreferences, audioSetup, audioSetup, QString, quint16)), rig, SLOT(commSetup(unsigned char, udpPreferences, audioSetup, audioSetup, QString, quint16)));
         connect(this, SIGNAL(sendCommSetup(unsigned char, QString, quint32,QString, quint16,quint8)), rig, SLOT(commSetup(unsigned char, QString, quint32,QString, quint16,quint8)));
+        connect(this, SIGNAL(sendVirtualPorts(QList<virtualPortConfig>,quint8)), rig, SLOT(setVirtualPorts(QList<virtualPortConfig>,quint8)));
         connect(this, SIGNAL(setRTSforPTT(bool)), rig, SLOT(setRTSforPTT(bool)));
 
         connect(rig, SIGNAL(haveBaudRate(quint32)), this, SLOT(receiveBaudRate(quint32)));
@@ -854,6 +852,7 @@ void wfmain::receiveFoundRigID(rigCapabilities rigCaps)
 
 void wfmain::receivePortError(errorType err)
 {
+    traceRecorder::dump(QString("%1: %2").arg(err.device).arg(err.message));
     if (err.alert) {
         connectionHandler(false); // Force disconnect
         QMessageBox::critical(this, err.device, err.message, QMessageBox::Ok);
@@ -938,6 +937,10 @@ void wfmain::setupPlots()
     freqIndicatorLine->setAntialiased(true);
     freqIndicatorLine->setPen(QPen(Qt::blue));
 
+    spotLabels = new spotOverlay(plot);
+    spotLabels->setFont(QFont(font().family(), 10));
+    spotLabels->setColor(clusterColor);
+
     /*
     text = new QCPItemText(plot);
     text->setAntialiased(true);
@@ -989,6 +992,13 @@ void wfmain::setupPlots()
     connect(plot, SIGNAL(mouseMove(QMouseEvent*)), this, SLOT(handlePlotMouseMove(QMouseEvent *)));
     connect(wf, SIGNAL(mouseWheel(QWheelEvent*)), this, SLOT(handleWFScroll(QWheelEvent*)));
     connect(plot, SIGNAL(mouseWheel(QWheelEvent*)), this, SLOT(handlePlotScroll(QWheelEvent*)));
+
+    // Software rendered alternative to the line plot, shown in its place when enabled.
+    softSpectrum = new spectrumWidget(ui->splitter);
+    ui->splitter->insertWidget(ui->splitter->indexOf(plot), softSpectrum);
+    softSpectrum->setVisible(false);
+    connect(softSpectrum, SIGNAL(frequencyDoubleClicked(double)), this, SLOT(handleSoftSpectrumDoubleClick(double)));
+    connect(softSpectrum, SIGNAL(mouseWheel(QWheelEvent*)), this, SLOT(handlePlotScroll(QWheelEvent*)));
     spectrumDrawLock = false;
 }
 
@@ -1367,7 +1377,6 @@ void wfmain::setServerToPrefs()
             connect(rig, SIGNAL(haveAudioData(audioPacket)), udp, SLOT(receiveAudioData(audioPacket)));
             // Need to add a signal/slot for audio from the client to rig.
             //connect(udp, SIGNAL(haveAudioData(audioPacket)), rig, SLOT(receiveAudioData(audioPacket)));
-            connect(rig, SIGNAL(haveDataForServer(QByteArray)), udp, SLOT(dataForServer(QByteArray)));
             connect(udp, SIGNAL(haveDataFromServer(QByteArray)), rig, SLOT(dataFromServer(QByteArray)));
         }
 
@@ -1425,6 +1434,9 @@ void wfmain::setUIToPrefs()
     ui->wfInterpolateChk->setChecked(prefs.wfInterpolate);
     on_wfInterpolateChk_clicked(prefs.wfInterpolate);
 
+    ui->softwareSpectrumChk->setChecked(prefs.softwareSpectrum);
+    on_softwareSpectrumChk_clicked(prefs.softwareSpectrum);
+
     ui->wfLengthSlider->setValue(prefs.wflength);
     prepareWf(prefs.wflength);
     preparePlasma();
@@ -1434,6 +1446,9 @@ void wfmain::setUIToPrefs()
     plot->yAxis->setRange(QCPRange(prefs.plotFloor, prefs.plotCeiling));
     colorMap->setDataRange(QCPRange(prefs.plotFloor, prefs.plotCeiling));
 
+    ui->scopeAutoRangeChk->setChecked(prefs.plotAutoRange);
+    on_scopeAutoRangeChk_clicked(prefs.plotAutoRange);
+
     colorPrefsType p;
     for(int pn=0; pn < numColorPresetsTotal; pn++)
     {
@@ -1725,6 +1740,17 @@ void wfmain::setupKeyShortcuts()
     keyDebug->setKey(Qt::CTRL | Qt::Key_D);
 #endif
     connect(keyDebug, SIGNAL(activated()), this, SLOT(on_debugBtn_clicked()));
+
+    keyTraceDump = new QShortcut(this);
+    keyTraceDump->setKey(QKeySequence("Ctrl+Shift+T"));
+    connect(keyTraceDump, SIGNAL(activated()), this, SLOT(dumpTrace()));
+}
+
+void wfmain::dumpTrace()
+{
+    QString fileName = traceRecorder::dump("User request");
+    if (!fileName.isEmpty())
+        ui->statusBar->showMessage(QString("Trace written to %1").arg(fileName), 10000);
 }
 
 void wfmain::setupUsbControllerDevice()
@@ -1755,6 +1781,7 @@ void wfmain::setupUsbControllerDevice()
     
     connect(usbWindow, SIGNAL(sendRequest(USBDEVICE*, usbFeatureType, int, QString, QImage*, QColor *)), usbControllerDev, SLOT(sendRequest(USBDEVICE*, usbFeatureType, int, QString, QImage*, QColor *)));
     connect(this, SIGNAL(sendControllerRequest(USBDEVICE*, usbFeatureType, int, QString, QImage*, QColor *)), usbControllerDev, SLOT(sendRequest(USBDEVICE*, usbFeatureType, int, QString, QImage*, QColor *)));
+    connect(this, SIGNAL(sendControllerLCD(USBDEVICE*,QImage)), usbControllerDev, SLOT(receiveLCD(USBDEVICE*,QImage)));
     connect(usbWindow, SIGNAL(programPages(USBDEVICE*,int)), usbControllerDev, SLOT(programPages(USBDEVICE*,int)));
     connect(usbWindow, SIGNAL(programDisable(USBDEVICE*,bool)), usbControllerDev, SLOT(programDisable(USBDEVICE*,bool)));
     connect(this, SIGNAL(sendLevel(cmds,unsigned char)), usbControllerDev, SLOT(receiveLevel(cmds,unsigned char)));
@@ -1971,6 +1998,7 @@ void wfmain::setDefPrefs()
     defPrefs.wfEnable = 2;
     defPrefs.wfAntiAlias = false;
     defPrefs.wfInterpolate = true;
+    defPrefs.softwareSpectrum = false;
     defPrefs.stylesheetPath = QString("qdarkstyle/style.qss");
     defPrefs.radioCIVAddr = 0x00; // previously was 0x94 for 7300.
     defPrefs.CIVisRadioModel = false;
@@ -1982,16 +2010,20 @@ void wfmain::setDefPrefs()
     defPrefs.niceTS = true;
     defPrefs.enableRigCtlD = false;
     defPrefs.rigCtlPort = 4533;
+    defPrefs.rigCtlSharedState = false;
     defPrefs.virtualSerialPort = QString("none");
+    defPrefs.arbiterCivAddr = ARBITER_CIV_ID;
     defPrefs.localAFgain = 255;
     defPrefs.wflength = 160;
     defPrefs.wftheme = static_cast<int>(QCPColorGradient::gpJet);
     defPrefs.plotFloor = 0;
     defPrefs.plotCeiling = 160;
+    defPrefs.plotAutoRange = false;
     defPrefs.confirmExit = true;
     defPrefs.confirmPowerOff = true;
     defPrefs.meter2Type = meterNone;
     defPrefs.tcpPort = 0;
+    defPrefs.metricsPort = 0;
     defPrefs.waterfallFormat = 0;
     defPrefs.audioSystem = qtAudio;
     defPrefs.enableUSBControllers = false;
@@ -2041,11 +2073,13 @@ void wfmain::loadSettings()
     plotCeiling = prefs.plotCeiling;
     wfFloor = prefs.plotFloor;
     wfCeiling = prefs.plotCeiling;
+    prefs.plotAutoRange = settings->value("plotAutoRange", defPrefs.plotAutoRange).toBool();
     prefs.drawPeaks = settings->value("DrawPeaks", defPrefs.drawPeaks).toBool();
     prefs.underlayBufferSize = settings->value("underlayBufferSize", defPrefs.underlayBufferSize).toInt();
     prefs.underlayMode = static_cast<underlay_t>(settings->value("underlayMode", defPrefs.underlayMode).toInt());
     prefs.wfAntiAlias = settings->value("WFAntiAlias", defPrefs.wfAntiAlias).toBool();
     prefs.wfInterpolate = settings->value("WFInterpolate", defPrefs.wfInterpolate).toBool();
+    prefs.softwareSpectrum = settings->value("SoftwareSpectrum", defPrefs.softwareSpectrum).toBool();
     prefs.wflength = (unsigned int)settings->value("WFLength", defPrefs.wflength).toInt();
     prefs.stylesheetPath = settings->value("StylesheetPath", defPrefs.stylesheetPath).toString();
     ui->splitter->restoreState(settings->value("splitter").toByteArray());
@@ -2180,6 +2214,23 @@ void wfmain::loadSettings()
         ui->vspCombo->setCurrentIndex(ui->vspCombo->count() - 1);
     }
 
+    // Extra virtual ports, shared with the one above through civArbiter.
+    prefs.arbiterCivAddr = (quint8)settings->value("ArbiterCIVuInt", defPrefs.arbiterCivAddr).toInt();
+    prefs.virtualPorts.clear();
+    int numPorts = settings->beginReadArray("VirtualPorts");
+    for (int i = 0; i < numPorts; i++)
+    {
+        settings->setArrayIndex(i);
+        virtualPortConfig p;
+        p.name = settings->value("Name", "none").toString();
+        p.rigCivAddr = (quint8)settings->value("RigCIVuInt", 0).toInt();
+        p.scope = settings->value("Scope", false).toBool();
+        p.maxRate = settings->value("MaxRate", 0).toInt();
+        p.priority = settings->value("Priority", 0).toInt();
+        prefs.virtualPorts.append(p);
+    }
+    settings->endArray();
+
     prefs.localAFgain = (unsigned char)settings->value("localAFgain", defPrefs.localAFgain).toUInt();
     rxSetup.localAFgain = prefs.localAFgain;
     txSetup.localAFgain = 255;
@@ -2222,12 +2273,22 @@ void wfmain::loadSettings()
     ui->enableRigctldChk->setChecked(prefs.enableRigCtlD);
     prefs.rigCtlPort = settings->value("RigCtlPort", defPrefs.rigCtlPort).toInt();
     ui->rigctldPortTxt->setText(QString("%1").arg(prefs.rigCtlPort));
+    prefs.rigCtlSharedState = settings->value("RigCtlSharedState", defPrefs.rigCtlSharedState).toBool();
+    ui->rigctldShmChk->setChecked(prefs.rigCtlSharedState);
     // Call the function to start rigctld if enabled.
     on_enableRigctldChk_clicked(prefs.enableRigCtlD);
 
     prefs.tcpPort = settings->value("TcpServerPort", defPrefs.tcpPort).toInt();
     ui->tcpServerPortTxt->setText(QString("%1").arg(prefs.tcpPort));
 
+    // No UI for this yet, set MetricsPort in the settings file to enable it.
+    prefs.metricsPort = settings->value("MetricsPort", defPrefs.metricsPort).toInt();
+    if (prefs.metricsPort > 0 && metricsHttp == Q_NULLPTR)
+    {
+        metricsHttp = new metricsServer(this);
+        metricsHttp->startServer(prefs.metricsPort);
+    }
+
     prefs.waterfallFormat = settings->value("WaterfallFormat", defPrefs.waterfallFormat).toInt();
     ui->waterfallFormatCombo->blockSignals(true);
     ui->waterfallFormatCombo->setCurrentIndex(prefs.waterfallFormat);
@@ -2317,6 +2378,11 @@ void wfmain::loadSettings()
     udpPrefs.clientName = settings->value("ClientName", udpDefPrefs.clientName).toString();
 
     udpPrefs.halfDuplex = settings->value("HalfDuplex", udpDefPrefs.halfDuplex).toBool();
+
+    // Scope stream reduction, only used when connected to a wfview server.
+    udpPrefs.scopeStream.maxRate = settings->value("ScopeStreamRate", 0).toInt();
+    udpPrefs.scopeStream.width = settings->value("ScopeStreamWidth", 0).toInt();
+    udpPrefs.scopeStream.delta = settings->value("ScopeStreamDelta", false).toBool();
     ui->audioDuplexCombo->setVisible(false);
     ui->label_51->setVisible(false);
 
@@ -2879,9 +2945,11 @@ void wfmain::saveSettings()
     settings->setValue("underlayBufferSize", prefs.underlayBufferSize);
     settings->setValue("WFAntiAlias", prefs.wfAntiAlias);
     settings->setValue("WFInterpolate", prefs.wfInterpolate);
+    settings->setValue("SoftwareSpectrum", prefs.softwareSpectrum);
     settings->setValue("WFTheme", prefs.wftheme);
     settings->setValue("plotFloor", prefs.plotFloor);
     settings->setValue("plotCeiling", prefs.plotCeiling);
+    settings->setValue("plotAutoRange", prefs.plotAutoRange);
     settings->setValue("StylesheetPath", prefs.stylesheetPath);
     settings->setValue("splitter", ui->splitter->saveState());
     settings->setValue("windowGeometry", saveGeometry());
@@ -2903,6 +2971,18 @@ void wfmain::saveSettings()
     settings->setValue("SerialPortRadio", prefs.serialPortRadio);
     settings->setValue("SerialPortBaud", prefs.serialPortBaud);
     settings->setValue("VirtualSerialPort", prefs.virtualSerialPort);
+    settings->setValue("ArbiterCIVuInt", prefs.arbiterCivAddr);
+    settings->beginWriteArray("VirtualPorts");
+    for (int i = 0; i < prefs.virtualPorts.size(); i++)
+    {
+        settings->setArrayIndex(i);
+        settings->setValue("Name", prefs.virtualPorts[i].name);
+        settings->setValue("RigCIVuInt", prefs.virtualPorts[i].rigCivAddr);
+        settings->setValue("Scope", prefs.virtualPorts[i].scope);
+        settings->setValue("MaxRate", prefs.virtualPorts[i].maxRate);
+        settings->setValue("Priority", prefs.virtualPorts[i].priority);
+    }
+    settings->endArray();
     settings->setValue("localAFgain", prefs.localAFgain);
     settings->setValue("AudioSystem", prefs.audioSystem);
 
@@ -2920,7 +3000,9 @@ void wfmain::saveSettings()
     settings->setValue("EnableRigCtlD", prefs.enableRigCtlD);
     settings->setValue("TcpServerPort", prefs.tcpPort);
     settings->setValue("RigCtlPort", prefs.rigCtlPort);
+    settings->setValue("RigCtlSharedState", prefs.rigCtlSharedState);
     settings->setValue("tcpServerPort", prefs.tcpPort);
+    settings->setValue("MetricsPort", prefs.metricsPort);
     settings->setValue("IPAddress", udpPrefs.ipAddress);
     settings->setValue("ControlLANPort", udpPrefs.controlLANPort);
     settings->setValue("SerialLANPort", udpPrefs.serialLANPort);
@@ -2939,6 +3021,9 @@ void wfmain::saveSettings()
     settings->setValue("ClientName", udpPrefs.clientName);
     settings->setValue("WaterfallFormat", prefs.waterfallFormat);
     settings->setValue("HalfDuplex", udpPrefs.halfDuplex);
+    settings->setValue("ScopeStreamRate", udpPrefs.scopeStream.maxRate);
+    settings->setValue("ScopeStreamWidth", udpPrefs.scopeStream.width);
+    settings->setValue("ScopeStreamDelta", udpPrefs.scopeStream.delta);
 
     settings->endGroup();
 
@@ -3263,7 +3348,8 @@ void wfmain::prepareWf(unsigned int wfLength)
 
         colorMap->data()->setValueRange(QCPRange(0, wfLength-1));
         colorMap->data()->setKeyRange(QCPRange(0, spectWidth-1));
-        colorMap->setDataRange(QCPRange(prefs.plotFloor, prefs.plotCeiling));
+        if (!prefs.plotAutoRange)
+            colorMap->setDataRange(QCPRange(prefs.plotFloor, prefs.plotCeiling)); // Otherwise the noise floor sets it
         colorMap->setGradient(static_cast<QCPColorGradient::GradientPreset>(ui->wfthemeCombo->currentData().toInt()));
 
         if(colorMapData == Q_NULLPTR)
@@ -4863,6 +4949,7 @@ void wfmain::receiveRigID(rigCapabilities rigCaps)
 
             ui->topLevelSlider->setMaximum(rigCaps.spectAmpMax);
             ui->botLevelSlider->setMaximum(rigCaps.spectAmpMax);
+            noiseFloor.setAmpMax(rigCaps.spectAmpMax);
         } else {
             ui->scopeRefLevelSlider->setVisible(false);
             ui->refLabel->setVisible(false);
@@ -4999,8 +5086,12 @@ void wfmain::receiveRigID(rigCapabilities rigCaps)
             {
                 ui->scopeBWCombo->addItem(rigCaps.scopeCenterSpans.at(i).name, (int)rigCaps.scopeCenterSpans.at(i).cstype);
             }
-            plot->yAxis->setRange(QCPRange(prefs.plotFloor, prefs.plotCeiling));
-            colorMap->setDataRange(QCPRange(prefs.plotFloor, prefs.plotCeiling));
+            if (!prefs.plotAutoRange)
+            {
+                // Otherwise the noise floor sets the range.
+                plot->yAxis->setRange(QCPRange(prefs.plotFloor, prefs.plotCeiling));
+                colorMap->setDataRange(QCPRange(prefs.plotFloor, prefs.plotCeiling));
+            }
         } else {
             ui->scopeBWCombo->setHidden(true);
         }
@@ -5256,8 +5347,21 @@ void wfmain::changeTxBtn()
 }
 
 
-void wfmain::receiveSpectrumData(QByteArray spectrum, double startFreq, double endFreq)
+void wfmain::receiveSpectrumData(QByteArray spectrum, double startFreq, double endFreq, qint64 stamp)
 {
+    static latencyHistogram* painted = metrics::histogram("wfview_spectrum_paint_seconds", "Time from a spectrum frame being parsed (by rigCommander or the replay) to the spectrum and waterfall being redrawn");
+
+    if (wfReplay != Q_NULLPTR && wfReplay->isPlaying())
+    {
+        // Live data is ignored while a recording is being replayed.
+        if (sender() != wfReplay)
+            return;
+    }
+    else if (wfRecorder != Q_NULLPTR && wfRecorder->isRecording())
+    {
+        wfRecorder->addLine(spectrum, startFreq, endFreq);
+    }
+
     if (ui->scopeEnableWFBtn->checkState()== Qt::PartiallyChecked)
     {
         return;
@@ -5327,6 +5431,19 @@ void wfmain::receiveSpectrumData(QByteArray spectrum, double startFreq, double e
             y2[i] = (unsigned char)spectrumPeaks.at(i);
         }
     }
+    if (prefs.plotAutoRange && noiseFloor.addLine(spectrum))
+    {
+        // Only the working range follows the noise floor, prefs keep the manual values.
+        plotFloor = wfFloor = noiseFloor.floor();
+        plotCeiling = wfCeiling = noiseFloor.ceiling();
+        ui->topLevelSlider->blockSignals(true);
+        ui->botLevelSlider->blockSignals(true);
+        ui->topLevelSlider->setValue(plotCeiling);
+        ui->botLevelSlider->setValue(plotFloor);
+        ui->topLevelSlider->blockSignals(false);
+        ui->botLevelSlider->blockSignals(false);
+    }
+
     plasmaMutex.lock();
     spectrumPlasma.push_front(spectrum);
     if(spectrumPlasma.size() > (int)spectrumPlasmaSize)
@@ -5341,11 +5458,14 @@ void wfmain::receiveSpectrumData(QByteArray spectrum, double startFreq, double e
         if ((plotFloor != oldPlotFloor) || (plotCeiling != oldPlotCeiling)){
             updateRange = true;
         }
+        if (!prefs.softwareSpectrum)
+        {
 #if QCUSTOMPLOT_VERSION < 0x020000
-        plot->graph(0)->setData(x, y);
+            plot->graph(0)->setData(x, y);
 #else
-        plot->graph(0)->setData(x, y, true);
+            plot->graph(0)->setData(x, y, true);
 #endif
+        }
 
         if((freq.MHzDouble < endFreq) && (freq.MHzDouble > startFreq))
         {
@@ -5430,35 +5550,64 @@ void wfmain::receiveSpectrumData(QByteArray spectrum, double startFreq, double e
             //qDebug() << "Default" << pbtDefault << "Inner" << TPBFInner << "Outer" << TPBFOuter << "Pass" << passbandWidth << "Center" << passbandCenterFrequency << "CW" << cwPitch;
         }
 
-        if (underlayMode == underlayPeakHold)
+        if (prefs.softwareSpectrum)
         {
+            // Same data as the line plot below, but rasterized by spectrumWidget.
+            softSpectrum->setFrequencyRange(startFreq, endFreq);
+            softSpectrum->setLevelRange(plotFloor, plotCeiling);
+            softSpectrum->setTuning(freq.MHzDouble);
+            softSpectrum->setPassband(passbandIndicator->topLeft->coords().x(), passbandIndicator->bottomRight->coords().x());
+            softSpectrum->setPbt(pbtIndicator->topLeft->coords().x(), pbtIndicator->bottomRight->coords().x(), pbtIndicator->visible());
+            if (underlayMode == underlayPeakHold)
+            {
+                softSpectrum->setUnderlay(spectrumPeaks);
+            }
+            else if (underlayMode != underlayNone)
+            {
+                computePlasma();
+                softSpectrum->setUnderlay(spectrumPlasmaLine);
+            }
+            else
+            {
+                softSpectrum->clearUnderlay();
+            }
+            softSpectrum->setTrace(spectrum);
+
+            // Keep the axis current, the waterfall and mouse handlers use it.
+            plot->xAxis->setRange(startFreq, endFreq);
+        }
+        else
+        {
+            if (underlayMode == underlayPeakHold)
+            {
 #if QCUSTOMPLOT_VERSION < 0x020000
-            plot->graph(1)->setData(x, y2); // peaks
+                plot->graph(1)->setData(x, y2); // peaks
 #else
-            plot->graph(1)->setData(x, y2, true); // peaks
+                plot->graph(1)->setData(x, y2, true); // peaks
 #endif
-        }
-        else if (underlayMode != underlayNone) {
-            computePlasma();
+            }
+            else if (underlayMode != underlayNone) {
+                computePlasma();
 #if QCUSTOMPLOT_VERSION < 0x020000
-            plot->graph(1)->setData(x, spectrumPlasmaLine);
+                plot->graph(1)->setData(x, spectrumPlasmaLine);
 #else
-            plot->graph(1)->setData(x, spectrumPlasmaLine, true);
+                plot->graph(1)->setData(x, spectrumPlasmaLine, true);
 #endif
-        }
-        else {
+            }
+            else {
 #if QCUSTOMPLOT_VERSION < 0x020000
-            plot->graph(1)->setData(x, y2); // peaks, but probably cleared out
+                plot->graph(1)->setData(x, y2); // peaks, but probably cleared out
 #else
-            plot->graph(1)->setData(x, y2, true); // peaks, but probably cleared out
+                plot->graph(1)->setData(x, y2, true); // peaks, but probably cleared out
 #endif
-        }
+            }
 
-        if(updateRange)
-            plot->yAxis->setRange(prefs.plotFloor, prefs.plotCeiling);
+            if(updateRange)
+                plot->yAxis->setRange(plotFloor, plotCeiling);
 
-        plot->xAxis->setRange(startFreq, endFreq);
-        plot->replot();
+            plot->xAxis->setRange(startFreq, endFreq);
+            plot->replot();
+        }
 
         if(specLen == spectWidth)
         {
@@ -5481,23 +5630,46 @@ void wfmain::receiveSpectrumData(QByteArray spectrum, double startFreq, double e
             wf->yAxis->setRange(0,wfLength - 1);
             wf->xAxis->setRange(0, spectWidth-1);
             wf->replot();
+            painted->recordSinceStamp(stamp);
 
 #if defined (USB_CONTROLLER)
-            // Send to USB Controllers if requested
-            auto i = usbDevices.begin();
-            while (i != usbDevices.end())
+            // Send to USB Controllers if requested, rendered at the LCD resolution
+            // and no more often than the LCD can usefully be updated.
+            if (!lcdFrameTimer.isValid() || lcdFrameTimer.elapsed() >= USB_LCD_FRAME_MS)
             {
-                if (i.value().connected && i.value().type.model == usbDeviceType::StreamDeckPlus && i.value().lcd == cmdLCDWaterfall )
+                QImage waterfallImage;
+                QImage spectrumImage;
+                auto i = usbDevices.begin();
+                while (i != usbDevices.end())
                 {
-                    lcdImage = wf->toPixmap().toImage();
-                    emit sendControllerRequest(&i.value(), usbFeatureType::featureLCD, 0, "", &lcdImage);
+                    if (i.value().connected && i.value().type.model == usbDeviceType::StreamDeckPlus && i.value().lcd == cmdLCDWaterfall )
+                    {
+                        if (waterfallImage.isNull())
+                            waterfallImage = wf->toPixmap(USB_LCD_WIDTH, USB_LCD_HEIGHT).toImage();
+                        emit sendControllerLCD(&i.value(), waterfallImage);
+                        lcdFrameTimer.start();
+                    }
+                    else if (i.value().connected && i.value().type.model == usbDeviceType::StreamDeckPlus && i.value().lcd == cmdLCDSpectrum)
+                    {
+                        if (spectrumImage.isNull())
+                        {
+                            if (prefs.softwareSpectrum)
+                            {
+                                spectrumImage = QImage(USB_LCD_WIDTH, USB_LCD_HEIGHT, QImage::Format_RGB888);
+                                QPainter painter(&spectrumImage);
+                                painter.scale(qreal(USB_LCD_WIDTH) / qMax(1, softSpectrum->width()), qreal(USB_LCD_HEIGHT) / qMax(1, softSpectrum->height()));
+                                softSpectrum->render(&painter);
+                            }
+                            else
+                            {
+                                spectrumImage = plot->toPixmap(USB_LCD_WIDTH, USB_LCD_HEIGHT).toImage();
+                            }
+                        }
+                        emit sendControllerLCD(&i.value(), spectrumImage);
+                        lcdFrameTimer.start();
+                    }
+                    ++i;
                 }
-                else if (i.value().connected && i.value().type.model == usbDeviceType::StreamDeckPlus && i.value().lcd == cmdLCDSpectrum)
-                {
-                    lcdImage = plot->toPixmap().toImage();
-                    emit sendControllerRequest(&i.value(), usbFeatureType::featureLCD, 0, "", &lcdImage);
-                }
-                 ++i;
             }
 #endif
 
@@ -5632,7 +5804,14 @@ void wfmain::handleWFDoubleClick(QMouseEvent *me)
     // cheap trick until I figure out how the axis works on the WF:
     if(!freqLock)
     {
-        x = plot->xAxis->pixelToCoord(me->pos().x());
+        if (prefs.softwareSpectrum)
+        {
+            // The line plot is hidden so its axis can't be used, map across the waterfall instead.
+            QRect r = wf->axisRect()->rect();
+            x = oldLowerFreq + (oldUpperFreq - oldLowerFreq) * (me->pos().x() - r.left()) / qMax(1, r.width());
+        } else {
+            x = plot->xAxis->pixelToCoord(me->pos().x());
+        }
         freqGo.Hz = x*1E6;
 
         freqGo.Hz = roundFrequency(freqGo.Hz, tsWfScrollHz);
@@ -7378,12 +7557,10 @@ void wfmain::receiveMeter(meterKind inMeter, unsigned char level)
         case meterS:
             ui->meterSPoWidget->setMeterType(meterS);
             ui->meterSPoWidget->setLevel(level);
-            ui->meterSPoWidget->repaint();
             break;
         case meterPower:
             ui->meterSPoWidget->setMeterType(meterPower);
             ui->meterSPoWidget->setLevel(level);
-            ui->meterSPoWidget->update();
             break;
         default:
             if(ui->meter2Widget->getMeterType() == inMeter)
@@ -8042,6 +8219,35 @@ void wfmain::on_wfInterpolateChk_clicked(bool checked)
     prefs.wfInterpolate = checked;
 }
 
+void wfmain::on_softwareSpectrumChk_clicked(bool checked)
+{
+    prefs.softwareSpectrum = checked;
+    softSpectrum->setVisible(checked);
+    plot->setVisible(!checked);
+    if (!checked)
+    {
+        // The line plot was not updated while hidden.
+        plot->yAxis->setRange(plotFloor, plotCeiling);
+        plot->replot();
+    }
+}
+
+void wfmain::handleSoftSpectrumDoubleClick(double freqMHz)
+{
+    if (freqLock)
+        return;
+
+    freqt freqGo;
+    freqGo.Hz = freqMHz * 1E6;
+    freqGo.Hz = roundFrequency(freqGo.Hz, tsWfScrollHz);
+    freqGo.MHzDouble = (float)freqGo.Hz / 1E6;
+
+    issueCmd(cmdSetFreq, freqGo);
+    freq = freqGo;
+    setUIFreq();
+    showStatusBarText(QString("Going to %1 MHz").arg(freqMHz));
+}
+
 cmds wfmain::meterKindToMeterCommand(meterKind m)
 {
     cmds c;
@@ -8125,6 +8331,7 @@ void wfmain::on_enableRigctldChk_clicked(bool checked)
         // Start rigctld
         rigCtl = new rigCtlD(this);
         rigCtl->startServer(prefs.rigCtlPort);
+        rigCtl->enableSharedState(prefs.rigCtlSharedState);
         connect(this, SIGNAL(sendRigCaps(rigCapabilities)), rigCtl, SLOT(receiveRigCaps(rigCapabilities)));
         if (rig != Q_NULLPTR) {
             // We are already connected to a rig.
@@ -8149,6 +8356,15 @@ void wfmain::on_rigctldPortTxt_editingFinished()
     }
 }
 
+void wfmain::on_rigctldShmChk_clicked(bool checked)
+{
+    prefs.rigCtlSharedState = checked;
+    if (rigCtl != Q_NULLPTR)
+    {
+        rigCtl->enableSharedState(checked);
+    }
+}
+
 void wfmain::on_tcpServerPortTxt_editingFinished()
 {
 
@@ -8299,6 +8515,135 @@ void wfmain::on_botLevelSlider_valueChanged(int value)
     colorMap->setDataRange(QCPRange(wfFloor, wfCeiling));
 }
 
+void wfmain::on_scopeAutoRangeChk_clicked(bool checked)
+{
+    prefs.plotAutoRange = checked;
+    ui->topLevelSlider->setEnabled(!checked);
+    ui->botLevelSlider->setEnabled(!checked);
+    noiseFloor.reset();
+    if (!checked)
+    {
+        // Return to the user's manual range
+        on_topLevelSlider_valueChanged(prefs.plotCeiling);
+        on_botLevelSlider_valueChanged(prefs.plotFloor);
+        ui->topLevelSlider->blockSignals(true);
+        ui->botLevelSlider->blockSignals(true);
+        ui->topLevelSlider->setValue(prefs.plotCeiling);
+        ui->botLevelSlider->setValue(prefs.plotFloor);
+        ui->topLevelSlider->blockSignals(false);
+        ui->botLevelSlider->blockSignals(false);
+    }
+}
+
+void wfmain::on_scopeRecordBtn_toggled(bool checked)
+{
+    if (wfRecorder == Q_NULLPTR)
+    {
+        wfRecorder = new spectrumRecorder(this);
+        connect(wfRecorder, SIGNAL(recordingFailed(QString)), this, SLOT(receiveRecordingFailed(QString)));
+    }
+
+    if (!checked)
+    {
+        wfRecorder->stopRecording();
+        return;
+    }
+
+    if (!haveRigCaps || !rigCaps.hasSpectrum)
+    {
+        showStatusBarText("Cannot record waterfall, the radio has no spectrum.");
+        ui->scopeRecordBtn->blockSignals(true);
+        ui->scopeRecordBtn->setChecked(false);
+        ui->scopeRecordBtn->blockSignals(false);
+        return;
+    }
+
+    QString path = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+    QDir().mkpath(path);
+    QString filename = QString("%1/%2-%3.wfspec").arg(path).arg(rigCaps.modelName.simplified().replace(' ', '_'))
+            .arg(QDateTime::currentDateTime().toString("yyyyMMddhhmmss"));
+
+    if (wfRecorder->startRecording(filename, rigCaps.spectLenMax))
+    {
+        showStatusBarText(QString("Recording waterfall to %1").arg(filename));
+    } else {
+        showStatusBarText(QString("Unable to record waterfall to %1").arg(filename));
+        ui->scopeRecordBtn->blockSignals(true);
+        ui->scopeRecordBtn->setChecked(false);
+        ui->scopeRecordBtn->blockSignals(false);
+    }
+}
+
+void wfmain::on_scopeReplayBtn_clicked()
+{
+    if (wfReplay == Q_NULLPTR)
+    {
+        wfReplay = new spectrumReplay(this);
+        connect(wfReplay, SIGNAL(haveSpectrumData(QByteArray, double, double, qint64)), this, SLOT(receiveSpectrumData(QByteArray, double, double, qint64)));
+        connect(wfReplay, SIGNAL(finished()), this, SLOT(receiveReplayFinished()));
+        connect(wfReplay, SIGNAL(replayFailed(QString)), this, SLOT(receiveReplayFailed(QString)));
+    }
+
+    if (wfReplay->isOpen())
+    {
+        // Second press stops the replay and returns to live data.
+        wfReplay->close();
+        receiveReplayFinished();
+        return;
+    }
+
+    QString filename = QFileDialog::getOpenFileName(this, "Select Waterfall Recording",
+                QStandardPaths::writableLocation(QStandardPaths::AppDataLocation), "Waterfall Recordings (*.wfspec)");
+    if (filename.isEmpty() || !wfReplay->open(filename))
+        return;
+
+    bool ok = false;
+    double speed = QInputDialog::getDouble(this, "Replay Speed", "Speed (1 = real time):", 1.0, 0.1, 1000.0, 1, &ok);
+    if (!ok)
+    {
+        wfReplay->close();
+        return;
+    }
+
+    QString start = QInputDialog::getText(this, "Replay Start",
+                QString("Start time (%1 to %2):").arg(wfReplay->startTime().toString("yyyy-MM-dd hh:mm:ss"))
+                    .arg(wfReplay->endTime().toString("yyyy-MM-dd hh:mm:ss")),
+                QLineEdit::Normal, wfReplay->startTime().toString("yyyy-MM-dd hh:mm:ss"), &ok);
+    if (ok)
+    {
+        QDateTime startTime = QDateTime::fromString(start, "yyyy-MM-dd hh:mm:ss");
+        if (startTime.isValid())
+            wfReplay->seek(startTime);
+    }
+
+    wfReplay->setSpeed(speed);
+    wfReplay->play();
+    ui->scopeReplayBtn->setText("Stop Replay");
+    showStatusBarText(QString("Replaying %1 lines from %2").arg(wfReplay->lines()).arg(filename));
+}
+
+void wfmain::receiveReplayFinished()
+{
+    if (wfReplay != Q_NULLPTR)
+        wfReplay->close();
+    ui->scopeReplayBtn->setText("Replay");
+    showStatusBarText("Waterfall replay finished");
+}
+
+void wfmain::receiveReplayFailed(QString reason)
+{
+    receiveReplayFinished();
+    showStatusBarText(QString("Waterfall replay stopped: %1").arg(reason));
+}
+
+void wfmain::receiveRecordingFailed(QString reason)
+{
+    ui->scopeRecordBtn->blockSignals(true);
+    ui->scopeRecordBtn->setChecked(false);
+    ui->scopeRecordBtn->blockSignals(false);
+    showStatusBarText(QString("Waterfall recording stopped: %1").arg(reason));
+}
+
 void wfmain::on_underlayBufferSlider_valueChanged(int value)
 {
     resizePlasmaBuffer(value);
@@ -8551,6 +8896,15 @@ void wfmain::useColorPreset(colorPrefsType *cp)
     ui->meter2Widget->setColors(cp->meterLevel, cp->meterPeakScale, cp->meterPeakLevel, cp->meterAverage, cp->meterLowerLine, cp->meterLowText);
 
     clusterColor = cp->clusterSpots;
+    if (spotLabels != Q_NULLPTR)
+        spotLabels->setColor(clusterColor);
+
+    if (softSpectrum != Q_NULLPTR)
+    {
+        softSpectrum->setColors(cp->plotBackground, cp->gridColor, cp->axisColor, cp->textColor,
+                                cp->spectrumLine, cp->spectrumFill, cp->underlayLine, cp->underlayFill,
+                                cp->tuningLine, cp->passband, cp->pbt, cp->clusterSpots);
+    }
 }
 
 void wfmain::setColorButtonOperations(QColor *colorStore,
@@ -9093,12 +9447,9 @@ void wfmain::on_showLogBtn_clicked()
 
 void wfmain::initLogging()
 {
-    // Set the logging file before doing anything else.
-    m_logFile.reset(new QFile(logFilename));
-    // Open the file logging
-    m_logFile.data()->open(QFile::WriteOnly | QFile::Truncate | QFile::Text);
-    // Set handler
-    qInstallMessageHandler(messageHandler);
+    // Set the logging file before doing anything else, the writer installs the handler.
+    logWriter::start(logFilename, false);
+    logWriter::enableWindow(true);
 
     connect(logWindow, SIGNAL(setDebugMode(bool)), this, SLOT(setDebugLogging(bool)));
 
@@ -9112,12 +9463,10 @@ void wfmain::logCheck()
 {
     // This is called by a timer to check for new log messages and copy
     // the messages into the logWindow.
-    QMutexLocker locker(&logTextMutex);
-    int size = logStringBuffer.size();
-    for(int i=0; i < size; i++)
+    const QStringList lines = logWriter::takeWindowLines();
+    for (const QString& text : lines)
     {
-        handleLogText(logStringBuffer.back());
-        logStringBuffer.pop_back();
+        handleLogText(text);
     }
 }
 
@@ -9130,61 +9479,7 @@ void wfmain::handleLogText(QString text)
 void wfmain::setDebugLogging(bool debugModeOn)
 {
     this->debugMode = debugModeOn;
-    debugModeLogging = debugModeOn;
-}
-
-void wfmain::messageHandler(QtMsgType type, const QMessageLogContext& context, const QString& msg)
-{
-    // Open stream file writes
-
-    if (type == QtDebugMsg && !debugModeLogging)
-    {
-        return;
-    }
-
-    QMutexLocker locker(&logMutex);
-    QTextStream out(m_logFile.data());
-    QString text;
-
-    // Write the date of recording
-    out << QDateTime::currentDateTime().toString("yyyy-MM-dd hh:mm:ss.zzz ");
-    text.append(QDateTime::currentDateTime().toString("yyyy-MM-dd hh:mm:ss.zzz "));
-    // By type determine to what level belongs message
-
-    switch (type)
-    {
-        case QtDebugMsg:
-            out << "DBG ";
-            text.append("DBG ");
-            break;
-        case QtInfoMsg:
-            out << "INF ";
-            text.append("INF ");
-            break;
-        case QtWarningMsg:
-            out << "WRN ";
-            text.append("WRN ");
-            break;
-        case QtCriticalMsg:
-            out << "CRT ";
-            text.append("CRT ");
-            break;
-        case QtFatalMsg:
-            out << "FTL ";
-            text.append("FLT ");
-            break;
-    }
-    // Write to the output category of the message and the message itself
-    out << context.category << ": " << msg << "\n";
-    out.flush();    // Clear the buffered data
-
-    text.append(context.category);
-    text.append(": ");
-    text.append(msg);
-    logTextMutex.lock();
-    logStringBuffer.push_front(text);
-    logTextMutex.unlock();
-
+    logWriter::setDebug(debugModeOn);
 }
 
 void wfmain::on_customEdgeBtn_clicked()
@@ -9368,25 +9663,38 @@ void wfmain::on_clusterTimeoutLineEdit_editingFinished()
 }
 
 
-void wfmain::receiveSpots(QList<spotData> spots)
+void wfmain::receiveSpotChanges(QList<spotData> added, QList<spotData> removed)
 {
     //QElapsedTimer timer;
     //timer.start();
 
-    bool current = false;
-    
-    if (clusterSpots.size() > 0) {
-        current=clusterSpots.begin().value()->current;
+    for (const spotData& s : removed)
+    {
+        QMap<QString, spotData*>::iterator spot = clusterSpots.find(s.dxcall);
+        while (spot != clusterSpots.end() && spot.key() == s.dxcall)
+        {
+            if (spot.value()->frequency == s.frequency)
+            {
+                spotLabels->remove(spot.value()->text);
+                //qDebug(logCluster()) << "REMOVE:" << spot.value()->dxcall;
+                delete spot.value();
+                spot = clusterSpots.erase(spot);
+            }
+            else
+            {
+                ++spot;
+            }
+        }
     }
 
-    foreach(spotData s, spots)
+    for (const spotData& s : added)
     {
         bool found = false;
         QMap<QString, spotData*>::iterator spot = clusterSpots.find(s.dxcall);
 
-        while (spot != clusterSpots.end() && spot.key() == s.dxcall && spot.value()->frequency == s.frequency) {
-            spot.value()->current = !current;
-            found = true;
+        while (spot != clusterSpots.end() && spot.key() == s.dxcall) {
+            if (spot.value()->frequency == s.frequency)
+                found = true;
             ++spot;
         }
 
@@ -9395,60 +9703,21 @@ void wfmain::receiveSpots(QList<spotData> spots)
             spotData* sp = new spotData(s);
 
             //qDebug(logCluster()) << "ADD:" << sp->dxcall;
-            sp->current = !current;
-            bool conflict = true;
-            double left = sp->frequency;
-            QCPRange range=plot->yAxis->range();
-            double top = range.upper-15.0;
-            sp->text = new QCPItemText(plot);
-            sp->text->setAntialiased(true);
-            sp->text->setColor(clusterColor);
-            sp->text->setText(sp->dxcall);
-            sp->text->setFont(QFont(font().family(), 10));
-            sp->text->setPositionAlignment(Qt::AlignVCenter | Qt::AlignHCenter);
-            sp->text->position->setType(QCPItemPosition::ptPlotCoords);
-            sp->text->setSelectable(true);
-            QMargins margin;
-            int width = (sp->text->right - sp->text->left) / 2;
-            margin.setLeft(width);
-            margin.setRight(width);
-            sp->text->setPadding(margin);
-            sp->text->position->setCoords(left, top);
-            sp->text->setVisible(false);
-            while (conflict) {
-#if QCUSTOMPLOT_VERSION < 0x020000
-                QCPAbstractItem* item = plot->itemAt(sp->text->position->pixelPoint(), true);
-#else
-                QCPAbstractItem* item = plot->itemAt(sp->text->position->pixelPosition(), true);
-#endif
-
-                QCPItemText* textItem = dynamic_cast<QCPItemText*> (item);
-                if (textItem != nullptr && sp->text != textItem) {
-                    top = top - 5.0;
-                }
-                else {
-                    conflict = false;
-                }
-                sp->text->position->setCoords(left, top);
-            }
-
-            sp->text->setVisible(true);
+            sp->text = spotLabels->add(sp->frequency, sp->dxcall);
             clusterSpots.insert(sp->dxcall, sp);
         }
     }
 
-    QMap<QString, spotData*>::iterator spot2 = clusterSpots.begin();
-    while (spot2 != clusterSpots.end()) {
-        if (spot2.value()->current == current) {
-            plot->removeItem(spot2.value()->text);
-            //qDebug(logCluster()) << "REMOVE:" << spot2.value()->dxcall;
-            delete spot2.value(); // Stop memory leak?
-            spot2 = clusterSpots.erase(spot2);
-        }
-        else {
-            ++spot2;
-        }
+    spotLabels->layout();
 
+    if (prefs.softwareSpectrum)
+    {
+        QList<spectrumLabel> labels;
+        for (spotData* sp : clusterSpots)
+        {
+            labels.append(spectrumLabel{ sp->frequency, sp->dxcall });
+        }
+        softSpectrum->setSpots(labels);
     }
 
     //qDebug(logCluster()) << "Processing took" << timer.nsecsElapsed() / 1000 << "us";
@@ -18,8 +18,10 @@
 #include <QMutex>
 #include <QMutexLocker>
 #include <QColorDialog>
+#include <QFileDialog>
 #include <QColor>
 #include <QMap>
+#include <QElapsedTimer>
 
 #include "logcategories.h"
 #include "wfviewtypes.h"
@@ -47,6 +49,11 @@
 #include "cluster.h"
 #include "audiodevices.h"
 #include "sidebandchooser.h"
+#include "noisefloor.h"
+#include "spectrumrecorder.h"
+#include "spectrumwidget.h"
+#include "spotoverlay.h"
+#include "metricsserver.h"
 
 #include <qcustomplot.h>
 #include <qserialportinfo.h>
@@ -88,7 +95,6 @@ class wfmain : public QMainWindow
 public:
     explicit wfmain(const QString settingsFile, const QString logFile, bool debugMode, QWidget *parent = 0);
     ~wfmain();
-    static void messageHandler(QtMsgType type, const QMessageLogContext& context, const QString& msg);
     void handleLogText(QString text);
 
 #ifdef USB_HOTPLUG
@@ -270,6 +276,7 @@ signals:
     void sayAll();
     void sendCommSetup(unsigned char rigCivAddr, QString rigSerialPort, quint32 rigBaudRate,QString vsp, quint16 tcp, quint8 wf);
     void sendCommSetup(unsigned char rigCivAddr, udpPreferences prefs, audioSetup rxSetup, audioSetup txSetup, QString vsp, quint16 tcp);
+    void sendVirtualPorts(QList<virtualPortConfig> ports, quint8 arbiterCivAddr);
     void sendCloseComm();
     void sendChangeLatency(quint16 latency);
     void initServer();
@@ -289,6 +296,7 @@ signals:
     void setClusterSkimmerSpots(bool enable);
     void setFrequencyRange(double low, double high);
     void sendControllerRequest(USBDEVICE* dev, usbFeatureType request, int val=0, QString text="", QImage* img=Q_NULLPTR, QColor* color=Q_NULLPTR);
+    void sendControllerLCD(USBDEVICE* dev, QImage image);
 
 private slots:
     void setAudioDevicesUI();
@@ -336,7 +344,7 @@ private slots:
     void receiveCommReady();
     void receiveFreq(freqt);
     void receiveMode(unsigned char mode, unsigned char filter);
-    void receiveSpectrumData(QByteArray spectrum, double startFreq, double endFreq);
+    void receiveSpectrumData(QByteArray spectrum, double startFreq, double endFreq, qint64 stamp);
     void receiveSpectrumMode(spectrumMode spectMode);
     void receiveSpectrumSpan(freqt freqspan, bool isSub);
     void handleScopeOutOfRange(bool outOfRange);
@@ -434,6 +442,18 @@ private slots:
 
     void on_clearPeakBtn_clicked();
 
+    void on_scopeAutoRangeChk_clicked(bool checked);
+
+    void on_scopeRecordBtn_toggled(bool checked);
+
+    void on_scopeReplayBtn_clicked();
+
+    void receiveReplayFinished();
+    void receiveReplayFailed(QString reason);
+    void receiveRecordingFailed(QString reason);
+
+    void handleSoftSpectrumDoubleClick(double freqMHz);
+
     void on_fullScreenChk_clicked(bool checked);
 
     void on_goFreqBtn_clicked();
@@ -518,6 +538,7 @@ private slots:
     void on_saveSettingsBtn_clicked();
 
     void on_debugBtn_clicked();
+    void dumpTrace();
 
     void on_pttEnableChk_clicked(bool checked);
 
@@ -639,6 +660,8 @@ private slots:
 
     void on_wfInterpolateChk_clicked(bool checked);
 
+    void on_softwareSpectrumChk_clicked(bool checked);
+
     void on_meter2selectionCombo_activated(int index);
 
     void on_waterfallFormatCombo_activated(int index);
@@ -647,6 +670,8 @@ private slots:
 
     void on_rigctldPortTxt_editingFinished();
 
+    void on_rigctldShmChk_clicked(bool checked);
+
     void on_tcpServerPortTxt_editingFinished();
 
     void on_moreControlsBtn_clicked();
@@ -808,7 +833,7 @@ private slots:
     void on_clickDragTuningEnableChk_clicked(bool checked);
 
     void receiveClusterOutput(QString text);
-    void receiveSpots(QList<spotData> spots);
+    void receiveSpotChanges(QList<spotData> added, QList<spotData> removed);
 
     void on_autoPollBtn_clicked(bool checked);
 
@@ -839,6 +864,7 @@ private:
 
     QCustomPlot *plot; // line plot
     QCustomPlot *wf; // waterfall image
+    spectrumWidget *softSpectrum = Q_NULLPTR; // line plot without QCustomPlot
     QCPItemLine * freqIndicatorLine;
     QCPItemRect* passbandIndicator;
     QCPItemRect* pbtIndicator;
@@ -908,6 +934,7 @@ private:
     QShortcut *keyControlJ;
 
     QShortcut *keyDebug;
+    QShortcut *keyTraceDump;
 
 
     rigCommander * rig=Q_NULLPTR;
@@ -965,6 +992,9 @@ private:
     double wfCeiling = 160;
     double oldPlotFloor = -1;
     double oldPlotCeiling = 999;
+    noiseFloorTracker noiseFloor;
+    spectrumRecorder* wfRecorder = Q_NULLPTR;
+    spectrumReplay* wfReplay = Q_NULLPTR;
     double passbandWidth = 0.0;
 
     double mousePressFreq = 0.0;
@@ -1162,6 +1192,7 @@ private:
 
     udpServer* udp = Q_NULLPTR;
     rigCtlD* rigCtl = Q_NULLPTR;
+    metricsServer* metricsHttp = Q_NULLPTR;
     QThread* serverThread = Q_NULLPTR;
 
     void bandStackBtnClick();
@@ -1225,8 +1256,9 @@ private:
     QList<clusterSettings> clusters;
     QMutex clusterMutex;
     QColor clusterColor;
+    spotOverlay* spotLabels = Q_NULLPTR;
     audioDevices* audioDev = Q_NULLPTR;
-    QImage lcdImage;
+    QElapsedTimer lcdFrameTimer;
 };
 
 Q_DECLARE_METATYPE(struct rigCapabilities)
@@ -1256,6 +1288,8 @@ Q_DECLARE_METATYPE(const COMMAND*)
 Q_DECLARE_METATYPE(const USBDEVICE*)
 Q_DECLARE_METATYPE(codecType)
 Q_DECLARE_METATYPE(errorType)
+Q_DECLARE_METATYPE(virtualPortConfig)
+Q_DECLARE_METATYPE(QList<virtualPortConfig>)
 Q_DECLARE_METATYPE(enum duplexMode)
 Q_DECLARE_METATYPE(enum rptAccessTxRx)
 Q_DECLARE_METATYPE(struct rptrTone_t)
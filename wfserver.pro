@@ -144,16 +144,23 @@ SOURCES += main.cpp\
     udpbase.cpp \
     udphandler.cpp \
     udpcivdata.cpp \
+    scopestream.cpp \
     udpaudio.cpp \
     logcategories.cpp \
+    logwriter.cpp \
+    tracerecorder.cpp \
+    metrics.cpp \
+    metricsserver.cpp \
     pahandler.cpp \
     rthandler.cpp \
     audiohandler.cpp \
     audioconverter.cpp \
     udpserver.cpp \
     pttyhandler.cpp \
+    civarbiter.cpp \
     resampler/resample.c \
     rigctld.cpp \
+    rigstateshm.cpp \
     tcpserver.cpp \
     keyboard.cpp \
     audiodevices.cpp
@@ -166,8 +173,13 @@ HEADERS  += servermain.h \
     udpbase.h \
     udphandler.h \
     udpcivdata.h \
+    scopestream.h \
     udpaudio.h \
     logcategories.h \
+    logwriter.h \
+    tracerecorder.h \
+    metrics.h \
+    metricsserver.h \
     pahandler.h \
     rthandler.h \
     audiohandler.h \
@@ -175,11 +187,13 @@ HEADERS  += servermain.h \
     udpserver.h \
     packettypes.h \
     pttyhandler.h \
+    civarbiter.h \
     resampler/speex_resampler.h \
     resampler/arch.h \
     resampler/resample_sse.h \
     repeaterattributes.h \
     rigctld.h \
+    rigstateshm.h \
     ulaw.h \
     tcpserver.h \
     audiotaper.h \
@@ -238,8 +238,13 @@ SOURCES += main.cpp\
     udpbase.cpp \
     udphandler.cpp \
     udpcivdata.cpp \
+    scopestream.cpp \
     udpaudio.cpp \
     logcategories.cpp \
+    logwriter.cpp \
+    tracerecorder.cpp \
+    metrics.cpp \
+    metricsserver.cpp \
     pahandler.cpp \
     rthandler.cpp \
     audiohandler.cpp \
@@ -248,11 +253,17 @@ SOURCES += main.cpp\
     satellitesetup.cpp \
     udpserver.cpp \
     meter.cpp \
+    noisefloor.cpp \
+    spectrumrecorder.cpp \
+    spectrumwidget.cpp \
+    spotoverlay.cpp \
     qledlabel.cpp \
     pttyhandler.cpp \
+    civarbiter.cpp \
     resampler/resample.c \
     repeatersetup.cpp \
     rigctld.cpp \
+    rigstateshm.cpp \
     usbcontroller.cpp \
     controllersetup.cpp \
     transceiveradjustments.cpp \
@@ -278,8 +289,13 @@ HEADERS  += wfmain.h \
     udpbase.h \
     udphandler.h \
     udpcivdata.h \
+    scopestream.h \
     udpaudio.h \
     logcategories.h \
+    logwriter.h \
+    tracerecorder.h \
+    metrics.h \
+    metricsserver.h \
     pahandler.h \
     rthandler.h \
     audiohandler.h \
@@ -289,8 +305,13 @@ HEADERS  += wfmain.h \
     udpserver.h \
     packettypes.h \
     meter.h \
+    noisefloor.h \
+    spectrumrecorder.h \
+    spectrumwidget.h \
+    spotoverlay.h \
     qledlabel.h \
     pttyhandler.h \
+    civarbiter.h \
     resampler/speex_resampler.h \
     resampler/arch.h \
     resampler/resample_sse.h \
@@ -298,6 +319,7 @@ HEADERS  += wfmain.h \
     repeaterattributes.h \
     rigctld.h \
     rigstate.h \
+    rigstateshm.h \
     ulaw.h \
     usbcontroller.h \
     controllersetup.h \
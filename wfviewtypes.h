@@ -195,6 +195,15 @@ struct errorType {
     QString message;
 };
 
+// Extra virtual CI-V port, see civArbiter
+struct virtualPortConfig {
+    QString name;                  // Port name/symlink, "none" to disable
+    quint8 rigCivAddr = 0;         // Rig address presented to the program, 0 for the real one
+    bool scope = false;            // Allow scope data on this port
+    int maxRate = 0;               // Commands per second, 0 for no limit
+    int priority = 0;              // Higher is served first
+};
+
 enum audioType {qtAudio,portAudio,rtAudio};
 enum codecType { LPCM, PCMU, OPUS };
 